@@ -19,6 +19,9 @@ def cflags_for file
   if basename == "vm-db.o" || basename == "debug.o"
     flags += " -DHVM_VM_DEBUG #{`pkg-config --cflags #{LUA}`.strip}"
   end
+  if basename == "jit-cache.o"
+    flags += " -DHVM_VERSION='\"#{VERSION}\"'"
+  end
   if basename == "jit-compiler.o"
     flags += " "+`#{LLVM_CONFIG} --cflags`.strip
   end
@@ -45,11 +45,11 @@ hvm_obj_ref *hvm_prim_exit(hvm_vm *vm) {
 
 hvm_obj_ref *hvm_prim_print_exception(hvm_vm *vm) {
   hvm_obj_ref *excref = vm->param_regs[0];
-  assert(excref->type == HVM_STRUCTURE);
+  assert(hvm_obj_type_of(excref) == HVM_STRUCTURE);
 
   hvm_symbol_id sym = hvm_symbolicate(vm->symbols, "message");
   hvm_obj_ref *messageref = hvm_obj_struct_internal_get(excref->data.v, sym);
-  assert(messageref->type == HVM_STRING);
+  assert(hvm_obj_type_of(messageref) == HVM_STRING);
 
   // TODO: Make exceptions be plain structures?
   // hvm_obj_ref *excstruct = vm->param_regs[0];
@@ -65,7 +65,7 @@ hvm_obj_ref *hvm_prim_print_exception(hvm_vm *vm) {
 }
 
 bool hvm_type_check(char *name, hvm_obj_type type, hvm_obj_ref* ref, hvm_vm *vm) {
-  if(ref->type != type) {
+  if(hvm_obj_type_of(ref) != type) {
     char buff[256];
     buff[0] = '\0';
     strcat(buff, "`");
@@ -73,8 +73,8 @@ bool hvm_type_check(char *name, hvm_obj_type type, hvm_obj_ref* ref, hvm_vm *vm)
     strcat(buff, "` expects ");
     strcat(buff, hvm_human_name_for_obj_type(type));
     strcat(buff, ", got ");
-    strcat(buff, hvm_human_name_for_obj_type(ref->type));
-    hvm_obj_ref *message = hvm_new_obj_ref_string_data(hvm_util_strclone(buff));
+    strcat(buff, hvm_human_name_for_obj_type(hvm_obj_type_of(ref)));
+    hvm_obj_ref *message = hvm_new_obj_ref_string_data(vm, hvm_util_strclone(buff));
     hvm_obj_ref *exc = hvm_exception_new(vm, message);
     // Push the primitive as the first location
     hvm_location *loc = hvm_new_location();
@@ -92,7 +92,7 @@ hvm_obj_ref *hvm_prim_print(hvm_vm *vm) {
   if(strref == NULL) {
     // Missing parameter
     static char *buff = "`print` expects 1 argument";
-    hvm_obj_ref *message = hvm_new_obj_ref_string_data(hvm_util_strclone(buff));
+    hvm_obj_ref *message = hvm_new_obj_ref_string_data(vm, hvm_util_strclone(buff));
     hvm_obj_ref *exc = hvm_exception_new(vm, message);
 
     hvm_location *loc = hvm_new_location();
@@ -110,7 +110,7 @@ hvm_obj_ref *hvm_prim_print(hvm_vm *vm) {
 hvm_obj_ref *hvm_prim_print_char(hvm_vm *vm) {
   hvm_obj_ref *intref = vm->param_regs[0];
   if(!hvm_type_check("print_char", HVM_INTEGER, intref, vm)) { return NULL; }
-  int64_t i = intref->data.i64;
+  int64_t i = hvm_obj_int_value(intref);
   // fprintf(stderr, "char: %lld\n", i);
   char    c = (char)i;
   fputc(c, stdout);
@@ -123,16 +123,15 @@ hvm_obj_ref *hvm_prim_array_clone(hvm_vm *vm) {
   hvm_obj_array *arr = arrref->data.v;
   guint len = arr->array->len;
   // Set up the new array and copy over
-  hvm_obj_array *newarr = malloc(sizeof(hvm_obj_array));
-  newarr->array = g_array_sized_new(TRUE, TRUE, sizeof(hvm_obj_ref*), len);
-  newarr->array->len = len;
+  hvm_obj_array *newarr = hvm_new_obj_array();
+  g_array_set_size(newarr->array, len);
   for(guint idx = 0; idx < len; idx++) {
     // Copy source pointer from original array into destination in new array
     hvm_obj_ref *src   = g_array_index(arr->array, hvm_obj_ref*, idx);
     hvm_obj_ref **dest = &g_array_index(newarr->array, hvm_obj_ref*, idx);
     *dest = src;
   }
-  hvm_obj_ref *newarrref = hvm_new_obj_ref();
+  hvm_obj_ref *newarrref = hvm_obj_ref_new_from_pool(vm);
   newarrref->type = HVM_ARRAY;
   newarrref->data.v = newarr;
   return newarrref;
@@ -141,12 +140,12 @@ hvm_obj_ref *hvm_prim_array_clone(hvm_vm *vm) {
 hvm_obj_ref *hvm_prim_int_to_string(hvm_vm *vm) {
   hvm_obj_ref *intref = vm->param_regs[0];
   assert(intref != NULL);
-  assert(intref->type == HVM_INTEGER);
-  int64_t intval = intref->data.i64;
+  assert(hvm_obj_type_of(intref) == HVM_INTEGER);
+  int64_t intval = hvm_obj_int_value(intref);
   char buff[24];// Enough to show a 64-bit signed integer in base 10
   int err = sprintf(buff, "%lld", intval);
   assert(err >= 0);
-  hvm_obj_ref *str = hvm_new_obj_ref_string_data(hvm_util_strclone(buff));
+  hvm_obj_ref *str = hvm_new_obj_ref_string_data(vm, hvm_util_strclone(buff));
   hvm_obj_space_add_obj_ref(vm->obj_space, str);
   return str;
 }
@@ -158,8 +157,8 @@ hvm_obj_ref *hvm_prim_time_as_int(hvm_vm *vm) {
   struct timeval tv;
   gettimeofday(&tv, NULL);
   sec = (1000000 * tv.tv_sec) + tv.tv_usec;
-  ret = hvm_new_obj_int(vm);
-  ret->data.i64 = sec;
+  ret = hvm_new_obj_int_value(vm, sec);
+  hvm_obj_space_add_obj_ref(vm->obj_space, ret);
   return ret;
 }
 
@@ -170,11 +169,12 @@ hvm_obj_ref *hvm_prim_debug_print_struct(hvm_vm *vm) {
   hvm_obj_struct *strct = structref->data.v;
   fprintf(stdout, "structure(%p)\n", strct);
   unsigned int idx;
-  for(idx = 0; idx < strct->heap_length; idx++) {
-    hvm_obj_struct_heap_pair *pair = strct->heap[idx];
-    char        *sym  = hvm_desymbolicate(vm->symbols, pair->id);
-    hvm_obj_ref *ref  = pair->obj;
-    const char  *name = hvm_human_name_for_obj_type(ref->type);
+  for(idx = 0; idx < hvm_obj_struct_slot_count(strct); idx++) {
+    hvm_symbol_id id = hvm_obj_struct_slot_key(strct, idx);
+    if(id == 0) { continue; }
+    char        *sym  = hvm_desymbolicate(vm->symbols, id);
+    hvm_obj_ref *ref  = strct->values[idx];
+    const char  *name = hvm_human_name_for_obj_type(hvm_obj_type_of(ref));
     fprintf(stdout, "  %s = %s(%p)\n", sym, name, ref);
   }
   return hvm_const_null;
@@ -203,9 +203,8 @@ hvm_obj_ref *hvm_prim_gc_run(hvm_vm *vm) {
 hvm_obj_ref *hvm_prim_rand(hvm_vm *vm) {
   int ret = rand();
   // Create the full object reference with our random integer
-  hvm_obj_ref *ref = hvm_new_obj_int(vm);
-  ref->data.i64 = (int64_t)ret;
-  // Make sure it's in the object space
+  hvm_obj_ref *ref = hvm_new_obj_int_value(vm, (int64_t)ret);
+  // Make sure it's in the object space (if it was boxed)
   hvm_obj_space_add_obj_ref(vm->obj_space, ref);
   return ref;
 }
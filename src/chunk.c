@@ -29,7 +29,7 @@ void hvm_chunk_expand_if_necessary(hvm_chunk *chunk) {
 hvm_obj_ref *hvm_chunk_get_constant_object(hvm_vm *vm, hvm_chunk_constant *cnst) {
   hvm_obj_ref* co = cnst->object;
   if(co->type == HVM_STRING) {
-    hvm_obj_ref    *ref = hvm_new_obj_ref();
+    hvm_obj_ref    *ref = hvm_obj_ref_new_from_pool(vm);
     hvm_obj_string *str = hvm_new_obj_string();
     ref->type  = HVM_STRING;
     ref->flags = ref->flags | HVM_OBJ_FLAG_CONSTANT;
@@ -37,11 +37,8 @@ hvm_obj_ref *hvm_chunk_get_constant_object(hvm_vm *vm, hvm_chunk_constant *cnst)
     str->data = co->data.v;
     return ref;
   } else if(co->type == HVM_SYMBOL) {
-    hvm_obj_ref *ref = hvm_new_obj_ref();
-    ref->type = HVM_SYMBOL;
-    ref->flags = ref->flags | HVM_OBJ_FLAG_CONSTANT;
-    ref->data.u64 = hvm_symbolicate(vm->symbols, co->data.v);
-    return ref;
+    // Symbols are immediates so they don't need a constant object
+    return hvm_obj_symbol_immediate(hvm_symbolicate(vm->symbols, co->data.v));
   } else {
     fprintf(stderr, "Can't yet handle object type %s\n", hvm_human_name_for_obj_type(co->type));
     return hvm_const_null;
@@ -94,7 +91,11 @@ void print_symbols(hvm_chunk *chunk) {
   int i = 0;
   while(*syms != NULL) {
     sym = *syms;
-    printf("  0x%08llX  %s\n", sym->index, sym->name);
+    if(sym->registers > 0) {
+      printf("  0x%08llX  %s  (%u registers)\n", sym->index, sym->name, sym->registers);
+    } else {
+      printf("  0x%08llX  %s\n", sym->index, sym->name);
+    }
     i++;
     syms++;
   }
@@ -193,6 +194,18 @@ void hvm_print_data(byte *data, uint64_t size) {
         i += 2;
         printf("$%-3d = getlocal[$%d]\n", reg1, reg2);
         break;
+      case HVM_OP_SETLOCALSLOT: // 1B OP | 1B SLOT | 1B REG
+        reg1 = data[i + 1];
+        reg2 = data[i + 2];
+        i += 2;
+        printf("setlocalslot[%d] = $%d\n", reg1, reg2);
+        break;
+      case HVM_OP_GETLOCALSLOT: // 1B OP | 1B REG | 1B SLOT
+        reg1 = data[i + 1];
+        reg2 = data[i + 2];
+        i += 2;
+        printf("$%-3d = getlocalslot[%d]\n", reg1, reg2);
+        break;
 
       case HVM_OP_STRUCTGET: // 1B OP | 3B REGS
         reg1 = data[i + 1];
@@ -201,6 +214,13 @@ void hvm_print_data(byte *data, uint64_t size) {
         i += 3;
         printf("$%-3d = $%d.structget[$%d]\n", reg1, reg2, reg3);
         break;
+      case HVM_OP_STRUCTHAS: // 1B OP | 3B REGS
+        reg1 = data[i + 1];
+        reg2 = data[i + 2];
+        reg3 = data[i + 3];
+        i += 3;
+        printf("$%-3d = $%d.structhas[$%d]\n", reg1, reg2, reg3);
+        break;
       case HVM_OP_STRUCTSET: // 1B OP | 3B REGS
         reg1 = data[i + 1];
         reg2 = data[i + 2];
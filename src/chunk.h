@@ -23,6 +23,9 @@ typedef struct hvm_chunk_symbol {
   uint64_t index;
   /// Name of that subroutine.
   char     *name;
+  /// Size of the subroutine's own register window (0 if it uses its
+  /// caller's registers).
+  unsigned int registers;
 } hvm_chunk_symbol;
 
 typedef struct hvm_chunk_debug_entry {
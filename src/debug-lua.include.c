@@ -64,7 +64,7 @@ int hvm_lua_registers(lua_State *L) {
   for(unsigned int i = 0; i < HVM_GENERAL_REGISTERS; i++) {
     hvm_obj_ref *ref = vm->general_regs[i];
     if(ref != hvm_const_null) {
-      const char *name = hvm_human_name_for_obj_type(ref->type);
+      const char *name = hvm_human_name_for_obj_type(hvm_obj_type_of(ref));
       fprintf(stderr, "g%-3d = %p (%s)\n", i, ref, name);
     }
   }
@@ -14,7 +14,7 @@
 #include "exception.h"
 
 hvm_obj_ref *hvm_exception_new(hvm_vm *vm, hvm_obj_ref *message) {
-  hvm_obj_ref *exc = hvm_new_obj_ref();
+  hvm_obj_ref *exc = hvm_obj_ref_new_from_pool(vm);
   hvm_obj_struct *excstruct = hvm_new_obj_struct();
   exc->type = HVM_STRUCTURE;
   exc->data.v = excstruct;
@@ -34,7 +34,7 @@ void hvm_exception_push_location(hvm_vm *vm, hvm_obj_ref *exc, hvm_location *loc
   if(locations == NULL) {
     // If there's no locations array then we need to make one and add it
     // to the exception struct.
-    locations = hvm_new_obj_ref();
+    locations = hvm_obj_ref_new_from_pool(vm);
     locations->type = HVM_ARRAY;
     locations->data.v = hvm_new_obj_array();
     hvm_obj_struct_internal_set(exc->data.v, sym, locations);
@@ -43,7 +43,7 @@ void hvm_exception_push_location(hvm_vm *vm, hvm_obj_ref *exc, hvm_location *loc
   }
   // Now let's create an internal object ref for the location and push it
   // onto the array.
-  hvm_obj_ref *locref = hvm_new_obj_ref();
+  hvm_obj_ref *locref = hvm_obj_ref_new_from_pool(vm);
   locref->type = HVM_INTERNAL;
   locref->data.v = loc;
   hvm_obj_array_push(locations, locref);
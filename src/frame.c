@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include "vm.h"
 #include "symbol.h"
@@ -8,6 +9,12 @@
 
 hvm_frame *hvm_new_frame() {
   hvm_frame *frame = malloc(sizeof(hvm_frame));
+  frame->locals = NULL;
+  frame->slots_length = 0;
+  frame->params = NULL;
+  frame->param_count = 0;
+  frame->general_regs = NULL;
+  frame->registers = 0;
   hvm_frame_initialize(frame);
   return frame;
 }
@@ -17,7 +24,14 @@ void hvm_frame_initialize(hvm_frame *frame) {
   frame->return_register = 0;
   frame->catch_addr = HVM_FRAME_EMPTY_CATCH;
   frame->catch_register = hvm_vm_reg_null();
-  frame->locals = hvm_new_obj_struct();
+  // Reuse the symbolic locals of the frame's previous occupant (if any)
+  // rather than allocating a fresh table on every call
+  if(frame->locals != NULL) {
+    hvm_obj_struct_clear(frame->locals);
+  }
+  // Only the slots the previous occupant wrote can be non-NULL
+  memset(frame->slots, 0, sizeof(struct hvm_obj_ref*) * frame->slots_length);
+  frame->slots_length = 0;
   frame->trace = NULL;
 }
 
@@ -4,6 +4,8 @@
 
 /// Default value for the exception catch destination for a frame.
 #define HVM_FRAME_EMPTY_CATCH 0xFFFFFFFFFFFFFFFF
+/// Number of slot-indexed locals available to each frame.
+#define HVM_FRAME_SLOTS 32
 
 /// Stack frame.
 typedef struct hvm_frame {
@@ -17,8 +19,23 @@ typedef struct hvm_frame {
   uint64_t       catch_addr;
   /// Register for exception to be written to
   unsigned char  catch_register;
-  /// Local variables of the frame.
+  /// Symbolic (dynamically-accessed) local variables of the frame; NULL
+  /// until the first SETLOCAL in the frame.
   hvm_obj_struct *locals;
+  /// Slot-indexed local variables of the frame (see GETLOCALSLOT).
+  struct hvm_obj_ref *slots[HVM_FRAME_SLOTS];
+  /// One past the highest slot written in this frame.
+  unsigned int slots_length;
+  /// Parameter window of the frame on the VM's value stack (set by the
+  /// caller).
+  struct hvm_obj_ref **params;
+  /// Number of parameters passed to the frame.
+  unsigned int param_count;
+  /// General registers in use by the frame (its own window just past its
+  /// parameters, or its caller's registers).
+  struct hvm_obj_ref **general_regs;
+  /// Size of the frame's own register window (0 if it shares its caller's).
+  unsigned int registers;
   /// Trace context of the frame (optional)
   void *trace;
 } hvm_frame;
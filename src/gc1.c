@@ -3,6 +3,9 @@
 #include <stdbool.h>
 #include <assert.h>
 #include <string.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include "vm.h"
 #include "symbol.h"
@@ -14,211 +17,1019 @@
 #define FLAGTRUE(v, f)  (v & f) == f
 #define FLAGFALSE(v, f) (v & f) == 0
 
-#define FLAG_GC_MARKED 0x1
+// Marking passes this budget to run until there are no gray objects left
+#define UNLIMITED_BUDGET UINT32_MAX
+// Scanning outside of a concurrent marking cycle
+#define NO_CYCLE 0
 
-// 0000 0001
-#define MARK_ENTRY(E)   E->flags = E->flags | 0x1;
-// 1111 1110
-#define UNMARK_ENTRY(E) E->flags = E->flags & 0xFE;
+// The collector thread also requests collections (when it's done with a
+// phase), so the flag is always written atomically.
+static inline void set_collect_pending(hvm_gc1_obj_space *space, bool pending) {
+  __atomic_store_n(&space->collect_pending, pending, __ATOMIC_RELAXED);
+}
 
-// Dereferences an entry pointer and returns the first byte of the struct.
-#define FIRST_BYTE_OF_ENTRY(V) *(char*)(V)
 
+static void worklist_init(hvm_gc1_worklist *gray) {
+  gray->size   = HVM_GC1_INITIAL_WORKLIST_SIZE;
+  gray->items  = malloc(sizeof(hvm_obj_ref*) * gray->size);
+  gray->length = 0;
+}
 
-hvm_gc1_obj_space *hvm_new_obj_space() {
+hvm_gc1_obj_space *hvm_new_obj_space(hvm_obj_ref_pool *pool) {
   hvm_gc1_obj_space *space = malloc(sizeof(hvm_gc1_obj_space));
-  space->heap.size    = HVM_GC1_INITIAL_HEAP_SIZE;
-  space->heap.entries = calloc(HVM_GC1_HEAP_MEMORY_SIZE(space->heap.size), sizeof(hvm_gc1_heap_entry));
-  space->heap.length  = 0;
+  space->heap.pool      = pool;
+  space->heap.length    = 0;
+  space->nursery.size   = HVM_GC1_NURSERY_SIZE;
+  space->nursery.items  = malloc(sizeof(hvm_obj_ref*) * space->nursery.size);
+  space->nursery.length = 0;
+  space->remembered_size   = HVM_GC1_INITIAL_REMEMBERED_SIZE;
+  space->remembered        = malloc(sizeof(hvm_gc1_remembered) * space->remembered_size);
+  space->remembered_length = 0;
+  space->ratio             = HVM_GC1_DEFAULT_RATIO;
+  space->heap_target       = HVM_GC1_MIN_HEAP_TARGET;
+  space->collect_pending   = false;
+  space->allocated         = 0;
+  space->minor_collections = 0;
+  space->major_collections = 0;
+  worklist_init(&space->gray);
+  worklist_init(&space->young_gray);
+  space->incremental         = false;
+  space->marking             = false;
+  space->mark_step_countdown = HVM_GC1_MARK_STEP_ALLOCATIONS;
+  space->pauses      = 0;
+  space->pause_total = 0;
+  space->pause_max   = 0;
+  space->concurrent        = false;
+  space->cycle             = 0;
+  space->concurrent_cycles = 0;
+  space->phase             = HVM_GC1_IDLE;
+  space->snapshot_length   = 0;
+  space->sweep_zones        = NULL;
+  space->sweep_zones_size   = 0;
+  space->sweep_zones_length = 0;
+  space->sweep_cursor      = 0;
+  space->sweep_slot        = 0;
+  worklist_init(&space->black);
+  worklist_init(&space->dead);
+  space->collector_started = false;
+  pthread_mutex_init(&space->lock, NULL);
+  pthread_cond_init(&space->wake, NULL);
+  pthread_cond_init(&space->done, NULL);
+  space->workers  = 0;
+  space->parallel = NULL;
+  space->roots_size   = HVM_GC1_INITIAL_ROOTS_SIZE;
+  space->roots        = malloc(sizeof(hvm_obj_ref**) * space->roots_size);
+  space->roots_length = 0;
+  space->torture      = false;
+  char *ratio = getenv(HVM_GC1_RATIO_ENV);
+  if(ratio != NULL) {
+    space->ratio = (strcmp(ratio, "off") == 0) ? 0 : (unsigned int)strtoul(ratio, NULL, 10);
+  }
+  char *incremental = getenv(HVM_GC1_INCREMENTAL_ENV);
+  if(incremental != NULL) {
+    space->incremental = (strcmp(incremental, "1") == 0);
+  }
+  char *concurrent = getenv(HVM_GC1_CONCURRENT_ENV);
+  if(concurrent != NULL) {
+    space->concurrent = (strcmp(concurrent, "1") == 0);
+  }
+  char *torture = getenv(HVM_GC1_TORTURE_ENV);
+  if(torture != NULL) {
+    space->torture = (strcmp(torture, "1") == 0);
+  }
+  char *workers = getenv(HVM_GC1_WORKERS_ENV);
+  if(workers != NULL) {
+    space->workers = (unsigned int)strtoul(workers, NULL, 10);
+  }
   return space;
 }
 
-static inline void obj_space_reset_marks(hvm_gc1_obj_space *space) {
-  unsigned int id = 0;
-  while(id < space->heap.length) {
-    hvm_gc1_heap_entry *entry = &space->heap.entries[id];
-    // entry->flags = entry->flags & 0xFE;
-    UNMARK_ENTRY(entry);
-    id += 1;
+// MARKING --------------------------------------------------------------------
+
+// Marking is tri-color: unmarked objects are white, marked objects on the
+// worklist are gray and marked objects that have been scanned are black.
+// Using an explicit worklist (rather than recursing through structures)
+// keeps deep structures from overflowing the C stack and lets marking be
+// stopped after a budget and resumed later.
+//
+// Marks are kept in each object's `gc` state. Young objects only get
+// marked during a minor collection and old ones during a major one, and
+// both kinds of collection clear the marks again as they sweep, so nothing
+// needs resetting before marking starts.
+//
+// Minor collections only trace young objects: anything old is assumed to
+// be live, and any young objects it refers to are found through the
+// remembered set instead. Major marking leaves young objects to minor
+// collections (which promote survivors gray while a major marking cycle is
+// in progress).
+
+static inline void worklist_push(hvm_gc1_worklist *gray, hvm_obj_ref *obj) {
+  if(gray->length == gray->size) {
+    gray->size  = gray->size * 2;
+    gray->items = realloc(gray->items, sizeof(hvm_obj_ref*) * gray->size);
   }
+  gray->items[gray->length] = obj;
+  gray->length += 1;
 }
 
-// Forward declaration
-static inline void mark_struct(hvm_obj_struct *strct);
-static inline void mark_array(hvm_obj_array *arr);
+// Set an object's mark bit. Parallel marking workers can race to mark the
+// same object, so only the one that sets the bit gets to scan it.
+static inline bool set_mark(hvm_obj_ref *obj) {
+  if(__atomic_load_n(&obj->gc, __ATOMIC_RELAXED) & HVM_GC1_OBJ_MARKED) { return false; }
+  return (__atomic_fetch_or(&obj->gc, HVM_GC1_OBJ_MARKED, __ATOMIC_RELAXED) & HVM_GC1_OBJ_MARKED) == 0;
+}
 
-static inline void mark_obj_ref(hvm_obj_ref *obj) {
+// Shade an object gray if it's white.
+static inline void mark_obj_ref(hvm_gc1_worklist *gray, hvm_obj_ref *obj, bool minor) {
+  if(obj == NULL || hvm_obj_is_immediate(obj)) {
+    return;// Tagged immediates aren't on the heap
+  }
   if(FLAGTRUE(obj->flags, HVM_OBJ_FLAG_CONSTANT) ||
      FLAGFALSE(obj->flags, HVM_OBJ_FLAG_GC_TRACKED)
   ) {
     return;// Don't process constants or untracked objects
   }
-  assert(obj->entry != NULL); // Make sure there is a GC entry
-  hvm_gc1_heap_entry *entry = obj->entry;
-  // Check if already marked
-  if(FLAGTRUE(entry->flags, FLAG_GC_MARKED)) { return; }
-  // Mark the GC entry
-  MARK_ENTRY(entry);
-  // Handle complex data structures
-  if(obj->type == HVM_STRUCTURE) {
-    mark_struct(obj->data.v);
-  } else if(obj->type == HVM_ARRAY) {
-    mark_array(obj->data.v);
-  } else if(obj->type == HVM_EXCEPTION) {
-    hvm_exception *exc = obj->data.v;
-    mark_obj_ref(exc->data);
+  if(minor != (FLAGTRUE(obj->flags, HVM_OBJ_FLAG_YOUNG))) {
+    return;// Belongs to the other generation
+  }
+  if(!set_mark(obj)) {
+    return;// Already marked
   }
+  worklist_push(gray, obj);
 }
 
-void mark_struct(hvm_obj_struct *strct) {
+static inline void mark_struct(hvm_gc1_worklist *gray, hvm_obj_struct *strct, bool minor) {
   unsigned int idx;
-  for(idx = 0; idx < strct->heap_length; idx++) {
-    hvm_obj_struct_heap_pair *pair = strct->heap[idx];
-    hvm_obj_ref *obj = pair->obj;
-    mark_obj_ref(obj);
+  for(idx = 0; idx < hvm_obj_struct_slot_count(strct); idx++) {
+    if(hvm_obj_struct_slot_key(strct, idx) == 0) { continue; }
+    mark_obj_ref(gray, strct->values[idx], minor);
   }
 }
-void mark_array(hvm_obj_array *arr) {
+static inline void mark_array(hvm_gc1_worklist *gray, hvm_obj_array *arr, bool minor) {
   uint64_t idx, len;
   len = hvm_array_len(arr);
   for(idx = 0; idx < len; idx++) {
     hvm_obj_ref *ptr = hvm_obj_array_internal_get(arr, idx);
-    mark_obj_ref(ptr);
+    mark_obj_ref(gray, ptr, minor);
   }
 }
 
-static inline void mark_registers(hvm_vm *vm) {
-  uint32_t i;
-  for(i = 0; i < HVM_GENERAL_REGISTERS; i++) {
-    hvm_obj_ref* obj = vm->general_regs[i];
-    if(obj != NULL) { mark_obj_ref(obj); }
+// Scan a gray object's references, turning it black.
+//
+// During a concurrent marking cycle a container is only scanned once: by
+// whichever of the collector and the write barrier gets to it first (with
+// the lock held). Once it's marked as scanned the VM is free to change it
+// without the lock, so the collector mustn't look at it again.
+static inline void scan_obj_ref(hvm_gc1_worklist *gray, hvm_obj_ref *obj, bool minor, unsigned int cycle) {
+  // Handle complex data structures
+  if(obj->type == HVM_STRUCTURE) {
+    hvm_obj_struct *strct = obj->data.v;
+    if(cycle != NO_CYCLE && strct->scanned == cycle) { return; }
+    mark_struct(gray, strct, minor);
+    if(cycle != NO_CYCLE) { __atomic_store_n(&strct->scanned, cycle, __ATOMIC_RELEASE); }
+  } else if(obj->type == HVM_ARRAY) {
+    hvm_obj_array *arr = obj->data.v;
+    if(cycle != NO_CYCLE && arr->scanned == cycle) { return; }
+    mark_array(gray, arr, minor);
+    if(cycle != NO_CYCLE) { __atomic_store_n(&arr->scanned, cycle, __ATOMIC_RELEASE); }
+  } else if(obj->type == HVM_EXCEPTION) {
+    hvm_exception *exc = obj->data.v;
+    mark_obj_ref(gray, exc->data, minor);
   }
-  for(i = 0; i < HVM_ARGUMENT_REGISTERS; i++) {
-    hvm_obj_ref* obj = vm->arg_regs[i];
-    if(obj != NULL) { mark_obj_ref(obj); }
+}
+
+// Scan up to `budget` gray objects. Returns whether the worklist was
+// emptied.
+static bool drain_worklist(hvm_gc1_worklist *gray, bool minor, unsigned int budget, unsigned int cycle) {
+  while(gray->length > 0 && budget > 0) {
+    gray->length -= 1;
+    scan_obj_ref(gray, gray->items[gray->length], minor, cycle);
+    budget -= 1;
   }
-  for(i = 0; i < HVM_PARAMETER_REGISTERS; i++) {
-    hvm_obj_ref* obj = vm->param_regs[i];
-    if(obj != NULL) { mark_obj_ref(obj); }
+  return gray->length == 0;
+}
+
+static inline void each_struct_slot(hvm_obj_struct *strct, hvm_gc1_root_visitor visit, void *data) {
+  for(unsigned int idx = 0; idx < hvm_obj_struct_slot_count(strct); idx++) {
+    if(hvm_obj_struct_slot_key(strct, idx) == 0) { continue; }
+    visit(&strct->values[idx], data);
   }
 }
 
-static inline void mark_stack(hvm_vm *vm) {
-  uint32_t i;
-  for(i = 0; i <= vm->stack_depth; i++) {
+// Marking goes through this too (with the marking visitor inlined), so
+// that there's just the one list of roots to keep up to date.
+static inline void each_root(hvm_vm *vm, hvm_gc1_root_visitor visit, void *data) {
+  // All of the frames' registers live on the value stack; only the part up
+  // to the arguments being written is live (and everything in it that isn't
+  // in use is NULL)
+  hvm_obj_ref **end = vm->arg_regs + vm->arg_count;
+  for(hvm_obj_ref **slot = vm->value_stack; slot < end; slot++) {
+    visit(slot, data);
+  }
+  // Climb through each of the stack frames
+  for(uint32_t i = 0; i <= vm->stack_depth; i++) {
     struct hvm_frame *frame = &vm->stack[i];
-    hvm_obj_struct *locals = frame->locals;
-    mark_struct(locals);
+    if(frame->locals != NULL) { each_struct_slot(frame->locals, visit, data); }
+    for(unsigned int s = 0; s < frame->slots_length; s++) {
+      visit(&frame->slots[s], data);
+    }
+  }
+  // And the globals
+  each_struct_slot(vm->globals, visit, data);
+  // Along with everything else the VM holds on to
+  visit(&vm->exception, data);
+  for(uint32_t id = 0; id < vm->const_pool.next_index; id++) {
+    visit(&vm->const_pool.entries[id], data);
+  }
+  each_struct_slot(vm->symbol_table, visit, data);
+  hvm_gc1_obj_space *space = vm->obj_space;
+  for(unsigned int i = 0; i < space->roots_length; i++) {
+    visit(space->roots[i], data);
   }
 }
 
-void hvm_gc1_free(hvm_gc1_heap_entry *entry) {
-  // Free the object referenced
-  hvm_obj_free(entry->obj);
-  // Then clear out the entry
-  // memset(entry, 0, sizeof(hvm_gc1_heap_entry));
-  // Only setting the first byte since that's what's checked.
-  FIRST_BYTE_OF_ENTRY(entry) = 0;
+void hvm_gc1_each_root(hvm_vm *vm, hvm_gc1_root_visitor visit, void *data) {
+  each_root(vm, visit, data);
 }
 
-static inline void sweep_space(hvm_gc1_obj_space *space) {
-  for(uint32_t id = 0; id < space->heap.length; id++) {
-    hvm_gc1_heap_entry *entry = &space->heap.entries[id];
-    if(FLAGFALSE(entry->flags, FLAG_GC_MARKED)) {
-      fprintf(stderr, "freeing:%d\n", id);
-      hvm_gc1_free(entry);
+typedef struct root_marker {
+  hvm_gc1_worklist *gray;
+  bool minor;
+} root_marker;
+
+static void mark_root(hvm_obj_ref **slot, void *data) {
+  root_marker *marker = data;
+  mark_obj_ref(marker->gray, *slot, marker->minor);
+}
+
+static inline void mark_roots(hvm_vm *vm, hvm_gc1_worklist *gray, bool minor) {
+  root_marker marker = { .gray = gray, .minor = minor };
+  each_root(vm, mark_root, &marker);
+}
+
+void hvm_gc1_add_root(hvm_gc1_obj_space *space, hvm_obj_ref **slot) {
+  if(space->roots_length == space->roots_size) {
+    space->roots_size = space->roots_size * 2;
+    space->roots = realloc(space->roots, sizeof(hvm_obj_ref**) * space->roots_size);
+  }
+  space->roots[space->roots_length] = slot;
+  space->roots_length += 1;
+}
+
+void hvm_gc1_remove_root(hvm_gc1_obj_space *space, hvm_obj_ref **slot) {
+  for(unsigned int i = space->roots_length; i > 0; i--) {
+    if(space->roots[i - 1] != slot) { continue; }
+    // Order doesn't matter, so the last one fills the gap
+    space->roots_length -= 1;
+    space->roots[i - 1] = space->roots[space->roots_length];
+    return;
+  }
+  fprintf(stderr, "gc1: removing a root that was never added\n");
+  assert(false);
+}
+
+static inline void mark_remembered(hvm_gc1_obj_space *space) {
+  for(unsigned int i = 0; i < space->remembered_length; i++) {
+    hvm_gc1_remembered *rem = &space->remembered[i];
+    if(rem->type == HVM_STRUCTURE) {
+      mark_struct(&space->young_gray, rem->container, true);
+    } else {
+      mark_array(&space->young_gray, rem->container, true);
     }
   }
 }
 
-static inline bool entry_is_null(hvm_gc1_obj_space *space, uint32_t idx) {
-  hvm_gc1_heap_entry *entry = &space->heap.entries[idx];
-  return FIRST_BYTE_OF_ENTRY(entry) == 0;
+static inline void forget_remembered(hvm_gc1_obj_space *space) {
+  for(unsigned int i = 0; i < space->remembered_length; i++) {
+    hvm_gc1_remembered *rem = &space->remembered[i];
+    if(rem->type == HVM_STRUCTURE) {
+      ((hvm_obj_struct*)rem->container)->remembered = false;
+    } else {
+      ((hvm_obj_array*)rem->container)->remembered = false;
+    }
+  }
+  space->remembered_length = 0;
+}
+
+static void remember(hvm_gc1_obj_space *space, hvm_obj_type type, void *container) {
+  if(space->remembered_length == space->remembered_size) {
+    space->remembered_size = HVM_GC1_REMEMBERED_GROW_FUNCTION(space->remembered_size);
+    space->remembered = realloc(space->remembered, sizeof(hvm_gc1_remembered) * space->remembered_size);
+  }
+  hvm_gc1_remembered *rem = &space->remembered[space->remembered_length];
+  rem->type      = type;
+  rem->container = container;
+  space->remembered_length += 1;
 }
 
-static inline void find_next_free_entry(hvm_gc1_obj_space *space, uint32_t *free_entry) {
-  uint32_t idx = *free_entry;
-  while(idx < space->heap.length && !entry_is_null(space, idx)) {
-    idx += 1;
+// Shade everything an old container holds before the VM changes it for the
+// first time in a concurrent marking cycle.
+static void snapshot_container(hvm_gc1_obj_space *space, hvm_obj_type type, void *container) {
+  unsigned int *scanned;
+  if(type == HVM_STRUCTURE) {
+    scanned = &((hvm_obj_struct*)container)->scanned;
+  } else {
+    assert(type == HVM_ARRAY);
+    scanned = &((hvm_obj_array*)container)->scanned;
+  }
+  if(__atomic_load_n(scanned, __ATOMIC_ACQUIRE) == space->cycle) {
+    return;// Already scanned by the collector or an earlier write
   }
-  *free_entry = idx;
+  pthread_mutex_lock(&space->lock);
+  if(*scanned != space->cycle) {
+    if(type == HVM_STRUCTURE) {
+      mark_struct(&space->gray, container, false);
+    } else {
+      mark_array(&space->gray, container, false);
+    }
+    __atomic_store_n(scanned, space->cycle, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&space->lock);
 }
-static inline bool has_used_entry_after(hvm_gc1_obj_space *space, uint32_t free_entry, uint32_t *used_entry) {
-  // Start at the index after the free entry index
-  uint32_t idx = free_entry + 1;
-  // Make sure we have space left to search
-  while(idx < space->heap.length) {
-    if(entry_is_null(space, idx)) {
-      // Pass over free entry
-      idx += 1;
+
+void hvm_gc1_write_barrier(hvm_gc1_obj_space *space, hvm_obj_type type, void *container, hvm_obj_ref *val) {
+  if(space->marking && space->concurrent) {
+    snapshot_container(space, type, container);
+  }
+  if(val == NULL || hvm_obj_is_immediate(val)) {
+    return;// Nothing on the heap is being stored
+  }
+  if(FLAGTRUE(val->flags, HVM_OBJ_FLAG_YOUNG)) {
+    bool *remembered;
+    if(type == HVM_STRUCTURE) {
+      remembered = &((hvm_obj_struct*)container)->remembered;
+    } else {
+      assert(type == HVM_ARRAY);
+      remembered = &((hvm_obj_array*)container)->remembered;
+    }
+    if(!*remembered) {
+      *remembered = true;
+      remember(space, type, container);
+    }
+  } else if(space->marking && !space->concurrent) {
+    // The container may already be black, so the object can't be left
+    // white
+    mark_obj_ref(&space->gray, val, false);
+  }
+}
+
+// SWEEPING -------------------------------------------------------------------
+
+// Sweep slots [start, end) of a reference pool zone for old objects. Marked
+// ones are unmarked for the next collection and the rest are freed: either
+// entirely or, when there's a `dead` list, by freeing just their data and
+// leaving their references on it to be released by the VM (since the pool
+// isn't thread-safe). Returns the number of objects freed.
+static unsigned int sweep_zone(hvm_obj_ref_pool_zone *zone, unsigned int start, unsigned int end, hvm_gc1_worklist *dead) {
+  unsigned int freed = 0;
+  for(unsigned int id = start; id < end; id++) {
+    hvm_obj_ref *obj = &zone->refs[id];
+    if(FLAGFALSE(obj->gc, HVM_GC1_OBJ_OLD)) {
+      continue;// Free slot, young object or not in the GC system
+    }
+    if(FLAGTRUE(obj->gc, HVM_GC1_OBJ_MARKED)) {
+      obj->gc = HVM_GC1_OBJ_OLD;
       continue;
+    }
+#ifdef HVM_GC1_DEBUG
+    fprintf(stderr, "freeing:%p\n", (void*)obj);
+#endif
+    obj->gc = 0;
+    freed += 1;
+    if(dead != NULL) {
+      hvm_obj_free_data(obj);
+      worklist_push(dead, obj);
     } else {
-      // Non-null entry, so it's used
-      *used_entry = idx;
-      return true;
-    }
-  }
-  return false; // No space left
-}
-
-static inline void relocate_entry(hvm_gc1_obj_space *space, uint32_t free_entry, uint32_t used_entry) {
-  assert(free_entry < used_entry);
-  hvm_gc1_heap_entry *dest   = &space->heap.entries[free_entry];
-  hvm_gc1_heap_entry *source = &space->heap.entries[used_entry];
-  // Copy the entries
-  memcpy(dest, source, sizeof(hvm_gc1_heap_entry));
-  // "Delete" the old entry
-  FIRST_BYTE_OF_ENTRY(source) = 0;
-  // Update the object reference to point to the right place
-  hvm_obj_ref *obj = dest->obj;
-  obj->entry = dest;
-}
-
-static inline void compact_space(hvm_gc1_obj_space *space) {
-  uint32_t free_entry = 0;
-  uint32_t used_entry = 0;
-  find_next_free_entry(space, &free_entry);
-  while(has_used_entry_after(space, free_entry, &used_entry)) {
-    // Move the used entry to the free entry
-    relocate_entry(space, free_entry, used_entry);
-    fprintf(stderr, "relocating from used:%d to free:%d\n", used_entry, free_entry);
-    // Find the next free entry after this one
-    free_entry += 1;
-    find_next_free_entry(space, &free_entry);
-  }
-  fprintf(stderr, "free entry:%d\n", free_entry);
-  space->heap.length = free_entry;
-}
-
-static inline void obj_space_mark(hvm_vm *vm) {
-  // Go through the registers
-  mark_registers(vm);
-  // Climb through each of the stack frames
-  mark_stack(vm);
+      hvm_obj_free(obj);
+    }
+  }
+  return freed;
 }
 
-void hvm_gc1_run(hvm_vm *vm, hvm_gc1_obj_space *space) {
-  // fprintf(stderr, "gc1_run.start\n");
-  // Reset all of our markings
-  obj_space_reset_marks(space);
-  // Mark objects
-  obj_space_mark(vm);
+static inline void sweep_space(hvm_gc1_obj_space *space) {
+  for(hvm_obj_ref_pool_zone *zone = space->heap.pool->head; zone != NULL; zone = zone->next) {
+    space->heap.length -= sweep_zone(zone, 0, zone->bump, NULL);
+  }
+}
+
+// Note down the pool's zones and how far each has been used, so that they
+// can be swept while the VM carries on allocating (into slots that are
+// either free or past the recorded bump, and so are skipped by the sweep).
+static void snapshot_zones(hvm_gc1_obj_space *space) {
+  space->sweep_zones_length = 0;
+  for(hvm_obj_ref_pool_zone *zone = space->heap.pool->head; zone != NULL; zone = zone->next) {
+    if(space->sweep_zones_length == space->sweep_zones_size) {
+      space->sweep_zones_size = (space->sweep_zones_size == 0) ? 16 : space->sweep_zones_size * 2;
+      space->sweep_zones = realloc(space->sweep_zones, sizeof(hvm_gc1_sweep_zone) * space->sweep_zones_size);
+    }
+    hvm_gc1_sweep_zone *sweep = &space->sweep_zones[space->sweep_zones_length];
+    sweep->zone = zone;
+    sweep->bump = zone->bump;
+    space->sweep_zones_length += 1;
+  }
+}
+
+// COLLECTION -----------------------------------------------------------------
+
+// Forward declarations
+static void promote_nursery(hvm_gc1_obj_space *space, bool sweep);
+static void parallel_collect_old(hvm_vm *vm, hvm_gc1_obj_space *space);
+
+// Everything that runs on the VM's side of a collection expects the lock to
+// be held, since the collector thread may be working on the old generation.
+static void minor_collect(hvm_vm *vm, hvm_gc1_obj_space *space) {
+  space->minor_collections += 1;
+  mark_roots(vm, &space->young_gray, true);
+  mark_remembered(space);
+  drain_worklist(&space->young_gray, true, UNLIMITED_BUDGET, NO_CYCLE);
+  // Survivors move to the old generation; the rest are freed
+  promote_nursery(space, true);
+  // The collector thread may still be sweeping the zones
+  if(space->phase == HVM_GC1_IDLE) {
+    hvm_obj_ref_pool_release_empty_zones(vm->ref_pool);
+  }
+}
+
+void hvm_gc1_run_minor(hvm_vm *vm, hvm_gc1_obj_space *space) {
+  pthread_mutex_lock(&space->lock);
+  minor_collect(vm, space);
+  pthread_mutex_unlock(&space->lock);
+}
+
+static void retarget_heap(hvm_gc1_obj_space *space, uint64_t live) {
+  uint64_t target = live + (live * space->ratio) / 100;
+  if(target < HVM_GC1_MIN_HEAP_TARGET) { target = HVM_GC1_MIN_HEAP_TARGET; }
+  if(target > UINT32_MAX) { target = UINT32_MAX; }
+  space->heap_target = (unsigned int)target;
+}
+
+// Tidy up the old generation once its dead objects have been freed.
+static void finish_sweep(hvm_vm *vm, hvm_gc1_obj_space *space) {
+  // Hand back reference pool zones the sweep emptied out
+  hvm_obj_ref_pool_release_empty_zones(vm->ref_pool);
+  // Size the heap for the live set
+  retarget_heap(space, space->heap.length);
+  set_collect_pending(space, false);
+}
+
+// Free everything left white once the old generation has been marked.
+static void sweep_old(hvm_vm *vm, hvm_gc1_obj_space *space) {
   // Free unmarked objects
   sweep_space(space);
-  // Compact the object space
-  compact_space(space);
-  // fprintf(stderr, "gc1_run.end\n");
-  // TODO: Shrink the object space
+  finish_sweep(vm, space);
+}
+
+// Full stop-the-world mark/sweep of the old generation (the nursery must
+// be empty).
+static void collect_old(hvm_vm *vm, hvm_gc1_obj_space *space) {
+  assert(space->nursery.length == 0);
+  if(space->workers > 0) {
+    parallel_collect_old(vm, space);
+    return;
+  }
+  space->major_collections += 1;
+  // Mark objects
+  mark_roots(vm, &space->gray, false);
+  drain_worklist(&space->gray, false, UNLIMITED_BUDGET, NO_CYCLE);
+  sweep_old(vm, space);
+}
+
+// Start an incremental marking cycle by shading the roots.
+static void start_marking(hvm_vm *vm, hvm_gc1_obj_space *space) {
+  space->major_collections += 1;
+  space->marking = true;
+  space->mark_step_countdown = HVM_GC1_MARK_STEP_ALLOCATIONS;
+  mark_roots(vm, &space->gray, false);
+}
+
+// Final remark: the write barrier only covers containers, so the roots are
+// scanned again before sweeping.
+static void finish_marking(hvm_vm *vm, hvm_gc1_obj_space *space) {
+  // Survivors in the nursery are promoted gray
+  minor_collect(vm, space);
+  mark_roots(vm, &space->gray, false);
+  drain_worklist(&space->gray, false, UNLIMITED_BUDGET, NO_CYCLE);
+  space->marking = false;
+  sweep_old(vm, space);
+}
+
+static void mark_step(hvm_vm *vm, hvm_gc1_obj_space *space) {
+  if(drain_worklist(&space->gray, false, HVM_GC1_MARK_STEP_BUDGET, NO_CYCLE)) {
+    finish_marking(vm, space);
+  }
+}
+
+// CONCURRENT COLLECTION ------------------------------------------------------
+
+static void *collector_main(void *arg);
+
+// Shade the roots and hand marking over to the collector thread.
+static void start_concurrent(hvm_vm *vm, hvm_gc1_obj_space *space) {
+  // Take the snapshot with an empty nursery so that everything reachable is
+  // either old or allocated after the cycle started
+  if(space->nursery.length > 0) { minor_collect(vm, space); }
+  space->major_collections += 1;
+  space->cycle += 1;
+  space->marking = true;
+  space->snapshot_length = space->heap.length;
+  mark_roots(vm, &space->gray, false);
+  space->phase = HVM_GC1_MARKING;
+  if(!space->collector_started) {
+    int err = pthread_create(&space->collector, NULL, collector_main, space);
+    if(err != 0) {
+      fprintf(stderr, "gc1: failed to start collector thread\n");
+      assert(err == 0);
+    }
+    space->collector_started = true;
+  }
+  pthread_cond_signal(&space->wake);
+}
+
+// Final remark: the collector thread has run out of gray objects, but the
+// write barrier may have shaded more since then.
+static void finish_concurrent_marking(hvm_gc1_obj_space *space) {
+  drain_worklist(&space->gray, false, UNLIMITED_BUDGET, space->cycle);
+  space->marking = false;
+  snapshot_zones(space);
+  space->sweep_cursor = 0;
+  space->sweep_slot   = 0;
+  space->phase        = HVM_GC1_SWEEPING;
+  pthread_cond_signal(&space->wake);
+}
+
+// Hand the references freed by the collector thread back to the pool.
+static void release_dead(hvm_vm *vm, hvm_gc1_obj_space *space) {
+  for(unsigned int i = 0; i < space->dead.length; i++) {
+    hvm_obj_ref_release(space->dead.items[i]);
+  }
+  space->dead.length = 0;
+  // Objects promoted during the cycle may have been left marked if they
+  // weren't in a swept part of the pool
+  for(unsigned int i = 0; i < space->black.length; i++) {
+    space->black.items[i]->gc = HVM_GC1_OBJ_OLD;
+  }
+  space->black.length = 0;
+  space->phase = HVM_GC1_IDLE;
+  hvm_obj_ref_pool_release_empty_zones(vm->ref_pool);
+  space->concurrent_cycles += 1;
+}
+
+// Block until the concurrent collection in progress is done.
+static void finish_concurrent(hvm_vm *vm, hvm_gc1_obj_space *space) {
+  while(space->phase != HVM_GC1_IDLE) {
+    if(space->phase == HVM_GC1_MARKED) {
+      finish_concurrent_marking(space);
+    } else if(space->phase == HVM_GC1_SWEPT) {
+      release_dead(vm, space);
+    } else {
+      pthread_cond_wait(&space->done, &space->lock);
+    }
+  }
+}
+
+// Finish whichever phase the collector thread is waiting on the VM for, or
+// start a new collection if the old generation is over its target.
+static void concurrent_step(hvm_vm *vm, hvm_gc1_obj_space *space) {
+  switch(space->phase) {
+    case HVM_GC1_MARKED:
+      finish_concurrent_marking(space);
+      break;
+    case HVM_GC1_SWEPT:
+      release_dead(vm, space);
+      break;
+    case HVM_GC1_IDLE:
+      if(space->heap.length >= space->heap_target) {
+        start_concurrent(vm, space);
+      }
+      break;
+    default:
+      // Collector thread is busy. If the VM is allocating faster than it
+      // can collect, wait for it instead of letting the heap grow without
+      // bound.
+      if(space->heap.length >= HVM_GC1_STALL_FACTOR * space->heap_target) {
+        finish_concurrent(vm, space);
+      }
+      break;
+  }
+}
+
+// Sweep the next chunk of the slots that were in use when marking finished.
+// Returns whether everything has been swept.
+static bool sweep_chunk(hvm_gc1_obj_space *space) {
+  unsigned int budget = HVM_GC1_SWEEP_CHUNK;
+  while(space->sweep_cursor < space->sweep_zones_length && budget > 0) {
+    hvm_gc1_sweep_zone *sweep = &space->sweep_zones[space->sweep_cursor];
+    unsigned int end = space->sweep_slot + budget;
+    if(end > sweep->bump) { end = sweep->bump; }
+    space->heap.length -= sweep_zone(sweep->zone, space->sweep_slot, end, &space->dead);
+    budget -= end - space->sweep_slot;
+    space->sweep_slot = end;
+    if(end == sweep->bump) {
+      space->sweep_cursor += 1;
+      space->sweep_slot    = 0;
+    }
+  }
+  return space->sweep_cursor == space->sweep_zones_length;
+}
+
+static void collector_phase_done(hvm_gc1_obj_space *space, hvm_gc1_phase phase) {
+  space->phase = phase;
+  set_collect_pending(space, true);
+  pthread_cond_broadcast(&space->done);
 }
 
-void hvm_obj_space_grow(hvm_gc1_obj_space *space) {
-  unsigned int old_size = space->heap.size;
-  space->heap.size = HVM_GC1_HEAP_GROW_FUNCTION(space->heap.size);
-  fprintf(stderr, "gc1: growing from %u to %u\n", old_size, space->heap.size);
-  space->heap.entries = realloc(space->heap.entries, HVM_GC1_HEAP_MEMORY_SIZE(space->heap.size));
+static void *collector_main(void *arg) {
+  hvm_gc1_obj_space *space = arg;
+  pthread_mutex_lock(&space->lock);
+  while(true) {
+    if(space->phase == HVM_GC1_MARKING) {
+      if(drain_worklist(&space->gray, false, HVM_GC1_MARK_STEP_BUDGET, space->cycle)) {
+        collector_phase_done(space, HVM_GC1_MARKED);
+      }
+    } else if(space->phase == HVM_GC1_SWEEPING) {
+      if(sweep_chunk(space)) {
+        // Objects promoted during the cycle aren't counted, since they
+        // haven't been found to be live yet
+        retarget_heap(space, space->snapshot_length - space->dead.length);
+        collector_phase_done(space, HVM_GC1_SWEPT);
+      }
+    } else {
+      pthread_cond_wait(&space->wake, &space->lock);
+      continue;
+    }
+    // Give the VM a chance at the lock between batches
+    pthread_mutex_unlock(&space->lock);
+    sched_yield();
+    pthread_mutex_lock(&space->lock);
+  }
+  return NULL;
+}
+
+// PARALLEL COLLECTION --------------------------------------------------------
+
+// Stop-the-world full collections can be split across several worker
+// threads. Marking sets the objects' mark bits atomically, and uses work
+// stealing to spread the gray objects between workers: each one scans from
+// its own worklist and tops up its shared deque from it whenever that's
+// empty, and workers that run out of gray objects take half of another
+// worker's shared deque. Sweeping hands out the reference pool's zones to
+// whichever worker asks next.
+
+static void *worker_main(void *arg);
+
+static hvm_gc1_parallel *parallel_new(hvm_gc1_obj_space *space) {
+  hvm_gc1_parallel *par = malloc(sizeof(hvm_gc1_parallel));
+  par->space      = space;
+  par->started    = 1;// The VM's thread
+  par->active     = 1;
+  par->generation = 0;
+  par->finished   = 0;
+  pthread_mutex_init(&par->lock, NULL);
+  pthread_cond_init(&par->start, NULL);
+  pthread_cond_init(&par->finish, NULL);
+  for(unsigned int id = 0; id < HVM_GC1_MAX_WORKERS; id++) {
+    hvm_gc1_worker *worker = &par->workers[id];
+    worker->parallel = par;
+    worker->id       = id;
+    worklist_init(&worker->gray);
+    worklist_init(&worker->shared);
+    worklist_init(&worker->dead);
+    pthread_mutex_init(&worker->lock, NULL);
+  }
+  return par;
+}
+
+// Start worker threads until there are `count` workers.
+static void parallel_start_workers(hvm_gc1_parallel *par, unsigned int count) {
+  while(par->started < count) {
+    hvm_gc1_worker *worker = &par->workers[par->started];
+    // Anything handed out from now on is for the new thread too
+    worker->generation = par->generation;
+    int err = pthread_create(&worker->thread, NULL, worker_main, worker);
+    if(err != 0) {
+      fprintf(stderr, "gc1: failed to start worker thread\n");
+      assert(err == 0);
+    }
+    par->started += 1;
+  }
+}
+
+// Move the last `count` items of one worklist onto another. Shared deques
+// are only changed with their lock held, but their lengths are also read
+// without it to look for work.
+static void worklist_move(hvm_gc1_worklist *from, hvm_gc1_worklist *to, unsigned int count) {
+  if(to->length + count > to->size) {
+    while(to->length + count > to->size) { to->size = to->size * 2; }
+    to->items = realloc(to->items, sizeof(hvm_obj_ref*) * to->size);
+  }
+  unsigned int from_length = from->length - count;
+  memcpy(&to->items[to->length], &from->items[from_length], sizeof(hvm_obj_ref*) * count);
+  __atomic_store_n(&to->length, to->length + count, __ATOMIC_RELAXED);
+  __atomic_store_n(&from->length, from_length, __ATOMIC_RELAXED);
+}
+
+// Offer half of a worker's gray objects to the others if it isn't already
+// offering any.
+static void share_gray(hvm_gc1_worker *worker) {
+  if(worker->gray.length < 2 || __atomic_load_n(&worker->shared.length, __ATOMIC_RELAXED) > 0) {
+    return;
+  }
+  pthread_mutex_lock(&worker->lock);
+  worklist_move(&worker->gray, &worker->shared, worker->gray.length / 2);
+  pthread_mutex_unlock(&worker->lock);
+}
+
+// Take half of the gray objects (at least one) from a worker's shared
+// deque. Returns whether any were taken.
+static bool take_gray(hvm_gc1_worker *worker, hvm_gc1_worker *victim) {
+  if(__atomic_load_n(&victim->shared.length, __ATOMIC_RELAXED) == 0) { return false; }
+  pthread_mutex_lock(&victim->lock);
+  unsigned int count = (victim->shared.length + 1) / 2;
+  worklist_move(&victim->shared, &worker->gray, count);
+  pthread_mutex_unlock(&victim->lock);
+  return count > 0;
+}
+
+static bool steal_gray(hvm_gc1_worker *worker) {
+  hvm_gc1_parallel *par = worker->parallel;
+  // Take back its own first
+  for(unsigned int i = 0; i < par->active; i++) {
+    hvm_gc1_worker *victim = &par->workers[(worker->id + i) % par->active];
+    if(take_gray(worker, victim)) { return true; }
+  }
+  return false;
+}
+
+// Called once a worker has run out of gray objects. Waits until either
+// another worker offers some (returns true) or every worker has run out,
+// which means marking is done (returns false). A worker is only idle once
+// it's emptied its own shared deque, and only non-idle workers add to
+// them, so once they're all idle there's no work left anywhere.
+static bool wait_for_gray(hvm_gc1_worker *worker) {
+  hvm_gc1_parallel *par = worker->parallel;
+  __atomic_add_fetch(&par->idle, 1, __ATOMIC_SEQ_CST);
+  while(true) {
+    if(__atomic_load_n(&par->idle, __ATOMIC_SEQ_CST) == par->active) { return false; }
+    for(unsigned int id = 0; id < par->active; id++) {
+      if(__atomic_load_n(&par->workers[id].shared.length, __ATOMIC_RELAXED) > 0) {
+        __atomic_sub_fetch(&par->idle, 1, __ATOMIC_SEQ_CST);
+        return true;
+      }
+    }
+    sched_yield();
+  }
+}
+
+static void parallel_mark(hvm_gc1_worker *worker) {
+  while(true) {
+    if(!drain_worklist(&worker->gray, false, HVM_GC1_PARALLEL_BATCH, NO_CYCLE)) {
+      share_gray(worker);
+    } else if(!steal_gray(worker) && !wait_for_gray(worker)) {
+      break;
+    }
+  }
+}
+
+// Sweep zones of the reference pool until there are none left. Only the
+// objects' data is freed; the references go back to the pool on the VM's
+// thread.
+static void parallel_sweep(hvm_gc1_worker *worker) {
+  hvm_gc1_parallel *par = worker->parallel;
+  hvm_gc1_obj_space *space = par->space;
+  while(true) {
+    unsigned int id = __atomic_fetch_add(&par->sweep_cursor, 1, __ATOMIC_RELAXED);
+    if(id >= space->sweep_zones_length) { break; }
+    hvm_gc1_sweep_zone *sweep = &space->sweep_zones[id];
+    sweep_zone(sweep->zone, 0, sweep->bump, &worker->dead);
+  }
+}
+
+static void parallel_run_job(hvm_gc1_worker *worker, hvm_gc1_parallel_job job) {
+  if(worker->id >= worker->parallel->active) {
+    return;// Not taking part in this collection
+  }
+  if(job == HVM_GC1_PARALLEL_MARK) {
+    parallel_mark(worker);
+  } else {
+    parallel_sweep(worker);
+  }
+}
+
+static void *worker_main(void *arg) {
+  hvm_gc1_worker *worker = arg;
+  hvm_gc1_parallel *par  = worker->parallel;
+  pthread_mutex_lock(&par->lock);
+  while(true) {
+    while(par->generation == worker->generation) {
+      pthread_cond_wait(&par->start, &par->lock);
+    }
+    worker->generation = par->generation;
+    hvm_gc1_parallel_job job = par->job;
+    pthread_mutex_unlock(&par->lock);
+    parallel_run_job(worker, job);
+    pthread_mutex_lock(&par->lock);
+    par->finished += 1;
+    if(par->finished == par->started - 1) {
+      pthread_cond_signal(&par->finish);
+    }
+  }
+  return NULL;
+}
+
+// Run a job on every worker (including the VM's thread) and wait for all
+// of them to finish it.
+static void parallel_run(hvm_gc1_parallel *par, hvm_gc1_parallel_job job) {
+  par->idle         = 0;
+  par->sweep_cursor = 0;
+  pthread_mutex_lock(&par->lock);
+  par->job        = job;
+  par->finished   = 0;
+  par->generation += 1;
+  pthread_cond_broadcast(&par->start);
+  pthread_mutex_unlock(&par->lock);
+  parallel_run_job(&par->workers[0], job);
+  pthread_mutex_lock(&par->lock);
+  while(par->finished < par->started - 1) {
+    pthread_cond_wait(&par->finish, &par->lock);
+  }
+  pthread_mutex_unlock(&par->lock);
+}
+
+static void parallel_collect_old(hvm_vm *vm, hvm_gc1_obj_space *space) {
+  if(space->parallel == NULL) { space->parallel = parallel_new(space); }
+  hvm_gc1_parallel *par = space->parallel;
+  unsigned int count = space->workers;
+  if(count > HVM_GC1_MAX_WORKERS) { count = HVM_GC1_MAX_WORKERS; }
+  parallel_start_workers(par, count);
+  par->active = count;
+  space->major_collections += 1;
+  // The other workers start out stealing from the VM's
+  mark_roots(vm, &par->workers[0].gray, false);
+  parallel_run(par, HVM_GC1_PARALLEL_MARK);
+  snapshot_zones(space);
+  parallel_run(par, HVM_GC1_PARALLEL_SWEEP);
+  for(unsigned int id = 0; id < count; id++) {
+    hvm_gc1_worklist *dead = &par->workers[id].dead;
+    for(unsigned int i = 0; i < dead->length; i++) {
+      hvm_obj_ref_release(dead->items[i]);
+    }
+    space->heap.length -= dead->length;
+    dead->length = 0;
+  }
+  finish_sweep(vm, space);
+}
+
+// PAUSES ---------------------------------------------------------------------
+
+static inline uint64_t now_us() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return ((uint64_t)tv.tv_sec * 1000000) + (uint64_t)tv.tv_usec;
+}
+
+static void record_pause(hvm_gc1_obj_space *space, uint64_t start) {
+  uint64_t pause = now_us() - start;
+  space->pause_samples[space->pauses % HVM_GC1_PAUSE_SAMPLES] = pause;
+  space->pauses      += 1;
+  space->pause_total += pause;
+  if(pause > space->pause_max) { space->pause_max = pause; }
+}
+
+static int compare_pauses(const void *a, const void *b) {
+  uint64_t pa = *(const uint64_t*)a, pb = *(const uint64_t*)b;
+  return (pa > pb) - (pa < pb);
+}
+
+void hvm_gc1_get_stats(hvm_gc1_obj_space *space, hvm_gc1_stats *stats) {
+  stats->allocated         = space->allocated;
+  stats->minor_collections = space->minor_collections;
+  stats->major_collections = space->major_collections;
+  stats->pauses            = space->pauses;
+  stats->pause_total       = space->pause_total;
+  stats->pause_max         = space->pause_max;
+  stats->pause_p99         = 0;
+  stats->concurrent_cycles = space->concurrent_cycles;
+  unsigned int count = (space->pauses < HVM_GC1_PAUSE_SAMPLES) ? (unsigned int)space->pauses : HVM_GC1_PAUSE_SAMPLES;
+  if(count == 0) { return; }
+  uint64_t *sorted = malloc(sizeof(uint64_t) * count);
+  memcpy(sorted, space->pause_samples, sizeof(uint64_t) * count);
+  qsort(sorted, count, sizeof(uint64_t), compare_pauses);
+  stats->pause_p99 = sorted[((count * 99) - 1) / 100];
+  free(sorted);
+}
+
+// ENTRY POINTS ---------------------------------------------------------------
+
+void hvm_gc1_run(hvm_vm *vm, hvm_gc1_obj_space *space) {
+  uint64_t start = now_us();
+  pthread_mutex_lock(&space->lock);
+  finish_concurrent(vm, space);
+  if(space->marking) {
+    // Complete the cycle that's in progress; anything that died after it
+    // started is still marked, so it's collected again below
+    finish_marking(vm, space);
+  }
+  // Empty out the nursery first so everything left is in the old heap
+  minor_collect(vm, space);
+  collect_old(vm, space);
+  pthread_mutex_unlock(&space->lock);
+  record_pause(space, start);
+}
+
+void hvm_gc1_finish(hvm_vm *vm, hvm_gc1_obj_space *space) {
+  pthread_mutex_lock(&space->lock);
+  finish_concurrent(vm, space);
+  pthread_mutex_unlock(&space->lock);
+}
+
+void hvm_gc1_collect(hvm_vm *vm, hvm_gc1_obj_space *space) {
+  if(space->torture) {
+    hvm_gc1_run(vm, space);
+    return;
+  }
+  uint64_t start = now_us();
+  pthread_mutex_lock(&space->lock);
+  set_collect_pending(space, false);
+  if(space->nursery.length >= space->nursery.size - HVM_GC1_NURSERY_HEADROOM) {
+    minor_collect(vm, space);
+  }
+  if(space->concurrent) {
+    concurrent_step(vm, space);
+  } else if(space->marking) {
+    mark_step(vm, space);
+  } else if(space->heap.length >= space->heap_target) {
+    // Promoting the survivors may have taken the old generation past its
+    // target
+    if(space->incremental) {
+      start_marking(vm, space);
+    } else {
+      if(space->nursery.length > 0) { minor_collect(vm, space); }
+      collect_old(vm, space);
+    }
+  }
+  pthread_mutex_unlock(&space->lock);
+  record_pause(space, start);
+}
+
+// OBJECT SPACE ---------------------------------------------------------------
+
+static inline void promote_obj_ref(hvm_gc1_obj_space *space, hvm_obj_ref *obj) {
+  obj->flags = (byte)(obj->flags & ~HVM_OBJ_FLAG_YOUNG);
+  obj->gc = HVM_GC1_OBJ_OLD;
+  space->heap.length += 1;
+  // While marking, collections are paced by allocation (or the collector
+  // thread) instead
+  if(space->heap.length >= space->heap_target && space->ratio > 0 &&
+     !space->marking && space->phase == HVM_GC1_IDLE
+  ) {
+    set_collect_pending(space, true);
+  }
+  // Old containers need their writes watched by the write barrier
+  if(obj->type == HVM_STRUCTURE) {
+    ((hvm_obj_struct*)obj->data.v)->remember_in = space;
+  } else if(obj->type == HVM_ARRAY) {
+    ((hvm_obj_array*)obj->data.v)->remember_in = space;
+  }
+  if(space->phase != HVM_GC1_IDLE) {
+    // Objects promoted during a concurrent cycle weren't in the snapshot,
+    // so they're left alone (and anything they refer to was either in it
+    // or is new too). They're marked in case they're in a part of the pool
+    // that's still to be swept, and their contents are treated as already
+    // scanned so that writing to them doesn't need the lock.
+    obj->gc = HVM_GC1_OBJ_OLD | HVM_GC1_OBJ_MARKED;
+    worklist_push(&space->black, obj);
+    if(obj->type == HVM_STRUCTURE) {
+      ((hvm_obj_struct*)obj->data.v)->scanned = space->cycle;
+    } else if(obj->type == HVM_ARRAY) {
+      ((hvm_obj_array*)obj->data.v)->scanned = space->cycle;
+    }
+  } else if(space->marking) {
+    // Objects promoted in the middle of incremental marking may refer to
+    // old objects that haven't been reached yet, so they start out gray
+    mark_obj_ref(&space->gray, obj, false);
+  }
+}
+
+// Moves the nursery's objects into the old generation. When sweeping,
+// unmarked objects are freed instead of being promoted.
+static void promote_nursery(hvm_gc1_obj_space *space, bool sweep) {
+  for(unsigned int id = 0; id < space->nursery.length; id++) {
+    hvm_obj_ref *obj = space->nursery.items[id];
+    if(sweep && FLAGFALSE(obj->gc, HVM_GC1_OBJ_MARKED)) {
+      hvm_obj_free(obj);
+    } else {
+      promote_obj_ref(space, obj);
+    }
+  }
+  space->nursery.length = 0;
+  // Nothing is young anymore, so old containers can't refer to young objects
+  forget_remembered(space);
 }
 
 void hvm_obj_space_add_obj_ref(hvm_gc1_obj_space *space, hvm_obj_ref *obj) {
+  if(hvm_obj_is_immediate(obj)) {
+    return;// Nothing to track for tagged immediates
+  }
   if(FLAGTRUE(obj->flags, HVM_OBJ_FLAG_CONSTANT)) {
     return;// Don't track constants
   }
@@ -227,17 +1038,33 @@ void hvm_obj_space_add_obj_ref(hvm_gc1_obj_space *space, hvm_obj_ref *obj) {
   } else {
     obj->flags |= HVM_OBJ_FLAG_GC_TRACKED;
   }
-  unsigned int next_id = space->heap.length;
-  space->heap.length += 1;
-  // Check if we still have space
-  if(next_id >= space->heap.size) {
-    hvm_obj_space_grow(space);
+  // The old generation is found by sweeping the reference pool
+  assert(FLAGTRUE(obj->flags, HVM_OBJ_FLAG_POOLED));
+  // Objects can be added at any time (not just at points where the roots
+  // are known), so a full nursery can't be collected here; instead all of
+  // its objects are promoted to make room.
+  if(space->nursery.length == space->nursery.size) {
+    pthread_mutex_lock(&space->lock);
+    promote_nursery(space, false);
+    pthread_mutex_unlock(&space->lock);
+  }
+  space->nursery.items[space->nursery.length] = obj;
+  space->nursery.length += 1;
+  space->allocated      += 1;
+  if(space->nursery.length >= space->nursery.size - HVM_GC1_NURSERY_HEADROOM && space->ratio > 0) {
+    set_collect_pending(space, true);
+  }
+  if(space->torture) {
+    set_collect_pending(space, true);
+  }
+  // Keep incremental marking ahead of allocation
+  if(space->marking && !space->concurrent) {
+    space->mark_step_countdown -= 1;
+    if(space->mark_step_countdown == 0) {
+      space->mark_step_countdown = HVM_GC1_MARK_STEP_ALLOCATIONS;
+      set_collect_pending(space, true);
+    }
   }
-  hvm_gc1_heap_entry *entry = &space->heap.entries[next_id];
   // fprintf(stderr, "obj_space_add: obj_ref = %p (%s)\n", obj, hvm_human_name_for_obj_type(obj->type));
-  // Set up the entry to point to the object
-  entry->obj = obj;
-  entry->flags = 0x0;
-  // Set the object to point back to the entry
-  obj->entry = entry;
+  obj->flags |= HVM_OBJ_FLAG_YOUNG;
 }
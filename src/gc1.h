@@ -1,43 +1,335 @@
 #ifndef HVM_GC1_H
 #define HVM_GC1_H
 
+#include <pthread.h>
+
 // Communicates with the VM, object space, and heap to mark and sweep memory
 // in the object space and heap.
 
-// Ideally this will run in a separate thread and do smart locking with the
-// object space and heap to sweep and defrag/compact both with minimal
-// locking with the VM.
+// In concurrent mode the old generation is marked and swept by a collector
+// thread, which takes the object space's lock a batch of work at a time;
+// the VM only takes it to make minor collections and for the first write
+// to each container during a marking cycle.
+
+/// Set in an object's `gc` state once it's in the old generation.
+#define HVM_GC1_OBJ_OLD 0x1
+/// Set in an object's `gc` state while it's marked.
+#define HVM_GC1_OBJ_MARKED 0x2
 
-#define HVM_GC1_INITIAL_HEAP_SIZE 1024
-#define HVM_GC1_HEAP_GROW_FUNCTION(V) (V * 8)
-#define HVM_GC1_HEAP_MEMORY_SIZE(S) (S * sizeof(hvm_gc1_heap_entry))
+/// Number of objects in the nursery; once it fills up its objects are all
+/// promoted to the old generation.
+#define HVM_GC1_NURSERY_SIZE 4096
+#define HVM_GC1_INITIAL_REMEMBERED_SIZE 64
+#define HVM_GC1_REMEMBERED_GROW_FUNCTION(V) (V * 2)
+/// A minor collection is requested once fewer than this many nursery
+/// slots are left (so that allocations between safepoints still fit).
+#define HVM_GC1_NURSERY_HEADROOM 256
+/// Default heap growth ratio: the old generation may grow to this percent
+/// past the live set before the next full collection (like GOGC).
+#define HVM_GC1_DEFAULT_RATIO 100
+/// Environment variable overriding the heap growth ratio ("off" disables
+/// automatic collection).
+#define HVM_GC1_RATIO_ENV "HVM_GC_RATIO"
+/// Smallest heap target (in objects).
+#define HVM_GC1_MIN_HEAP_TARGET 1024
+#define HVM_GC1_INITIAL_WORKLIST_SIZE 256
+/// Environment variable enabling incremental marking of the old generation
+/// (set to "1").
+#define HVM_GC1_INCREMENTAL_ENV "HVM_GC_INCREMENTAL"
+/// While incrementally marking, a marking step is requested every this many
+/// allocations.
+#define HVM_GC1_MARK_STEP_ALLOCATIONS 64
+/// Most gray objects scanned by a single incremental marking step.
+#define HVM_GC1_MARK_STEP_BUDGET 1024
+/// Number of most recent pauses kept for computing percentiles.
+#define HVM_GC1_PAUSE_SAMPLES 1024
+/// Environment variable enabling the torture mode (set to "1"): every
+/// allocation runs a full collection at the next safepoint, to flush out
+/// objects the roots don't account for.
+#define HVM_GC1_TORTURE_ENV "HVM_GC_TORTURE"
+#define HVM_GC1_INITIAL_ROOTS_SIZE 16
+/// Environment variable enabling concurrent marking and sweeping of the
+/// old generation on a collector thread (set to "1").
+#define HVM_GC1_CONCURRENT_ENV "HVM_GC_CONCURRENT"
+/// Number of reference pool slots the collector thread sweeps each time it
+/// takes the lock.
+#define HVM_GC1_SWEEP_CHUNK 4096
+/// If the old generation reaches this many times its target while the
+/// collector thread is still busy, the VM waits for it to finish.
+#define HVM_GC1_STALL_FACTOR 2
+/// Environment variable setting the number of threads stop-the-world full
+/// collections are marked and swept with, including the VM's own (unset or
+/// "0" keeps the serial collector).
+#define HVM_GC1_WORKERS_ENV "HVM_GC_WORKERS"
+/// Most threads a parallel collection can use.
+#define HVM_GC1_MAX_WORKERS 64
+/// Gray objects a parallel marking worker scans before offering some of
+/// its work to idle workers.
+#define HVM_GC1_PARALLEL_BATCH 64
 
+/// Old generation. Its objects aren't listed anywhere: they're the ones in
+/// the VM's reference pool with HVM_GC1_OBJ_OLD set, so sweeping walks the
+/// pool's zones.
 typedef struct hvm_gc1_heap {
-  /// Base of entries area
-  struct hvm_gc1_heap_entry *entries;
-  /// Number of entries allocated
-  unsigned int size;
-  /// Number of entries in the heap
+  /// Pool the VM allocates references from
+  struct hvm_obj_ref_pool *pool;
+  /// Number of objects in the old generation
   unsigned int length;
 } hvm_gc1_heap;
 
-typedef struct hvm_gc1_heap_entry {
-  /// Object this entry is tied to
-  hvm_obj_ref *obj;
-  /// Flags pertaining to the entry and its object
-  byte flags;
-} hvm_gc1_heap_entry;
+/// Stack of gray objects: marked, but with their references still to be
+/// scanned.
+typedef struct hvm_gc1_worklist {
+  hvm_obj_ref **items;
+  unsigned int size;
+  unsigned int length;
+} hvm_gc1_worklist;
+
+/// Reference pool zone to be swept, with the number of its slots that had
+/// been used when sweeping started (anything past that is newer).
+typedef struct hvm_gc1_sweep_zone {
+  struct hvm_obj_ref_pool_zone *zone;
+  unsigned int bump;
+} hvm_gc1_sweep_zone;
+
+/// Thread taking part in a parallel collection (the first one is the VM's
+/// own). Each worker marks from its private `gray` worklist, moving some of
+/// it into its `shared` deque whenever that runs out, and idle workers
+/// steal from the other workers' shared deques.
+typedef struct hvm_gc1_worker {
+  struct hvm_gc1_parallel *parallel;
+  unsigned int id;
+  pthread_t thread;
+  /// Last job generation the worker's thread has seen
+  unsigned int generation;
+  hvm_gc1_worklist gray;
+  /// Guards `shared`
+  pthread_mutex_t lock;
+  hvm_gc1_worklist shared;
+  /// Objects swept by this worker; their references are released by the
+  /// VM once sweeping is done
+  hvm_gc1_worklist dead;
+} hvm_gc1_worker;
 
+typedef enum {
+  HVM_GC1_PARALLEL_MARK,
+  HVM_GC1_PARALLEL_SWEEP
+} hvm_gc1_parallel_job;
+
+/// Worker threads for parallel collections; created on the first one.
+typedef struct hvm_gc1_parallel {
+  struct hvm_gc1_obj_space *space;
+  hvm_gc1_worker workers[HVM_GC1_MAX_WORKERS];
+  /// Number of workers whose threads have been started (plus the VM's)
+  unsigned int started;
+  /// Number of workers taking part in the current collection
+  unsigned int active;
+  /// Number of marking workers that have run out of gray objects
+  unsigned int idle;
+  /// Next zone to be swept
+  unsigned int sweep_cursor;
+  /// Guarded by `lock`:
+  hvm_gc1_parallel_job job;
+  /// Incremented every time a job is handed to the workers
+  unsigned int generation;
+  /// Number of worker threads done with the current job
+  unsigned int finished;
+  pthread_mutex_t lock;
+  pthread_cond_t start;
+  pthread_cond_t finish;
+} hvm_gc1_parallel;
+
+/// Where the collector thread is in a concurrent collection of the old
+/// generation.
+typedef enum {
+  HVM_GC1_IDLE,
+  /// Collector thread is tracing from the roots.
+  HVM_GC1_MARKING,
+  /// Tracing is done; waiting for the VM to finish marking at a safepoint.
+  HVM_GC1_MARKED,
+  /// Collector thread is freeing unmarked objects.
+  HVM_GC1_SWEEPING,
+  /// Sweeping is done; waiting for the VM to release the freed references.
+  HVM_GC1_SWEPT
+} hvm_gc1_phase;
+
+/// Old-generation structure or array that has been given a reference to a
+/// young object.
+typedef struct hvm_gc1_remembered {
+  /// HVM_STRUCTURE or HVM_ARRAY
+  hvm_obj_type type;
+  /// The `hvm_obj_struct` or `hvm_obj_array`
+  void *container;
+} hvm_gc1_remembered;
+
+/// @brief   Generational object space.
+/// @details New objects are added to the nursery. Minor collections only
+///          trace young objects (from the registers, the stack and the
+///          remembered set), free the dead ones and promote the survivors
+///          into the old generation. Objects never move:
+///          promotion just flags them as old, and full collections sweep
+///          the reference pool's zones for old objects that weren't marked.
+///
+///          The old generation is either collected all at once or, in
+///          incremental mode, marked a budgeted step at a time between
+///          safepoints (with the write barrier shading stored objects gray
+///          and a final remark of the roots before sweeping).
+///
+///          In concurrent mode the VM stops to shade the roots and then
+///          carries on while the collector thread marks. Marking is
+///          snapshot-at-the-beginning: the first write to an old container
+///          during the cycle shades everything it held beforehand, so
+///          everything reachable when the cycle started gets marked.
+///          Objects promoted during the cycle aren't in the snapshot and are
+///          kept until the next one. Once the VM has drained whatever the
+///          write barrier shaded after the collector ran out of work, the
+///          collector thread sweeps, and the freed references are handed
+///          back to the reference pool at the next safepoint.
+///
+///          With `workers` set, stop-the-world full collections are marked
+///          and swept by that many threads instead of just the VM's.
 typedef struct hvm_gc1_obj_space {
+  /// Old generation
   hvm_gc1_heap heap;
+  /// Young generation (`size` is fixed at HVM_GC1_NURSERY_SIZE)
+  hvm_gc1_worklist nursery;
+  /// Old containers written to by the write barrier since the last minor
+  /// collection
+  hvm_gc1_remembered *remembered;
+  unsigned int remembered_size;
+  unsigned int remembered_length;
+  /// Heap growth ratio (percent); 0 disables automatic collection.
+  unsigned int ratio;
+  /// Number of old-generation objects at which the next full collection is
+  /// triggered; set from the live set and `ratio` after each one.
+  unsigned int heap_target;
+  /// Whether a collection should be run at the next safepoint.
+  bool collect_pending;
+  /// Total number of objects tracked.
+  uint64_t allocated;
+  unsigned int minor_collections;
+  unsigned int major_collections;
+  /// Gray objects for marking the old generation
+  hvm_gc1_worklist gray;
+  /// Gray objects for minor collections
+  hvm_gc1_worklist young_gray;
+  /// Whether the old generation is marked incrementally.
+  bool incremental;
+  /// Whether an incremental marking cycle is in progress.
+  bool marking;
+  /// Allocations left before the next incremental marking step.
+  unsigned int mark_step_countdown;
+  // Pause accounting (in microseconds)
+  uint64_t pauses;
+  uint64_t pause_total;
+  uint64_t pause_max;
+  /// Ring of the most recent pause times.
+  uint64_t pause_samples[HVM_GC1_PAUSE_SAMPLES];
+  /// Whether the old generation is collected on the collector thread.
+  bool concurrent;
+  /// Number of concurrent collections started (containers are marked with
+  /// it once their contents have been scanned).
+  unsigned int cycle;
+  /// Number of concurrent collections finished.
+  unsigned int concurrent_cycles;
+  /// Guarded by `lock`:
+  hvm_gc1_phase phase;
+  /// Number of objects in the heap when the cycle started
+  unsigned int snapshot_length;
+  /// Zones to be swept (by the collector thread or parallel workers) and
+  /// how far they'd been used once marking finished
+  hvm_gc1_sweep_zone *sweep_zones;
+  unsigned int sweep_zones_size;
+  unsigned int sweep_zones_length;
+  /// Where the collector thread is up to in `sweep_zones`
+  unsigned int sweep_cursor;
+  unsigned int sweep_slot;
+  /// Objects promoted during the cycle; they're marked so that they aren't
+  /// swept, and unmarked again once the cycle is done
+  hvm_gc1_worklist black;
+  /// Swept objects whose references still need to go back to the pool
+  hvm_gc1_worklist dead;
+  bool collector_started;
+  pthread_t collector;
+  pthread_mutex_t lock;
+  /// Signals the collector thread that there's work to do
+  pthread_cond_t wake;
+  /// Signals the VM that the collector thread finished a phase
+  pthread_cond_t done;
+  /// Number of threads full collections are run with (0 for the serial
+  /// collector).
+  unsigned int workers;
+  hvm_gc1_parallel *parallel;
+  /// Slots outside of the VM registered with hvm_gc1_add_root
+  hvm_obj_ref ***roots;
+  unsigned int roots_size;
+  unsigned int roots_length;
+  /// Whether every allocation runs a full collection at the next safepoint
+  bool torture;
 } hvm_gc1_obj_space;
 
-hvm_gc1_obj_space *hvm_new_obj_space();
+/// Collector statistics; pause times are in microseconds.
+typedef struct hvm_gc1_stats {
+  uint64_t allocated;
+  unsigned int minor_collections;
+  unsigned int major_collections;
+  /// Number of times the mutator was stopped for the collector.
+  uint64_t pauses;
+  uint64_t pause_total;
+  uint64_t pause_max;
+  /// 99th percentile of the most recent HVM_GC1_PAUSE_SAMPLES pauses.
+  uint64_t pause_p99;
+  unsigned int concurrent_cycles;
+} hvm_gc1_stats;
+
+/// New object space for objects whose references come from `pool`.
+hvm_gc1_obj_space *hvm_new_obj_space(hvm_obj_ref_pool *pool);
 void hvm_obj_space_add_obj_ref(hvm_gc1_obj_space *space, hvm_obj_ref *obj);
 
+/// Full collection of both generations.
 void hvm_gc1_run(hvm_vm *vm, hvm_gc1_obj_space *space);
-/// Traverse the object space and reset the mark bits.
-void hvm_gc1_obj_space_mark_reset(hvm_gc1_obj_space *space);
-void hvm_gc1_obj_space_mark(hvm_vm*);
+/// Wait for the concurrent collection in progress (if any) to finish; must
+/// be called at a safepoint.
+void hvm_gc1_finish(hvm_vm *vm, hvm_gc1_obj_space *space);
+/// Minor collection of just the nursery.
+void hvm_gc1_run_minor(hvm_vm *vm, hvm_gc1_obj_space *space);
+/// Slow path of the write barrier for changing an old structure or array
+/// (see `hvm_obj_struct_write_barrier`): young objects get the container
+/// added to the remembered set, while incrementally marking old ones are
+/// shaded gray, and while concurrently marking the container's current
+/// contents are shaded the first time it's changed.
+void hvm_gc1_write_barrier(hvm_gc1_obj_space *space, hvm_obj_type type, void *container, hvm_obj_ref *val);
+void hvm_gc1_get_stats(hvm_gc1_obj_space *space, hvm_gc1_stats *stats);
+/// Run whichever collections were requested by allocation.
+void hvm_gc1_collect(hvm_vm *vm, hvm_gc1_obj_space *space);
+
+/// Called by hvm_gc1_each_root with each root slot.
+typedef void (*hvm_gc1_root_visitor)(hvm_obj_ref **slot, void *data);
+/// @brief   Visit every slot outside of the heap that can hold a reference
+///          to a collected object.
+/// @details These are the live part of the value stack, each frame's
+///          locals and slots, the globals, the current exception, the
+///          constant pool, the symbol table and the slots registered with
+///          hvm_gc1_add_root. Primitives are plain function pointers, and
+///          compiled traces only embed constants (which are never
+///          collected), so neither adds any. Empty slots may be visited
+///          with NULL.
+void hvm_gc1_each_root(hvm_vm *vm, hvm_gc1_root_visitor visit, void *data);
+/// Register a slot outside of the VM (eg. in an embedder's or a primitive's
+/// own data) whose object has to survive collections. It's read each time
+/// a collection starts, so it can be changed freely while registered.
+void hvm_gc1_add_root(hvm_gc1_obj_space *space, hvm_obj_ref **slot);
+/// Unregister a slot registered with hvm_gc1_add_root.
+void hvm_gc1_remove_root(hvm_gc1_obj_space *space, hvm_obj_ref **slot);
+
+/// Called by the dispatch loop at points where every live object is
+/// reachable from the roots (calls, backward branches and just after
+/// allocating instructions have written their result).
+static inline void hvm_gc1_safepoint(hvm_vm *vm, hvm_gc1_obj_space *space) {
+  // Also set by the collector thread
+  if(__atomic_load_n(&space->collect_pending, __ATOMIC_RELAXED)) {
+    hvm_gc1_collect(vm, space);
+  }
+}
 
 #endif
@@ -9,6 +9,7 @@
 #include "vm.h"
 #include "object.h"
 #include "chunk.h"
+#include "frame.h"
 #include "generator.h"
 
 char *gen_strclone(char *str) {
@@ -50,8 +51,30 @@ struct hvm_gen_data {
   GArray *debug_entries;
   char *current_name;
   char *current_file;
+
+  /// Slot indices (offset by one) of the slot locals in the current
+  /// subroutine, keyed by name.
+  GHashTable *local_slots;
+  /// Number of slots allocated in the current subroutine.
+  unsigned int local_slots_length;
 };
 
+// Look up (or allocate) the frame slot for a named local in the current
+// subroutine.
+static byte hvm_gen_data_local_slot(struct hvm_gen_data *gd, char *name) {
+  unsigned int slot = GPOINTER_TO_UINT(g_hash_table_lookup(gd->local_slots, name));
+  if(slot > 0) {
+    return (byte)(slot - 1);
+  }
+  if(gd->local_slots_length >= HVM_FRAME_SLOTS) {
+    fprintf(stderr, "Too many slot locals in subroutine (max %d): %s\n", HVM_FRAME_SLOTS, name);
+    assert(false);
+  }
+  slot = gd->local_slots_length++;
+  g_hash_table_insert(gd->local_slots, name, GUINT_TO_POINTER(slot + 1));
+  return (byte)slot;
+}
+
 void hvm_gen_data_add_debug_entry(struct hvm_gen_data *gd, uint64_t start, uint64_t end, uint64_t line, char *name, unsigned char flags) {
   hvm_chunk_debug_entry *de = malloc(sizeof(hvm_chunk_debug_entry));
   de->start = start;
@@ -67,7 +90,7 @@ void hvm_gen_data_add_debug_entry(struct hvm_gen_data *gd, uint64_t start, uint6
   de->file  = gd->gen->file;
   g_array_append_val(gd->debug_entries, de);
 }
-void hvm_gen_data_add_symbol(struct hvm_gen_data *gd, char *sym, uint64_t idx) {
+void hvm_gen_data_add_symbol(struct hvm_gen_data *gd, char *sym, uint64_t idx, unsigned int registers) {
   /*
   GList *positions = g_hash_table_lookup(gd->symbols, sym);
   uint64_t *idxptr = malloc(sizeof(uint64_t));
@@ -78,6 +101,7 @@ void hvm_gen_data_add_symbol(struct hvm_gen_data *gd, char *sym, uint64_t idx) {
   hvm_chunk_symbol *cs = malloc(sizeof(hvm_chunk_symbol));
   cs->index = idx;
   cs->name = gen_strclone(sym);
+  cs->registers = registers;
   g_array_append_val(gd->symbols, cs);
 }
 
@@ -214,7 +238,7 @@ void hvm_gen_process_block(hvm_chunk *chunk, struct hvm_gen_data *data, hvm_gen_
 
   unsigned int len = block->items->len;
   unsigned int i;
-  byte op, reg;
+  byte op, reg, slot;
   uint64_t *idxptr;
   uint64_t dest;
   int64_t i64;
@@ -248,7 +272,10 @@ void hvm_gen_process_block(hvm_chunk *chunk, struct hvm_gen_data *data, hvm_gen_
         hvm_gen_process_block(chunk, data, (hvm_gen_item_block*)item);
         break;
       case HVM_GEN_SUB:
-        hvm_gen_data_add_symbol(data, item->sub.name, idx);
+        hvm_gen_data_add_symbol(data, item->sub.name, idx, item->sub.registers);
+        // Each subroutine gets a fresh set of local slots
+        g_hash_table_remove_all(data->local_slots);
+        data->local_slots_length = 0;
         // Also add a label for the subroutine
         idxptr = malloc(sizeof(uint64_t));
         *idxptr = idx;
@@ -344,6 +371,14 @@ void hvm_gen_process_block(hvm_chunk *chunk, struct hvm_gen_data *data, hvm_gen_
         chunk->size += 6 + HVM_SUBROUTINE_TAG_SIZE;
         break;
 
+      case HVM_GEN_OP_INVOKESYMBOLIC:// 1B OP | 3B TAG | 1B REG | 1B REG
+        WRITE(0, &item->op_invokesymbolic.op, byte);
+        WRITE_TAG();
+        WRITE(1 + HVM_SUBROUTINE_TAG_SIZE, &item->op_invokesymbolic.sym, byte);
+        WRITE(2 + HVM_SUBROUTINE_TAG_SIZE, &item->op_invokesymbolic.ret, byte);
+        chunk->size += 3 + HVM_SUBROUTINE_TAG_SIZE;
+        break;
+
       case HVM_GEN_OP_INVOKEADDRESS:// 1B OP | 3B TAG | 1B REG | 1B REG
         WRITE(0, &item->op_invokeaddress.op, byte);
         WRITE_TAG();
@@ -352,6 +387,23 @@ void hvm_gen_process_block(hvm_chunk *chunk, struct hvm_gen_data *data, hvm_gen_
         chunk->size += 3 + HVM_SUBROUTINE_TAG_SIZE;
         break;        
 
+      case HVM_GEN_OP_LOCALSLOT:
+        op  = item->op_localslot.op;
+        reg = item->op_localslot.reg;
+        slot = hvm_gen_data_local_slot(data, item->op_localslot.name);
+        WRITE(0, &op, byte);
+        if(op == HVM_OP_GETLOCALSLOT) {
+          // 1B OP | 1B REG | 1B SLOT
+          WRITE(1, &reg, byte);
+          WRITE(2, &slot, byte);
+        } else {
+          // 1B OP | 1B SLOT | 1B REG
+          WRITE(1, &slot, byte);
+          WRITE(2, &reg, byte);
+        }
+        chunk->size += 3;
+        break;
+
       case HVM_GEN_OP_INVOKEPRIMITIVE:// 1B OP | 1B REG | 1B REG
         WRITE(0, &item->op_invokeprimitive.op, byte);
         WRITE(1, &item->op_invokeprimitive.sym, byte);
@@ -431,7 +483,7 @@ void hvm_gen_process_block(hvm_chunk *chunk, struct hvm_gen_data *data, hvm_gen_
 
       case HVM_GEN_OP_CALL_LABEL:// Same as OP_CALL
         {
-          uint64_t destip = chunk->size + HVM_SUBROUTINE_TAG_SIZE + 4;
+          uint64_t destip = chunk->size + 1 + HVM_SUBROUTINE_TAG_SIZE;
           dest = GET_LABEL(item->op_call_label.label, destip);
 
           WRITE(0, &item->op_call_label.op, byte);
@@ -490,8 +542,11 @@ struct hvm_chunk *hvm_gen_chunk(hvm_gen *gen) {
   gd.constants = g_array_new(TRUE, TRUE, sizeof(hvm_chunk_constant*));
   gd.symbols   = g_array_new(TRUE, TRUE, sizeof(hvm_chunk_symbol*));
   gd.debug_entries = g_array_new(TRUE, TRUE, sizeof(hvm_chunk_debug_entry*));
+  gd.local_slots   = g_hash_table_new(g_str_hash, g_str_equal);
+  gd.local_slots_length = 0;
 
   hvm_gen_process_block(chunk, &gd, gen->block);
+  g_hash_table_destroy(gd.local_slots);
 
   uint64_t i;
 
@@ -676,6 +731,23 @@ void hvm_gen_setlocal(hvm_gen_item_block *block, byte sym_reg, byte val_reg) {
   GEN_PUSH_ITEM(op);
 }
 
+void hvm_gen_getlocalslot(hvm_gen_item_block *block, byte val_reg, char *name) {
+  hvm_gen_item_op_localslot *op = malloc(sizeof(hvm_gen_item_op_localslot));
+  op->type = HVM_GEN_OP_LOCALSLOT;
+  op->op   = HVM_OP_GETLOCALSLOT;
+  op->reg  = val_reg;
+  op->name = gen_strclone(name);
+  GEN_PUSH_ITEM(op);
+}
+void hvm_gen_setlocalslot(hvm_gen_item_block *block, char *name, byte val_reg) {
+  hvm_gen_item_op_localslot *op = malloc(sizeof(hvm_gen_item_op_localslot));
+  op->type = HVM_GEN_OP_LOCALSLOT;
+  op->op   = HVM_OP_SETLOCALSLOT;
+  op->reg  = val_reg;
+  op->name = gen_strclone(name);
+  GEN_PUSH_ITEM(op);
+}
+
 void hvm_gen_getglobal(hvm_gen_item_block *block, byte val_reg, byte sym_reg) {
   hvm_gen_item_op_a2 *op = malloc(sizeof(hvm_gen_item_op_a2));
   op->type = HVM_GEN_OPA2;
@@ -814,6 +886,15 @@ void hvm_gen_structdelete(hvm_gen_item_block *block, byte reg, byte strct, byte
   op->reg3 = key;
   GEN_PUSH_ITEM(op);
 }
+void hvm_gen_structhas(hvm_gen_item_block *block, byte reg, byte strct, byte key) {
+  hvm_gen_item_op_a3 *op = malloc(sizeof(hvm_gen_item_op_a3));
+  op->type = HVM_GEN_OPA3;
+  op->op   = HVM_OP_STRUCTHAS;
+  op->reg1 = reg;
+  op->reg2 = strct;
+  op->reg3 = key;
+  GEN_PUSH_ITEM(op);
+}
 void hvm_gen_structset(hvm_gen_item_block *block, byte strct, byte key, byte val) {
   hvm_gen_item_op_a3 *op = malloc(sizeof(hvm_gen_item_op_a3));
   op->type = HVM_GEN_OPA3;
@@ -976,6 +1057,15 @@ void hvm_gen_sub(hvm_gen_item_block *block, char *name) {
   hvm_gen_item_sub *sub = malloc(sizeof(hvm_gen_item_sub));
   sub->type = HVM_GEN_SUB;
   sub->name = gen_strclone(name);
+  sub->registers = 0;
+  GEN_PUSH_ITEM(sub);
+}
+void hvm_gen_sub_with_registers(hvm_gen_item_block *block, char *name, unsigned int registers) {
+  assert(registers > 0 && registers <= HVM_GENERAL_REGISTERS);
+  hvm_gen_item_sub *sub = malloc(sizeof(hvm_gen_item_sub));
+  sub->type = HVM_GEN_SUB;
+  sub->name = gen_strclone(name);
+  sub->registers = registers;
   GEN_PUSH_ITEM(sub);
 }
 void hvm_gen_call_label(hvm_gen_item_block *block, char *label, byte ret) {
@@ -44,6 +44,7 @@ typedef enum {
   HVM_GEN_OPH_DATA,   // 1B OP | 1B REG    | [4B CONST]
   HVM_GEN_OPG_LABEL,  // 1B OP | 1B REG    | 8B DEST (i64)
   HVM_GEN_OPB2_SYMBOL,// 1B OP | [4B SYM]  | 1B REG
+  HVM_GEN_OP_LOCALSLOT,// 1B OP | 1B REG | [1B SLOT] (or slot first for SET)
 
   HVM_GEN_LABEL,
   HVM_GEN_SUB,
@@ -181,6 +182,14 @@ typedef struct hvm_gen_item_op_g_label {
 } hvm_gen_item_op_g_label;
 
 
+// Local variable resolved to a frame slot when the chunk is generated.
+typedef struct hvm_gen_item_op_localslot {
+  HVM_GEN_ITEM_HEAD;
+  byte op;
+  byte reg;
+  char *name;
+} hvm_gen_item_op_localslot;
+
 typedef struct hvm_gen_op_call {
   HVM_GEN_ITEM_HEAD;
   byte op;
@@ -261,6 +270,8 @@ typedef struct hvm_gen_item_label {
 typedef struct hvm_gen_item_sub {
   HVM_GEN_ITEM_HEAD;
   char *name;
+  /// Size of the subroutine's own register window (0 to share the caller's)
+  unsigned int registers;
 } hvm_gen_item_sub;
 
 typedef struct hvm_gen_item_block {
@@ -295,6 +306,7 @@ typedef union hvm_gen_item {
   hvm_gen_item_op_d3_label  op_d3_label;
   hvm_gen_item_op_g_label   op_g_label;
   hvm_gen_item_op_h_data    op_h_data;
+  hvm_gen_item_op_localslot op_localslot;
 
   hvm_gen_op_call          op_call;
   hvm_gen_op_call_label    op_call_label;
@@ -302,6 +314,7 @@ typedef union hvm_gen_item {
   hvm_gen_op_callprimitive op_callprimitive;
 
   hvm_gen_op_invokeprimitive op_invokeprimitive;
+  hvm_gen_op_invokesymbolic  op_invokesymbolic;
   hvm_gen_op_invokeaddress   op_invokeaddress;
 
   // hvm_gen_item_macro macro;
@@ -347,6 +360,12 @@ void hvm_gen_setexception(hvm_gen_item_block *block, byte reg);
 
 void hvm_gen_getlocal(hvm_gen_item_block *block, byte val_reg, byte sym_reg);
 void hvm_gen_setlocal(hvm_gen_item_block *block, byte sym_reg, byte val_reg);
+/// Read a named local through its frame slot. Names are resolved to dense
+/// slot indices per subroutine when the chunk is generated; slot locals are
+/// not visible to GETLOCAL/SETLOCAL or closures.
+void hvm_gen_getlocalslot(hvm_gen_item_block *block, byte val_reg, char *name);
+/// Write a named local through its frame slot (see hvm_gen_getlocalslot).
+void hvm_gen_setlocalslot(hvm_gen_item_block *block, char *name, byte val_reg);
 
 void hvm_gen_getglobal(hvm_gen_item_block *block, byte val_reg, byte sym_reg);
 void hvm_gen_setglobal(hvm_gen_item_block *block, byte sym_reg, byte val_reg);
@@ -367,6 +386,7 @@ void hvm_gen_arraylen(hvm_gen_item_block *block, byte len, byte arr);
 
 void hvm_gen_structget(hvm_gen_item_block *block, byte reg, byte strct, byte key);
 void hvm_gen_structdelete(hvm_gen_item_block *block, byte reg, byte strct, byte key);
+void hvm_gen_structhas(hvm_gen_item_block *block, byte reg, byte strct, byte key);
 void hvm_gen_structset(hvm_gen_item_block *block, byte strct, byte key, byte val);
 void hvm_gen_structnew(hvm_gen_item_block *block, byte reg);
 
@@ -407,6 +427,11 @@ void hvm_gen_catch_label(hvm_gen_item_block *block, char *label, byte reg);
 // Call at the head of a sub-routine to set up a symbol in the symbol table
 // for the sub-routine.
 void hvm_gen_sub(hvm_gen_item_block *block, char *name);
+/// Start a subroutine whose frames get their own window of the given number
+/// of general registers (which must only use $r0 through $r<registers - 1>).
+/// Frames of subroutines started with `hvm_gen_sub` share their caller's
+/// registers.
+void hvm_gen_sub_with_registers(hvm_gen_item_block *block, char *name, unsigned int registers);
 
 /// Create a LITINTEGER instruction with a relocated address for the given
 /// label in the chunk.
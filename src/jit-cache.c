@@ -0,0 +1,102 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vm.h"
+#include "object.h"
+#include "jit-tracer.h"
+#include "jit-cache.h"
+
+#define FNV_PRIME 1099511628211ULL
+
+typedef struct hvm_jit_cache_header {
+  char     magic[8];
+  char     version[HVM_JIT_CACHE_VERSION_SIZE];
+  char     compiler[HVM_JIT_CACHE_VERSION_SIZE];
+  uint64_t key;
+  uint64_t size;
+} hvm_jit_cache_header;
+
+uint64_t hvm_jit_cache_hash(uint64_t hash, const void *data, size_t size) {
+  const byte *bytes = data;
+  for(size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+uint64_t hvm_jit_cache_key(hvm_vm *vm, hvm_call_trace *trace) {
+  // Items are zeroed before they're filled in, so their padding hashes the
+  // same every time
+  uint64_t hash = hvm_jit_cache_hash(HVM_JIT_CACHE_HASH_SEED, &vm->chunk_hash, sizeof(uint64_t));
+  hash = hvm_jit_cache_hash(hash, &trace->entry, sizeof(uint64_t));
+  // A side trace of the same instructions is compiled differently (it loads
+  // its registers and locals on entry)
+  byte side = (trace->parent != NULL);
+  hash = hvm_jit_cache_hash(hash, &side, sizeof(byte));
+  return hvm_jit_cache_hash(hash, trace->sequence, sizeof(hvm_trace_sequence_item) * trace->sequence_length);
+}
+
+static void header_init(hvm_jit_cache_header *header, uint64_t key, const char *compiler, size_t size) {
+  memset(header, 0, sizeof(hvm_jit_cache_header));
+  memcpy(header->magic, HVM_JIT_CACHE_MAGIC, sizeof(header->magic));
+  strncpy(header->version, HVM_VERSION, HVM_JIT_CACHE_VERSION_SIZE - 1);
+  strncpy(header->compiler, compiler, HVM_JIT_CACHE_VERSION_SIZE - 1);
+  header->key  = key;
+  header->size = size;
+}
+
+static void cache_path(char *path, size_t length, const char *dir, uint64_t key) {
+  snprintf(path, length, "%s/%016llx.trace", dir, (unsigned long long)key);
+}
+
+void *hvm_jit_cache_read(const char *dir, uint64_t key, const char *compiler, size_t *size) {
+  char path[1024];
+  cache_path(path, sizeof(path), dir, key);
+  FILE *file = fopen(path, "rb");
+  if(file == NULL) { return NULL; }
+  hvm_jit_cache_header header, expected;
+  header_init(&expected, key, compiler, 0);
+  void *data = NULL;
+  // Find out how much code the file can hold
+  if(fseek(file, 0, SEEK_END) != 0) { goto done; }
+  long length = ftell(file);
+  if(length < (long)sizeof(header) || fseek(file, 0, SEEK_SET) != 0) { goto done; }
+  if(fread(&header, sizeof(header), 1, file) != 1) { goto done; }
+  // Everything but the size has to match
+  expected.size = header.size;
+  if(memcmp(&header, &expected, sizeof(header)) != 0) { goto done; }
+  if(header.size == 0 || header.size > (uint64_t)length - sizeof(header)) { goto done; }
+  data = malloc(header.size);
+  if(data == NULL) { goto done; }
+  if(fread(data, 1, header.size, file) != header.size) {
+    free(data);
+    data = NULL;
+    goto done;
+  }
+  *size = header.size;
+done:
+  fclose(file);
+  return data;
+}
+
+bool hvm_jit_cache_write(const char *dir, uint64_t key, const char *compiler, const void *data, size_t size) {
+  char path[1024], tmp[1100];
+  cache_path(path, sizeof(path), dir, key);
+  // Write to a file of our own and then move it into place, so other
+  // processes (and VMs) never see it half-written
+  snprintf(tmp, sizeof(tmp), "%s.%d.%p", path, (int)getpid(), data);
+  FILE *file = fopen(tmp, "wb");
+  if(file == NULL) { return false; }
+  hvm_jit_cache_header header;
+  header_init(&header, key, compiler, size);
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(data, 1, size, file) == size;
+  ok = (fclose(file) == 0) && ok;
+  if(ok) { ok = rename(tmp, path) == 0; }
+  if(!ok) { unlink(tmp); }
+  return ok;
+}
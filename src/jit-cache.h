@@ -0,0 +1,39 @@
+#ifndef HVM_JIT_CACHE_H
+#define HVM_JIT_CACHE_H
+/// @file jit-cache.h
+
+// Compiled traces can be cached on disk so that a restarted process doesn't
+// have to compile the same hot subroutines all over again. Each trace is
+// stored in its own file named after a hash of the chunks the VM had
+// loaded and of the trace itself (its entry point, instructions and the
+// types and branches it was specialized for). The file's header records
+// the VM and compiler versions it was written by, and files from any other
+// version are ignored.
+
+/// Environment variable with the directory to cache compiled traces in
+/// (caching is off if it's unset).
+#define HVM_JIT_CACHE_ENV "HVM_JIT_CACHE"
+#define HVM_JIT_CACHE_MAGIC "HVMJIT02"
+/// Room for each of the version strings in a cache file's header
+#define HVM_JIT_CACHE_VERSION_SIZE 32
+/// Starting value for hvm_jit_cache_hash (64-bit FNV-1a).
+#define HVM_JIT_CACHE_HASH_SEED 14695981039346656037ULL
+
+// Set by the build from the VERSION file
+#ifndef HVM_VERSION
+#define HVM_VERSION "unknown"
+#endif
+
+/// Fold `size` bytes of `data` into `hash`.
+uint64_t hvm_jit_cache_hash(uint64_t hash, const void *data, size_t size);
+/// Key a (sorted) trace is cached under.
+uint64_t hvm_jit_cache_key(hvm_vm *vm, hvm_call_trace *trace);
+/// Read the cached code for `key` out of the `dir` cache directory. Returns
+/// NULL if there isn't any, it was written by a different VM or `compiler`
+/// version, or it's damaged; otherwise the caller has to free the data.
+void *hvm_jit_cache_read(const char *dir, uint64_t key, const char *compiler, size_t *size);
+/// Write code for `key` into the `dir` cache directory (replacing whatever
+/// was there). Returns false if it couldn't be written.
+bool hvm_jit_cache_write(const char *dir, uint64_t key, const char *compiler, const void *data, size_t size);
+
+#endif
@@ -1,15 +1,20 @@
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <assert.h>
 #include <string.h>
+#include <pthread.h>
 
 #include <llvm-c/Core.h>
 #include <llvm-c/ExecutionEngine.h>
 #include <llvm-c/Target.h>
 #include <llvm-c/Analysis.h>
 #include <llvm-c/Transforms/Scalar.h>
+#include <llvm-c/BitReader.h>
+#include <llvm-c/BitWriter.h>
+#include <llvm/Config/llvm-config.h>
 
 #include <jemalloc/jemalloc.h>
 
@@ -20,6 +25,8 @@
 #include "bootstrap.h"
 #include "jit-tracer.h"
 #include "jit-compiler.h"
+#include "jit-queue.h"
+#include "jit-cache.h"
 
 // Forward declarations for a few things
 LLVMTypeRef hvm_jit_obj_ref_llvm_type();
@@ -48,11 +55,16 @@ static LLVMValueRef const_hvm_integer;
 
 // Setting up the internals
 static bool llvm_setup;
-// Reuse our compilation context and module through program lifetime
+// Reuse our compilation context and engine through program lifetime. Each
+// trace is compiled in a module of its own which is added to the engine
+// when it's done, so compiling a trace doesn't get slower as more of them
+// are compiled and a trace's module can be taken out of the engine again.
+// The engine's own module stays empty.
 static LLVMContextRef         hvm_shared_llvm_context;
 static LLVMModuleRef          hvm_shared_llvm_module;
 static LLVMExecutionEngineRef hvm_shared_llvm_engine;
-static LLVMPassManagerRef     hvm_shared_llvm_pass_manager;
+// Each VM compiles on its own thread, but they all share the LLVM state
+static pthread_mutex_t hvm_shared_llvm_lock = PTHREAD_MUTEX_INITIALIZER;
 
 void hvm_jit_define_constants() {
   if(constants_defined) {
@@ -84,8 +96,7 @@ void hvm_jit_setup_llvm() {
   }
   char *error;
   LLVMBool status;
-  LLVMPassManagerRef pass;
-  // Set up our context and module
+  // Set up our context, and the module the engine is created with
   hvm_shared_llvm_context = LLVMContextCreate();
   hvm_shared_llvm_module  = LLVMModuleCreateWithNameInContext("hvm", hvm_shared_llvm_context);
   // Set up compilation to our current native target
@@ -101,9 +112,13 @@ void hvm_jit_setup_llvm() {
     fprintf(stderr, "Error instantiating execution engine: %s\n", error);
     assert(false);
   }
-  // Set up our pass manager
-  hvm_shared_llvm_pass_manager = LLVMCreateFunctionPassManagerForModule(hvm_shared_llvm_module);
-  pass = hvm_shared_llvm_pass_manager;// Save our fingers!
+  llvm_setup = true;
+}
+
+// Function pass managers belong to a module, so each trace's module gets
+// its own.
+LLVMPassManagerRef hvm_jit_new_pass_manager(LLVMModuleRef module) {
+  LLVMPassManagerRef pass = LLVMCreateFunctionPassManagerForModule(module);
   LLVMAddTargetData(LLVMGetExecutionEngineTargetData(hvm_shared_llvm_engine), pass);
   // Constant propagation simplifies/removes-unnecessary computations of
   // constant values.
@@ -128,42 +143,45 @@ void hvm_jit_setup_llvm() {
   // Now that we've added all our passes we can initialize the FPM so that it
   // will be ready to run on values in our module.
   LLVMInitializeFunctionPassManager(pass);
+  return pass;
 }
 
 
 #define UNPACK_BUNDLE(BUNDLE) \
-  LLVMModuleRef module          = BUNDLE->llvm_module; \
-  LLVMExecutionEngineRef engine = BUNDLE->llvm_engine;
+  LLVMModuleRef module = BUNDLE->llvm_module;
 
 #define STATIC_VALUE(TYPE, NAME) \
   static TYPE NAME; \
   if(NAME) { return NAME; }
 
+// Declares a VM function in the trace's module the first time the trace
+// calls it; it's mapped to the function's address when the module is linked
+// (see hvm_jit_vm_functions).
 // NOTE: Last argument to LLVMFunctionType tells LLVM it's non-variadic.
 #define ADD_FUNCTION(FUNC, EXT_FUNCTION, RETURN_TYPE, NUM_PARAMS, PARAM_TYPES...) \
-  { \
+  FUNC = LLVMGetNamedFunction(module, #EXT_FUNCTION); \
+  if(FUNC == NULL) { \
     LLVMTypeRef param_types[] = {PARAM_TYPES}; \
     LLVMTypeRef func_type = LLVMFunctionType(RETURN_TYPE, param_types, NUM_PARAMS, false); \
     FUNC = LLVMAddFunction(module, #EXT_FUNCTION, func_type); \
-    LLVMAddGlobalMapping(engine, func, &EXT_FUNCTION); \
   }
 
 LLVMValueRef hvm_jit_obj_array_get_llvm_value(hvm_compile_bundle *bundle) {
-  STATIC_VALUE(LLVMValueRef, func);
+  LLVMValueRef func;
   UNPACK_BUNDLE(bundle);
   ADD_FUNCTION(func, hvm_obj_array_get, obj_ref_ptr_type, 2, obj_ref_ptr_type, obj_ref_ptr_type);
   return func;
 }
 
 LLVMValueRef hvm_jit_obj_array_set_llvm_value(hvm_compile_bundle *bundle) {
-  STATIC_VALUE(LLVMValueRef, func);
+  LLVMValueRef func;
   UNPACK_BUNDLE(bundle);
   ADD_FUNCTION(func, hvm_obj_array_set, void_type, 3, obj_ref_ptr_type, obj_ref_ptr_type, obj_ref_ptr_type);
   return func;
 }
 
 LLVMValueRef hvm_jit_obj_array_len_llvm_value(hvm_compile_bundle *bundle) {
-  STATIC_VALUE(LLVMValueRef, func);
+  LLVMValueRef func;
   UNPACK_BUNDLE(bundle);
   // (hvm_vm*, hvm_obj_ref*) -> hvm_obj_ref*
   ADD_FUNCTION(func, hvm_obj_array_len, obj_ref_ptr_type, 2, pointer_type, obj_ref_ptr_type);
@@ -171,7 +189,7 @@ LLVMValueRef hvm_jit_obj_array_len_llvm_value(hvm_compile_bundle *bundle) {
 }
 
 LLVMValueRef hvm_jit_vm_call_primitive_llvm_value(hvm_compile_bundle *bundle) {
-  STATIC_VALUE(LLVMValueRef, func);
+  LLVMValueRef func;
   UNPACK_BUNDLE(bundle);
   // (hvm_vm*, hvm_obj_ref*) -> hvm_obj_ref*
   ADD_FUNCTION(func, hvm_vm_call_primitive, obj_ref_ptr_type, 2, pointer_type, obj_ref_ptr_type);
@@ -179,44 +197,44 @@ LLVMValueRef hvm_jit_vm_call_primitive_llvm_value(hvm_compile_bundle *bundle) {
 }
 
 LLVMValueRef hvm_jit_obj_cmp_and_llvm_value(hvm_compile_bundle *bundle) {
-  STATIC_VALUE(LLVMValueRef, func);
+  LLVMValueRef func;
   UNPACK_BUNDLE(bundle);
   // (hvm_vm*, hvm_obj_ref*, hvm_obj_ref*) -> hvm_obj_ref*
   ADD_FUNCTION(func, hvm_obj_cmp_and, obj_ref_ptr_type, 3, pointer_type, obj_ref_ptr_type, obj_ref_ptr_type);
   return func;
 }
 
-LLVMValueRef hvm_jit_vm_copy_regs_llvm_value(hvm_compile_bundle *bundle) {
-  STATIC_VALUE(LLVMValueRef, func);
+LLVMValueRef hvm_jit_vm_register_write_llvm_value(hvm_compile_bundle *bundle) {
+  LLVMValueRef func;
   UNPACK_BUNDLE(bundle);
-  // (hvm_vm*) -> void
-  ADD_FUNCTION(func, hvm_vm_copy_regs, void_type, 1, pointer_type);
+  // (hvm_vm*, byte, hvm_obj_ref*) -> void
+  ADD_FUNCTION(func, hvm_vm_register_write, void_type, 3, pointer_type, byte_type, obj_ref_ptr_type);
   return func;
 }
 
 LLVMValueRef hvm_jit_obj_int_add_llvm_value(hvm_compile_bundle *bundle) {
-  STATIC_VALUE(LLVMValueRef, func);
+  LLVMValueRef func;
   UNPACK_BUNDLE(bundle);
   ADD_FUNCTION(func, hvm_obj_int_add, obj_ref_ptr_type, 3, pointer_type, obj_ref_ptr_type, obj_ref_ptr_type);
   return func;
 }
 
 LLVMValueRef hvm_jit_obj_int_eq_llvm_value(hvm_compile_bundle *bundle) {
-  STATIC_VALUE(LLVMValueRef, func);
+  LLVMValueRef func;
   UNPACK_BUNDLE(bundle);
   ADD_FUNCTION(func, hvm_obj_int_eq, obj_ref_ptr_type, 3, pointer_type, obj_ref_ptr_type, obj_ref_ptr_type);
   return func;
 }
 
 LLVMValueRef hvm_jit_obj_int_gt_llvm_value(hvm_compile_bundle *bundle) {
-  STATIC_VALUE(LLVMValueRef, func);
+  LLVMValueRef func;
   UNPACK_BUNDLE(bundle);
   ADD_FUNCTION(func, hvm_obj_int_gt, obj_ref_ptr_type, 3, pointer_type, obj_ref_ptr_type, obj_ref_ptr_type);
   return func;
 }
 
 LLVMValueRef hvm_jit_obj_is_truthy_llvm_value(hvm_compile_bundle *bundle) {
-  STATIC_VALUE(LLVMValueRef, func);
+  LLVMValueRef func;
   UNPACK_BUNDLE(bundle);
   // (hvm_obj_ref*) -> bool
   ADD_FUNCTION(func, hvm_obj_is_truthy, bool_type, 1, obj_ref_ptr_type);
@@ -224,7 +242,7 @@ LLVMValueRef hvm_jit_obj_is_truthy_llvm_value(hvm_compile_bundle *bundle) {
 }
 
 LLVMValueRef hvm_jit_set_local_llvm_value(hvm_compile_bundle *bundle) {
-  STATIC_VALUE(LLVMValueRef, func);
+  LLVMValueRef func;
   UNPACK_BUNDLE(bundle);
   // (hvm_frame*, hvm_symbol_id, hvm_obj_ref*) -> void
   ADD_FUNCTION(func, hvm_set_local, void_type, 3, pointer_type, int64_type, obj_ref_ptr_type);
@@ -232,26 +250,23 @@ LLVMValueRef hvm_jit_set_local_llvm_value(hvm_compile_bundle *bundle) {
 }
 
 LLVMValueRef hvm_jit_get_local_llvm_value(hvm_compile_bundle *bundle) {
-  STATIC_VALUE(LLVMValueRef, func);
+  LLVMValueRef func;
   UNPACK_BUNDLE(bundle);
   // (hvm_frame*, hvm_symbol_id) -> hvm_obj_ref*
   ADD_FUNCTION(func, hvm_get_local, obj_ref_ptr_type, 2, pointer_type, int64_type);
   return func;
 }
 
-LLVMValueRef hvm_jit_new_obj_int_llvm_value(hvm_compile_bundle *bundle) {
-  STATIC_VALUE(LLVMValueRef, func);
+LLVMValueRef hvm_jit_new_obj_int_value_llvm_value(hvm_compile_bundle *bundle) {
+  LLVMValueRef func;
   UNPACK_BUNDLE(bundle);
-  // (hvm_vm*) -> hvm_obj_ref*
-  LLVMTypeRef param_types[] = {pointer_type};
-  LLVMTypeRef func_type = LLVMFunctionType(pointer_type, param_types, 1, false);
-  func = LLVMAddFunction(module, "hvm_new_obj_int", func_type);
-  LLVMAddGlobalMapping(engine, func, &hvm_new_obj_int);
+  // (hvm_vm*, int64_t) -> hvm_obj_ref*
+  ADD_FUNCTION(func, hvm_new_obj_int_value, obj_ref_ptr_type, 2, pointer_type, int64_type);
   return func;
 }
 
 LLVMValueRef hvm_jit_puts_llvm_value(hvm_compile_bundle *bundle) {
-  STATIC_VALUE(LLVMValueRef, func);
+  LLVMValueRef func;
   UNPACK_BUNDLE(bundle);
   ADD_FUNCTION(func, puts, void_type, 1, pointer_type);
   return func;
@@ -356,7 +371,70 @@ unsigned int hvm_jit_get_trace_index_for_ip(hvm_call_trace *trace, uint64_t ip,
 }
 
 
+// Addresses that only hold in this process (the VM, its registers, objects
+// in the constant pool, etc.) aren't baked into the IR. Instead they're
+// referenced through external globals named after what they point to,
+// which are mapped to the real addresses when the module is linked (see
+// hvm_jit_resolve_address). That keeps the modules relocatable, so they
+// can be cached on disk and loaded by another process.
+#define HVM_JIT_ADDRESS_PREFIX "hvm."
+
+LLVMValueRef hvm_jit_address_value(LLVMBuilderRef builder, const char *name, LLVMTypeRef type) {
+  LLVMValueRef  function = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
+  LLVMModuleRef module   = LLVMGetGlobalParent(function);
+  LLVMValueRef  global   = LLVMGetNamedGlobal(module, name);
+  if(global == NULL) {
+    global = LLVMAddGlobal(module, byte_type, name);
+  }
+  return LLVMConstBitCast(global, type);
+}
+
+// Stand-in that boxed-object loads are pointed at when the value being
+// examined is actually a tagged immediate; the result of those loads is
+// then discarded by a `select`. This keeps the generated code branch-free.
+static hvm_obj_ref hvm_jit_immediate_stand_in = {
+  .type  = HVM_NULL,
+  .data  = {.u64 = 0},
+  .flags = HVM_OBJ_FLAG_CONSTANT
+};
+
+// Integers too big to be immediates are boxed in objects of their own (the
+// reference pool belongs to the VM thread).
+hvm_obj_ref *hvm_jit_new_constant_int(int64_t literal) {
+  hvm_obj_ref *ref = hvm_new_obj_ref();
+  ref->type     = HVM_INTEGER;
+  ref->data.i64 = literal;
+  // Mark it as a constant to be exempt from GC.
+  ref->flags = ref->flags | HVM_OBJ_FLAG_CONSTANT;
+  return ref;
+}
+
+LLVMValueRef hvm_jit_compile_value_is_immediate(LLVMBuilderRef builder, LLVMValueRef val_ref, LLVMValueRef *val_bits) {
+  LLVMValueRef tag_mask = LLVMConstInt(int64_type, HVM_OBJ_TAG_MASK, false);
+  *val_bits = LLVMBuildPtrToInt(builder, val_ref, int64_type, "val_bits");
+  LLVMValueRef val_tag = LLVMBuildAnd(builder, *val_bits, tag_mask, "val_tag");
+  return LLVMBuildICmp(builder, LLVMIntNE, val_tag, i64_zero, "val_is_immediate");
+}
+
+// Returns a pointer that's safe to load from: the value itself if it's boxed
+// or the stand-in if it's an immediate.
+LLVMValueRef hvm_jit_compile_value_boxed_ref(LLVMBuilderRef builder, LLVMValueRef val_ref, LLVMValueRef is_immediate) {
+  LLVMValueRef stand_in = hvm_jit_address_value(builder, "hvm.immediate_stand_in", LLVMTypeOf(val_ref));
+  return LLVMBuildSelect(builder, is_immediate, stand_in, val_ref, "boxed_ref");
+}
+
 LLVMValueRef hvm_jit_compile_value_is_falsey(LLVMBuilderRef builder, LLVMValueRef val_ref) {
+  LLVMValueRef val_bits;
+  LLVMValueRef is_immediate = hvm_jit_compile_value_is_immediate(builder, val_ref, &val_bits);
+  // Immediates are falsey if they're the tagged null or tagged zero
+  LLVMValueRef imm_null    = LLVMConstInt(int64_type, (unsigned long long)HVM_OBJ_NULL, false);
+  LLVMValueRef imm_zero    = LLVMConstInt(int64_type, (unsigned long long)hvm_obj_int_immediate(0), false);
+  LLVMValueRef imm_is_null = LLVMBuildICmp(builder, LLVMIntEQ, val_bits, imm_null, "imm_is_null");
+  LLVMValueRef imm_is_zero = LLVMBuildICmp(builder, LLVMIntEQ, val_bits, imm_zero, "imm_is_zero");
+  LLVMValueRef imm_falsey  = LLVMBuildOr(builder, imm_is_null, imm_is_zero, "imm_falsey");
+  // Boxed values are checked by their type and data
+  val_ref = hvm_jit_compile_value_boxed_ref(builder, val_ref, is_immediate);
+
   // Get a pointer the the .type of the object ref struct (first 0 index
   // is to get the first value pointed at, the second 0 index is to get
   // the first item in the struct). Then load it into an integer value.
@@ -384,15 +462,40 @@ LLVMValueRef hvm_jit_compile_value_is_falsey(LLVMBuilderRef builder, LLVMValueRe
   // Final is-falsey computation
   val_is_null         = LLVMBuildIntCast(builder, val_is_null,     int1_type, "val_is_null");
   val_is_zero_int     = LLVMBuildIntCast(builder, val_is_zero_int, int1_type, "val_is_zero_int");
-  LLVMValueRef falsey = LLVMBuildOr(builder, val_is_null, val_is_zero_int, "falsey");
-  return falsey;
+  LLVMValueRef boxed_falsey = LLVMBuildOr(builder, val_is_null, val_is_zero_int, "boxed_falsey");
+  return LLVMBuildSelect(builder, is_immediate, imm_falsey, boxed_falsey, "falsey");
 }
 
 LLVMValueRef hvm_jit_load_symbol_id_from_obj_ref_value(LLVMBuilderRef builder, LLVMValueRef value) {
+  LLVMValueRef bits;
+  LLVMValueRef is_immediate = hvm_jit_compile_value_is_immediate(builder, value, &bits);
+  // Immediate symbols keep their ID above the 3 tag bits
+  LLVMValueRef imm_id = LLVMBuildLShr(builder, bits, LLVMConstInt(int64_type, 3, false), "imm_id");
+  value = hvm_jit_compile_value_boxed_ref(builder, value, is_immediate);
   LLVMValueRef data_ptr = LLVMBuildGEP(builder, value, (LLVMValueRef[]){i32_zero, i32_one}, 2, "data_ptr");
   LLVMValueRef data     = LLVMBuildLoad(builder, data_ptr, "");
   // Fetch out the .data as an int64 (same as hvm_symbol_id)
-  return LLVMBuildIntCast(builder, data, int64_type, "data");
+  data = LLVMBuildIntCast(builder, data, int64_type, "data");
+  return LLVMBuildSelect(builder, is_immediate, imm_id, data, "symbol_id");
+}
+
+LLVMValueRef hvm_jit_load_int_from_obj_ref_value(LLVMBuilderRef builder, LLVMValueRef value) {
+  LLVMValueRef bits;
+  LLVMValueRef is_immediate = hvm_jit_compile_value_is_immediate(builder, value, &bits);
+  // Arithmetic shift to drop the tag bit and restore the sign
+  LLVMValueRef imm_value = LLVMBuildAShr(builder, bits, LLVMConstInt(int64_type, 1, false), "imm_value");
+  value = hvm_jit_compile_value_boxed_ref(builder, value, is_immediate);
+  LLVMValueRef data_ptr = LLVMBuildGEP(builder, value, (LLVMValueRef[]){i32_zero, i32_one}, 2, "data_ptr");
+  LLVMValueRef data     = LLVMBuildLoad(builder, data_ptr, "");
+  data = LLVMBuildIntCast(builder, data, int64_type, "data");
+  return LLVMBuildSelect(builder, is_immediate, imm_value, data, "int_value");
+}
+
+// Tag a 0/1 (or otherwise known-small) i64 as an immediate integer.
+LLVMValueRef hvm_jit_build_int_immediate(LLVMBuilderRef builder, LLVMValueRef value) {
+  value = LLVMBuildShl(builder, value, LLVMConstInt(int64_type, 1, false), "");
+  value = LLVMBuildOr(builder, value, LLVMConstInt(int64_type, HVM_OBJ_TAG_INTEGER, false), "");
+  return LLVMBuildIntToPtr(builder, value, obj_ref_ptr_type, "int_immediate");
 }
 
 // #define JIT_SAVE_DATA_ITEM_AND_VALUE(REG, DATA_ITEM, VALUE) \
@@ -489,27 +592,13 @@ void hvm_jit_store_general_reg_value(struct hvm_jit_compile_context *context, LL
 
 void hvm_jit_store_arg_reg_value(struct hvm_jit_compile_context *context, LLVMBuilderRef builder, byte reg, LLVMValueRef value) {
   // `value` should be an object reference pointer
-  LLVMValueRef args_ptr, arg_ptr;
-  // Figure out our offset
-  unsigned int offset = reg - HVM_REG_ARG_OFFSET;
-  char scratch[40];
-  sprintf(scratch, "arg_reg[%d]", offset);
-
-  static LLVMTypeRef ptr_to_obj_ptr_type;
-  if(!ptr_to_obj_ptr_type) {
-    ptr_to_obj_ptr_type = LLVMPointerType(obj_ref_ptr_type, 0);
-  }
-
-  // Get the base of the argument registers array
-  hvm_obj_ref **arg_regs = context->vm->arg_regs;
-  // Make a constant pointer to that base of the array
-  args_ptr = LLVMConstInt(int64_type, (unsigned long long)arg_regs, false);
-  args_ptr = LLVMBuildIntToPtr(builder, args_ptr, ptr_to_obj_ptr_type, "args");
-  // Offset into that array
-  LLVMValueRef offset_value = LLVMConstInt(int32_type, offset, false);
-  arg_ptr = LLVMBuildGEP(builder, args_ptr, (LLVMValueRef[]){offset_value}, 1, scratch);
-  // Write the contents of the value pointer into the VM's argument register
-  LLVMBuildStore(builder, value, arg_ptr);
+  LLVMValueRef func, vm_ptr;
+  // The argument registers are a window onto the VM's value stack that
+  // moves with each call, so go through the VM to write into the current one
+  func   = hvm_jit_vm_register_write_llvm_value(context->bundle);
+  vm_ptr = hvm_jit_address_value(builder, "hvm.vm", pointer_type);
+  LLVMValueRef args[3] = {vm_ptr, LLVMConstInt(byte_type, reg, false), value};
+  LLVMBuildCall(builder, func, args, 3, "");
 }
 
 LLVMValueRef hvm_llvm_value_for_obj_ref(LLVMBuilderRef builder, hvm_obj_ref *ref) {
@@ -518,51 +607,32 @@ LLVMValueRef hvm_llvm_value_for_obj_ref(LLVMBuilderRef builder, hvm_obj_ref *ref
 }
 
 LLVMValueRef hvm_jit_obj_int_add_direct(struct hvm_jit_compile_context *context, LLVMBuilderRef builder, LLVMValueRef vm_ptr, hvm_compile_value *cv1, hvm_compile_value *cv2, byte reg1, byte reg2) {
-  LLVMValueRef func, value, data_ptr, data_ptr1, data_ptr2, value1, value2;
+  LLVMValueRef func, value, operand1, operand2;
   // Get the bundle from the context
   hvm_compile_bundle *bundle = context->bundle;
-  // printf("$%d = $%d + $%d\n", register_result, reg1, reg2);
-  // printf("cv1->constant = %d\n", cv1->constant);
-  // printf("cv2->constant = %d\n", cv2->constant);
-  // printf("cv1->constant_object = %p\n", cv1->constant_object);
-  // printf("cv2->constant_object = %p\n", cv2->constant_object);
 
   // If the left side is constant in the scope and has an unchanging value
+  // then we can use its integer value directly.
   if(context->constant_regs[reg1] && cv1->constant) {
-    // printf("using constant object for LHS\n");
-    value1 = hvm_llvm_value_for_obj_ref(builder, cv1->constant_object);
+    operand1 = LLVMConstInt(int64_type, (unsigned long long)hvm_obj_int_value(cv1->constant_object), true);
   } else {
-    // Insert code to extract the operand object refs from the stack slots
-    value1 = hvm_jit_load_general_reg_value(context, builder, reg1);
+    // Insert code to extract the operand from the stack slot and untag it
+    value    = hvm_jit_load_general_reg_value(context, builder, reg1);
+    operand1 = hvm_jit_load_int_from_obj_ref_value(builder, value);
   }
   // Same for right side
   if(context->constant_regs[reg2] && cv2->constant) {
-    // printf("using constant object for RHS\n");
-    value2 = hvm_llvm_value_for_obj_ref(builder, cv2->constant_object);
+    operand2 = LLVMConstInt(int64_type, (unsigned long long)hvm_obj_int_value(cv2->constant_object), true);
   } else {
-    value2 = hvm_jit_load_general_reg_value(context, builder, reg2);
+    value    = hvm_jit_load_general_reg_value(context, builder, reg2);
+    operand2 = hvm_jit_load_int_from_obj_ref_value(builder, value);
   }
-  // Get the data pointer and fetch it
-  data_ptr1 = LLVMBuildGEP(builder, value1, (LLVMValueRef[]){i32_zero, i32_one}, 2, "");
-  data_ptr2 = LLVMBuildGEP(builder, value2, (LLVMValueRef[]){i32_zero, i32_one}, 2, "");
-  LLVMValueRef operand1, operand2;
-  operand1 = LLVMBuildLoad(builder, data_ptr1, "");
-  operand2 = LLVMBuildLoad(builder, data_ptr2, "");
-  // Then cast them to i64
-  operand1 = LLVMBuildIntCast(builder, operand1, int64_type, "operand1");
-  operand2 = LLVMBuildIntCast(builder, operand2, int64_type, "operand2");
   // Add the values
   LLVMValueRef value_i64 = LLVMBuildAdd(builder, operand1, operand2, "value");
-  // Create the integer to return
-  func = hvm_jit_new_obj_int_llvm_value(bundle);
-  LLVMValueRef new_obj_int_args[1] = {vm_ptr};
-  value = LLVMBuildCall(builder, func, new_obj_int_args, 1, "obj_ref_int");
-  value = LLVMBuildPointerCast(builder, value, obj_ref_ptr_type, "value");
-  // Get the pointer into its data and set the new value
-  data_ptr = LLVMBuildGEP(builder, value, (LLVMValueRef[]){i32_zero, i32_one}, 2, "");
-  data_ptr = LLVMBuildPointerCast(builder, data_ptr, int64_pointer_type, "value->data.i64");
-  LLVMBuildStore(builder, value_i64, data_ptr);
-  return value;
+  // Tag the result (the VM will box it if it doesn't fit)
+  func = hvm_jit_new_obj_int_value_llvm_value(bundle);
+  LLVMValueRef new_obj_int_args[2] = {vm_ptr, value_i64};
+  return LLVMBuildCall(builder, func, new_obj_int_args, 2, "obj_ref_int");
 }
 
 void hvm_jit_build_bailout_return_to_ip(LLVMBuilderRef builder, LLVMValueRef exit_value, uint64_t ip) {
@@ -570,9 +640,12 @@ void hvm_jit_build_bailout_return_to_ip(LLVMBuilderRef builder, LLVMValueRef exi
   LLVMTypeRef  status_type  = LLVMIntType(sizeof(hvm_jit_exit_status) * 8);
   LLVMValueRef status_value = LLVMConstInt(status_type, HVM_JIT_EXIT_BAILOUT, false);
   LLVMValueRef dest_value   = LLVMConstInt(int64_type, ip, false);
+  // Cast the exit value to an exit bailout
+  LLVMTypeRef  eb_ptr_type  = LLVMPointerType(hvm_jit_exit_bailout_llvm_type(), 0);
+  LLVMValueRef exit_bailout = LLVMBuildPointerCast(builder, exit_value, eb_ptr_type, "exit_bailout");
   // Get the pointers to the struct elements
-  LLVMValueRef status_ptr   = LLVMBuildGEP(builder, exit_value, (LLVMValueRef[]){i32_zero, i32_zero}, 2, NULL);
-  LLVMValueRef dest_ptr     = LLVMBuildGEP(builder, exit_value, (LLVMValueRef[]){i32_zero, i32_one},  2, NULL);
+  LLVMValueRef status_ptr   = LLVMBuildGEP(builder, exit_bailout, (LLVMValueRef[]){i32_zero, i32_zero}, 2, "status_ptr");
+  LLVMValueRef dest_ptr     = LLVMBuildGEP(builder, exit_bailout, (LLVMValueRef[]){i32_zero, i32_one},  2, "dest_ptr");
   // And store the actual values in them
   LLVMBuildStore(builder, status_value, status_ptr);
   LLVMBuildStore(builder, dest_value,   dest_ptr);
@@ -581,52 +654,56 @@ void hvm_jit_build_bailout_return_to_ip(LLVMBuilderRef builder, LLVMValueRef exi
 }
 
 
-LLVMBasicBlockRef hvm_jit_build_bailout_block(hvm_vm *vm, LLVMBuilderRef builder, LLVMValueRef parent_func, LLVMValueRef exit_value, void *void_context, uint64_t ip) {
+// The registers live in a window on the value stack which depends on the
+// frame, so load the current window from the VM rather than baking it in
+LLVMValueRef hvm_jit_build_general_regs_window(LLVMBuilderRef builder) {
+  LLVMTypeRef regs_type = LLVMPointerType(obj_ref_ptr_type, 0);
+  LLVMValueRef general_regs_addr = hvm_jit_address_value(builder, "hvm.general_regs", LLVMPointerType(regs_type, 0));
+  return LLVMBuildLoad(builder, general_regs_addr, "general_regs");
+}
+
+LLVMBasicBlockRef hvm_jit_build_bailout_block(LLVMBuilderRef builder, LLVMValueRef parent_func, LLVMValueRef exit_value, void *void_context, uint64_t ip) {
   // Liven up the type
   struct hvm_jit_compile_context *context = void_context;
   hvm_compile_bundle *bundle = context->bundle;
 
   // Create the basic block for our bailout code
-  LLVMBasicBlockRef basic_block = LLVMAppendBasicBlockInContext(hvm_shared_llvm_context, parent_func, NULL);
+  LLVMBasicBlockRef basic_block = LLVMAppendBasicBlockInContext(hvm_shared_llvm_context, parent_func, "bailout");
   LLVMPositionBuilderAtEnd(builder, basic_block);
 
-  // Get the pointer to the VM registers
-  hvm_obj_ref **general_regs = vm->general_regs;
-  // Then convert that to an LLVM pointer
-  LLVMValueRef general_regs_ptr = LLVMConstInt(pointer_type, (unsigned long long)general_regs, false);
-
-  // TODO: Track writers to general registers so that we know which registers
-  //       need copying (instead of wasting time copying all of them)
+  LLVMValueRef general_regs_ptr = hvm_jit_build_general_regs_window(builder);
 
   // Loop over each computed general reg value and copy that into the VM's
-  // general regs
+  // general regs. Only the ones the trace writes can have changed (and a
+  // subroutine without registers of its own shares its caller's, so the
+  // rest mustn't be touched).
   for(byte i = 0; i < HVM_GENERAL_REGISTERS; i++) {
     LLVMValueRef value_ptr = context->general_regs[i];
-    if(value_ptr == NULL) {
-      // Don't need to worry about copying NULLs
+    if(value_ptr == NULL || !context->written_regs[i]) {
       continue;
     }
     LLVMValueRef value = hvm_jit_load_general_reg_value(context, builder, i);
     LLVMValueRef idx_val = LLVMConstInt(int32_type, i, true);
     // Get the pointer to the item in the pointer array
-    LLVMValueRef reg_ptr = LLVMBuildGEP(builder, general_regs_ptr, (LLVMValueRef[]){idx_val}, 1, NULL);
+    LLVMValueRef reg_ptr = LLVMBuildGEP(builder, general_regs_ptr, (LLVMValueRef[]){idx_val}, 1, "");
     // Now actually copy the value into the register
     LLVMBuildStore(builder, value, reg_ptr);
   }
 
   // Get the function to set a local in the VM frame
   LLVMValueRef func = hvm_jit_set_local_llvm_value(bundle);
-  // Make a pointer to the frame
-  LLVMValueRef frame_ptr = LLVMConstInt(int64_type, (unsigned long long)(bundle->frame), false);
-  frame_ptr = LLVMBuildIntToPtr(builder, frame_ptr, pointer_type, "frame");
+  // The frame the trace is running in is passed in by the VM
+  LLVMValueRef frame_ptr = LLVMGetParam(parent_func, 2);
   hvm_obj_struct *locals = context->locals;
   // Iterate through the slots in the locals dictionary
-  for(unsigned int i = 0; i < locals->heap_length; i++) {
-    hvm_obj_struct_heap_pair *pair = locals->heap[i];
-    hvm_symbol_id sym = pair->id;
-    void *slot        = pair->obj;
-    // Load the object ref from the value
-    char *symbol_name = hvm_desymbolicate(context->vm->symbols, sym);
+  for(unsigned int i = 0; i < locals->capacity; i++) {
+    if(locals->keys[i] == 0) { continue; }
+    hvm_symbol_id sym = locals->keys[i];
+    void *slot        = locals->values[i];
+    // Load the object ref from the value (the symbol store isn't safe to
+    // read off of the VM thread, so values are named by symbol ID)
+    char symbol_name[32];
+    sprintf(symbol_name, "local:%llu", (unsigned long long)sym);
     LLVMValueRef value = hvm_jit_load_slot(builder, slot, symbol_name);
     // Create a value for the symbol ID
     LLVMValueRef value_symbol = LLVMConstInt(int64_type, sym, false);
@@ -743,18 +820,24 @@ void hvm_jit_compile_pass_identify_blocks(hvm_call_trace *trace, hvm_compile_bun
 
   char scratch[40];
 
-  // Get the first item and set up a block based off of it for entry
+  // The function's entry block comes first; it's branched out of once all
+  // of the stack allocations are in it
+  bundle->llvm_entry_block = LLVMAppendBasicBlockInContext(context, parent_func, "entry");
+
+  // Get the first item and set up a block based off of it
   item = &trace->sequence[0];
-  // Set up a block for our entry point
-  uint64_t entry_ip = item->head.ip;
-  sprintf(scratch, "entry_0x%08llX", entry_ip);
-  hvm_jit_block *entry  = je_malloc(sizeof(hvm_jit_block));
-  entry->next           = NULL;
-  entry->ip             = entry_ip;
-  entry->basic_block    = LLVMAppendBasicBlockInContext(context, parent_func, scratch);
-  bundle->blocks_head   = entry;
-  bundle->blocks_tail   = entry;
+  uint64_t first_ip = item->head.ip;
+  sprintf(scratch, "block_0x%08llX", first_ip);
+  hvm_jit_block *first  = je_malloc(sizeof(hvm_jit_block));
+  first->next           = NULL;
+  first->ip             = first_ip;
+  first->basic_block    = LLVMAppendBasicBlockInContext(context, parent_func, scratch);
+  bundle->blocks_head   = first;
+  bundle->blocks_tail   = first;
   bundle->blocks_length = 1;
+  // Side traces start partway through (eg. a loop can take them back to
+  // an earlier instruction), so they need a block of their own
+  hvm_jit_compile_find_or_insert_block(parent_func, bundle, trace->entry);
 
   for(unsigned int i = 0; i < trace->sequence_length; i++) {
     item = &trace->sequence[i];
@@ -775,7 +858,7 @@ void hvm_jit_compile_pass_identify_blocks(hvm_call_trace *trace, hvm_compile_bun
           data_item->item_if.truthy_block = NULL;
         }
 
-        ip = item->head.ip + 10;// 10 bytes for op, register, and destination
+        ip = item->head.ip + 1;// Falls through to the next instruction
         if(hvm_jit_trace_contains_ip(trace, ip)) {
           // Setting up a FALSINESS block
           block = hvm_jit_compile_find_or_insert_block(parent_func, bundle, ip);
@@ -786,6 +869,18 @@ void hvm_jit_compile_pass_identify_blocks(hvm_call_trace *trace, hvm_compile_bun
         }
         break;
 
+      case HVM_TRACE_SEQUENCE_ITEM_GETLOCALSLOT:
+        // Checking the slot is set ends the block, so the next instruction
+        // needs one of its own
+        ip = item->head.ip + 1;
+        if(hvm_jit_trace_contains_ip(trace, ip)) {
+          block = hvm_jit_compile_find_or_insert_block(parent_func, bundle, ip);
+          data_item->getlocalslot.next_block = block;
+        } else {
+          data_item->getlocalslot.next_block = NULL;
+        }
+        break;
+
       case HVM_TRACE_SEQUENCE_ITEM_GOTO:
         ip = item->item_goto.destination;
         assert(hvm_jit_trace_contains_ip(trace, ip));// TODO: Generate bailout
@@ -838,6 +933,7 @@ void hvm_jit_compile_pass_identify_registers(hvm_call_trace *trace, struct hvm_j
       case HVM_TRACE_SEQUENCE_ITEM_MOVE:
       case HVM_TRACE_SEQUENCE_ITEM_LITINTEGER:
       case HVM_TRACE_SEQUENCE_ITEM_GETLOCAL:
+      case HVM_TRACE_SEQUENCE_ITEM_GETLOCALSLOT:
         register_return = item->returning.register_return;
         writes[register_return] += 1;
         break;
@@ -848,29 +944,61 @@ void hvm_jit_compile_pass_identify_registers(hvm_call_trace *trace, struct hvm_j
   // Make a pointer to null
   LLVMValueRef null_ptr = LLVMConstInt(int64_type, (unsigned long long)hvm_const_null, false);
   null_ptr = LLVMBuildIntToPtr(builder, null_ptr, obj_ref_ptr_type, "null");
+  // Side traces pick up where their parent bailed out, which wrote its
+  // registers back to the VM first
+  LLVMValueRef general_regs_ptr = NULL;
+  if(trace->parent != NULL) {
+    general_regs_ptr = hvm_jit_build_general_regs_window(builder);
+  }
 
   for(byte i = 0; i < HVM_TOTAL_REGISTERS; i++) {
     // printf("writes[%d] = %u\n", i, writes[i]);
     // Mark the register as constant if we write to it 1 or less times.
     context->constant_regs[i] = (writes[i] < 2);
+    context->written_regs[i]  = (writes[i] > 0);
     // Also pre-allocate it if it's a general register
     // TODO: Actually track usage
-    if(hvm_is_gen_reg(i)) {
+    if(!hvm_is_gen_reg(i)) {
+      continue;
+    }
+    if(general_regs_ptr == NULL) {
       // Pre-allocate the slot for it if it's been used at all
       hvm_jit_store_general_reg_value(context, builder, i, null_ptr);
+    } else {
+      // Nothing is known about the values coming in
+      LLVMValueRef idx_val = LLVMConstInt(int32_type, i, true);
+      LLVMValueRef reg_ptr = LLVMBuildGEP(builder, general_regs_ptr, (LLVMValueRef[]){idx_val}, 1, "");
+      LLVMValueRef value   = LLVMBuildLoad(builder, reg_ptr, "");
+      hvm_jit_store_value(context, hvm_compile_value_new(HVM_UNKNOWN_TYPE, i));
+      hvm_jit_store_general_reg_value(context, builder, i, value);
     }
   }
 }
 
 void hvm_jit_position_builder_at_entry(hvm_call_trace *trace, struct hvm_jit_compile_context *context, LLVMBuilderRef builder) {
-  hvm_trace_sequence_item *entry;
-  hvm_jit_block *entry_block;
-  LLVMBasicBlockRef entry_basic_block;
-  // Get the entry item and its associated block
-  entry             = &trace->sequence[0];
-  entry_block       = hvm_jit_get_current_block(context->bundle, entry->head.ip);
-  entry_basic_block = entry_block->basic_block;
-  LLVMPositionBuilderAtEnd(builder, entry_basic_block);
+  LLVMPositionBuilderAtEnd(builder, context->bundle->llvm_entry_block);
+}
+
+// Once the entry block has everything it needs, start running the trace.
+void hvm_jit_build_entry_branch(hvm_call_trace *trace, struct hvm_jit_compile_context *context, LLVMBuilderRef builder) {
+  hvm_jit_block *entry_block = hvm_jit_get_current_block(context->bundle, trace->entry);
+  assert(entry_block->ip == trace->entry);
+  hvm_jit_position_builder_at_entry(trace, context, builder);
+  LLVMBuildBr(builder, entry_block->basic_block);
+}
+
+// Pointer to the field `offset` bytes into the frame the trace is running in
+// (the native function's third argument).
+static LLVMValueRef hvm_jit_build_frame_field_ptr(LLVMBuilderRef builder, LLVMValueRef parent_func, size_t offset, LLVMTypeRef type, const char *name) {
+  LLVMValueRef frame_ptr  = LLVMGetParam(parent_func, 2);
+  LLVMValueRef offset_val = LLVMConstInt(int64_type, offset, false);
+  LLVMValueRef field_ptr  = LLVMBuildGEP(builder, frame_ptr, (LLVMValueRef[]){offset_val}, 1, "");
+  return LLVMBuildPointerCast(builder, field_ptr, LLVMPointerType(type, 0), name);
+}
+// Pointer to one of the frame's slot-indexed locals.
+static LLVMValueRef hvm_jit_build_frame_slot_ptr(LLVMBuilderRef builder, LLVMValueRef parent_func, byte slot) {
+  size_t offset = offsetof(hvm_frame, slots) + (sizeof(hvm_obj_ref*) * slot);
+  return hvm_jit_build_frame_field_ptr(builder, parent_func, offset, obj_ref_ptr_type, "slot_ptr");
 }
 
 void hvm_jit_compile_pass_emit(hvm_vm *vm, hvm_call_trace *trace, struct hvm_jit_compile_context *context) {
@@ -893,8 +1021,7 @@ void hvm_jit_compile_pass_emit(hvm_vm *vm, hvm_call_trace *trace, struct hvm_jit
   hvm_jit_position_builder_at_entry(trace, context, builder);
 
   // Pre-compute a pointer to our VM instance
-  LLVMValueRef value_vm_ptr_int   = LLVMConstInt(int64_type, (unsigned long long)vm, false);
-  const LLVMValueRef value_vm_ptr = LLVMBuildIntToPtr(builder, value_vm_ptr_int, pointer_type, "vm");
+  const LLVMValueRef value_vm_ptr = hvm_jit_address_value(builder, "hvm.vm", pointer_type);
 
   // Get the top-level basic block and its parent function
   LLVMValueRef   parent_func = bundle->llvm_function;
@@ -940,7 +1067,9 @@ void hvm_jit_compile_pass_emit(hvm_vm *vm, hvm_call_trace *trace, struct hvm_jit
             // Extract it from the argument registers array
             unsigned int idx = reg_source - 146;
             // Fetch the parameter pointer from the parameter registers array
-            value = LLVMBuildExtractValue(builder, param_regs, idx, "param");
+            LLVMValueRef idx_val   = LLVMConstInt(int32_type, idx, false);
+            LLVMValueRef param_ptr = LLVMBuildGEP(builder, param_regs, (LLVMValueRef[]){idx_val}, 1, "param_ptr");
+            value = LLVMBuildLoad(builder, param_ptr, "param");
             // Cast it from a simple *i8 pointer to a object reference pointer
             value = LLVMBuildPointerCast(builder, value, obj_ref_ptr_type, "param_obj_ref");
           } else {
@@ -963,8 +1092,9 @@ void hvm_jit_compile_pass_emit(hvm_vm *vm, hvm_call_trace *trace, struct hvm_jit
           // Get the object reference from the constant pool
           ref = hvm_const_pool_get_const(&vm->const_pool, trace_item->setstring.constant);
           // Convert it to a pointer
-          LLVMValueRef value = LLVMConstInt(int64_type, (unsigned long long)ref, false);
-          value = LLVMBuildIntToPtr(builder, value, obj_ref_ptr_type, "string");
+          char name[32];
+          sprintf(name, "hvm.const.%u", trace_item->setstring.constant);
+          LLVMValueRef value = hvm_jit_address_value(builder, name, obj_ref_ptr_type);
           cv = hvm_compile_value_new(HVM_STRING, reg);
           cv->constant = true;
           cv->constant_object = ref;
@@ -981,9 +1111,9 @@ void hvm_jit_compile_pass_emit(hvm_vm *vm, hvm_call_trace *trace, struct hvm_jit
           data_item->setsymbol.constant = trace_item->setsymbol.constant;
           // Also compile our symbol as a LLVM value
           ref = hvm_const_pool_get_const(&vm->const_pool, data_item->setsymbol.constant);
-          // Integer constant wants an `unsigned long long`.
-          LLVMValueRef value = LLVMConstInt(int64_type, (unsigned long long)ref, false);
-          value = LLVMBuildIntToPtr(builder, value, obj_ref_ptr_type, "symbol");
+          char name[32];
+          sprintf(name, "hvm.const.%u", data_item->setsymbol.constant);
+          LLVMValueRef value = hvm_jit_address_value(builder, name, obj_ref_ptr_type);
           // Save our new value into the data item.
           data_item->setsymbol.value = value;
           cv = hvm_compile_value_new(HVM_SYMBOL, reg);
@@ -1043,7 +1173,7 @@ void hvm_jit_compile_pass_emit(hvm_vm *vm, hvm_call_trace *trace, struct hvm_jit
       case HVM_TRACE_SEQUENCE_ITEM_AND:
         DATA_ITEM_TYPE = HVM_COMPILE_DATA_AND;
         {
-          LLVMValueRef value, value1, value2, value_returned, data_ptr;
+          LLVMValueRef value, value1, value2, value_returned;
           byte reg, reg1, reg2;
           // Unpack register and build loads from JIT register slots
           reg    = trace_item->eq.register_return;
@@ -1059,21 +1189,10 @@ void hvm_jit_compile_pass_emit(hvm_vm *vm, hvm_call_trace *trace, struct hvm_jit
           // Then do an and comparison of those two
           sprintf(scratch, "value = $%-3d && $%-3d", reg1, reg2);
           value = LLVMBuildAnd(builder, value1, value2, scratch);
-          // Convert our value to an i64.
-          value = LLVMBuildIntCast(builder, value, int64_type, "value");
-          // And build an integer with that value
-          func = hvm_jit_new_obj_int_llvm_value(bundle);
-          // Going to get a pointer and cast it properly
-          LLVMValueRef new_obj_int_args[1] = {value_vm_ptr};
-          value_returned = LLVMBuildCall(builder, func, new_obj_int_args, 1, "obj_ref_int");
-          value_returned = LLVMBuildPointerCast(builder, value_returned, obj_ref_ptr_type, "value_returned");
-          // Then get the pointer to the data property and set it (first 0 index
-          // is to get the first value pointed at, the second 0 index is to get
-          // the first item in the struct).
-          data_ptr = LLVMBuildGEP(builder, value_returned, (LLVMValueRef[]){i32_zero, i32_one}, 2, "data_ptr");
-          // Convert it to the proper 64-bit integer pointer
-          data_ptr = LLVMBuildPointerCast(builder, data_ptr, int64_pointer_type, "data_ptr");
-          LLVMBuildStore(builder, value, data_ptr);
+          // Convert our value to an i64 (zero-extended since it's a bool).
+          value = LLVMBuildZExt(builder, value, int64_type, "value");
+          // And tag it as an immediate integer; no allocation needed
+          value_returned = hvm_jit_build_int_immediate(builder, value);
           // Slow comparison path:
           // func           = hvm_jit_obj_cmp_and_llvm_value(bundle);
           // value_returned = LLVMBuildCall(builder, func, (LLVMValueRef[]){value1, value2}, 2, "and");
@@ -1132,10 +1251,8 @@ void hvm_jit_compile_pass_emit(hvm_vm *vm, hvm_call_trace *trace, struct hvm_jit
           byte reg_symbol = trace_item->invokeprimitive.register_symbol;
           LLVMValueRef value_symbol = hvm_jit_load_general_reg_value(context, builder, reg_symbol);
           assert(value_symbol != NULL);
-          // Build and run the call to copy the registers
-          func = hvm_jit_vm_copy_regs_llvm_value(bundle);
-          LLVMBuildCall(builder, func, (LLVMValueRef[]){value_vm_ptr}, 1, "");
-          // Build the call to `hvm_vm_call_primitive`.
+          // Build the call to `hvm_vm_call_primitive` (which passes the
+          // argument registers to the primitive).
           func = hvm_jit_vm_call_primitive_llvm_value(bundle);
           LLVMValueRef invokeprimitive_args[2] = {value_vm_ptr, value_symbol};
           value_returned = LLVMBuildCall(builder, func, invokeprimitive_args, 2, "result");
@@ -1242,6 +1359,8 @@ void hvm_jit_compile_pass_emit(hvm_vm *vm, hvm_call_trace *trace, struct hvm_jit
           LLVMValueRef falsey = hvm_jit_compile_value_is_falsey(builder, value1);
           // Invert for our truthy test
           LLVMValueRef truthy = LLVMBuildNot(builder, falsey, "truthy");
+          // Building bailouts moves the builder into them
+          LLVMBasicBlockRef if_block = LLVMGetInsertBlock(builder);
 
           // Get the TRUTHY block to branch to or set up a bailout
           LLVMBasicBlockRef truthy_block;
@@ -1249,7 +1368,7 @@ void hvm_jit_compile_pass_emit(hvm_vm *vm, hvm_call_trace *trace, struct hvm_jit
             truthy_block = data_item->item_if.truthy_block->basic_block;
           } else {
             ip = trace_item->item_if.destination;
-            truthy_block = hvm_jit_build_bailout_block(vm, builder, parent_func, exit_value, context, ip);
+            truthy_block = hvm_jit_build_bailout_block(builder, parent_func, exit_value, context, ip);
           }
           // Same for the FALSEY block
           LLVMBasicBlockRef falsey_block;
@@ -1257,10 +1376,11 @@ void hvm_jit_compile_pass_emit(hvm_vm *vm, hvm_call_trace *trace, struct hvm_jit
             falsey_block = data_item->item_if.falsey_block->basic_block;
           } else {
             // Falsey just continues past the instruction
-            ip = trace_item->head.ip + 10;
-            falsey_block = hvm_jit_build_bailout_block(vm, builder, parent_func, exit_value, context, ip);
+            ip = trace_item->head.ip + 1;
+            falsey_block = hvm_jit_build_bailout_block(builder, parent_func, exit_value, context, ip);
           }
           // And finally actually do the branch with those blocks
+          LLVMPositionBuilderAtEnd(builder, if_block);
           LLVMBuildCondBr(builder, truthy, truthy_block, falsey_block);
         }
         continue;// Skip continuation checks
@@ -1296,16 +1416,21 @@ void hvm_jit_compile_pass_emit(hvm_vm *vm, hvm_call_trace *trace, struct hvm_jit
           LLVMValueRef value;
           hvm_obj_ref *ref;
           byte reg = trace_item->litinteger.register_return;
-          // Create a new object reference and store the literal value in it
-          ref = hvm_new_obj_int(vm);
-          // Mark it as a constant to be exempt from GC.
-          ref->flags = ref->flags | HVM_OBJ_FLAG_CONSTANT;
-          // TODO: Add it to the object space so that the VM and GC will still
-          //       know about it.
-          ref->data.i64 = trace_item->litinteger.literal_value;
-          // Convert the reference to a pointer
-          value = LLVMConstInt(int64_type, (unsigned long long)ref, false);
-          value = LLVMBuildIntToPtr(builder, value, obj_ref_ptr_type, "integer");
+          // Build the literal; this is a tagged immediate unless it's too
+          // big, in which case it's boxed. Boxes are process-specific, so
+          // the code refers to them by value and they're allocated when the
+          // module is linked; the one here is only for constant folding.
+          int64_t literal = trace_item->litinteger.literal_value;
+          if(hvm_obj_int_fits_immediate(literal)) {
+            ref   = hvm_obj_int_immediate(literal);
+            value = LLVMConstInt(int64_type, (unsigned long long)ref, false);
+            value = LLVMBuildIntToPtr(builder, value, obj_ref_ptr_type, "integer");
+          } else {
+            ref = hvm_jit_new_constant_int(literal);
+            char name[32];
+            sprintf(name, "hvm.int.%lld", (long long)literal);
+            value = hvm_jit_address_value(builder, name, obj_ref_ptr_type);
+          }
           // Save that value into the data item
           data_item->litinteger.value = value;
           data_item->litinteger.register_return = reg;
@@ -1408,6 +1533,47 @@ void hvm_jit_compile_pass_emit(hvm_vm *vm, hvm_call_trace *trace, struct hvm_jit
         */
         break;
 
+      case HVM_TRACE_SEQUENCE_ITEM_SETLOCALSLOT:
+        DATA_ITEM_TYPE = HVM_COMPILE_DATA_SETLOCALSLOT;
+        {
+          byte slot = trace_item->setlocalslot.slot;
+          LLVMValueRef value = hvm_jit_load_general_reg_value(context, builder, trace_item->setlocalslot.register_value);
+          LLVMBuildStore(builder, value, hvm_jit_build_frame_slot_ptr(builder, parent_func, slot));
+          // Keep the collector scanning up to the highest slot written
+          LLVMTypeRef  length_type  = LLVMIntType(sizeof(unsigned int) * 8);
+          LLVMValueRef length_ptr   = hvm_jit_build_frame_field_ptr(builder, parent_func, offsetof(hvm_frame, slots_length), length_type, "slots_length_ptr");
+          LLVMValueRef length       = LLVMBuildLoad(builder, length_ptr, "slots_length");
+          LLVMValueRef slot_length  = LLVMConstInt(length_type, slot + 1, false);
+          LLVMValueRef shorter      = LLVMBuildICmp(builder, LLVMIntULT, length, slot_length, "shorter");
+          LLVMBuildStore(builder, LLVMBuildSelect(builder, shorter, slot_length, length, ""), length_ptr);
+        }
+        break;
+
+      case HVM_TRACE_SEQUENCE_ITEM_GETLOCALSLOT:
+        DATA_ITEM_TYPE = HVM_COMPILE_DATA_GETLOCALSLOT;
+        {
+          byte reg_result = trace_item->getlocalslot.register_return;
+          LLVMValueRef slot_ptr = hvm_jit_build_frame_slot_ptr(builder, parent_func, trace_item->getlocalslot.slot);
+          LLVMValueRef value    = LLVMBuildLoad(builder, slot_ptr, "slot_local");
+          cv = hvm_compile_value_new(HVM_UNKNOWN_TYPE, reg_result);
+          STORE(cv, value);
+          // Reading an unset slot raises an exception, so leave that to the
+          // interpreter
+          LLVMValueRef      unset      = LLVMBuildIsNull(builder, value, "unset");
+          LLVMBasicBlockRef slot_block = LLVMGetInsertBlock(builder);
+          ip = trace_item->head.ip;
+          LLVMBasicBlockRef unset_block = hvm_jit_build_bailout_block(builder, parent_func, exit_value, context, ip);
+          LLVMBasicBlockRef set_block;
+          if(data_item->getlocalslot.next_block != NULL) {
+            set_block = data_item->getlocalslot.next_block->basic_block;
+          } else {
+            set_block = hvm_jit_build_bailout_block(builder, parent_func, exit_value, context, ip + 1);
+          }
+          LLVMPositionBuilderAtEnd(builder, slot_block);
+          LLVMBuildCondBr(builder, unset, unset_block, set_block);
+        }
+        continue;// Skip continuation checks
+
       default:
         type = trace_item->head.type;
         fprintf(stderr, "jit-compiler: Don't know what to do with item type %d\n", type);
@@ -1430,12 +1596,31 @@ void hvm_jit_compile_pass_emit(hvm_vm *vm, hvm_call_trace *trace, struct hvm_jit
   }//for
 }
 
+// Allocate a slot for a local in the entry block.
+static LLVMValueRef hvm_jit_alloca_local(LLVMBuilderRef builder, hvm_symbol_id symbol_id) {
+  char scratch[32];
+  sprintf(scratch, "local:%llu", (unsigned long long)symbol_id);
+  return LLVMBuildAlloca(builder, obj_ref_ptr_type, scratch);
+}
+// Load a local's current value out of the frame the trace is running in
+// (the native function's third argument) into its slot.
+static void hvm_jit_seed_local(struct hvm_jit_compile_context *context, LLVMBuilderRef builder, hvm_symbol_id symbol_id, LLVMValueRef slot) {
+  hvm_compile_bundle *bundle = context->bundle;
+  LLVMValueRef frame_ptr    = LLVMGetParam(bundle->llvm_function, 2);
+  LLVMValueRef value_symbol = LLVMConstInt(int64_type, symbol_id, false);
+  LLVMValueRef func  = hvm_jit_get_local_llvm_value(bundle);
+  LLVMValueRef value = LLVMBuildCall(builder, func, (LLVMValueRef[]){frame_ptr, value_symbol}, 2, "local");
+  hvm_jit_store_slot(builder, slot, value, "");
+}
+
 void hvm_jit_compile_pass_identify_locals(hvm_call_trace *trace, struct hvm_jit_compile_context *context) {
   hvm_compile_sequence_data *data = context->bundle->data;
   LLVMBuilderRef builder = context->bundle->llvm_builder;
   // Set up a structure to store all of our LLVMValueRefs; each local will
   // get its own LLVMValueRef slot
   hvm_obj_struct *locals = hvm_new_obj_struct();
+  // Locals whose slots are loaded from the frame on entry
+  hvm_obj_struct *seeded = hvm_new_obj_struct();
   // Register the local is being read from/written to
   byte reg_return, reg_value;
   hvm_symbol_id symbol_id;
@@ -1459,7 +1644,14 @@ void hvm_jit_compile_pass_identify_locals(hvm_call_trace *trace, struct hvm_jit_
         // Fetching the hvm_obj_ref* pointer but casting it as a void since
         // it's really just an LLVMValueRef slot pointer
         slot = hvm_obj_struct_internal_get(locals, symbol_id);
-        assert(slot != NULL);
+        if(slot == NULL) {
+          // Set before the trace started (eg. ahead of a side exit), so its
+          // value has to come from the frame
+          slot = hvm_jit_alloca_local(builder, symbol_id);
+          hvm_obj_struct_internal_set(locals, symbol_id, slot);
+          hvm_jit_seed_local(context, builder, symbol_id, slot);
+          hvm_obj_struct_internal_set(seeded, symbol_id, slot);
+        }
         // Convert it to a LLVMValueRef to add it to the `data_item`
         data_item->getlocal.slot = (LLVMValueRef)slot;
         break;
@@ -1470,11 +1662,8 @@ void hvm_jit_compile_pass_identify_locals(hvm_call_trace *trace, struct hvm_jit_
         // Check if the local's slot has already been allocated
         slot = hvm_obj_struct_internal_get(locals, symbol_id);
         if(slot == NULL) {
-          char scratch[80];// FIXME: Possible overflow here
-          char *symbol_name = hvm_desymbolicate(context->vm->symbols, symbol_id);
-          sprintf(scratch, "local:%s", symbol_name);
           // Allocate the slot and add it to the structure dictionary
-          slot = LLVMBuildAlloca(builder, obj_ref_ptr_type, scratch);
+          slot = hvm_jit_alloca_local(builder, symbol_id);
           hvm_obj_struct_internal_set(locals, symbol_id, slot);
         }
         data_item->setlocal.slot = (LLVMValueRef)slot;
@@ -1483,6 +1672,22 @@ void hvm_jit_compile_pass_identify_locals(hvm_call_trace *trace, struct hvm_jit_
         continue;
     }
   }
+  // The sequence is in instruction order, but a side trace can start
+  // partway through it: a loop may read a local at a later instruction
+  // before running the set at an earlier one. So side traces load every
+  // local they read.
+  if(trace->parent != NULL) {
+    for(i = 0; i < trace->sequence_length; i++) {
+      item = &trace->sequence[i];
+      if(item->head.type != HVM_TRACE_SEQUENCE_ITEM_GETLOCAL) { continue; }
+      symbol_id = item->getlocal.symbol_value;
+      if(hvm_obj_struct_internal_get(seeded, symbol_id) != NULL) { continue; }
+      slot = hvm_obj_struct_internal_get(locals, symbol_id);
+      hvm_jit_seed_local(context, builder, symbol_id, (LLVMValueRef)slot);
+      hvm_obj_struct_internal_set(seeded, symbol_id, slot);
+    }
+  }
+  hvm_obj_struct_free(seeded);
   context->locals = locals;
 }
 
@@ -1498,30 +1703,194 @@ void hvm_jit_sort_trace(hvm_call_trace *trace) {
   qsort(trace->sequence, trace->sequence_length, sizeof(hvm_trace_sequence_item), &hvm_trace_item_comparator);
 }
 
+// Linking --------------------------------------------------------------------
+
+#define VM_FUNCTION(F) {#F, (void*)&F}
+
+// Everything compiled code can call.
+static const struct {
+  const char *name;
+  void *address;
+} hvm_jit_vm_functions[] = {
+  VM_FUNCTION(hvm_obj_array_get),
+  VM_FUNCTION(hvm_obj_array_set),
+  VM_FUNCTION(hvm_obj_array_len),
+  VM_FUNCTION(hvm_vm_call_primitive),
+  VM_FUNCTION(hvm_obj_cmp_and),
+  VM_FUNCTION(hvm_vm_register_write),
+  VM_FUNCTION(hvm_obj_int_add),
+  VM_FUNCTION(hvm_obj_int_eq),
+  VM_FUNCTION(hvm_obj_int_gt),
+  VM_FUNCTION(hvm_obj_is_truthy),
+  VM_FUNCTION(hvm_set_local),
+  VM_FUNCTION(hvm_get_local),
+  VM_FUNCTION(hvm_new_obj_int_value),
+  VM_FUNCTION(puts)
+};
+
+void *hvm_jit_resolve_function(const char *name) {
+  unsigned int count = sizeof(hvm_jit_vm_functions) / sizeof(hvm_jit_vm_functions[0]);
+  for(unsigned int i = 0; i < count; i++) {
+    if(strcmp(hvm_jit_vm_functions[i].name, name) == 0) {
+      return hvm_jit_vm_functions[i].address;
+    }
+  }
+  return NULL;
+}
+
+// Look up what one of the names given out by hvm_jit_address_value points
+// to in this process. Returns NULL if it's not one we know of.
+void *hvm_jit_resolve_address(hvm_vm *vm, const char *name) {
+  unsigned int index;
+  long long literal;
+  if(strcmp(name, "hvm.vm") == 0) {
+    return vm;
+  } else if(strcmp(name, "hvm.general_regs") == 0) {
+    return &vm->general_regs;
+  } else if(strcmp(name, "hvm.immediate_stand_in") == 0) {
+    return &hvm_jit_immediate_stand_in;
+  } else if(sscanf(name, "hvm.const.%u", &index) == 1) {
+    if(index >= vm->const_pool.next_index) { return NULL; }
+    return hvm_const_pool_get_const(&vm->const_pool, index);
+  } else if(sscanf(name, "hvm.int.%lld", &literal) == 1) {
+    return hvm_jit_new_constant_int((int64_t)literal);
+  }
+  return NULL;
+}
+
+// Map every external reference in the module to its address in this
+// process. Returns false if the module refers to anything unknown.
+bool hvm_jit_link_module(hvm_vm *vm, LLVMModuleRef module, const char *function_name) {
+  LLVMExecutionEngineRef engine = hvm_shared_llvm_engine;
+  char scratch[128];
+  LLVMValueRef global;
+  for(global = LLVMGetFirstGlobal(module); global != NULL; global = LLVMGetNextGlobal(global)) {
+    const char *name = LLVMGetValueName(global);
+    if(strncmp(name, HVM_JIT_ADDRESS_PREFIX, strlen(HVM_JIT_ADDRESS_PREFIX)) != 0) {
+      return false;
+    }
+    void *address = hvm_jit_resolve_address(vm, name);
+    if(address == NULL) {
+      return false;
+    }
+    // Symbols in the engine are shared by all of its modules, and each
+    // trace's globals point somewhere different
+    snprintf(scratch, sizeof(scratch), "%s.%s", name, function_name);
+    LLVMSetValueName(global, scratch);
+    LLVMAddGlobalMapping(engine, global, address);
+  }
+  LLVMValueRef func;
+  for(func = LLVMGetFirstFunction(module); func != NULL; func = LLVMGetNextFunction(func)) {
+    if(!LLVMIsDeclaration(func)) { continue; }
+    const char *name = LLVMGetValueName(func);
+    // Intrinsics are provided by LLVM
+    if(strncmp(name, "llvm.", 5) == 0) { continue; }
+    void *address = hvm_jit_resolve_function(name);
+    if(address == NULL) {
+      return false;
+    }
+    LLVMAddGlobalMapping(engine, func, address);
+  }
+  return true;
+}
+
+// Cached code is only good for the LLVM it was built by.
+#define STRINGIFY(X) #X
+#define VERSION_STRING(MAJOR, MINOR) STRINGIFY(MAJOR) "." STRINGIFY(MINOR)
+#define HVM_JIT_COMPILER_VERSION ("llvm-" VERSION_STRING(LLVM_VERSION_MAJOR, LLVM_VERSION_MINOR))
+
+// Load a trace's optimized module out of the cache, if it's there.
+LLVMValueRef hvm_jit_load_cached_trace(hvm_vm *vm, uint64_t key, const char *function_name) {
+  size_t size;
+  void *code = hvm_jit_cache_read(vm->jit_cache, key, HVM_JIT_COMPILER_VERSION, &size);
+  if(code == NULL) {
+    return NULL;
+  }
+  LLVMMemoryBufferRef buffer = LLVMCreateMemoryBufferWithMemoryRangeCopy(code, size, function_name);
+  free(code);
+  LLVMModuleRef module;
+  char *err = NULL;
+  LLVMBool failed = LLVMParseBitcodeInContext(hvm_shared_llvm_context, buffer, &module, &err);
+  LLVMDisposeMemoryBuffer(buffer);
+  if(failed) {
+    LLVMDisposeMessage(err);
+    return NULL;
+  }
+  // The function is the only thing the module defines
+  LLVMValueRef function = LLVMGetFirstFunction(module);
+  while(function != NULL && LLVMIsDeclaration(function)) {
+    function = LLVMGetNextFunction(function);
+  }
+  if(function == NULL || !hvm_jit_link_module(vm, module, function_name)) {
+    LLVMDisposeModule(module);
+    return NULL;
+  }
+  LLVMSetValueName(function, function_name);
+  return function;
+}
+
+void hvm_jit_store_cached_trace(hvm_vm *vm, uint64_t key, LLVMModuleRef module) {
+  LLVMMemoryBufferRef buffer = LLVMWriteBitcodeToMemoryBuffer(module);
+  const char *code = LLVMGetBufferStart(buffer);
+  size_t      size = LLVMGetBufferSize(buffer);
+  if(!hvm_jit_cache_write(vm->jit_cache, key, HVM_JIT_COMPILER_VERSION, code, size)) {
+    fprintf(stderr, "jit: couldn't write to cache in %s\n", vm->jit_cache);
+  }
+  LLVMDisposeMemoryBuffer(buffer);
+}
+
 // Compilation public API -----------------------------------------------------
 
+// Save the compiled function and generate its native code here, so the VM
+// never has to touch the engine; then publish it for the VM to switch to.
+// Must be called with the LLVM lock held.
+static void hvm_jit_add_trace(hvm_call_trace *trace, LLVMValueRef function) {
+  trace->compiled_function = function;
+  LLVMAddModule(hvm_shared_llvm_engine, LLVMGetGlobalParent(function));
+  void *native = LLVMGetPointerToGlobal(hvm_shared_llvm_engine, function);
+  __atomic_store_n(&trace->native_function, native, __ATOMIC_RELEASE);
+}
+
 void hvm_jit_compile_trace(hvm_vm *vm, hvm_call_trace *trace) {
+  pthread_mutex_lock(&hvm_shared_llvm_lock);
   // Make sure our LLVM context, module, engine, etc. are available
   hvm_jit_setup_llvm();
-  LLVMContextRef         context = hvm_shared_llvm_context;
-  LLVMModuleRef          module  = hvm_shared_llvm_module;
-  LLVMExecutionEngineRef engine  = hvm_shared_llvm_engine;
+  LLVMContextRef context = hvm_shared_llvm_context;
   // Make sure our constants and such are already defined
   hvm_jit_define_constants();
 
-  // Build the name for our function
+  // Build the name for our function, and a module of its own to put it in
   char *function_name = je_malloc(sizeof(char) * 64);
   function_name[0]    = '\0';
   sprintf(function_name, "hvm_jit_function_%p", trace);
 
-  LLVMTypeRef ptr_array_type = LLVMArrayType(pointer_type, HVM_ARGUMENT_REGISTERS);
+  // Rearrange the trace to be a linear sequence of ordered IPs
+  hvm_jit_sort_trace(trace);
+
+  // If it's been compiled before then we can skip straight to generating
+  // its native code
+  uint64_t cache_key = 0;
+  LLVMValueRef function;
+  if(vm->jit_cache != NULL) {
+    cache_key = hvm_jit_cache_key(vm, trace);
+    function  = hvm_jit_load_cached_trace(vm, cache_key, function_name);
+    if(function != NULL) {
+      hvm_jit_add_trace(trace, function);
+      pthread_mutex_unlock(&hvm_shared_llvm_lock);
+      return;
+    }
+  }
+  LLVMModuleRef module = LLVMModuleCreateWithNameInContext(function_name, context);
+
+  LLVMTypeRef ptr_array_type = LLVMPointerType(pointer_type, 0);
 
   LLVMTypeRef  function_args[] = {
-    pointer_type,// hvm_jit_exit*
-    ptr_array_type // hvm_obj_ref*[]
+    pointer_type,  // hvm_jit_exit*
+    ptr_array_type,// hvm_obj_ref**
+    pointer_type   // hvm_frame*
   };
-  LLVMTypeRef  function_type   = LLVMFunctionType(void_type, function_args, 2, false);
-  LLVMValueRef function        = LLVMAddFunction(module, function_name, function_type);
+  LLVMTypeRef  function_type   = LLVMFunctionType(void_type, function_args, 3, false);
+  function = LLVMAddFunction(module, function_name, function_type);
   // Builder that we'll write the instructions from our trace into
   LLVMBuilderRef builder = LLVMCreateBuilderInContext(context);
 
@@ -1529,12 +1898,12 @@ void hvm_jit_compile_trace(hvm_vm *vm, hvm_call_trace *trace) {
   hvm_compile_sequence_data *data = je_calloc(trace->sequence_length, sizeof(hvm_compile_sequence_data));
   // Establish a bundle for all of our stuff related to this compilation.
   hvm_compile_bundle bundle = {
-    .frame = hvm_new_frame(),
     .data  = data,
     .llvm_module   = module,
     .llvm_builder  = builder,
-    .llvm_engine   = engine,
+    .llvm_engine   = hvm_shared_llvm_engine,
     .llvm_function = function,
+    .llvm_entry_block = NULL,
     .blocks_head   = NULL,
     .blocks_tail   = NULL,
     .blocks_length = 0
@@ -1543,10 +1912,6 @@ void hvm_jit_compile_trace(hvm_vm *vm, hvm_call_trace *trace) {
   // Eventually going to run this as a hopefully-two-pass compilation. For now
   // though it's going to be multi-pass.
 
-  // Rearrange the trace to be a linear sequence of ordered IPs
-  hvm_jit_sort_trace(trace);
-
-
   // Initialize array pointer containers to NULL
   LLVMValueRef general_reg_boxes[HVM_GENERAL_REGISTERS];
   for(unsigned int i = 0; i < HVM_GENERAL_REGISTERS; i++) {
@@ -1554,13 +1919,15 @@ void hvm_jit_compile_trace(hvm_vm *vm, hvm_call_trace *trace) {
   }
   // Wrapped values read and written into registers during the trace
   hvm_compile_value *wrapped_values[HVM_TOTAL_REGISTERS];
-  // Registers marked as constant
+  // Registers marked as constant, and those written by the trace
   bool constant_registers[HVM_TOTAL_REGISTERS];
+  bool written_registers[HVM_TOTAL_REGISTERS];
   // Setting up the context
   struct hvm_jit_compile_context compile_context = {
     .bundle        = &bundle,
     .general_regs  = general_reg_boxes,
     .constant_regs = constant_registers,
+    .written_regs  = written_registers,
     .vm            = vm,
     .values        = wrapped_values
   };
@@ -1583,33 +1950,81 @@ void hvm_jit_compile_trace(hvm_vm *vm, hvm_call_trace *trace) {
   // Resolve register references in instructions into concrete IR value
   // references and build the instruction sequence.
   hvm_jit_compile_pass_emit(vm, trace, &compile_context);
+  hvm_jit_build_entry_branch(trace, &compile_context, builder);
 
   // Now let's run the LLVM passes on the function
-  LLVMRunFunctionPassManager(hvm_shared_llvm_pass_manager, function);
-  // Verify and abort if it's invalid
-  char *err = NULL;
-  LLVMVerifyModule(module, LLVMAbortProcessAction, &err);
-  LLVMDisposeMessage(err);
+  LLVMPassManagerRef pass_manager = hvm_jit_new_pass_manager(module);
+  LLVMRunFunctionPassManager(pass_manager, function);
+  LLVMFinalizeFunctionPassManager(pass_manager);
+  LLVMDisposePassManager(pass_manager);
+  // Verify and abort if it's invalid; only the new function needs checking
+  // since the rest of the module is just declarations of VM functions
+  LLVMVerifyFunction(function, LLVMAbortProcessAction);
 
   // LLVMDumpModule(module);
   // exit(1);
 
-  // Save the compiled function
-  trace->compiled_function = function;
+  // Cache it before it's linked, while it only refers to things by name
+  if(vm->jit_cache != NULL) {
+    hvm_jit_store_cached_trace(vm, cache_key, module);
+  }
+  if(!hvm_jit_link_module(vm, module, function_name)) {
+    fprintf(stderr, "jit: compiled trace refers to an unknown address or function\n");
+    assert(false);
+  }
+  hvm_jit_add_trace(trace, function);
 
   je_free(data);
+  pthread_mutex_unlock(&hvm_shared_llvm_lock);
 }
 
-hvm_jit_exit *hvm_jit_run_compiled_trace(hvm_vm *vm, hvm_call_trace *trace) {
-  LLVMExecutionEngineRef engine = hvm_shared_llvm_engine;
-  LLVMValueRef function         = trace->compiled_function;
-  // Set up the memory for our exit information.
-  hvm_jit_exit *result = je_malloc(sizeof(hvm_jit_exit));
-  // Get a pointer to the JIT-compiled native code
-  void *vfp = LLVMGetPointerToGlobal(engine, function);
-  // Cast it to the correct function pointer type and call the code
-  hvm_jit_native_function fp = (hvm_jit_native_function)vfp;
-  fp(result, *(vm->param_regs));
-  // Return the result
-  return result;
+void hvm_jit_discard_trace(hvm_vm *vm, hvm_call_trace *trace) {
+  // Let the trace finish compiling if it's been queued
+  hvm_jit_queue_wait(vm->jit_queue);
+  __atomic_store_n(&trace->native_function, NULL, __ATOMIC_RELEASE);
+  trace->queued = false;
+  // Unhook it from the call's tag (and cool the tag down) so that the
+  // subroutine is traced afresh once it's hot again
+  if(trace->caller_tag != NULL) {
+    trace->caller_tag->trace_index = 0;
+    trace->caller_tag->heat        = 0;
+    trace->caller_tag = NULL;
+  }
+  // Free up its index for the next trace to be registered
+  if(trace->index > 0) {
+    vm->traces[trace->index] = NULL;
+    trace->index = 0;
+  }
+  // Its side traces were started from its code, so they go with it
+  for(unsigned int i = 0; i < trace->side_exits_length; i++) {
+    hvm_call_trace *side_trace = trace->side_exits[i].trace;
+    if(side_trace != NULL && side_trace->complete) {
+      hvm_jit_discard_trace(vm, side_trace);
+    } else if(side_trace != NULL && side_trace->abandoned) {
+      // Nothing else refers to an abandoned side trace
+      free(side_trace);
+    }
+  }
+  trace->side_exits_length = 0;
+  if(trace->compiled_function == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&hvm_shared_llvm_lock);
+  LLVMModuleRef module = LLVMGetGlobalParent(trace->compiled_function);
+  LLVMModuleRef removed;
+  char *err = NULL;
+  if(LLVMRemoveModule(hvm_shared_llvm_engine, module, &removed, &err) != 0) {
+    fprintf(stderr, "Error removing trace module: %s\n", err);
+    assert(false);
+  }
+  LLVMDisposeModule(removed);
+  trace->compiled_function = NULL;
+  pthread_mutex_unlock(&hvm_shared_llvm_lock);
+}
+
+void hvm_jit_run_compiled_trace(hvm_vm *vm, hvm_call_trace *trace, hvm_jit_exit *exit) {
+  // Cast the published native code to the correct function pointer type and
+  // call it
+  hvm_jit_native_function fp = (hvm_jit_native_function)trace->native_function;
+  fp(exit, vm->param_regs, vm->top);
 }
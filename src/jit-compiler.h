@@ -38,7 +38,9 @@ typedef enum {
   HVM_COMPILE_DATA_AND,
   HVM_COMPILE_DATA_RETURN,
   HVM_COMPILE_DATA_SETLOCAL,
-  HVM_COMPILE_DATA_GETLOCAL
+  HVM_COMPILE_DATA_GETLOCAL,
+  HVM_COMPILE_DATA_SETLOCALSLOT,
+  HVM_COMPILE_DATA_GETLOCALSLOT
 } hvm_compile_data_type;
 
 #define HVM_COMPILE_DATA_HEAD hvm_compile_data_type type;
@@ -164,6 +166,13 @@ typedef struct hvm_compile_sequence_data_setlocal {
   LLVMValueRef slot;
 } hvm_compile_sequence_data_setlocal;
 
+typedef struct hvm_compile_sequence_data_getlocalslot {
+  HVM_COMPILE_DATA_HEAD;
+  // Block to carry on in once the slot is known to be set (NULL if the next
+  // instruction isn't in the trace)
+  hvm_jit_block *next_block;
+} hvm_compile_sequence_data_getlocalslot;
+
 /// Structs used for figuring out and keeping track of data related to each
 /// sequence in the trace instruction sequence being compiled.
 typedef union hvm_compile_sequence_data {
@@ -179,14 +188,13 @@ typedef union hvm_compile_sequence_data {
   hvm_compile_sequence_data_litinteger litinteger;
   hvm_compile_sequence_data_getlocal   getlocal;
   hvm_compile_sequence_data_setlocal   setlocal;
+  hvm_compile_sequence_data_getlocalslot getlocalslot;
   hvm_compile_sequence_data_invokeprimitive invokeprimitive;
 } hvm_compile_sequence_data;
 
 /// Holds all information relevant to a compilation of a trace (eg. instruction
 /// sequence compilation data).
 typedef struct hvm_compile_bundle {
-  // VM execution frame
-  struct hvm_frame *frame;
   // Instructions as they are compiled
   hvm_compile_sequence_data *data;
 
@@ -205,6 +213,10 @@ typedef struct hvm_compile_bundle {
   LLVMExecutionEngineRef llvm_engine;
   LLVMBuilderRef         llvm_builder;
   LLVMValueRef           llvm_function;
+  /// Block the function starts in. It holds the stack allocations and then
+  /// branches to the block for the trace's entry (which isn't the first
+  /// block for side traces).
+  LLVMBasicBlockRef      llvm_entry_block;
 #endif
 } hvm_compile_bundle;
 
@@ -219,6 +231,8 @@ struct hvm_jit_compile_context {
   LLVMValueRef *general_regs;
   /// For knowing whether a register is constant or not
   bool *constant_regs;
+  /// Registers the trace writes (the ones a bailout has to copy back)
+  bool *written_regs;
   /// Local variable slots
   struct hvm_obj_struct *locals;
   /// Pointer to the VM we're compiling for
@@ -252,15 +266,27 @@ typedef union hvm_jit_exit {
 } hvm_jit_exit;
 
 // Second argument is the pointer to the first element of the parameter
-// registers array.
-typedef void (*hvm_jit_native_function)(hvm_jit_exit*, hvm_obj_ref*);
+// registers array; the third is the frame the trace is running in (its
+// locals are read from and written back to it).
+typedef void (*hvm_jit_native_function)(hvm_jit_exit*, hvm_obj_ref**, struct hvm_frame*);
 
 // External API
 
-/// Compile a given trace to native function.
+/// Compile a given trace to native function and publish it in the trace's
+/// `native_function`. Runs on the compile queue's thread (see jit-queue.h),
+/// so it mustn't touch VM state the interpreter may be changing.
 void hvm_jit_compile_trace(hvm_vm*, hvm_call_trace*);
-/// Run a compiled traced.
-hvm_jit_exit* hvm_jit_run_compiled_trace(hvm_vm*, hvm_call_trace*);
+/// Run a compiled trace through its published native function, filling in
+/// `exit` with how it finished. Doesn't allocate, so the exit record can
+/// live on the caller's stack.
+void hvm_jit_run_compiled_trace(hvm_vm*, hvm_call_trace*, hvm_jit_exit *exit);
+/// Take a trace's compiled function out of the execution engine and free
+/// its module, and detach it from its call's tag, so the VM goes back to
+/// interpreting the subroutine (eg. once the trace has gone stale). The
+/// subroutine is traced and compiled afresh the next time it's hot. The
+/// traces of its side exits are discarded along with it. Must be called on
+/// the VM thread, and not while the trace is running.
+void hvm_jit_discard_trace(hvm_vm*, hvm_call_trace*);
 
 /// Given a trace and a compilation bundle, actually compiles each item
 /// in the trace into the LLVM IR builder.
@@ -274,6 +300,6 @@ hvm_jit_block* hvm_jit_compile_find_or_insert_block(LLVMValueRef, hvm_compile_bu
 /// Set up a bailout from the current JIT state back to the normal VM state
 /// at the given instruction address; execution will resume at that address
 /// in the VM.
-LLVMBasicBlockRef hvm_jit_build_bailout_block(hvm_vm*, LLVMBuilderRef, LLVMValueRef parent_func, LLVMValueRef exit_value, void*, uint64_t);
+LLVMBasicBlockRef hvm_jit_build_bailout_block(LLVMBuilderRef, LLVMValueRef parent_func, LLVMValueRef exit_value, void*, uint64_t);
 
 #endif
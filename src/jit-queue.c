@@ -0,0 +1,141 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <sys/time.h>
+#include <pthread.h>
+
+#include "vm.h"
+#include "object.h"
+#include "jit-tracer.h"
+#include "jit-compiler.h"
+#include "jit-queue.h"
+
+static void *compiler_main(void *arg);
+
+hvm_jit_queue *hvm_new_jit_queue(hvm_vm *vm) {
+  hvm_jit_queue *queue = malloc(sizeof(hvm_jit_queue));
+  queue->vm         = vm;
+  queue->background = true;
+  queue->compile_trace = hvm_jit_compile_trace;
+  queue->head       = 0;
+  queue->length     = 0;
+  queue->compiling  = false;
+  queue->compiler_started = false;
+  pthread_mutex_init(&queue->lock, NULL);
+  pthread_cond_init(&queue->wake, NULL);
+  pthread_cond_init(&queue->idle, NULL);
+  queue->length_max = 0;
+  queue->queued     = 0;
+  queue->rejected   = 0;
+  queue->compiled   = 0;
+  queue->compile_time_total = 0;
+  queue->compile_time_max   = 0;
+  memset(queue->compile_times, 0, sizeof(queue->compile_times));
+  char *background = getenv(HVM_JIT_BACKGROUND_ENV);
+  if(background != NULL) {
+    queue->background = (strcmp(background, "0") != 0);
+  }
+  return queue;
+}
+
+static inline uint64_t now_us() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return ((uint64_t)tv.tv_sec * 1000000) + (uint64_t)tv.tv_usec;
+}
+
+// Must be called with the lock held.
+static void record_compile(hvm_jit_queue *queue, uint64_t time) {
+  unsigned int bucket = 0;
+  while(bucket < HVM_JIT_COMPILE_TIME_BUCKETS - 1 && (time >> (bucket + 1)) > 0) {
+    bucket += 1;
+  }
+  queue->compile_times[bucket] += 1;
+  queue->compiled           += 1;
+  queue->compile_time_total += time;
+  if(time > queue->compile_time_max) { queue->compile_time_max = time; }
+}
+
+// The compiler publishes the trace's native function itself, so the VM
+// doesn't need to hear back from here.
+static void compile(hvm_jit_queue *queue, hvm_call_trace *trace) {
+  uint64_t start = now_us();
+  queue->compile_trace(queue->vm, trace);
+  uint64_t time = now_us() - start;
+  pthread_mutex_lock(&queue->lock);
+  record_compile(queue, time);
+  pthread_mutex_unlock(&queue->lock);
+}
+
+bool hvm_jit_queue_push(hvm_jit_queue *queue, hvm_call_trace *trace) {
+  if(!queue->background) {
+    queue->queued += 1;
+    compile(queue, trace);
+    return true;
+  }
+  pthread_mutex_lock(&queue->lock);
+  if(queue->length == HVM_JIT_QUEUE_SIZE) {
+    queue->rejected += 1;
+    pthread_mutex_unlock(&queue->lock);
+    return false;
+  }
+  queue->items[(queue->head + queue->length) % HVM_JIT_QUEUE_SIZE] = trace;
+  queue->length += 1;
+  queue->queued += 1;
+  if(queue->length > queue->length_max) { queue->length_max = queue->length; }
+  if(!queue->compiler_started) {
+    int err = pthread_create(&queue->compiler, NULL, compiler_main, queue);
+    if(err != 0) {
+      fprintf(stderr, "jit: failed to start compiler thread\n");
+      assert(err == 0);
+    }
+    queue->compiler_started = true;
+  }
+  pthread_cond_signal(&queue->wake);
+  pthread_mutex_unlock(&queue->lock);
+  return true;
+}
+
+void hvm_jit_queue_wait(hvm_jit_queue *queue) {
+  pthread_mutex_lock(&queue->lock);
+  while(queue->length > 0 || queue->compiling) {
+    pthread_cond_wait(&queue->idle, &queue->lock);
+  }
+  pthread_mutex_unlock(&queue->lock);
+}
+
+static void *compiler_main(void *arg) {
+  hvm_jit_queue *queue = arg;
+  pthread_mutex_lock(&queue->lock);
+  while(true) {
+    if(queue->length == 0) {
+      pthread_cond_wait(&queue->wake, &queue->lock);
+      continue;
+    }
+    hvm_call_trace *trace = queue->items[queue->head];
+    queue->head       = (queue->head + 1) % HVM_JIT_QUEUE_SIZE;
+    queue->length    -= 1;
+    queue->compiling  = true;
+    pthread_mutex_unlock(&queue->lock);
+    compile(queue, trace);
+    pthread_mutex_lock(&queue->lock);
+    queue->compiling = false;
+    if(queue->length == 0) { pthread_cond_broadcast(&queue->idle); }
+  }
+  return NULL;
+}
+
+void hvm_jit_get_stats(hvm_jit_queue *queue, hvm_jit_stats *stats) {
+  pthread_mutex_lock(&queue->lock);
+  stats->queue_depth        = queue->length;
+  stats->queue_depth_max    = queue->length_max;
+  stats->queued             = queue->queued;
+  stats->rejected           = queue->rejected;
+  stats->compiled           = queue->compiled;
+  stats->compile_time_total = queue->compile_time_total;
+  stats->compile_time_max   = queue->compile_time_max;
+  memcpy(stats->compile_times, queue->compile_times, sizeof(stats->compile_times));
+  pthread_mutex_unlock(&queue->lock);
+}
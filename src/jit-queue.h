@@ -0,0 +1,80 @@
+#ifndef HVM_JIT_QUEUE_H
+#define HVM_JIT_QUEUE_H
+/// @file jit-queue.h
+
+#include <pthread.h>
+
+// Hot traces are compiled on a background thread so the VM doesn't stall
+// for the whole of an LLVM compilation. The VM pushes completed traces
+// onto a bounded queue and keeps interpreting them; the compiler thread
+// publishes each trace's native function once it's ready, and the next
+// call through the trace's tag picks it up.
+
+/// Most traces that can be waiting to be compiled. Once it's full hot
+/// traces are left to be interpreted and offered again on a later call.
+#define HVM_JIT_QUEUE_SIZE 64
+/// Environment variable to compile traces on the VM thread instead of in
+/// the background (set to "0").
+#define HVM_JIT_BACKGROUND_ENV "HVM_JIT_BACKGROUND"
+/// Number of buckets in the compile time histogram: bucket 0 counts
+/// compilations under 2 microseconds, bucket N those taking from 2^N up
+/// to 2^(N+1) microseconds, and the last one everything longer.
+#define HVM_JIT_COMPILE_TIME_BUCKETS 24
+
+typedef struct hvm_jit_queue {
+  hvm_vm *vm;
+  /// Whether traces are compiled on the compiler thread
+  bool background;
+  /// What compiles each trace (hvm_jit_compile_trace unless it's replaced,
+  /// eg. by tests)
+  void (*compile_trace)(hvm_vm *vm, hvm_call_trace *trace);
+  /// Ring buffer of traces waiting to be compiled
+  hvm_call_trace *items[HVM_JIT_QUEUE_SIZE];
+  unsigned int head;
+  unsigned int length;
+  /// Whether the compiler thread is in the middle of a compilation
+  bool compiling;
+  bool compiler_started;
+  pthread_t compiler;
+  pthread_mutex_t lock;
+  /// Signals the compiler thread that there are traces to compile
+  pthread_cond_t wake;
+  /// Signals the VM that the queue has been emptied
+  pthread_cond_t idle;
+  // Statistics (guarded by `lock`)
+  unsigned int length_max;
+  uint64_t queued;
+  uint64_t rejected;
+  uint64_t compiled;
+  uint64_t compile_time_total;
+  uint64_t compile_time_max;
+  uint64_t compile_times[HVM_JIT_COMPILE_TIME_BUCKETS];
+} hvm_jit_queue;
+
+/// Compiler statistics; times are in microseconds.
+typedef struct hvm_jit_stats {
+  /// Traces waiting to be compiled, and the most there have ever been
+  unsigned int queue_depth;
+  unsigned int queue_depth_max;
+  /// Traces handed to the compiler
+  uint64_t queued;
+  /// Times a trace couldn't be queued because the queue was full
+  uint64_t rejected;
+  uint64_t compiled;
+  uint64_t compile_time_total;
+  uint64_t compile_time_max;
+  /// Histogram of compile times (see HVM_JIT_COMPILE_TIME_BUCKETS)
+  uint64_t compile_times[HVM_JIT_COMPILE_TIME_BUCKETS];
+} hvm_jit_stats;
+
+hvm_jit_queue *hvm_new_jit_queue(hvm_vm *vm);
+/// Hand a completed trace to the compiler; the compiler thread is started
+/// by the first one. Returns false if the queue is full. When compiling in
+/// the foreground the trace is compiled before this returns.
+bool hvm_jit_queue_push(hvm_jit_queue *queue, hvm_call_trace *trace);
+/// Block until every queued trace has been compiled. The compiler reads the
+/// VM's constant pool, so this is called before the pool is reallocated.
+void hvm_jit_queue_wait(hvm_jit_queue *queue);
+void hvm_jit_get_stats(hvm_jit_queue *queue, hvm_jit_stats *stats);
+
+#endif
@@ -3,6 +3,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <assert.h>
+#include <string.h>
 
 #include "vm.h"
 #include "object.h"
@@ -17,8 +18,15 @@ hvm_call_trace *hvm_new_call_trace(hvm_vm *vm) {
   trace->sequence_length = 0;
   trace->sequence = malloc(sizeof(hvm_trace_sequence_item) * trace->sequence_capacity);
   trace->complete = false;
+  trace->unsupported = false;
+  trace->abandoned = false;
+  trace->index = 0;
   trace->caller_tag = NULL;
+  trace->parent = NULL;
+  trace->side_exits_length = 0;
   trace->compiled_function = NULL;
+  trace->queued = false;
+  trace->native_function = NULL;
   return trace;
 }
 
@@ -30,6 +38,25 @@ void hvm_jit_call_trace_check_expand_capacity(hvm_call_trace *trace) {
   }
 }
 
+hvm_jit_side_exit *hvm_jit_trace_side_exit(hvm_call_trace *trace, uint64_t destination) {
+  hvm_jit_side_exit *side_exit;
+  for(unsigned int i = 0; i < trace->side_exits_length; i++) {
+    side_exit = &trace->side_exits[i];
+    if(side_exit->destination == destination) {
+      return side_exit;
+    }
+  }
+  if(trace->side_exits_length == HVM_JIT_MAX_SIDE_EXITS) {
+    return NULL;
+  }
+  side_exit = &trace->side_exits[trace->side_exits_length];
+  trace->side_exits_length += 1;
+  side_exit->destination = destination;
+  side_exit->count       = 0;
+  side_exit->trace       = NULL;
+  return side_exit;
+}
+
 hvm_trace_sequence_item *hvm_jit_call_trace_find_ip(hvm_call_trace *trace, uint64_t ip) {
   for(unsigned int i = 0; i < trace->sequence_length; i++) {
     hvm_trace_sequence_item *item = &trace->sequence[i];
@@ -40,22 +67,49 @@ hvm_trace_sequence_item *hvm_jit_call_trace_find_ip(hvm_call_trace *trace, uint6
   return NULL;
 }
 
-void hvm_jit_call_trace_push_instruction(hvm_vm *vm, hvm_call_trace *trace) {
+// Register the trace in the VM trace index and point its call's tag at it.
+static void hvm_jit_call_trace_register(hvm_vm *vm, hvm_call_trace *trace) {
+  unsigned short index;
+  // Reuse the slot of a discarded trace if there is one
+  for(index = 1; index <= vm->traces_length; index++) {
+    if(vm->traces[index] == NULL) { break; }
+  }
+  if(index > vm->traces_length) {
+    // Make sure there's space for this trace
+    assert(index < (HVM_MAX_TRACES - 1));
+    vm->traces_length = index;
+  }
+  vm->traces[index] = trace;
+  trace->index = index;
+  // Update the caller's tag with the index if possible
+  if(trace->caller_tag) {
+    // Actually setting the index here (remember it's off-by-one so that
+    // 0 can mean not-set)
+    trace->caller_tag->trace_index = index + 1;
+  }
+}
+
+// Push an item for the instruction at the given IP onto the trace.
+static void hvm_jit_call_trace_push_item(hvm_vm *vm, hvm_call_trace *trace, uint64_t ip) {
   hvm_trace_sequence_item *item, *existing_item;
 
   // Skip tracing if we've already traced this instruction
-  existing_item = hvm_jit_call_trace_find_ip(trace, vm->ip);
+  existing_item = hvm_jit_call_trace_find_ip(trace, ip);
   if(existing_item != NULL) {
     trace->current_item = existing_item;
     return;
   }
 
-  byte instr = vm->program[vm->ip];
+  hvm_instruction *inst = &vm->code[ip];
+  // Superinstructions are traced as the instructions they're made of
+  byte instr = hvm_vm_superinstruction_head(inst->op);
   bool do_increment = true;
   // fprintf(stderr, "trace instruction: %d\n", instr);
   item = &trace->sequence[trace->sequence_length];
+  // Start from zero so that traces can be hashed (see hvm_jit_cache_key)
+  memset(item, 0, sizeof(hvm_trace_sequence_item));
   // Keep track of the instruction the item originally came from
-  item->head.ip = vm->ip;
+  item->head.ip = ip;
   // Also note in the trace that this is the current item for our annotation
   // helpers.
   trace->current_item = item;
@@ -70,58 +124,52 @@ void hvm_jit_call_trace_push_instruction(hvm_vm *vm, hvm_call_trace *trace) {
         item->setsymbol.head.type = HVM_TRACE_SEQUENCE_ITEM_SETSYMBOL;
       }
       // 1B OP | 1B REG | 4B CONST
-      item->setstring.register_return = vm->program[vm->ip + 1];
-      item->setstring.constant        = *(uint32_t*)(&vm->program[vm->ip + 2]);
+      item->setstring.register_return = inst->a;
+      item->setstring.constant        = inst->constant;
       break;
 
     case HVM_OP_INVOKEPRIMITIVE:
       item->invokeprimitive.head.type = HVM_TRACE_SEQUENCE_ITEM_INVOKEPRIMITIVE;
-      item->invokeprimitive.register_symbol = vm->program[vm->ip + 1];
-      item->invokeprimitive.register_return = vm->program[vm->ip + 2];
+      item->invokeprimitive.register_symbol = inst->a;
+      item->invokeprimitive.register_return = inst->b;
       // Look up the symbol of the primitive we're going to be invoking
       // TODO: Actually store the address of the register that's going to be
       //       read so that we can speed up checks in the future.
       hvm_obj_ref *ref = hvm_vm_register_read(vm, item->invokeprimitive.register_symbol);
-      assert(ref->type == HVM_SYMBOL);
-      item->invokeprimitive.symbol_value = ref->data.u64;
+      assert(hvm_obj_type_of(ref) == HVM_SYMBOL);
+      item->invokeprimitive.symbol_value = hvm_obj_symbol_value(ref);
       break;
 
     case HVM_OP_RETURN:
       item->item_return.head.type = HVM_TRACE_SEQUENCE_ITEM_RETURN;
-      item->item_return.register_return = vm->program[vm->ip + 1];
+      item->item_return.register_return = inst->a;
       // Look up the object being returned so we can annotate the trace
       // with its type.
       hvm_obj_ref *return_obj_ref = hvm_vm_register_read(vm, item->item_return.register_return);
-      item->item_return.returning_type = return_obj_ref->type;
+      item->item_return.returning_type = hvm_obj_type_of(return_obj_ref);
       // Mark this trace as complete
       trace->complete = true;
-      // And register an index for it in the VM trace index
-      unsigned short next_index = vm->traces_length + 1;
-      // Make sure there's space for this trace
-      assert(next_index < (HVM_MAX_TRACES - 1));
-      vm->traces[next_index] = trace;
-      // Update the caller's tag with the index if possible
-      if(trace->caller_tag) {
-        hvm_subroutine_tag tag;
-        hvm_subroutine_read_tag(trace->caller_tag, &tag);
-        // Actually setting the index here (remember it's off-by-one so that
-        // 0 can mean not-set)
-        tag.trace_index = next_index + 1;
-        hvm_subroutine_write_tag(trace->caller_tag, &tag);
+      vm->is_tracing = 0;
+      // Side traces are reached through their parent's side exit rather
+      // than a call, so only traces of whole calls are registered
+      if(trace->parent == NULL) {
+        hvm_jit_call_trace_register(vm, trace);
       }
+#ifdef HVM_JIT_DEBUG
       fprintf(stderr, "trace: completed trace %p\n", trace);
+#endif
       break;
 
     case HVM_OP_IF:
       item->item_if.head.type = HVM_TRACE_SEQUENCE_ITEM_IF;
-      item->item_if.register_value = vm->program[vm->ip + 1];
-      item->item_if.destination    = *(uint64_t*)(&vm->program[vm->ip + 2]);
+      item->item_if.register_value = inst->a;
+      item->item_if.destination    = inst->arg.dest;
       item->item_if.branched       = false;
       break;
 
     case HVM_OP_GOTO:
       item->item_goto.head.type   = HVM_TRACE_SEQUENCE_ITEM_GOTO;
-      item->item_goto.destination = *(uint64_t*)(&vm->program[vm->ip + 1]);
+      item->item_goto.destination = inst->arg.dest;
       break;
 
     case HVM_OP_ADD:
@@ -134,75 +182,89 @@ void hvm_jit_call_trace_push_instruction(hvm_vm *vm, hvm_call_trace *trace) {
       if(instr == HVM_OP_LT)  { item->head.type = HVM_TRACE_SEQUENCE_ITEM_LT;  }
       if(instr == HVM_OP_GT)  { item->head.type = HVM_TRACE_SEQUENCE_ITEM_GT;  }
       if(instr == HVM_OP_AND) { item->head.type = HVM_TRACE_SEQUENCE_ITEM_AND; }
-      item->add.register_return   = vm->program[vm->ip + 1];
-      item->add.register_operand1 = vm->program[vm->ip + 2];
-      item->add.register_operand2 = vm->program[vm->ip + 3];
+      item->add.register_return   = inst->a;
+      item->add.register_operand1 = inst->b;
+      item->add.register_operand2 = inst->c;
       break;
 
     case HVM_OP_ARRAYSET:
       item->arrayset.head.type = HVM_TRACE_SEQUENCE_ITEM_ARRAYSET;
-      item->arrayset.register_array = vm->program[vm->ip + 1];
-      item->arrayset.register_index = vm->program[vm->ip + 2];
-      item->arrayset.register_value = vm->program[vm->ip + 3];
+      item->arrayset.register_array = inst->a;
+      item->arrayset.register_index = inst->b;
+      item->arrayset.register_value = inst->c;
       break;
 
     case HVM_OP_ARRAYGET:
       item->arrayget.head.type = HVM_TRACE_SEQUENCE_ITEM_ARRAYGET;
-      item->arrayget.register_return = vm->program[vm->ip + 1];
-      item->arrayget.register_array = vm->program[vm->ip + 2];
-      item->arrayget.register_index = vm->program[vm->ip + 3];
+      item->arrayget.register_return = inst->a;
+      item->arrayget.register_array = inst->b;
+      item->arrayget.register_index = inst->c;
       break;
 
     case HVM_OP_ARRAYLEN:
       item->arraylen.head.type = HVM_TRACE_SEQUENCE_ITEM_ARRAYLEN;
-      item->arraylen.register_return = vm->program[vm->ip + 1];
-      item->arraylen.register_array  = vm->program[vm->ip + 2];
+      item->arraylen.register_return = inst->a;
+      item->arraylen.register_array  = inst->b;
       break;
 
     case HVM_OP_ARRAYPUSH:
       item->arraypush.head.type = HVM_TRACE_SEQUENCE_ITEM_ARRAYPUSH;
-      item->arraypush.register_array = vm->program[vm->ip + 1];
-      item->arraypush.register_value = vm->program[vm->ip + 2];
+      item->arraypush.register_array = inst->a;
+      item->arraypush.register_value = inst->b;
       break;
 
     case HVM_OP_MOVE:
       item->move.head.type = HVM_TRACE_SEQUENCE_ITEM_MOVE;
-      item->move.register_return = vm->program[vm->ip + 1];
-      item->move.register_source = vm->program[vm->ip + 2];
+      item->move.register_return = inst->a;
+      item->move.register_source = inst->b;
       break;
 
     case HVM_OP_LITINTEGER:
       item->litinteger.head.type = HVM_TRACE_SEQUENCE_ITEM_LITINTEGER;
-      item->litinteger.register_return = vm->program[vm->ip + 1];
-      item->litinteger.literal_value   = *(int64_t*)(&vm->program[vm->ip + 2]);
+      item->litinteger.register_return = inst->a;
+      item->litinteger.literal_value   = inst->arg.i64;
       break;
 
     case HVM_OP_GETLOCAL:
       item->getlocal.head.type = HVM_TRACE_SEQUENCE_ITEM_GETLOCAL;
-      item->getlocal.register_return = vm->program[vm->ip + 1];
-      item->getlocal.register_symbol = vm->program[vm->ip + 2];
+      item->getlocal.register_return = inst->a;
+      item->getlocal.register_symbol = inst->b;
       break;
 
     case HVM_OP_SETLOCAL:
       item->setlocal.head.type = HVM_TRACE_SEQUENCE_ITEM_SETLOCAL;
-      item->setlocal.register_symbol = vm->program[vm->ip + 1];
-      item->setlocal.register_value  = vm->program[vm->ip + 2];
+      item->setlocal.register_symbol = inst->a;
+      item->setlocal.register_value  = inst->b;
       break;
 
     case HVM_OP_GETGLOBAL:
       item->getglobal.head.type = HVM_TRACE_SEQUENCE_ITEM_GETGLOBAL;
-      item->getglobal.register_return = vm->program[vm->ip + 1];
-      item->getglobal.register_symbol = vm->program[vm->ip + 2];
+      item->getglobal.register_return = inst->a;
+      item->getglobal.register_symbol = inst->b;
       break;
 
     case HVM_OP_SETGLOBAL:
       item->setglobal.head.type = HVM_TRACE_SEQUENCE_ITEM_SETGLOBAL;
-      item->setglobal.register_symbol = vm->program[vm->ip + 1];
-      item->setglobal.register_value  = vm->program[vm->ip + 2];
+      item->setglobal.register_symbol = inst->a;
+      item->setglobal.register_value  = inst->b;
+      break;
+
+    case HVM_OP_GETLOCALSLOT:
+      item->getlocalslot.head.type = HVM_TRACE_SEQUENCE_ITEM_GETLOCALSLOT;
+      item->getlocalslot.register_return = inst->a;
+      item->getlocalslot.slot            = inst->b;
+      break;
+
+    case HVM_OP_SETLOCALSLOT:
+      item->setlocalslot.head.type = HVM_TRACE_SEQUENCE_ITEM_SETLOCALSLOT;
+      item->setlocalslot.slot           = inst->a;
+      item->setlocalslot.register_value = inst->b;
       break;
 
     default:
       fprintf(stderr, "jit-tracer: Don't know what to do with instruction: %d\n", instr);
+      // Compiling the trace without it would silently drop it
+      trace->unsupported = true;
       do_increment = false;
   }
   if(do_increment == true) {
@@ -211,6 +273,17 @@ void hvm_jit_call_trace_push_instruction(hvm_vm *vm, hvm_call_trace *trace) {
   }
 }
 
+void hvm_jit_call_trace_push_instruction(hvm_vm *vm, hvm_call_trace *trace) {
+  byte op = vm->code[vm->ip].op;
+  hvm_jit_call_trace_push_item(vm, trace, vm->ip);
+  // If it's a superinstruction then also trace the instruction it absorbed;
+  // that leaves the absorbed one as the current item for annotations (eg.
+  // the IF of a compare-and-branch).
+  if(hvm_vm_superinstruction_head(op) != op) {
+    hvm_jit_call_trace_push_item(vm, trace, vm->ip + 1);
+  }
+}
+
 void hvm_jit_tracer_before_instruction(hvm_vm *vm) {
   hvm_frame *frame = vm->top;
   if(frame->trace != NULL) {
@@ -219,6 +292,27 @@ void hvm_jit_tracer_before_instruction(hvm_vm *vm) {
   }
 }
 
+void hvm_jit_tracer_abandon_frame(hvm_vm *vm, hvm_frame *frame) {
+  hvm_call_trace *trace = frame->trace;
+  frame->trace   = NULL;
+  vm->is_tracing = 0;
+  trace->abandoned = true;
+  // It'll never be compiled, so its sequence can go
+  free(trace->sequence);
+  trace->sequence          = NULL;
+  trace->current_item      = NULL;
+  trace->sequence_length   = 0;
+  trace->sequence_capacity = 0;
+  // Side traces stay with their side exit, which won't start another one.
+  // A call's trace is registered like a complete one so that its tag
+  // stops the call from being traced again.
+  if(trace->parent == NULL) {
+    hvm_jit_call_trace_register(vm, trace);
+  }
+#ifdef HVM_JIT_DEBUG
+  fprintf(stderr, "trace: abandoned trace %p\n", trace);
+#endif
+}
 
 hvm_trace_sequence_item *hvm_jit_tracer_get_current_item(hvm_vm *vm) {
   hvm_frame *frame              = vm->top;
@@ -235,7 +329,7 @@ void hvm_jit_tracer_annotate_invokeprimitive_returned_type(hvm_vm *vm, hvm_obj_r
   assert(item->head.type == HVM_TRACE_SEQUENCE_ITEM_INVOKEPRIMITIVE);
   // Update the return object type annotation using the object handed to us
   // by the VM.
-  item->invokeprimitive.returned_type = val->type;
+  item->invokeprimitive.returned_type = hvm_obj_type_of(val);
 }
 
 void hvm_jit_tracer_annotate_if_branched(hvm_vm *vm, bool branched) {
@@ -303,7 +397,7 @@ void hvm_jit_tracer_dump_trace(hvm_vm *vm, hvm_call_trace *trace) {
         reg = item->setsymbol.register_return;
         short_symbol_id = item->setsymbol.constant;
         hvm_obj_ref *ref = hvm_const_pool_get_const(&vm->const_pool, short_symbol_id);
-        symbol_name = hvm_desymbolicate(vm->symbols, ref->data.u64);
+        symbol_name = hvm_desymbolicate(vm->symbols, hvm_obj_symbol_value(ref));
         printf("$%-3d = setsymbol(#%d = %s)", reg, short_symbol_id, symbol_name);
         break;
       case HVM_TRACE_SEQUENCE_ITEM_ADD:
@@ -344,6 +438,14 @@ void hvm_jit_tracer_dump_trace(hvm_vm *vm, hvm_call_trace *trace) {
         char *cmp = "==";
         printf("$%-3d = $%-3d %s $%-3d", reg1, reg2, cmp, reg3);
         break;
+      case HVM_TRACE_SEQUENCE_ITEM_GETLOCALSLOT:
+        reg1 = item->getlocalslot.register_return;
+        printf("$%-3d = slot(%d)", reg1, item->getlocalslot.slot);
+        break;
+      case HVM_TRACE_SEQUENCE_ITEM_SETLOCALSLOT:
+        reg1 = item->setlocalslot.register_value;
+        printf("slot(%d) = $%d", item->setlocalslot.slot, reg1);
+        break;
       default:
         break;
     }
@@ -23,7 +23,9 @@ typedef enum {
   HVM_TRACE_SEQUENCE_ITEM_GETLOCAL        = 18,
   HVM_TRACE_SEQUENCE_ITEM_SETLOCAL        = 19,
   HVM_TRACE_SEQUENCE_ITEM_GETGLOBAL       = 20,
-  HVM_TRACE_SEQUENCE_ITEM_SETGLOBAL       = 21
+  HVM_TRACE_SEQUENCE_ITEM_SETGLOBAL       = 21,
+  HVM_TRACE_SEQUENCE_ITEM_GETLOCALSLOT    = 22,
+  HVM_TRACE_SEQUENCE_ITEM_SETLOCALSLOT    = 23
 } hvm_trace_sequence_item_type;
 
 
@@ -171,6 +173,20 @@ typedef struct hvm_trace_sequence_item_setglobal {
   byte register_value;
 } hvm_trace_sequence_item_setglobal;
 
+typedef struct hvm_trace_sequence_item_getlocalslot {
+  hvm_trace_sequence_item_head head;
+  byte register_return;
+  /// Index of the local in the frame's slots
+  byte slot;
+} hvm_trace_sequence_item_getlocalslot;
+
+typedef struct hvm_trace_sequence_item_setlocalslot {
+  hvm_trace_sequence_item_head head;
+  /// Index of the local in the frame's slots
+  byte slot;
+  byte register_value;
+} hvm_trace_sequence_item_setlocalslot;
+
 
 /// @brief Item in a traced instruction sequence.
 ///
@@ -202,6 +218,8 @@ typedef union hvm_trace_sequence_item {
   hvm_trace_sequence_item_setlocal         setlocal;
   hvm_trace_sequence_item_getglobal        getglobal;
   hvm_trace_sequence_item_setglobal        setglobal;
+  hvm_trace_sequence_item_getlocalslot     getlocalslot;
+  hvm_trace_sequence_item_setlocalslot     setlocalslot;
 } hvm_trace_sequence_item;
 
 /// Stores information about a call site (traces, JIT blocks, etc.).
@@ -211,6 +229,24 @@ typedef struct hvm_call_site {
 
 /// Start traces off with space for 64 instructions.
 #define HVM_TRACE_INITIAL_SEQUENCE_SIZE 64
+/// Most side exits that are counted (and can get traces of their own) for
+/// each trace; bailouts to any others are always interpreted.
+#define HVM_JIT_MAX_SIDE_EXITS 8
+/// Number of bailouts through a side exit for it to be hot and traced.
+#define HVM_JIT_SIDE_EXIT_THRESHOLD 8
+
+struct hvm_call_trace;
+
+/// Place a compiled trace bails out to the interpreter from (eg. a branch
+/// that wasn't taken while it was being traced).
+typedef struct hvm_jit_side_exit {
+  /// IP the VM resumes at
+  uint64_t destination;
+  /// Number of times the trace has bailed out here
+  unsigned int count;
+  /// Trace of the rest of the call from `destination`, once it's hot
+  struct hvm_call_trace *trace;
+} hvm_jit_side_exit;
 
 /// Each trace of a subroutine call.
 typedef struct hvm_call_trace {
@@ -226,20 +262,45 @@ typedef struct hvm_call_trace {
   unsigned int sequence_capacity;
   /// Whether or not the trace is done and ready for analysis
   bool complete;
-
-  /// Pointer to the tag in the bytecode of the caller for us to update with
+  /// Whether the trace ran into an instruction the tracer doesn't know; it
+  /// can't be compiled without it, so the call stays interpreted.
+  bool unsupported;
+  /// Whether the call was cut short (by a tail call or an exception) before
+  /// the trace got to its return. The call isn't traced again.
+  bool abandoned;
+  /// Index of the trace in hvm_vm.traces (0 if it isn't registered)
+  unsigned short index;
+
+  /// Pointer to the tag in the caller's instruction for us to update with
   /// the trace's index.
-  byte *caller_tag;
+  hvm_subroutine_tag *caller_tag;
+  /// Trace this one was started from at one of its side exits (NULL if it
+  /// starts at the subroutine's entry). Together they make up a tree.
+  struct hvm_call_trace *parent;
+  hvm_jit_side_exit side_exits[HVM_JIT_MAX_SIDE_EXITS];
+  unsigned int side_exits_length;
 
   /// Pointer to LLVMValueRef for our compiled function
   void *compiled_function;
+  /// Whether the trace has been handed to the compiler
+  bool queued;
+  /// Native code for the trace (a `hvm_jit_native_function`); it's
+  /// published by the compiler thread, so it has to be read atomically.
+  void *native_function;
 } hvm_call_trace;
 
 /// Allocate a new trace. The entry IP will be set to the current VM IP.
 /// The trace is initialized with an empty sequence and marked incomplete.
 hvm_call_trace *hvm_new_call_trace(hvm_vm *vm);
+/// Find the trace's side exit to `destination`, adding it if it's new.
+/// Returns NULL if the trace is out of room for side exits.
+hvm_jit_side_exit *hvm_jit_trace_side_exit(hvm_call_trace *trace, uint64_t destination);
 /// Called by the instruction dispatch loop while in the JIT dispatcher.
 void hvm_jit_tracer_before_instruction(hvm_vm *vm);
+/// Stop tracing the frame's call because the frame is being replaced (by a
+/// tail call) or unwound (by an exception). Its trace is kept so that the
+/// call isn't traced again, but it'll never be compiled.
+void hvm_jit_tracer_abandon_frame(hvm_vm *vm, struct hvm_frame *frame);
 
 // Special hooks for annotating instructions (invoked by the instruction
 // execution code in the JIT dispatcher).
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <string.h>
 
 #include <glib.h>
 #include <jemalloc/jemalloc.h>
@@ -27,7 +28,9 @@ hvm_obj_string *hvm_new_obj_string() {
 
 ALWAYS_INLINE bool _hvm_obj_is_falsey(hvm_obj_ref *ref) {
   // Falsey values are null and integer zero
-  if(ref->type == HVM_NULL) {
+  if(hvm_obj_is_immediate(ref)) {
+    return (ref == HVM_OBJ_NULL || ref == hvm_obj_int_immediate(0));
+  } else if(ref->type == HVM_NULL) {
     return true;
   } else if(ref->type == HVM_INTEGER && ref->data.i64 == 0) {
     return true;
@@ -73,20 +76,27 @@ hvm_obj_array *hvm_new_obj_array() {
   //arr->data[0] = NULL;
   //arr->length = 0;
   arr->array = g_array_new(TRUE, TRUE, sizeof(hvm_obj_ref*));
+  arr->remember_in = NULL;
+  arr->remembered  = false;
+  arr->scanned     = 0;
   return arr;
 }
 hvm_obj_array *hvm_new_obj_array_with_length(hvm_obj_ref *lenref) {
   hvm_obj_array *arr = je_malloc(sizeof(hvm_obj_array));
   guint len;
-  if(lenref->type == HVM_INTEGER) {
-    len = (guint)(lenref->data.i64);
-  } else if(lenref->type == HVM_NULL) {
+  hvm_obj_type type = hvm_obj_type_of(lenref);
+  if(type == HVM_INTEGER) {
+    len = (guint)hvm_obj_int_value(lenref);
+  } else if(type == HVM_NULL) {
     len = 0;
   } else {
     fprintf(stderr, "Invalid object type for length\n");
     assert(false);
   }
   arr->array = g_array_sized_new(TRUE, TRUE, sizeof(hvm_obj_ref*), len);
+  arr->remember_in = NULL;
+  arr->remembered  = false;
+  arr->scanned     = 0;
   // Pre-fill the array with nulls
   // TODO: See if we can use `g_array_append_vals` to make this faster
   for(guint i = 0; i < len; i++) {
@@ -97,26 +107,30 @@ hvm_obj_array *hvm_new_obj_array_with_length(hvm_obj_ref *lenref) {
 
 // Push B onto the end of A
 void hvm_obj_array_push(hvm_obj_ref *a, hvm_obj_ref *b) {
-  assert(a->type == HVM_ARRAY);
+  assert(hvm_obj_type_of(a) == HVM_ARRAY);
   hvm_obj_array *arr = a->data.v;
+  hvm_obj_array_write_barrier(arr, b);
   g_array_append_val(arr->array, b);
 }
 void hvm_obj_array_unshift(hvm_obj_ref *a, hvm_obj_ref *b) {
-  assert(a->type == HVM_ARRAY);
+  assert(hvm_obj_type_of(a) == HVM_ARRAY);
   hvm_obj_array *arr = a->data.v;
+  hvm_obj_array_write_barrier(arr, b);
   g_array_prepend_val(arr->array, b);
 }
 
 hvm_obj_ref* hvm_obj_array_shift(hvm_obj_ref *a) {
-  assert(a->type == HVM_ARRAY);
+  assert(hvm_obj_type_of(a) == HVM_ARRAY);
   hvm_obj_array *arr = a->data.v;
+  hvm_obj_array_write_barrier(arr, NULL);
   hvm_obj_ref *ptr = g_array_index(arr->array, hvm_obj_ref*, 0);
   g_array_remove_index(arr->array, 0);
   return ptr;
 }
 hvm_obj_ref* hvm_obj_array_pop(hvm_obj_ref *a) {
-  assert(a->type == HVM_ARRAY);
+  assert(hvm_obj_type_of(a) == HVM_ARRAY);
   hvm_obj_array *arr = a->data.v;
+  hvm_obj_array_write_barrier(arr, NULL);
   guint end = arr->array->len - 1;
   hvm_obj_ref *ptr = g_array_index(arr->array, hvm_obj_ref*, end);
   g_array_remove_index(arr->array, end);
@@ -126,58 +140,56 @@ hvm_obj_ref* hvm_obj_array_pop(hvm_obj_ref *a) {
 hvm_obj_ref* hvm_obj_array_len(hvm_vm *vm, hvm_obj_ref *a) {
   hvm_obj_array *arr = a->data.v;
   guint len = arr->array->len;
-  hvm_obj_ref *intval = hvm_new_obj_int(vm);
-  intval->data.i64 = (int64_t)len;
-  return intval;
+  return hvm_new_obj_int_value(vm, (int64_t)len);
 }
 
 hvm_obj_ref* hvm_obj_array_get(hvm_obj_ref *arrref, hvm_obj_ref *idxref) {
-  assert(arrref->type == HVM_ARRAY); assert(idxref->type == HVM_INTEGER);
-  return _hvm_obj_array_internal_get(arrref->data.v, (uint64_t)(idxref->data.i64));
+  assert(hvm_obj_type_of(arrref) == HVM_ARRAY); assert(hvm_obj_type_of(idxref) == HVM_INTEGER);
+  return _hvm_obj_array_internal_get(arrref->data.v, (uint64_t)hvm_obj_int_value(idxref));
 }
 
 hvm_obj_ref* hvm_obj_array_remove(hvm_obj_ref *arrref, hvm_obj_ref *idxref) {
-  assert(arrref->type == HVM_ARRAY); assert(idxref->type == HVM_INTEGER);
+  assert(hvm_obj_type_of(arrref) == HVM_ARRAY); assert(hvm_obj_type_of(idxref) == HVM_INTEGER);
   hvm_obj_array *arr = arrref->data.v;
   guint idx, len;
-  idx = (guint)(idxref->data.i64);
+  idx = (guint)hvm_obj_int_value(idxref);
   len = arr->array->len;
   assert(idx < len);
+  hvm_obj_array_write_barrier(arr, NULL);
   hvm_obj_ref *ptr = g_array_index(arr->array, hvm_obj_ref*, idx);
   g_array_remove_index(arr->array, idx);
   return ptr;
 }
 
 void hvm_obj_array_set(hvm_obj_ref *arrref, hvm_obj_ref *idxref, hvm_obj_ref *valref) {
-  assert(arrref->type == HVM_ARRAY);
-  assert(idxref->type == HVM_INTEGER);
+  assert(hvm_obj_type_of(arrref) == HVM_ARRAY);
+  assert(hvm_obj_type_of(idxref) == HVM_INTEGER);
   hvm_obj_array *arr = arrref->data.v;
   guint idx, len;
-  idx = (guint)(idxref->data.i64);
+  idx = (guint)hvm_obj_int_value(idxref);
   // Look up the length of the array
   len = arr->array->len;
   assert(idx < len);
+  hvm_obj_array_write_barrier(arr, valref);
   hvm_obj_ref **el = &g_array_index(arr->array, hvm_obj_ref*, idx);
   *el = valref;
 }
 
 void hvm_obj_struct_set(hvm_obj_ref *sref, hvm_obj_ref *key, hvm_obj_ref *val) {
-  assert(sref->type == HVM_STRUCTURE); assert(key->type == HVM_SYMBOL);
+  assert(hvm_obj_type_of(sref) == HVM_STRUCTURE); assert(hvm_obj_type_of(key) == HVM_SYMBOL);
   hvm_obj_struct *strct = sref->data.v;
-  hvm_obj_struct_internal_set(strct, (hvm_symbol_id)(key->data.u64), val);
+  hvm_obj_struct_internal_set(strct, hvm_obj_symbol_value(key), val);
 }
 hvm_obj_ref* hvm_obj_struct_get(hvm_obj_ref *sref, hvm_obj_ref *key) {
-  assert(sref->type == HVM_STRUCTURE); assert(key->type == HVM_SYMBOL);
+  assert(hvm_obj_type_of(sref) == HVM_STRUCTURE); assert(hvm_obj_type_of(key) == HVM_SYMBOL);
   hvm_obj_struct *strct = sref->data.v;
-  return hvm_obj_struct_internal_get(strct, (hvm_symbol_id)(key->data.u64));
+  return hvm_obj_struct_internal_get(strct, hvm_obj_symbol_value(key));
 }
 hvm_obj_ref* hvm_obj_struct_delete(hvm_obj_ref *sref, hvm_obj_ref *key) {
-  assert(sref->type == HVM_STRUCTURE); assert(key->type == HVM_SYMBOL);
+  assert(hvm_obj_type_of(sref) == HVM_STRUCTURE); assert(hvm_obj_type_of(key) == HVM_SYMBOL);
   hvm_obj_struct *strct = sref->data.v;
-  hvm_symbol_id   sym = key->data.u64;
-  hvm_obj_ref    *val = hvm_obj_struct_internal_get(strct, sym);
-  hvm_obj_struct_internal_set(strct, sym, hvm_const_null);
-  return val;
+  hvm_symbol_id   sym = hvm_obj_symbol_value(key);
+  return hvm_obj_struct_internal_delete(strct, sym);
 }
 
 
@@ -186,197 +198,279 @@ hvm_obj_ref *hvm_new_obj_int(hvm_vm *vm) {
   hvm_obj_ref *ref = hvm_obj_ref_new_from_pool(vm);
   ref->type = HVM_INTEGER;
   ref->data.i64 = zero;
-  ref->flags = 0x0;
+  return ref;
+}
+hvm_obj_ref *hvm_new_obj_int_value(hvm_vm *vm, int64_t value) {
+  if(hvm_obj_int_fits_immediate(value)) {
+    return hvm_obj_int_immediate(value);
+  }
+  // Only box integers that won't fit in the tagged representation
+  hvm_obj_ref *ref = hvm_new_obj_int(vm);
+  ref->data.i64 = value;
   return ref;
 }
 
 hvm_obj_ref *hvm_obj_cmp_and(hvm_vm *vm, hvm_obj_ref *a, hvm_obj_ref *b) {
-  // Integer value for the result
-  hvm_obj_ref *val = hvm_new_obj_int(vm);
   // Do our truthy test (using always-inlined _hvm_obj_is_truthy)
-  val->data.i64 = (int64_t)((_hvm_obj_is_truthy(a) && _hvm_obj_is_truthy(b)) ? 1 : 0);
-  return val;
+  return hvm_obj_int_immediate((_hvm_obj_is_truthy(a) && _hvm_obj_is_truthy(b)) ? 1 : 0);
 }
 
 #define INT_TYPE_CHECK assert(a != NULL); \
                        assert(b != NULL); \
-                       if(a->type != HVM_INTEGER || b->type != HVM_INTEGER) { return NULL; }
-
-hvm_obj_ref *hvm_obj_int_add(hvm_vm *vm, hvm_obj_ref *a, hvm_obj_ref *b) {
-  INT_TYPE_CHECK;
-  hvm_obj_ref *c = hvm_obj_ref_new_from_pool(vm);
-  int64_t av, bv, cv;
-  av = a->data.i64;
-  bv = b->data.i64;
-  cv = av + bv;
-  c->type = HVM_INTEGER;
-  c->data.i64 = cv;
-  c->flags = 0x0;
-  return c;
-}
-hvm_obj_ref *hvm_obj_int_sub(hvm_vm *vm, hvm_obj_ref *a, hvm_obj_ref *b) {
-  INT_TYPE_CHECK;
-  hvm_obj_ref *c = hvm_obj_ref_new_from_pool(vm);
-  int64_t av, bv, cv;
-  av = a->data.i64;
-  bv = b->data.i64;
-  cv = av - bv;
-  c->type = HVM_INTEGER;
-  c->data.i64 = cv;
-  c->flags = 0x0;
-  return c;
-}
-hvm_obj_ref *hvm_obj_int_mul(hvm_vm *vm, hvm_obj_ref *a, hvm_obj_ref *b) {
-  INT_TYPE_CHECK;
-  hvm_obj_ref *c = hvm_obj_ref_new_from_pool(vm);
-  int64_t av, bv, cv;
-  av = a->data.i64;
-  bv = b->data.i64;
-  cv = av * bv;
-  c->type = HVM_INTEGER;
-  c->data.i64 = cv;
-  c->flags = 0x0;
-  return c;
-}
-hvm_obj_ref *hvm_obj_int_div(hvm_vm *vm, hvm_obj_ref *a, hvm_obj_ref *b) {
-  INT_TYPE_CHECK;
-  hvm_obj_ref *c = hvm_obj_ref_new_from_pool(vm);
-  int64_t av, bv, cv;
-  av = a->data.i64;
-  bv = b->data.i64;
-  cv = av / bv;
-  c->type = HVM_INTEGER;
-  c->data.i64 = cv;
-  c->flags = 0x0;
-  return c;
-}
-hvm_obj_ref *hvm_obj_int_mod(hvm_vm *vm, hvm_obj_ref *a, hvm_obj_ref *b) {
-  INT_TYPE_CHECK;
-  hvm_obj_ref *c = hvm_obj_ref_new_from_pool(vm);
-  int64_t av, bv, cv;
-  av = a->data.i64;
-  bv = b->data.i64;
-  cv = av % bv;
-  c->type = HVM_INTEGER;
-  c->data.i64 = cv;
-  c->flags = 0x0;
-  return c;
-}
-#define INT_COMPARISON_OP_HEAD hvm_obj_ref *c = hvm_obj_ref_new_from_pool(vm); \
-                               c->type  = HVM_INTEGER; \
-                               c->flags = 0x0; \
-                               int64_t av, bv, cv; \
-                               av = a->data.i64; \
-                               bv = b->data.i64;
-hvm_obj_ref *hvm_obj_int_lt(hvm_vm *vm, hvm_obj_ref *a, hvm_obj_ref *b) {
-  INT_TYPE_CHECK;
-  INT_COMPARISON_OP_HEAD;
-  cv = av < bv;
-  c->data.i64 = cv;
-  return c;
-}
-hvm_obj_ref *hvm_obj_int_gt(hvm_vm *vm, hvm_obj_ref *a, hvm_obj_ref *b) {
-  INT_TYPE_CHECK;
-  INT_COMPARISON_OP_HEAD;
-  cv = av > bv;
-  c->data.i64 = cv;
-  return c;
-}
-hvm_obj_ref *hvm_obj_int_lte(hvm_vm *vm, hvm_obj_ref *a, hvm_obj_ref *b) {
-  INT_TYPE_CHECK;
-  INT_COMPARISON_OP_HEAD;
-  cv = av <= bv;
-  c->data.i64 = cv;
-  return c;
-}
-hvm_obj_ref *hvm_obj_int_gte(hvm_vm *vm, hvm_obj_ref *a, hvm_obj_ref *b) {
-  INT_TYPE_CHECK;
-  INT_COMPARISON_OP_HEAD;
-  cv = av >= bv;
-  c->data.i64 = cv;
-  return c;
-}
-hvm_obj_ref *hvm_obj_int_eq(hvm_vm *vm, hvm_obj_ref *a, hvm_obj_ref *b) {
-  INT_TYPE_CHECK;
-  INT_COMPARISON_OP_HEAD;
-  cv = av == bv;
-  c->data.i64 = cv;
-  return c;
-}
+                       if(hvm_obj_type_of(a) != HVM_INTEGER || hvm_obj_type_of(b) != HVM_INTEGER) { return NULL; }
+
+// Results are tagged immediates unless they overflow into needing a box.
+#define INT_ARITHMETIC_OP(NAME, OP) \
+  hvm_obj_ref *NAME(hvm_vm *vm, hvm_obj_ref *a, hvm_obj_ref *b) { \
+    INT_TYPE_CHECK; \
+    int64_t av, bv; \
+    av = hvm_obj_int_value(a); \
+    bv = hvm_obj_int_value(b); \
+    return hvm_new_obj_int_value(vm, av OP bv); \
+  }
+// Comparison results are always 0 or 1 so never need to be boxed.
+#define INT_COMPARISON_OP(NAME, OP) \
+  hvm_obj_ref *NAME(hvm_vm *vm, hvm_obj_ref *a, hvm_obj_ref *b) { \
+    INT_TYPE_CHECK; \
+    int64_t av, bv; \
+    av = hvm_obj_int_value(a); \
+    bv = hvm_obj_int_value(b); \
+    return hvm_obj_int_immediate(av OP bv); \
+  }
+
+INT_ARITHMETIC_OP(hvm_obj_int_add, +)
+INT_ARITHMETIC_OP(hvm_obj_int_sub, -)
+INT_ARITHMETIC_OP(hvm_obj_int_mul, *)
+INT_ARITHMETIC_OP(hvm_obj_int_div, /)
+INT_ARITHMETIC_OP(hvm_obj_int_mod, %)
+
+INT_COMPARISON_OP(hvm_obj_int_lt,  <)
+INT_COMPARISON_OP(hvm_obj_int_gt,  >)
+INT_COMPARISON_OP(hvm_obj_int_lte, <=)
+INT_COMPARISON_OP(hvm_obj_int_gte, >=)
+INT_COMPARISON_OP(hvm_obj_int_eq,  ==)
 
 // STRUCTS --------------------------------------------------------------------
 
+static inline void hvm_obj_struct_alloc(hvm_obj_struct *strct, unsigned int capacity) {
+  // Keys and values share one zeroed allocation: keys first, then values
+  strct->capacity = capacity;
+  strct->keys     = je_calloc(1, HVM_STRUCT_MEMORY_SIZE(capacity));
+  strct->values   = (hvm_obj_ref**)(strct->keys + capacity);
+}
 hvm_obj_struct *hvm_new_obj_struct() {
   hvm_obj_struct *strct = je_malloc(sizeof(hvm_obj_struct));
-  strct->heap_length = 0;
-  strct->heap_size = HVM_STRUCT_INITIAL_HEAP_SIZE;
-  strct->heap = je_malloc(HVM_STRUCT_HEAP_MEMORY_SIZE(strct->heap_size));
-  strct->heap[0] = NULL;
+  strct->shape  = NULL;
+  strct->length = 0;
+  strct->remember_in = NULL;
+  strct->remembered  = false;
+  strct->scanned     = 0;
+  hvm_obj_struct_alloc(strct, HVM_STRUCT_INITIAL_CAPACITY);
   return strct;
 }
-void hvm_obj_struct_internal_grow_heap(hvm_obj_struct *strct) {
-  strct->heap_size = strct->heap_size * HVM_STRUCT_HEAP_GROWTH_RATE;
-  strct->heap = je_realloc(strct->heap, HVM_STRUCT_HEAP_MEMORY_SIZE(strct->heap_size));
+hvm_obj_struct *hvm_new_obj_struct_shaped(hvm_obj_shape *root) {
+  assert(root->length == 0);
+  hvm_obj_struct *strct = je_malloc(sizeof(hvm_obj_struct));
+  strct->shape    = root;
+  strct->keys     = NULL;
+  strct->length   = 0;
+  strct->capacity = HVM_STRUCT_INITIAL_CAPACITY;
+  strct->values   = je_malloc(sizeof(hvm_obj_ref*) * strct->capacity);
+  strct->remember_in = NULL;
+  strct->remembered  = false;
+  strct->scanned     = 0;
+  return strct;
+}
+
+// SHAPES ---------------------------------------------------------------------
+
+static hvm_obj_shape *hvm_new_obj_shape(hvm_obj_shape *parent, unsigned int length) {
+  hvm_obj_shape *shape = je_malloc(sizeof(hvm_obj_shape));
+  shape->parent       = parent;
+  shape->length       = length;
+  shape->keys         = (length > 0) ? je_malloc(sizeof(hvm_symbol_id) * length) : NULL;
+  shape->children     = NULL;
+  shape->next_sibling = NULL;
+  return shape;
+}
+hvm_obj_shape *hvm_new_obj_shape_root() {
+  return hvm_new_obj_shape(NULL, 0);
+}
+uint32_t hvm_obj_shape_slot(hvm_obj_shape *shape, hvm_symbol_id id) {
+  for(uint32_t i = 0; i < shape->length; i++) {
+    if(shape->keys[i] == id) { return i; }
+  }
+  return HVM_SHAPE_NO_SLOT;
+}
+hvm_obj_shape *hvm_obj_shape_transition(hvm_obj_shape *shape, hvm_symbol_id id) {
+  if(shape->length >= HVM_SHAPE_MAX_SLOTS) { return NULL; }
+  hvm_obj_shape *child;
+  for(child = shape->children; child != NULL; child = child->next_sibling) {
+    if(child->keys[shape->length] == id) { return child; }
+  }
+  // First structure to take this path; build the child shape
+  child = hvm_new_obj_shape(shape, shape->length + 1);
+  memcpy(child->keys, shape->keys, sizeof(hvm_symbol_id) * shape->length);
+  child->keys[shape->length] = id;
+  child->next_sibling = shape->children;
+  shape->children     = child;
+  return child;
+}
+
+// DICTIONARY MODE ------------------------------------------------------------
+
+// Home slot for a key; symbol IDs are dense so they get scrambled with a
+// Fibonacci hash to spread them over the table.
+static inline unsigned int hvm_obj_struct_home(hvm_obj_struct *strct, hvm_symbol_id id) {
+  return (unsigned int)((id * 0x9E3779B97F4A7C15ULL) >> 32) & (strct->capacity - 1);
+}
+// Slot holding the key, or the empty slot where it would be inserted.
+static inline unsigned int hvm_obj_struct_find(hvm_obj_struct *strct, hvm_symbol_id id) {
+  unsigned int mask = strct->capacity - 1;
+  unsigned int idx  = hvm_obj_struct_home(strct, id);
+  while(strct->keys[idx] != 0 && strct->keys[idx] != id) {
+    idx = (idx + 1) & mask;
+  }
+  return idx;
+}
+
+void hvm_obj_struct_internal_grow(hvm_obj_struct *strct) {
+  hvm_symbol_id *old_keys     = strct->keys;
+  hvm_obj_ref  **old_values   = strct->values;
+  unsigned int   old_capacity = strct->capacity;
+  hvm_obj_struct_alloc(strct, old_capacity * HVM_STRUCT_GROWTH_RATE);
+  // Reinsert everything into the new table
+  for(unsigned int i = 0; i < old_capacity; i++) {
+    if(old_keys[i] == 0) { continue; }
+    unsigned int idx = hvm_obj_struct_find(strct, old_keys[i]);
+    strct->keys[idx]   = old_keys[i];
+    strct->values[idx] = old_values[i];
+  }
+  je_free(old_keys);
+}
+static void hvm_obj_struct_dict_set(hvm_obj_struct *strct, hvm_symbol_id id, hvm_obj_ref *obj) {
+  unsigned int idx = hvm_obj_struct_find(strct, id);
+  if(strct->keys[idx] == id) {
+    // Existing key gets updated in place
+    strct->values[idx] = obj;
+    return;
+  }
+  if(strct->length >= HVM_STRUCT_MAX_LOAD(strct->capacity)) {
+    hvm_obj_struct_internal_grow(strct);
+    idx = hvm_obj_struct_find(strct, id);
+  }
+  strct->keys[idx]   = id;
+  strct->values[idx] = obj;
+  strct->length += 1;
+}
+static hvm_obj_ref *hvm_obj_struct_dict_delete(hvm_obj_struct *strct, hvm_symbol_id id) {
+  unsigned int mask = strct->capacity - 1;
+  unsigned int idx  = hvm_obj_struct_find(strct, id);
+  if(strct->keys[idx] != id) { return NULL; }
+  hvm_obj_ref *val = strct->values[idx];
+  // Shift later members of the probe run back into the hole so lookups
+  // never need tombstones
+  unsigned int next = idx;
+  while(true) {
+    next = (next + 1) & mask;
+    if(strct->keys[next] == 0) { break; }
+    unsigned int home = hvm_obj_struct_home(strct, strct->keys[next]);
+    // Leave it alone if its home lies cyclically within (idx, next]
+    bool in_place = (idx <= next) ? (idx < home && home <= next)
+                                  : (idx < home || home <= next);
+    if(in_place) { continue; }
+    strct->keys[idx]   = strct->keys[next];
+    strct->values[idx] = strct->values[next];
+    idx = next;
+  }
+  strct->keys[idx]   = 0;
+  strct->values[idx] = NULL;
+  strct->length -= 1;
+  return val;
+}
+
+// Move a shaped structure's values into a hash table.
+static void hvm_obj_struct_to_dictionary(hvm_obj_struct *strct) {
+  hvm_obj_shape *shape  = strct->shape;
+  hvm_obj_ref  **values = strct->values;
+  unsigned int   length = strct->length;
+  unsigned int capacity = HVM_STRUCT_INITIAL_CAPACITY;
+  while(HVM_STRUCT_MAX_LOAD(capacity) <= length) {
+    capacity = capacity * HVM_STRUCT_GROWTH_RATE;
+  }
+  strct->shape  = NULL;
+  strct->length = 0;
+  hvm_obj_struct_alloc(strct, capacity);
+  for(unsigned int i = 0; i < length; i++) {
+    hvm_obj_struct_dict_set(strct, shape->keys[i], values[i]);
+  }
+  je_free(values);
+}
+
+// STRUCT INTERFACE -----------------------------------------------------------
+
+void hvm_obj_struct_reserve_slots(hvm_obj_struct *strct, unsigned int slots) {
+  assert(strct->shape != NULL);
+  if(slots <= strct->capacity) { return; }
+  while(strct->capacity < slots) {
+    strct->capacity = strct->capacity * HVM_STRUCT_GROWTH_RATE;
+  }
+  strct->values = je_realloc(strct->values, sizeof(hvm_obj_ref*) * strct->capacity);
 }
 void hvm_obj_struct_internal_set(hvm_obj_struct *strct, hvm_symbol_id id, hvm_obj_ref *obj) {
-  while(strct->heap_length >= strct->heap_size) {
-    hvm_obj_struct_internal_grow_heap(strct);
-  }
-  // Create the pair
-  hvm_obj_struct_heap_pair *pair = je_malloc(sizeof(hvm_obj_struct_heap_pair));
-  pair->id = id;
-  pair->obj = obj;
-  // Start at the bottom
-  unsigned int idx = strct->heap_length;
-  // Swap with parent if it's less than its parent
-  while(idx > 0 && id < strct->heap[idx / 2]->id) {
-    strct->heap[idx] = strct->heap[idx / 2];
-    idx = idx / 2;
-  }
-  strct->heap[idx] = pair;
-  strct->heap_length += 1;
+  assert(id != 0);
+  hvm_obj_struct_write_barrier(strct, obj);
+  hvm_obj_shape *shape = strct->shape;
+  if(shape != NULL) {
+    uint32_t slot = hvm_obj_shape_slot(shape, id);
+    if(slot != HVM_SHAPE_NO_SLOT) {
+      strct->values[slot] = obj;
+      return;
+    }
+    hvm_obj_shape *next = hvm_obj_shape_transition(shape, id);
+    if(next != NULL) {
+      hvm_obj_struct_reserve_slots(strct, next->length);
+      strct->values[shape->length] = obj;
+      strct->shape  = next;
+      strct->length = next->length;
+      return;
+    }
+    // Too many keys to be worth a shape
+    hvm_obj_struct_to_dictionary(strct);
+  }
+  hvm_obj_struct_dict_set(strct, id, obj);
 }
 hvm_obj_ref *hvm_obj_struct_internal_get(hvm_obj_struct *strct, hvm_symbol_id id) {
-  // Definitely not there if it's empty
-  if(strct->heap_length == 0) { return NULL; }
-
-  // Using binary search
-  unsigned int min, max, mid;
-  hvm_symbol_id i;
-
-  min = 0;
-  max = strct->heap_length - 1;
-  while(min < max) {
-    // Calculate midpoint of current range
-    mid = min + ((max - min) / 2);
-    // Sanity check
-    assert(mid < max);
-    // Branching to halves
-    i = strct->heap[mid]->id;
-    if(i < id) {
-      // If the middle is less than the target take the right half.
-      min = mid + 1;
-    } else {
-      max = mid;
-    }
+  if(strct->shape != NULL) {
+    uint32_t slot = hvm_obj_shape_slot(strct->shape, id);
+    return (slot != HVM_SHAPE_NO_SLOT) ? strct->values[slot] : NULL;
   }
-  if(max == min) {
-    i = strct->heap[min]->id;
-    if(i == id) {
-      return strct->heap[min]->obj;
-    }
+  unsigned int idx = hvm_obj_struct_find(strct, id);
+  return (strct->keys[idx] == id) ? strct->values[idx] : NULL;
+}
+hvm_obj_ref *hvm_obj_struct_internal_delete(hvm_obj_struct *strct, hvm_symbol_id id) {
+  hvm_obj_struct_write_barrier(strct, NULL);
+  if(strct->shape != NULL) {
+    if(hvm_obj_shape_slot(strct->shape, id) == HVM_SHAPE_NO_SLOT) { return NULL; }
+    // Shapes only ever grow, so deleting drops to dictionary mode
+    hvm_obj_struct_to_dictionary(strct);
   }
-  return NULL;
+  return hvm_obj_struct_dict_delete(strct, id);
+}
+void hvm_obj_struct_clear(hvm_obj_struct *strct) {
+  assert(strct->shape == NULL);
+  if(strct->length == 0) { return; }
+  // Keys and values are a single allocation
+  memset(strct->keys, 0, HVM_STRUCT_MEMORY_SIZE(strct->capacity));
+  strct->length = 0;
 }
 
 void hvm_obj_print_structure(hvm_vm *vm, hvm_obj_struct *strct) {
-  hvm_obj_struct_heap_pair *pair;
-  unsigned int idx = 0;
   fprintf(stderr, "struct(%p):\n", strct);
-  while(idx < strct->heap_length) {
-    pair = strct->heap[idx];
-    fprintf(stderr, "  %llu = %p (sym: %s)\n", pair->id, pair->obj, hvm_desymbolicate(vm->symbols, pair->id));
-    idx++;
+  for(unsigned int idx = 0; idx < hvm_obj_struct_slot_count(strct); idx++) {
+    hvm_symbol_id id = hvm_obj_struct_slot_key(strct, idx);
+    if(id == 0) { continue; }
+    fprintf(stderr, "  %llu = %p (sym: %s)\n", id, strct->values[idx], hvm_desymbolicate(vm->symbols, id));
   }
 }
 
@@ -387,7 +481,7 @@ hvm_obj_ref *hvm_new_obj_ref() {
   ref->type = HVM_NULL;
   ref->data.u64 = 0;
   ref->flags = 0;
-  ref->entry = NULL;
+  ref->gc = 0;
   return ref;
 }
 void hvm_obj_ref_set_string(hvm_obj_ref *ref, hvm_obj_string *str) {
@@ -395,8 +489,8 @@ void hvm_obj_ref_set_string(hvm_obj_ref *ref, hvm_obj_string *str) {
   ref->data.v = str;
 }
 
-hvm_obj_ref *hvm_new_obj_ref_string_data(char *data) {
-  hvm_obj_ref    *obj = hvm_new_obj_ref();
+hvm_obj_ref *hvm_new_obj_ref_string_data(hvm_vm *vm, char *data) {
+  hvm_obj_ref    *obj = hvm_obj_ref_new_from_pool(vm);
   hvm_obj_string *str = hvm_new_obj_string();
   str->data = data;
   hvm_obj_ref_set_string(obj, str);
@@ -408,164 +502,201 @@ hvm_obj_ref *hvm_new_obj_ref_string_data(char *data) {
 #define POOL hvm_obj_ref_pool
 
 // Forward delcarations of private functions
-static ZONE *pool_find_next_earliest_free(POOL *pool, ZONE *zone);
-
-ZONE *hvm_obj_ref_pool_zone_new() {
-  ZONE *zone          = je_malloc(sizeof(ZONE));
-  zone->refs          = je_malloc(sizeof(hvm_obj_ref) * HVM_OBJ_REF_POOL_ZONE_SIZE);
-  // Earliest free index in the zone is the first since it's empty
-  zone->earliest_free = 0;
-  zone->prev          = NULL;
-  zone->next          = NULL;
+static ZONE *pool_add_zone(POOL *pool);
+static void pool_zone_release_ref(ZONE *zone, hvm_obj_ref *ref);
+
+static ZONE *hvm_obj_ref_pool_zone_new(POOL *pool) {
+  void *mem = NULL;
+  // Zones are aligned to their size so that hvm_obj_ref_pool_zone_of() can
+  // find them from any of their references
+  int err = je_posix_memalign(&mem, HVM_OBJ_REF_POOL_ZONE_BYTES, HVM_OBJ_REF_POOL_ZONE_BYTES);
+  if(err != 0) {
+    fprintf(stderr, "Failed to allocate object reference pool zone\n");
+    assert(err == 0);
+  }
+  ZONE *zone           = mem;
+  zone->pool           = pool;
+  zone->free_list      = NULL;
+  zone->bump           = 0;
+  zone->used           = 0;
+  zone->available      = false;
+  zone->next_available = NULL;
+  zone->prev           = NULL;
+  zone->next           = NULL;
   return zone;
 }
 
 hvm_obj_ref_pool *hvm_obj_ref_pool_new() {
   hvm_obj_ref_pool *pool = je_malloc(sizeof(hvm_obj_ref_pool));
+  pool->head      = NULL;
+  pool->tail      = NULL;
+  pool->available = NULL;
+  pool->zones     = 0;
   // Create the initial zone for the pool too
-  hvm_obj_ref_pool_zone *zone = hvm_obj_ref_pool_zone_new();
-  // And set it to all the right slots
-  pool->head          = zone;
-  pool->tail          = zone;
-  pool->earliest_free = zone;
+  pool_add_zone(pool);
   return pool;
 }
+
+static ZONE *pool_add_zone(POOL *pool) {
+  ZONE *zone = hvm_obj_ref_pool_zone_new(pool);
+  // Append it to the list of all zones
+  zone->prev = pool->tail;
+  if(pool->tail != NULL) {
+    pool->tail->next = zone;
+  } else {
+    pool->head = zone;
+  }
+  pool->tail = zone;
+  pool->zones += 1;
+  // And make it the first place to allocate from
+  zone->available      = true;
+  zone->next_available = pool->available;
+  pool->available      = zone;
+  return zone;
+}
+
 hvm_obj_ref *hvm_obj_ref_new_from_pool(hvm_vm *vm) {
-  return je_malloc(sizeof(hvm_obj_ref));
-  // TODO: Switch to a fast pool allocator
-  /*
-  hvm_obj_ref_pool *pool = vm->ref_pool;
-  // Get the earliest zone with free slots
-  ZONE *zone = pool->earliest_free;
-  // Get the earliest free slot of that zone as our reference
-  hvm_obj_ref *ref = &zone->refs[zone->earliest_free];
-  // Calculate the next earliest free zone since the current is now invalid
-  pool->earliest_free = pool_find_next_earliest_free(pool, zone);
-  // Make sure the ref is all sanitized
-  if(ref->type != HVM_NULL) {
-    fprintf(stderr, "Encountered non-sanitized object reference\n");
-    assert(ref->type == HVM_NULL);
-  }
-  ref->data.v = 0x0;
-  ref->flags  = 0x0;
-  ref->entry  = 0x0;
+  POOL *pool = vm->ref_pool;
+  ZONE *zone = pool->available;
+  hvm_obj_ref *ref;
+  if(zone == NULL) {
+    zone = pool_add_zone(pool);
+  }
+  // Prefer recycling freed slots before touching fresh ones
+  if(zone->free_list != NULL) {
+    // Freed slots are always left with their GC state cleared (and a
+    // collector thread may be reading it)
+    ref = zone->free_list;
+    zone->free_list = ref->data.v;
+  } else {
+    ref = &zone->refs[zone->bump];
+    ref->gc = 0;
+    zone->bump += 1;
+  }
+  zone->used += 1;
+  // Full zones drop off the available list until something is freed in them
+  if(zone->free_list == NULL && zone->bump == HVM_OBJ_REF_POOL_ZONE_SIZE) {
+    pool->available      = zone->next_available;
+    zone->available      = false;
+    zone->next_available = NULL;
+  }
+  ref->type     = HVM_NULL;
+  ref->data.u64 = 0;
+  ref->flags    = HVM_OBJ_FLAG_POOLED;
   return ref;
-  */
 }
 
-ZONE *pool_find_next_earliest_free(POOL *pool, ZONE *zone) {
-  ZONE *last_zone = zone;
-  // Bump it forward since we just used the current free slot in
-  // the caller (`hvm_obj_ref_new_from_pool`).
-  zone->earliest_free += 1;
-  while(zone != NULL) {
-    // Make sure this zone is recorded as the last being processed in case
-    // it turns out to be the last in the list
-    last_zone = zone;
-    // Check if we're out of space
-    if(zone->earliest_free == HVM_OBJ_REF_POOL_ZONE_FULL) {
-      // Advance to the next zone if we're out of space
-      zone = zone->next;
-      continue;
-    }
-    hvm_obj_ref *ref = &zone->refs[zone->earliest_free];
-    if(ref->type == HVM_NULL) {
-      return zone;
-    }
-    zone->earliest_free += 1;
-  }
-  // Make sure we've actually run out of zones
-  if(zone != NULL) {
-    fprintf(stderr, "Failed to fully scan pool zones\n");
-    assert(zone == NULL);
-  }
-  zone = hvm_obj_ref_pool_zone_new();
-  // Update the double-links
-  zone->prev = last_zone;
-  assert(last_zone->next == NULL);
-  last_zone->next = zone;
-  // Update the pool
-  pool->tail = zone;
-  return zone;
+static void pool_zone_release_ref(ZONE *zone, hvm_obj_ref *ref) {
+  assert(zone->used > 0);
+  // Push the slot onto the zone's free list
+  ref->type   = HVM_NULL;
+  ref->flags  = 0x0;
+  ref->data.v = zone->free_list;
+  zone->free_list = ref;
+  zone->used -= 1;
+  // Make the zone available for allocation again if it was full
+  if(!zone->available) {
+    POOL *pool = zone->pool;
+    zone->available      = true;
+    zone->next_available = pool->available;
+    pool->available      = zone;
+  }
 }
 
 void hvm_obj_ref_free(hvm_vm *vm, hvm_obj_ref *ref) {
-  POOL *pool = vm->ref_pool;
-  // Now we need to find the zone for this ref; going to start backwards
-  // from the latest-zone
-  ZONE *zone = pool->tail;
-  while(zone != NULL) {
-    hvm_obj_ref *start = zone->refs;
-    hvm_obj_ref *end   = zone->refs + HVM_OBJ_REF_POOL_ZONE_SIZE;
-    if(ref >= start && ref < end) {
-      // Found the right zone!
-      break;
-    }
-    zone = zone->prev;
+  assert(ref->flags & HVM_OBJ_FLAG_POOLED);
+  ZONE *zone = hvm_obj_ref_pool_zone_of(ref);
+  if(zone->pool != vm->ref_pool) {
+    fprintf(stderr, "Object reference freed to the wrong pool\n");
+    assert(zone->pool == vm->ref_pool);
   }
-  if(zone == NULL) {
-    fprintf(stderr, "Failed to find zone containing object reference\n");
-    assert(zone != NULL);
-  }
-  // Use the address difference from the base of the zone to the pointer to
-  // calculate the index of that pointer
-  intptr_t diff = ref - zone->refs;
-
-  bool valid_diff = (diff >= 0 && diff < HVM_OBJ_REF_POOL_ZONE_SIZE);
-  if(!valid_diff) {
-    fprintf(stderr, "Invalid reference index into zone\n");
-    assert(valid_diff);
-  }
-  // Convert the pointer to an integer offset (ie. index)
-  unsigned int idx = (unsigned int)diff;
-  // Now let's mark it as HVM_NULL and check if we need to update the
-  // .earliest_free of the zone
-  ref->type = HVM_NULL;
-  if(idx < zone->earliest_free) {
-    zone->earliest_free = idx;
-  }
-  // Check if one of this zone's successors is marked as the earliest free zone
-  bool is_earliest = false;
-  ZONE *succ = zone->next;
-  while(succ != NULL) {
-    // Successor is marked as earliest, so this means we're the new earliest
-    if(succ == pool->earliest_free) {
-      is_earliest = true;
-      break;
+  pool_zone_release_ref(zone, ref);
+}
+
+unsigned int hvm_obj_ref_pool_release_empty_zones(POOL *pool) {
+  unsigned int released = 0;
+  ZONE *zone = pool->head;
+  ZONE *next;
+  // Rebuild the available list from scratch while we walk the zones
+  pool->available = NULL;
+  while(zone != NULL) {
+    next = zone->next;
+    if(zone->used == 0 && pool->zones > 1) {
+      // Unlink and free the whole zone at once
+      if(zone->prev != NULL) { zone->prev->next = next; } else { pool->head = next; }
+      if(next != NULL) { next->prev = zone->prev; } else { pool->tail = zone->prev; }
+      pool->zones -= 1;
+      released += 1;
+      je_free(zone);
+    } else {
+      if(zone->used == 0) {
+        // Last zone standing; reset it so it bump-allocates from the start
+        zone->free_list = NULL;
+        zone->bump      = 0;
+      }
+      zone->available = (zone->free_list != NULL || zone->bump < HVM_OBJ_REF_POOL_ZONE_SIZE);
+      if(zone->available) {
+        zone->next_available = pool->available;
+        pool->available      = zone;
+      } else {
+        zone->next_available = NULL;
+      }
     }
-    succ = succ->next;
-  }
-  // We are the earliest free zone in the whole pool
-  if(is_earliest) {
-    pool->earliest_free = zone;
+    zone = next;
   }
+  return released;
 }
 
 // DESTRUCTORS ----------------------------------------------------------------
 
-void hvm_obj_free(hvm_obj_ref *ref) {
+void hvm_obj_free_data(hvm_obj_ref *ref) {
+  // Immediates never live on the heap
+  assert(!hvm_obj_is_immediate(ref));
   // Make sure it's not a special data type
   assert(ref->type != HVM_NULL && ref->type != HVM_SYMBOL && ref->type != HVM_INTERNAL);
   // Complex data structures need their underpinnings freed first
   if(ref->type == HVM_STRUCTURE) {
     hvm_obj_struct_free(ref->data.v);
   } else if(ref->type == HVM_ARRAY) {
-    fprintf(stderr, "hvm_obj_array_free not implemented yet\n");
-    assert(false);
+    hvm_obj_array_free(ref->data.v);
   } else if(ref->type == HVM_EXCEPTION) {
     fprintf(stderr, "HVM_EXCEPTION is deprecated\n");
     assert(false);
     // hvm_exception *exc = ref->data.v;
     // free(exc);
   } else if(ref->type == HVM_STRING) {
-    fprintf(stderr, "hvm_obj_string_free not implemented yet\n");
-    assert(false);
+    hvm_obj_string_free(ref->data.v);
   }
-  je_free(ref);
+}
+void hvm_obj_ref_release(hvm_obj_ref *ref) {
+  if(ref->flags & HVM_OBJ_FLAG_POOLED) {
+    pool_zone_release_ref(hvm_obj_ref_pool_zone_of(ref), ref);
+  } else {
+    je_free(ref);
+  }
+}
+void hvm_obj_free(hvm_obj_ref *ref) {
+  hvm_obj_free_data(ref);
+  hvm_obj_ref_release(ref);
+}
+void hvm_obj_array_free(hvm_obj_array *arr) {
+  // The elements belong to the GC, so only the array itself is freed
+  g_array_free(arr->array, TRUE);
+  je_free(arr);
+}
+void hvm_obj_string_free(hvm_obj_string *str) {
+  // Non-constant strings own their (malloc'ed) data
+  free(str->data);
+  je_free(str);
 }
 void hvm_obj_struct_free(hvm_obj_struct *strct) {
-  // Free the struct's internal heap
-  je_free(strct->heap);
+  if(strct->shape != NULL) {
+    je_free(strct->values);
+  } else {
+    // Keys and values are a single allocation
+    je_free(strct->keys);
+  }
+  je_free(strct);
 }
 
 
@@ -2,10 +2,12 @@
 #define HVM_OBJECT_H
 
 ///@relates hvm_obj_struct
-#define HVM_STRUCT_INITIAL_HEAP_SIZE 8
+#define HVM_STRUCT_INITIAL_CAPACITY 8
 ///@relates hvm_obj_struct
-#define HVM_STRUCT_HEAP_MEMORY_SIZE(S) (S * (sizeof(hvm_symbol_id) + sizeof(void*)))
-#define HVM_STRUCT_HEAP_GROWTH_RATE 2
+#define HVM_STRUCT_MEMORY_SIZE(C) (C * (sizeof(hvm_symbol_id) + sizeof(void*)))
+#define HVM_STRUCT_GROWTH_RATE 2
+/// Grow once more than 3/4 of the slots are in use.
+#define HVM_STRUCT_MAX_LOAD(C) ((C / 4) * 3)
 
 // Objects are either primitive or composite.
 
@@ -40,6 +42,8 @@ union hvm_obj_ref_data {
 /// For INTERNAL objects this tells the GC to not to try to free the memory
 /// at `.data.v`.
 #define HVM_OBJ_FLAG_NO_FOLLOW 0x8
+/// Flags a GC-tracked object as being in the nursery (young generation).
+#define HVM_OBJ_FLAG_YOUNG 0x20
 
 /// Base reference to an object.
 typedef struct hvm_obj_ref {
@@ -49,32 +53,136 @@ typedef struct hvm_obj_ref {
   union hvm_obj_ref_data data;
   /// Internal flags for the reference.
   byte flags;
-  /// Pointer to its entry in the GC heap
-  void *entry;
+  /// Garbage collector state (HVM_GC1_OBJ_OLD/HVM_GC1_OBJ_MARKED). It's only
+  /// changed by the collector, and is kept apart from `flags` so that
+  /// collector threads never write to the same byte as the VM.
+  byte gc;
 } hvm_obj_ref;
 
-
-/// Each zone will hold 65,536 `hvm_obj_ref`
-#define HVM_OBJ_REF_POOL_ZONE_SIZE 65536
-#define HVM_OBJ_REF_POOL_ZONE_FULL HVM_OBJ_REF_POOL_ZONE_SIZE
-
+// TAGGED VALUES --------------------------------------------------------------
+
+// Integers, symbols and null are stored directly in the `hvm_obj_ref*` word
+// (in registers, array slots, struct values, etc.) rather than being boxed
+// on the heap. Boxed references are always at least 8-byte aligned, which
+// leaves their low three bits free for a tag:
+//   ...xxx1  63-bit signed integer (value in the upper 63 bits)
+//   ...x010  symbol (ID in the upper 61 bits)
+//   00..0100 null
+//   ...x000  pointer to a boxed hvm_obj_ref
+// Integers that don't fit in 63 bits are still boxed as HVM_INTEGER, so
+// the accessors below must be used rather than reading `->type` and
+// `->data` directly.
+
+#define HVM_OBJ_TAG_MASK    0x7
+#define HVM_OBJ_TAG_INTEGER 0x1
+#define HVM_OBJ_TAG_SYMBOL  0x2
+#define HVM_OBJ_TAG_NULL    0x4
+/// Immediate null value.
+#define HVM_OBJ_NULL ((hvm_obj_ref*)HVM_OBJ_TAG_NULL)
+/// Range of integers that can be stored as immediates.
+#define HVM_OBJ_INT_IMMEDIATE_MAX (INT64_MAX >> 1)
+#define HVM_OBJ_INT_IMMEDIATE_MIN (INT64_MIN >> 1)
+
+/// Whether the reference is a tagged immediate (ie. not a heap pointer).
+static inline bool hvm_obj_is_immediate(hvm_obj_ref *ref) {
+  return ((uintptr_t)ref & HVM_OBJ_TAG_MASK) != 0;
+}
+static inline bool hvm_obj_is_immediate_int(hvm_obj_ref *ref) {
+  return ((uintptr_t)ref & HVM_OBJ_TAG_INTEGER) != 0;
+}
+/// Type of the value, whether it's immediate or boxed.
+static inline hvm_obj_type hvm_obj_type_of(hvm_obj_ref *ref) {
+  uintptr_t bits = (uintptr_t)ref;
+  if(bits & HVM_OBJ_TAG_INTEGER) { return HVM_INTEGER; }
+  if((bits & HVM_OBJ_TAG_MASK) == HVM_OBJ_TAG_SYMBOL) { return HVM_SYMBOL; }
+  if(bits == HVM_OBJ_TAG_NULL) { return HVM_NULL; }
+  return ref->type;
+}
+/// Value of an immediate or boxed integer.
+static inline int64_t hvm_obj_int_value(hvm_obj_ref *ref) {
+  if(hvm_obj_is_immediate_int(ref)) {
+    // Arithmetic shift to restore the sign
+    return ((int64_t)(intptr_t)ref) >> 1;
+  }
+  return ref->data.i64;
+}
+/// ID of an immediate or boxed symbol.
+static inline hvm_symbol_id hvm_obj_symbol_value(hvm_obj_ref *ref) {
+  if(((uintptr_t)ref & HVM_OBJ_TAG_MASK) == HVM_OBJ_TAG_SYMBOL) {
+    return (hvm_symbol_id)((uintptr_t)ref >> 3);
+  }
+  return (hvm_symbol_id)ref->data.u64;
+}
+static inline bool hvm_obj_int_fits_immediate(int64_t value) {
+  return value >= HVM_OBJ_INT_IMMEDIATE_MIN && value <= HVM_OBJ_INT_IMMEDIATE_MAX;
+}
+/// Tag an integer; the caller must check `hvm_obj_int_fits_immediate` first.
+static inline hvm_obj_ref *hvm_obj_int_immediate(int64_t value) {
+  return (hvm_obj_ref*)(uintptr_t)(((uint64_t)value << 1) | HVM_OBJ_TAG_INTEGER);
+}
+static inline hvm_obj_ref *hvm_obj_symbol_immediate(hvm_symbol_id id) {
+  return (hvm_obj_ref*)(uintptr_t)(((uint64_t)id << 3) | HVM_OBJ_TAG_SYMBOL);
+}
+/// Whether the value is a boxed object in the nursery.
+static inline bool hvm_obj_is_young(hvm_obj_ref *ref) {
+  return ref != NULL && !hvm_obj_is_immediate(ref) && (ref->flags & HVM_OBJ_FLAG_YOUNG) != 0;
+}
+
+
+// REFERENCE POOL -------------------------------------------------------------
+
+// Boxed references are carved out of large zones rather than individually
+// malloc'ed. Each zone is a single block aligned to its own size, so the
+// zone owning any pooled reference is found by masking off the low bits of
+// its address. Freed references go onto an intrusive free list in their
+// zone (linked through `.data.v`), and zones that end up empty after a GC
+// sweep are handed back to the system in bulk.
+
+/// Size (and alignment) in bytes of each zone; must be a power of two.
+#define HVM_OBJ_REF_POOL_ZONE_BYTES (1 << 20)
+/// Number of `hvm_obj_ref` slots that fit in a zone after its header.
+#define HVM_OBJ_REF_POOL_ZONE_SIZE \
+  ((HVM_OBJ_REF_POOL_ZONE_BYTES - sizeof(hvm_obj_ref_pool_zone)) / sizeof(hvm_obj_ref))
+
+/// Marks a reference as having been allocated from a hvm_obj_ref_pool
+/// (rather than by `je_malloc`).
+#define HVM_OBJ_FLAG_POOLED 0x10
+
+/// Header at the start of each zone; its slots follow immediately after.
 typedef struct hvm_obj_ref_pool_zone {
-  hvm_obj_ref *refs;
-  /// Index of the first free slot in this zone, set this to
-  /// HVM_OBJ_REF_POOL_ZONE_FULL to indicate that this zone is full
-  unsigned int earliest_free;
+  /// Pool this zone belongs to.
+  struct hvm_obj_ref_pool *pool;
+  /// Head of the list of freed slots in this zone.
+  hvm_obj_ref *free_list;
+  /// Index of the first never-used slot (slots past it are bump-allocated).
+  unsigned int bump;
+  /// Number of slots currently handed out.
+  unsigned int used;
+  /// Whether the zone is currently on the pool's available list.
+  bool available;
+  /// Next zone in the pool's list of zones with free slots.
+  struct hvm_obj_ref_pool_zone *next_available;
   // Doubly-linked-list to preceding and following zones
-  void *prev;
-  void *next;
+  struct hvm_obj_ref_pool_zone *prev;
+  struct hvm_obj_ref_pool_zone *next;
+  /// Slots for the references.
+  hvm_obj_ref refs[];
 } hvm_obj_ref_pool_zone;
 
 typedef struct hvm_obj_ref_pool {
   hvm_obj_ref_pool_zone *head;
   hvm_obj_ref_pool_zone *tail;
-  /// First zone with empty slots
-  hvm_obj_ref_pool_zone *earliest_free;
+  /// Stack of zones with free slots; allocation always takes from the top.
+  hvm_obj_ref_pool_zone *available;
+  /// Number of zones currently allocated.
+  unsigned int zones;
 } hvm_obj_ref_pool;
 
+/// Zone owning a pooled reference.
+static inline hvm_obj_ref_pool_zone *hvm_obj_ref_pool_zone_of(hvm_obj_ref *ref) {
+  return (hvm_obj_ref_pool_zone*)((uintptr_t)ref & ~((uintptr_t)HVM_OBJ_REF_POOL_ZONE_BYTES - 1));
+}
+
 // TYPES ----------------------------------------------------------------------
 
 typedef struct hvm_obj_string {
@@ -92,29 +200,103 @@ typedef struct hvm_obj_array {
   void *array;
   /// @endcond
 #endif
+  /// Object space to remember young values stored in the array in (set
+  /// once the array is promoted out of the nursery).
+  struct hvm_gc1_obj_space *remember_in;
+  /// Whether the array is already in that remembered set.
+  bool remembered;
+  /// Concurrent marking cycle in which the array's elements were last
+  /// scanned.
+  unsigned int scanned;
   // hvm_obj_ref** data;
   // unsigned int length;
 } hvm_obj_array;
 
-/// Pair of symbol ID and object references in a hvm_obj_struct's heap.
-typedef struct hvm_obj_struct_heap_pair {
-  /// Symbol key
-  hvm_symbol_id id;
-  /// Object value
-  hvm_obj_ref*  obj;
-} hvm_obj_struct_heap_pair;
+/// @brief   Hidden class shared by structures that were given the same keys
+///          in the same order.
+/// @details Shapes form a tree rooted at an empty shape: adding a key to a
+///          structure moves it to the child shape for that key, creating it
+///          the first time. A shape maps each of its keys to a fixed slot
+///          in the structure's value array.
+typedef struct hvm_obj_shape {
+  /// Shape this one was derived from (NULL for the root).
+  struct hvm_obj_shape *parent;
+  /// Keys in slot order (`length` entries).
+  hvm_symbol_id *keys;
+  /// Number of slots.
+  unsigned int length;
+  /// First of the shapes derived from this one (created on first
+  /// transition); each child's key is the last of its `keys`.
+  struct hvm_obj_shape *children;
+  /// Next child of `parent`.
+  struct hvm_obj_shape *next_sibling;
+} hvm_obj_shape;
+
+/// Shapes stop growing at this many slots; adding another key (or deleting
+/// any key) switches a structure over to a hash table.
+#define HVM_SHAPE_MAX_SLOTS 32
+/// Slot index returned when a key isn't in a shape.
+#define HVM_SHAPE_NO_SLOT UINT32_MAX
 
 /// @brief   Structure/table complex data type.
-/// @details `memory size (bytes) = heap_size (pairs) * 2 (words/pair) * 8 (bytes/word)`
+/// @details Structures are in one of two modes:
+///
+///          Shaped (`shape` is non-NULL): values are stored in the slots
+///          given by the shape; `keys` is NULL and `length` is the number
+///          of slots filled.
+///
+///          Dictionary (`shape` is NULL): an open-addressed hash table keyed
+///          by symbol ID with linear probing. Keys and values live in
+///          parallel arrays carved out of a single allocation:
+///          `memory size (bytes) = capacity * (8 (key) + 8 (value))`
 typedef struct hvm_obj_struct {
-  /// Binary heap of symbol-integer-and-pointer pairs.
-  hvm_obj_struct_heap_pair** heap;
-  /// Number of pairs allocated for the binary heap.
-  unsigned int heap_size;
-  /// Number of pairs in the binary heap.
-  unsigned int heap_length;
+  /// Shape of the structure (NULL in dictionary mode).
+  hvm_obj_shape *shape;
+  /// Symbol keys; 0 (never a valid symbol ID) marks an empty slot.
+  hvm_symbol_id *keys;
+  /// Values for the keys in the same slot.
+  hvm_obj_ref  **values;
+  /// Number of slots allocated (always a power of two in dictionary mode).
+  unsigned int capacity;
+  /// Number of keys in the table.
+  unsigned int length;
+  /// Object space to remember young values stored in the structure in (set
+  /// once the structure is promoted out of the nursery).
+  struct hvm_gc1_obj_space *remember_in;
+  /// Whether the structure is already in that remembered set.
+  bool remembered;
+  /// Concurrent marking cycle in which the structure's values were last
+  /// scanned.
+  unsigned int scanned;
 } hvm_obj_struct;
 
+/// Number of entries in `values` to iterate over when walking a structure.
+static inline unsigned int hvm_obj_struct_slot_count(hvm_obj_struct *strct) {
+  return (strct->shape != NULL) ? strct->length : strct->capacity;
+}
+/// Key for an entry in `values` (0 if the entry is empty).
+static inline hvm_symbol_id hvm_obj_struct_slot_key(hvm_obj_struct *strct, unsigned int idx) {
+  return (strct->shape != NULL) ? strct->shape->keys[idx] : strct->keys[idx];
+}
+
+// Old containers holding references to young objects are roots for minor
+// collections, incremental marking needs to know about objects stored into
+// containers it has already scanned, and concurrent marking needs to see a
+// container's contents before they're overwritten. So every change to a
+// structure or array has to go through one of these write barriers *before*
+// it's made (with a NULL value for removals).
+void hvm_gc1_write_barrier(struct hvm_gc1_obj_space*, hvm_obj_type, void*, hvm_obj_ref*);
+static inline void hvm_obj_struct_write_barrier(hvm_obj_struct *strct, hvm_obj_ref *val) {
+  if(strct->remember_in != NULL) {
+    hvm_gc1_write_barrier(strct->remember_in, HVM_STRUCTURE, strct, val);
+  }
+}
+static inline void hvm_obj_array_write_barrier(hvm_obj_array *arr, hvm_obj_ref *val) {
+  if(arr->remember_in != NULL) {
+    hvm_gc1_write_barrier(arr->remember_in, HVM_ARRAY, arr, val);
+  }
+}
+
 
 // CONSTRUCTORS
 hvm_obj_string *hvm_new_obj_string();
@@ -123,10 +305,33 @@ hvm_obj_array *hvm_new_obj_array_with_length(hvm_obj_ref*);
 /// Construct a new structure.
 /// @memberof hvm_obj_struct
 hvm_obj_struct *hvm_new_obj_struct();
+/// Construct a new (empty) structure in shaped mode.
+/// @memberof hvm_obj_struct
+hvm_obj_struct *hvm_new_obj_struct_shaped(hvm_obj_shape *root);
+/// Construct a new root (empty) shape.
+/// @memberof hvm_obj_shape
+hvm_obj_shape *hvm_new_obj_shape_root();
+/// Slot of a key in the shape (or HVM_SHAPE_NO_SLOT).
+/// @memberof hvm_obj_shape
+uint32_t hvm_obj_shape_slot(hvm_obj_shape*, hvm_symbol_id);
+/// Shape reached by adding a key to the given shape (NULL if the shape is
+/// already at HVM_SHAPE_MAX_SLOTS).
+/// @memberof hvm_obj_shape
+hvm_obj_shape *hvm_obj_shape_transition(hvm_obj_shape*, hvm_symbol_id);
+/// Make sure a shaped structure has room for at least the given number of
+/// slots.
+void hvm_obj_struct_reserve_slots(hvm_obj_struct*, unsigned int);
 
 // DESTRUCTORS
 void hvm_obj_free(hvm_obj_ref *ref);
+/// Free just what the reference points to (so that the collector thread
+/// can do it); the reference itself is still in use until it's passed to
+/// `hvm_obj_ref_release`.
+void hvm_obj_free_data(hvm_obj_ref *ref);
+void hvm_obj_ref_release(hvm_obj_ref *ref);
 void hvm_obj_struct_free(hvm_obj_struct*);
+void hvm_obj_array_free(hvm_obj_array*);
+void hvm_obj_string_free(hvm_obj_string*);
 
 bool hvm_obj_is_falsey(hvm_obj_ref *ref);
 bool hvm_obj_is_truthy(hvm_obj_ref *ref);
@@ -134,6 +339,11 @@ bool hvm_obj_is_truthy(hvm_obj_ref *ref);
 // Internal struct manipulation
 hvm_obj_ref *hvm_obj_struct_internal_get(hvm_obj_struct*, hvm_symbol_id);
 void hvm_obj_struct_internal_set(hvm_obj_struct*, hvm_symbol_id, hvm_obj_ref*);
+/// Remove a key from the structure.
+/// @returns Value that was stored for the key (or NULL if it wasn't present)
+hvm_obj_ref *hvm_obj_struct_internal_delete(hvm_obj_struct*, hvm_symbol_id);
+/// Remove every key from a dictionary-mode structure (keeping its capacity).
+void hvm_obj_struct_clear(hvm_obj_struct*);
 // External manipulation (via object refs)
 void hvm_obj_struct_set(hvm_obj_ref*, hvm_obj_ref*, hvm_obj_ref*);
 hvm_obj_ref* hvm_obj_struct_get(hvm_obj_ref*, hvm_obj_ref*);
@@ -146,9 +356,16 @@ void hvm_obj_ref_set_string(hvm_obj_ref*, hvm_obj_string*);
 /// New pool-based `hvm_obj_ref` allocator
 hvm_obj_ref *hvm_obj_ref_new_from_pool(hvm_vm*);
 hvm_obj_ref_pool *hvm_obj_ref_pool_new();
+/// Return a pooled reference to its zone.
 void hvm_obj_ref_free(hvm_vm*, hvm_obj_ref*);
+/// Free every zone that no longer has any references in use (keeping at
+/// least one around for future allocations). Returns the number freed.
+unsigned int hvm_obj_ref_pool_release_empty_zones(hvm_obj_ref_pool*);
 
 hvm_obj_ref *hvm_new_obj_int(hvm_vm*);
+/// Integer with the given value; tagged as an immediate whenever it fits,
+/// otherwise boxed on the heap.
+hvm_obj_ref *hvm_new_obj_int_value(hvm_vm*, int64_t);
 hvm_obj_ref *hvm_obj_int_add(hvm_vm*, hvm_obj_ref*, hvm_obj_ref*);
 hvm_obj_ref *hvm_obj_int_sub(hvm_vm*, hvm_obj_ref*, hvm_obj_ref*);
 hvm_obj_ref *hvm_obj_int_mul(hvm_vm*, hvm_obj_ref*, hvm_obj_ref*);
@@ -175,7 +392,7 @@ uint64_t hvm_array_len(hvm_obj_array *arr);
 hvm_obj_ref* hvm_obj_array_internal_get(hvm_obj_array*, uint64_t);
 
 // UTILITIES ------------------------------------------------------------------
-hvm_obj_ref *hvm_new_obj_ref_string_data(char *data);
+hvm_obj_ref *hvm_new_obj_ref_string_data(hvm_vm*, char *data);
 const char *hvm_human_name_for_obj_type(hvm_obj_type type);
 
 // PRIMITIVE
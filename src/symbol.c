@@ -13,9 +13,42 @@ hvm_symbol_store *hvm_new_symbol_store() {
   st->next_id = 1;
   st->size = HVM_SYMBOL_TABLE_INITIAL_SIZE;
   st->symbols = malloc(sizeof(hvm_symbol_store_entry*) * st->size);
+  st->index_size = HVM_SYMBOL_INDEX_INITIAL_SIZE;
+  st->index = calloc(st->index_size, sizeof(hvm_symbol_id));
   return st;
 }
 
+// FNV-1a
+static inline uint64_t hvm_symbol_hash(char *str) {
+  uint64_t hash = 14695981039346656037ULL;
+  while(*str != '\0') {
+    hash ^= (uint64_t)(unsigned char)*str;
+    hash *= 1099511628211ULL;
+    str++;
+  }
+  return hash;
+}
+
+// Put an entry's ID in the first open bucket of its probe sequence.
+static inline void hvm_symbol_index_insert(hvm_symbol_store *st, hvm_symbol_store_entry *entry) {
+  uint64_t mask = st->index_size - 1;
+  uint64_t i = entry->hash & mask;
+  while(st->index[i] != 0) {
+    i = (i + 1) & mask;
+  }
+  st->index[i] = entry->id;
+}
+
+static void hvm_symbol_index_expand(hvm_symbol_store *st) {
+  free(st->index);
+  st->index_size = st->index_size * HVM_SYMBOL_TABLE_GROWTH_RATE;
+  st->index = calloc(st->index_size, sizeof(hvm_symbol_id));
+  // Rehashing is cheap since every entry carries its hash
+  for(hvm_symbol_id id = 1; id < st->next_id; id++) {
+    hvm_symbol_index_insert(st, st->symbols[id]);
+  }
+}
+
 char *hvm_sym_strclone(char *str) {
   size_t len = strlen(str);
   char  *clone = malloc(sizeof(char) * (size_t)(len + 1));
@@ -28,42 +61,50 @@ void hvm_symbol_store_expand(hvm_symbol_store *st) {
   st->symbols = realloc(st->symbols, sizeof(hvm_symbol_store_entry*) * st->size);
 }
 
-hvm_symbol_store_entry *hvm_symbol_store_add(hvm_symbol_store *st, char *value) {
+hvm_symbol_store_entry *hvm_symbol_store_add(hvm_symbol_store *st, char *value, uint64_t hash) {
   hvm_symbol_id id = st->next_id;
   hvm_symbol_store_entry *entry = malloc(sizeof(hvm_symbol_store_entry));
   entry->value = hvm_sym_strclone(value);
   entry->id = id;
+  entry->hash = hash;
   if(id >= (st->size - 1)) {
     hvm_symbol_store_expand(st);
   }
   st->symbols[id] = entry;
   st->next_id += 1;
+  // Keep the index at most half full
+  if((st->next_id * 2) > st->index_size) {
+    hvm_symbol_index_expand(st);
+  } else {
+    hvm_symbol_index_insert(st, entry);
+  }
   // fprintf(stderr, "symbol_add: %llu = %s\n", entry->id, entry->value);
   return entry;
 }
 
 hvm_symbol_id hvm_symbolicate(hvm_symbol_store *st, char *value) {
   hvm_symbol_store_entry *entry;
-  hvm_symbol_id i;
-  for(i = 1; i < st->next_id; i++) {
-    entry = st->symbols[i];
-    if(strcmp(entry->value, value) == 0) {
-      assert(i == entry->id);
+  uint64_t hash = hvm_symbol_hash(value);
+  uint64_t mask = st->index_size - 1;
+  uint64_t i    = hash & mask;
+  hvm_symbol_id id;
+  // Linear probe until we find the symbol or hit an empty bucket
+  while((id = st->index[i]) != 0) {
+    entry = st->symbols[id];
+    if(entry->hash == hash && strcmp(entry->value, value) == 0) {
+      assert(id == entry->id);
       return entry->id;
     }
+    i = (i + 1) & mask;
   }
-  entry = hvm_symbol_store_add(st, value);
+  entry = hvm_symbol_store_add(st, value, hash);
   return entry->id;
 }
 
 char *hvm_desymbolicate(hvm_symbol_store *st, hvm_symbol_id id) {
-  hvm_symbol_store_entry *entry;
-  hvm_symbol_id i;
-  for(i = 1; i < st->next_id; i++) {
-    entry = st->symbols[i];
-    if(id == entry->id) {
-      return entry->value;
-    }
+  // IDs are dense indices into the table
+  if(id == 0 || id >= st->next_id) {
+    return NULL;
   }
-  return NULL;
+  return st->symbols[id]->value;
 }
@@ -7,6 +7,9 @@
 #define HVM_SYMBOL_TABLE_INITIAL_SIZE 128
 // Double in size when out of space
 #define HVM_SYMBOL_TABLE_GROWTH_RATE  2
+// Hash index starts with twice as many buckets as the table has slots and
+// is kept at most half full
+#define HVM_SYMBOL_INDEX_INITIAL_SIZE (HVM_SYMBOL_TABLE_INITIAL_SIZE * 2)
 
 /// Internal symbol table.
 typedef struct hvm_symbol_store {
@@ -16,6 +19,10 @@ typedef struct hvm_symbol_store {
   hvm_symbol_id next_id;
   /// Size of the allocated heap (in entries).
   uint64_t size;
+  /// Open-addressed hash index of symbol IDs (0 marks an empty bucket).
+  hvm_symbol_id *index;
+  /// Number of buckets in the index (always a power of two).
+  uint64_t index_size;
 } hvm_symbol_store;
 
 /// Entry mapping ID to string in the symbol store.
@@ -24,6 +31,8 @@ typedef struct hvm_symbol_store_entry {
   hvm_symbol_id id;
   /// String value/name of the symbol.
   char* value;
+  /// Precomputed hash of the value.
+  uint64_t hash;
 } hvm_symbol_store_entry;
 
 /// Create a new symbol store
@@ -34,6 +43,9 @@ hvm_symbol_store *hvm_new_symbol_store();
 /// @returns  Symbol ID for the string
 hvm_symbol_id hvm_symbolicate(hvm_symbol_store*, char*);
 
+/// Look up the string for a symbol ID
+/// @memberof hvm_symbol_store
+/// @returns  String value of the symbol (or NULL if the ID is unknown)
 char *hvm_desymbolicate(hvm_symbol_store *st, hvm_symbol_id id);
 
 #endif
@@ -1,6 +1,7 @@
 
 // Normal and JIT dispatching hooks
-#define EXECUTE_JIT execute_jit
+#define EXECUTE_NORMAL execute
+#define EXECUTE_JIT    execute_jit
 
 // Undefine EXECUTE, EXCEPTION, and IN_JIT since we'll always be redefining them
 #undef EXECUTE
@@ -22,13 +23,92 @@
 #define IN_JIT(V)
 #endif
 
+#undef OP_CASE
+#undef DISPATCH
+#undef DISPATCH_NEXT
+#undef DISPATCH_TABLE
+
+#ifdef HVM_VM_COMPUTED_GOTO
+// Each opcode handler also gets a label (eg. `execute_jit_HVM_OP_ADD`) so
+// that it can be jumped to directly through the dispatch table.
+#define OP_CASE(OP)    case OP: HVM_DISPATCH_LABEL(EXECUTE, OP):
+#define DISPATCH_TABLE HVM_DISPATCH_LABEL(EXECUTE, table)
+// Fetch and jump straight to the next instruction's handler. This is
+// replicated at the end of every handler so that each one gets its own
+// indirect branch (and its own slot in the branch predictor).
+#define DISPATCH                           \
+  vm->top->current_addr = vm->ip;          \
+  inst  = &vm->code[vm->ip];               \
+  instr = inst->op;                        \
+  IN_JIT(                                  \
+    if(!vm->is_tracing) {                  \
+      goto EXECUTE_NORMAL;                 \
+    }                                      \
+    hvm_jit_tracer_before_instruction(vm); \
+  )                                        \
+  goto *DISPATCH_TABLE[instr];
+#define DISPATCH_NEXT vm->ip++; DISPATCH
+#else
+#define OP_CASE(OP)   case OP:
+#define DISPATCH      goto EXECUTE;
+#define DISPATCH_NEXT break;
+#endif
+
+#ifdef HVM_VM_COMPUTED_GOTO
+#define L(OP) [OP] = &&HVM_DISPATCH_LABEL(EXECUTE, OP)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Woverride-init"
+  static void *DISPATCH_TABLE[256] = {
+    [0 ... 255] = &&HVM_DISPATCH_LABEL(EXECUTE, unknown),
+    L(HVM_OP_NOOP),            L(HVM_OP_DIE),
+    L(HVM_OP_JUMP),            L(HVM_OP_GOTO),
+    L(HVM_OP_RETURN),          L(HVM_OP_IF),
+    L(HVM_OP_CALL),            L(HVM_OP_CALLSYMBOLIC),
+    L(HVM_OP_CALLPRIMITIVE),   L(HVM_OP_TAILCALL),
+    L(HVM_OP_INVOKESYMBOLIC),  L(HVM_OP_INVOKEADDRESS),
+    L(HVM_OP_INVOKEPRIMITIVE),
+    L(HVM_OP_SETSTRING),       L(HVM_OP_SETINTEGER),
+    L(HVM_OP_SETFLOAT),        L(HVM_OP_SETSTRUCT),
+    L(HVM_OP_SETSYMBOL),       L(HVM_OP_SETNULL),
+    L(HVM_OP_LITINTEGER),      L(HVM_OP_SYMBOLICATE),
+    L(HVM_OP_GETLOCAL),        L(HVM_OP_SETLOCAL),
+    L(HVM_OP_GETLOCALSLOT),    L(HVM_OP_SETLOCALSLOT),
+    L(HVM_OP_GETGLOBAL),       L(HVM_OP_SETGLOBAL),
+    L(HVM_OP_GETCLOSURE),
+    L(HVM_OP_ADD),             L(HVM_OP_SUB),
+    L(HVM_OP_MUL),             L(HVM_OP_DIV),
+    L(HVM_OP_MOD),
+    L(HVM_OP_LT),              L(HVM_OP_GT),
+    L(HVM_OP_LTE),             L(HVM_OP_GTE),
+    L(HVM_OP_EQ),              L(HVM_OP_AND),
+    L(HVM_OP_CATCH),           L(HVM_OP_CLEARCATCH),
+    L(HVM_OP_CLEAREXCEPTION),  L(HVM_OP_SETEXCEPTION),
+    L(HVM_OP_THROW),           L(HVM_OP_GETEXCEPTIONDATA),
+    L(HVM_OP_ARRAYPUSH),       L(HVM_OP_ARRAYSHIFT),
+    L(HVM_OP_ARRAYPOP),        L(HVM_OP_ARRAYUNSHIFT),
+    L(HVM_OP_ARRAYGET),        L(HVM_OP_ARRAYSET),
+    L(HVM_OP_ARRAYREMOVE),     L(HVM_OP_ARRAYNEW),
+    L(HVM_OP_ARRAYLEN),
+    L(HVM_OP_STRUCTSET),       L(HVM_OP_STRUCTGET),
+    L(HVM_OP_STRUCTDELETE),    L(HVM_OP_STRUCTNEW),
+    L(HVM_OP_STRUCTHAS),
+    L(HVM_OP_MOVE),            L(HVM_OP_GOTOADDRESS),
+    L(HVM_OP_LTIF),            L(HVM_OP_GTIF),
+    L(HVM_OP_LTEIF),           L(HVM_OP_GTEIF),
+    L(HVM_OP_EQIF),            L(HVM_OP_LITADD),
+    L(HVM_OP_ARRAYGET2)
+  };
+#pragma GCC diagnostic pop
+#undef L
+#endif
 
 EXECUTE:
   // fprintf(stderr, "top: %p, ip: %llu\n", vm->top, vm->ip);
   // Update the current frame address
   vm->top->current_addr = vm->ip;
   // Fetch the instruction
-  instr = vm->program[vm->ip];
+  inst  = &vm->code[vm->ip];
+  instr = inst->op;
 
 #ifdef HVM_VM_DEBUG
   // Debugger breakpoint-checking code goes here
@@ -41,58 +121,68 @@ EXECUTE:
 #endif
 
   IN_JIT(
-    // If this is the dispatch loop for JIT tracing...
-    assert(vm->is_tracing == 1);
-    // Then trace the instruction
+    // If this is the dispatch loop for JIT tracing then hand back to the
+    // plain one once the trace is done with
+    if(!vm->is_tracing) {
+      goto EXECUTE_NORMAL;
+    }
+    // Otherwise trace the instruction
     hvm_jit_tracer_before_instruction(vm);
   )
 
   // Execute the instruction
+#ifdef HVM_VM_COMPUTED_GOTO
+  goto *DISPATCH_TABLE[instr];
+#endif
   switch(instr) {
-    case HVM_OP_NOOP:
+    OP_CASE(HVM_OP_NOOP)
       // fprintf(stderr, "NOOP\n");
-      break;
-    case HVM_OP_DIE:
+      DISPATCH_NEXT;
+    OP_CASE(HVM_OP_DIE)
       // fprintf(stderr, "DIE\n");
       goto end;
-    case HVM_OP_TAILCALL:// 1B OP | 3B TAG | 8B DEST
+    OP_CASE(HVM_OP_TAILCALL)// 1B OP | 3B TAG | 8B DEST
       PROCESS_TAG;
-      dest = READ_U64(&vm->program[vm->ip + 4]);
+      hvm_gc1_safepoint(vm, vm->obj_space);
+      dest = inst->arg.dest;
       // Copy important bits from parent.
       parent_frame = vm->top;
       uint64_t parent_ret_addr = parent_frame->return_addr;
       byte     parent_ret_reg  = parent_frame->return_register;
       // Overwrite current frame (ie. parent).
       frame = &vm->stack[vm->stack_depth];
+      // Its call can't be traced through to its return anymore
+      if(frame->trace != NULL) {
+        hvm_jit_tracer_abandon_frame(vm, frame);
+      }
       // hvm_frame_initialize(frame);
       // frame->return_addr     = parent_ret_addr;
       // frame->return_register = parent_ret_reg;
       hvm_frame_initialize_returning(frame, parent_ret_addr, parent_ret_reg);
-      hvm_vm_copy_regs(vm);
+      hvm_vm_replace_windows(vm, frame, vm->code[dest].registers);
       vm->ip = dest;
-      goto EXECUTE;
-    case HVM_OP_CALL:// 1B OP | 3B TAG | 8B DEST  | 1B REG
+      DISPATCH;
+    OP_CASE(HVM_OP_CALL)// 1B OP | 3B TAG | 8B DEST  | 1B REG
       PROCESS_TAG;
-      dest = READ_U64(&vm->program[vm->ip + 4]);
-      reg  = vm->program[vm->ip + 12];
+      hvm_gc1_safepoint(vm, vm->obj_space);
+      dest = inst->arg.dest;
+      reg  = inst->a;
       vm->stack_depth += 1;
       frame = &vm->stack[vm->stack_depth];
       // hvm_frame_initialize(frame);
-      // frame->return_addr     = vm->ip + 13; // Instruction is 13 bytes long.
+      // frame->return_addr     = vm->ip + 1;
       // frame->return_register = reg;
-      // Instruction is 13 bytes long
-      hvm_frame_initialize_returning(frame, vm->ip + 13, reg);
-      hvm_vm_copy_regs(vm);
+      hvm_frame_initialize_returning(frame, vm->ip + 1, reg);
+      hvm_vm_push_windows(vm, frame, vm->code[dest].registers);
       vm->ip = dest;
       vm->top = frame;
-      goto EXECUTE;
-    case HVM_OP_CALLPRIMITIVE:// 1B OP | 3B TAG | 4B CONST | 1B REG
+      DISPATCH;
+    OP_CASE(HVM_OP_CALLPRIMITIVE)// 1B OP | 3B TAG | 4B CONST | 1B REG
       PROCESS_TAG;
-      const_index = READ_U32(&vm->program[vm->ip + 4]);
-      reg         = vm->program[vm->ip + 8];
+      const_index = inst->constant;
+      reg         = inst->a;
       // Get symbol of the primitive out of the constant table
       key = hvm_vm_get_const(vm, const_index);
-      hvm_vm_copy_regs(vm);
       {
         // Save any current exception
         hvm_obj_ref *current_exc = vm->exception;
@@ -104,86 +194,78 @@ EXECUTE:
       }
       // Write the result value to the right register
       hvm_vm_register_write(vm, reg, val);
-      vm->ip += 8;
-      break;
+      DISPATCH_NEXT;
 
-    case HVM_OP_CALLSYMBOLIC:// 1B OP | 3B TAG | 4B CONST | 1B REG
+    OP_CASE(HVM_OP_CALLSYMBOLIC)// 1B OP | 3B TAG | 4B CONST | 1B REG
       PROCESS_TAG;
-      const_index = READ_U32(&vm->program[vm->ip + 4]);
-      reg         = vm->program[vm->ip + 8];
+      hvm_gc1_safepoint(vm, vm->obj_space);
+      const_index = inst->constant;
+      reg         = inst->a;
       // Get the symbol out of the constant table
       key = hvm_vm_get_const(vm, const_index);
-      assert(key->type == HVM_SYMBOL);
-      sym_id = key->data.u64;
+      assert(hvm_obj_type_of(key) == HVM_SYMBOL);
+      sym_id = hvm_obj_symbol_value(key);
       // char *sym_name = hvm_desymbolicate(vm->symbols, sym_id);
       // fprintf(stderr, "debug: %s:0x%08llX has heat %u\n", sym_name, dest, tag.heat);
-      // Preserve the caller's tag for tracing stuff below
-      caller_tag = &vm->program[vm->ip + 1];
-      // Get the destination from the symbol table
-      val  = hvm_obj_struct_internal_get(vm->symbol_table, sym_id);
-      assert(val->type == HVM_INTERNAL);
-      dest = val->data.u64;
+      // Get the destination from the call-site cache (or the symbol table)
+      dest = hvm_vm_callsymbolic_dest(vm, inst, sym_id);
       // Then perform the call
       vm->stack_depth += 1;
       frame = &vm->stack[vm->stack_depth];
       // hvm_frame_initialize(frame);
-      // frame->return_addr     = vm->ip + 9;
+      // frame->return_addr     = vm->ip + 1;
       // frame->return_register = reg;
-      // Instruction is 9 bytes long
-      hvm_frame_initialize_returning(frame, vm->ip + 9, reg);
-      hvm_vm_copy_regs(vm);
+      hvm_frame_initialize_returning(frame, vm->ip + 1, reg);
+      hvm_vm_push_windows(vm, frame, vm->code[dest].registers);
       vm->ip = dest;
       vm->top = frame;
-      hvm_dispatch_path path = hvm_dispatch_frame(vm, frame, &tag, caller_tag);
+      hvm_dispatch_path path = hvm_dispatch_frame(vm, frame, &inst->tag);
       DISPATCH_PATH(path);
 
-    case HVM_OP_INVOKESYMBOLIC:// 1B OP | 3B TAG | 1B REG | 1B REG
+    OP_CASE(HVM_OP_INVOKESYMBOLIC)// 1B OP | 3B TAG | 1B REG | 1B REG
       PROCESS_TAG;
-      areg = vm->program[vm->ip + 4];
-      breg = vm->program[vm->ip + 5];
+      hvm_gc1_safepoint(vm, vm->obj_space);
+      AREG; BREG;
       key = _hvm_vm_register_read(vm, areg);// This is the symbol we need to look up.
-      assert(key->type == HVM_SYMBOL);
-      sym_id = key->data.u64;
+      assert(hvm_obj_type_of(key) == HVM_SYMBOL);
+      sym_id = hvm_obj_symbol_value(key);
       // fprintf(stderr, "0x%08llX  ", vm->ip);
       // fprintf(stderr, "sym: %llu -> %s\n", sym_id, hvm_desymbolicate(vm->symbols, sym_id));
       // hvm_obj_print_structure(vm, vm->symbol_table);
-      val  = hvm_obj_struct_internal_get(vm->symbol_table, sym_id);
-      assert(val->type == HVM_INTERNAL);
-      dest = val->data.u64;
+      dest = hvm_vm_invokesymbolic_dest(vm, inst, sym_id);
       // fprintf(stderr, "CALLSYMBOLIC(0x%08llX, $%d)\n", dest, breg);
       vm->stack_depth += 1;
       frame = &vm->stack[vm->stack_depth];
       // hvm_frame_initialize(frame);
-      // frame->return_addr = vm->ip + 6;
+      // frame->return_addr = vm->ip + 1;
       // frame->return_register = breg;
-      // Instruction is 6 bytes long
-      hvm_frame_initialize_returning(frame, vm->ip + 6, breg);
-      hvm_vm_copy_regs(vm);
+      hvm_frame_initialize_returning(frame, vm->ip + 1, breg);
+      hvm_vm_push_windows(vm, frame, vm->code[dest].registers);
       vm->ip = dest;
       vm->top = frame;
-      goto EXECUTE;
-    case HVM_OP_INVOKEADDRESS:// 1B OP | 3B TAG | 1B REG | 1B REG
+      DISPATCH;
+    OP_CASE(HVM_OP_INVOKEADDRESS)// 1B OP | 3B TAG | 1B REG | 1B REG
       PROCESS_TAG;
-      reg  = vm->program[vm->ip + 4];
+      hvm_gc1_safepoint(vm, vm->obj_space);
+      reg  = inst->a;
       val  = _hvm_vm_register_read(vm, reg);
-      assert(val->type == HVM_INTEGER);
-      dest = (uint64_t)val->data.i64;
-      reg  = vm->program[vm->ip + 5]; // Return register now
+      assert(hvm_obj_type_of(val) == HVM_INTEGER);
+      // Addresses in registers are byte offsets into the program
+      dest = hvm_vm_instruction_index(vm, (uint64_t)hvm_obj_int_value(val));
+      reg  = inst->b; // Return register now
       vm->stack_depth += 1;
       frame = &vm->stack[vm->stack_depth];
       // hvm_frame_initialize(frame);
-      // frame->return_addr     = vm->ip + 6;
+      // frame->return_addr     = vm->ip + 1;
       // frame->return_register = reg;
-      // Instruction is 6 bytes long
-      hvm_frame_initialize_returning(frame, vm->ip + 6, reg);
-      hvm_vm_copy_regs(vm);
+      hvm_frame_initialize_returning(frame, vm->ip + 1, reg);
+      hvm_vm_push_windows(vm, frame, vm->code[dest].registers);
       vm->ip = dest;
       vm->top = frame;
-      goto EXECUTE;
-    case HVM_OP_INVOKEPRIMITIVE: // 1B OP | 1B REG | 1B REG
+      DISPATCH;
+    OP_CASE(HVM_OP_INVOKEPRIMITIVE) // 1B OP | 1B REG | 1B REG
       AREG; BREG;
       key = _hvm_vm_register_read(vm, areg);// This is the symbol we need to look up.
-      hvm_vm_copy_regs(vm);
       // fprintf(stderr, "CALLPRIMITIVE(%lld, $%d)\n", sym_id, breg);
       // FIXME: This may need to be smartened up.
       hvm_obj_ref *current_exc = vm->exception;// If there's a current exception
@@ -198,113 +280,116 @@ EXECUTE:
           hvm_jit_tracer_annotate_invokeprimitive_returned_type(vm, val);
         }
       )
-      vm->ip += 2;
-      break;
+      DISPATCH_NEXT;
 
-    case HVM_OP_CATCH: // 1B OP | 8B DEST | 1B REG
-      dest = READ_U64(&vm->program[vm->ip + 1]);
-      reg  = vm->program[vm->ip + 9];
+    OP_CASE(HVM_OP_CATCH) // 1B OP | 8B DEST | 1B REG
+      dest = inst->arg.dest;
+      reg  = inst->a;
       frame = &vm->stack[vm->stack_depth];
       frame->catch_addr     = dest;
       frame->catch_register = reg;
-      vm->ip += 9;
-      break;
-    case HVM_OP_CLEARCATCH: // 1B OP
+      DISPATCH_NEXT;
+    OP_CASE(HVM_OP_CLEARCATCH) // 1B OP
       frame = &vm->stack[vm->stack_depth];
       frame->catch_addr     = HVM_FRAME_EMPTY_CATCH;
       frame->catch_register = hvm_vm_reg_null();
-      break;
-    case HVM_OP_CLEAREXCEPTION: // 1B OP
+      DISPATCH_NEXT;
+    OP_CASE(HVM_OP_CLEAREXCEPTION) // 1B OP
       vm->exception = NULL;
-      break;
-    case HVM_OP_SETEXCEPTION: // 1B OP | 1B REG
-      reg = vm->program[vm->ip + 1];
+      DISPATCH_NEXT;
+    OP_CASE(HVM_OP_SETEXCEPTION) // 1B OP | 1B REG
+      reg = inst->a;
       // Throw new exception if there's no current exception
       if(vm->exception == NULL) {
         msg = "Attempt to SETEXCEPTION with no exception state";
-        hvm_obj_ref *message = hvm_new_obj_ref_string_data(hvm_util_strclone(msg));
+        hvm_obj_ref *message = hvm_new_obj_ref_string_data(vm, hvm_util_strclone(msg));
         vm->exception = hvm_exception_new(vm, message);
         goto EXCEPTION;
       }
       // val = hvm_obj_for_exception(vm, vm->exception);
       val = vm->exception;
       hvm_vm_register_write(vm, reg, val);
-      vm->ip += 1;
-      break;
-    case HVM_OP_THROW: // 1B OP | 1B REG
+      DISPATCH_NEXT;
+    OP_CASE(HVM_OP_THROW) // 1B OP | 1B REG
       {
         AREG;
         // Get the object to be associated with the execption
         hvm_obj_ref *val = _hvm_vm_register_read(vm, areg);
         // Make sure it's a structure
-        if(val->type != HVM_STRUCTURE) {
+        if(hvm_obj_type_of(val) != HVM_STRUCTURE) {
           msg = "Expected structure when throwing exception";
-          hvm_obj_ref *message = hvm_new_obj_ref_string_data(hvm_util_strclone(msg));
+          hvm_obj_ref *message = hvm_new_obj_ref_string_data(vm, hvm_util_strclone(msg));
           vm->exception = hvm_exception_new(vm, message);
           goto EXCEPTION;
         }
-        assert(val->type == HVM_STRUCTURE);
+        assert(hvm_obj_type_of(val) == HVM_STRUCTURE);
         // Set the exception and jump to the handler
         vm->exception = val;
         goto EXCEPTION;
       }
-    case HVM_OP_GETEXCEPTIONDATA: // 1B OP | 1B REG | 1B REG
+    OP_CASE(HVM_OP_GETEXCEPTIONDATA) // 1B OP | 1B REG | 1B REG
       // AREG; BREG;
       // b = _hvm_vm_register_read(vm, breg);
       // assert(b->type == HVM_EXCEPTION);
       // exc = b->data.v;
       // val = exc->data;
       // hvm_vm_register_write(vm, areg, val);
-      // vm->ip += 2;
       fprintf(stderr, "GETEXCEPTIONDATA is no longer supported.\n");
       assert(false);
-      break;
+      DISPATCH_NEXT;
 
-    case HVM_OP_RETURN: // 1B OP | 1B REG
-      reg = vm->program[vm->ip + 1];
+    OP_CASE(HVM_OP_RETURN) // 1B OP | 1B REG
+      reg = inst->a;
       if(vm->stack_depth == 0) {
         msg = "Attempt to return from stack root";
-        hvm_obj_ref *message = hvm_new_obj_ref_string_data(hvm_util_strclone(msg));
+        hvm_obj_ref *message = hvm_new_obj_ref_string_data(vm, hvm_util_strclone(msg));
         vm->exception = hvm_exception_new(vm, message);
         goto EXCEPTION;
       }
       // Current frame
       frame = vm->top;
+      // Read the value before the windows slide back down (it may be in a
+      // parameter register)
+      val = _hvm_vm_register_read(vm, reg);
       vm->ip = frame->return_addr;
       vm->stack_depth -= 1;
       vm->top = &vm->stack[vm->stack_depth];
-      hvm_vm_register_write(vm, frame->return_register, _hvm_vm_register_read(vm, reg));
+      hvm_vm_pop_windows(vm, frame, vm->top);
+      hvm_vm_register_write(vm, frame->return_register, val);
       // fprintf(stderr, "RETURN(0x%08llX) $%d -> $%d\n", frame->return_addr, reg, frame->return_register);
-      goto EXECUTE;
-    case HVM_OP_JUMP: // 1B OP | 4B DIFF
-      diff = READ_I32(&vm->program[vm->ip + 1]);
-      if(diff >= 0) {
-        vm->ip += (uint64_t)diff;
-      } else {
-        // TODO: Check for reverse-overflow (ie. abs(diff) > vm->ip)
-        vm->ip -= (uint64_t)(diff * -1);
-      }
-      goto EXECUTE;
-    case HVM_OP_GOTO: // 1B OP | 8B DEST
-      dest = READ_U64(&vm->program[vm->ip + 1]);
+      DISPATCH;
+    OP_CASE(HVM_OP_JUMP) // 1B OP | 4B DIFF
+      // Difference was resolved to a destination when decoded
+      if(inst->arg.dest <= vm->ip) { hvm_gc1_safepoint(vm, vm->obj_space); }
+      vm->ip = inst->arg.dest;
+      DISPATCH;
+    OP_CASE(HVM_OP_GOTO) // 1B OP | 8B DEST
+      dest = inst->arg.dest;
+      if(dest <= vm->ip) { hvm_gc1_safepoint(vm, vm->obj_space); }
       vm->ip = dest;
-      goto EXECUTE;
-    case HVM_OP_GOTOADDRESS: // 1B OP | 1B REGDEST
-      reg = vm->program[vm->ip + 1];
+      DISPATCH;
+    OP_CASE(HVM_OP_GOTOADDRESS) // 1B OP | 1B REGDEST
+      reg = inst->a;
       val  = _hvm_vm_register_read(vm, reg);
-      assert(val->type == HVM_INTEGER);
-      i64  = val->data.i64;
-      dest = (uint64_t)i64;
+      assert(hvm_obj_type_of(val) == HVM_INTEGER);
+      i64  = hvm_obj_int_value(val);
+      // Addresses in registers are byte offsets into the program
+      dest = hvm_vm_instruction_index(vm, (uint64_t)i64);
+      if(dest <= vm->ip) { hvm_gc1_safepoint(vm, vm->obj_space); }
       vm->ip = dest;
       // fprintf(stderr, "GOTOADDRESS(0x%08llX)\n", dest);
-      goto EXECUTE;
-    case HVM_OP_IF: // 1B OP | 1B REG  | 8B DEST
-      reg  = vm->program[vm->ip + 1];
-      dest = READ_U64(&vm->program[vm->ip + 2]);
+      DISPATCH;
+    OP_CASE(HVM_OP_IF) // 1B OP | 1B REG  | 8B DEST
+      reg  = inst->a;
+      dest = inst->arg.dest;
       val  = _hvm_vm_register_read(vm, reg);
       // Figure out whether or not we need to branch be seeing if the value
       // is falsey (null or integer zero).
-      bool dont_branch = (val->type == HVM_NULL || (val->type == HVM_INTEGER && val->data.i64 == 0));
+      bool dont_branch = (val == hvm_const_null || val == hvm_const_zero);
+      if(!dont_branch && !hvm_obj_is_immediate(val)) {
+        // Boxed values are only falsey if they're null or a zero integer
+        dont_branch = (val->type == HVM_NULL || (val->type == HVM_INTEGER && val->data.i64 == 0));
+      }
       IN_JIT(
         // Update the JIT branch predictor
         if(vm->top->trace != NULL) {
@@ -313,125 +398,139 @@ EXECUTE:
         }
       )
       if(dont_branch) {
-        // Falsey; add on the 9 bytes for the instruction parameters and
-        // continue onwards
-        vm->ip += 9;
-        break;
+        // Falsey; continue onwards
+        DISPATCH_NEXT;
       } else {
         // Truthy; go straight to destination
+        if(dest <= vm->ip) { hvm_gc1_safepoint(vm, vm->obj_space); }
         vm->ip = dest;
-        goto EXECUTE;
+        DISPATCH;
       }
 
-    case HVM_OP_LITINTEGER: // 1B OP | 1B REG | 8B LIT
-      reg = vm->program[vm->ip + 1];
-      i64 = READ_I64(&vm->program[vm->ip + 2]);
-      val = hvm_new_obj_int(vm);
-      val->data.i64 = i64;
-      hvm_obj_space_add_obj_ref(vm->obj_space, val);
+    OP_CASE(HVM_OP_LITINTEGER) // 1B OP | 1B REG | 8B LIT
+      reg = inst->a;
+      i64 = inst->arg.i64;
+      if(hvm_obj_int_fits_immediate(i64)) {
+        val = hvm_obj_int_immediate(i64);
+      } else {
+        val = hvm_new_obj_int_value(vm, i64);
+        hvm_obj_space_add_obj_ref(vm->obj_space, val);
+      }
       hvm_vm_register_write(vm, reg, val);
-      vm->ip += 9;
-      break;
+      hvm_gc1_safepoint(vm, vm->obj_space);
+      DISPATCH_NEXT;
 
-    case HVM_OP_MOVE: // 1B OP | 1B REG | 1B REG
+    OP_CASE(HVM_OP_MOVE) // 1B OP | 1B REG | 1B REG
       AREG; BREG;
       hvm_vm_register_write(vm, areg, _hvm_vm_register_read(vm, breg));
-      vm->ip += 2;
-      break;
-
-    case HVM_OP_SETSTRING:  // 1 = reg, 2-5 = const
-    case HVM_OP_SETINTEGER: // 1B OP | 1B REG | 4B CONST
-    case HVM_OP_SETFLOAT:
-    case HVM_OP_SETSTRUCT:
-    case HVM_OP_SETSYMBOL:
+      DISPATCH_NEXT;
+
+    OP_CASE(HVM_OP_SETSTRING)  // 1 = reg, 2-5 = const
+    OP_CASE(HVM_OP_SETINTEGER) // 1B OP | 1B REG | 4B CONST
+    OP_CASE(HVM_OP_SETFLOAT)
+    OP_CASE(HVM_OP_SETSTRUCT)
+    OP_CASE(HVM_OP_SETSYMBOL)
       // TODO: Type-checking or just do SETCONSTANT
-      reg         = vm->program[vm->ip + 1];
-      const_index = READ_U32(&vm->program[vm->ip + 2]);
+      reg         = inst->a;
+      const_index = inst->constant;
       // fprintf(stderr, "0x%08llX  ", vm->ip);
       // fprintf(stderr, "SET $%u = const(%u)\n", reg, const_index);
       hvm_vm_register_write(vm, reg, hvm_vm_get_const(vm, const_index));
-      vm->ip += 5;
-      break;
-    case HVM_OP_SETNULL: // 1B OP | 1B REG
-      reg = vm->program[vm->ip + 1];
+      DISPATCH_NEXT;
+    OP_CASE(HVM_OP_SETNULL) // 1B OP | 1B REG
+      reg = inst->a;
       hvm_vm_register_write(vm, reg, hvm_const_null);
-      vm->ip += 1;
-      break;
+      DISPATCH_NEXT;
 
     // case HVM_OP_SETSYMBOL: // 1B OP | 1B REG | 4B CONST
-    //   reg = vm->program[vm->ip + 1];
-    //   const_index = READ_U32(&vm->program[vm->ip + 2]);
+    //   reg = inst->a;
+    //   const_index = inst->constant;
     //   vm->general_regs[reg] = hvm_vm_get_const(vm, const_index);
 
-    case HVM_OP_SETLOCAL: // 1B OP | 1B REG   | 1B REG (local(A) = B)
+    OP_CASE(HVM_OP_SETLOCAL) // 1B OP | 1B REG   | 1B REG (local(A) = B)
       AREG; BREG;
       key = _hvm_vm_register_read(vm, areg);
-      assert(key->type == HVM_SYMBOL);
-      hvm_set_local(vm->top, key->data.u64, _hvm_vm_register_read(vm, breg));
+      assert(hvm_obj_type_of(key) == HVM_SYMBOL);
+      hvm_set_local(vm->top, hvm_obj_symbol_value(key), _hvm_vm_register_read(vm, breg));
       IN_JIT(
         if(vm->top->trace != NULL) {
-          hvm_jit_tracer_annotate_setlocal(vm, key->data.u64);
+          hvm_jit_tracer_annotate_setlocal(vm, hvm_obj_symbol_value(key));
         }
       )
-      vm->ip += 2;
-      break;
-    case HVM_OP_GETLOCAL: // 1B OP | 1B REG   | 1B REG (A = local(B))
+      DISPATCH_NEXT;
+    OP_CASE(HVM_OP_GETLOCAL) // 1B OP | 1B REG   | 1B REG (A = local(B))
       AREG; BREG;
       key = _hvm_vm_register_read(vm, breg);
-      assert(key->type == HVM_SYMBOL);
-      val = hvm_get_local(vm->top, key->data.u64);
+      assert(hvm_obj_type_of(key) == HVM_SYMBOL);
+      val = hvm_get_local(vm->top, hvm_obj_symbol_value(key));
       if(val == NULL) {
         // Local not found
         char buff[256];// TODO: Danger, Will Robinson, buffer overflow!
         buff[0] = '\0';
         strcat(buff, "Undefined local: ");
-        strcat(buff, hvm_desymbolicate(vm->symbols, key->data.u64));
-        hvm_obj_ref *message = hvm_new_obj_ref_string_data(hvm_util_strclone(buff));
+        strcat(buff, hvm_desymbolicate(vm->symbols, hvm_obj_symbol_value(key)));
+        hvm_obj_ref *message = hvm_new_obj_ref_string_data(vm, hvm_util_strclone(buff));
         vm->exception = hvm_exception_new(vm, message);
         goto EXCEPTION;
       }
       hvm_vm_register_write(vm, areg, val);
       IN_JIT(
         if(vm->top->trace != NULL) {
-          printf("tracing: GETLOCAL %s\n", hvm_desymbolicate(vm->symbols, key->data.u64));
-          hvm_jit_tracer_annotate_getlocal(vm, key->data.u64);
+          printf("tracing: GETLOCAL %s\n", hvm_desymbolicate(vm->symbols, hvm_obj_symbol_value(key)));
+          hvm_jit_tracer_annotate_getlocal(vm, hvm_obj_symbol_value(key));
         }
       )
-      vm->ip += 2;
-      break;
+      DISPATCH_NEXT;
 
-    case HVM_OP_SETGLOBAL: // 1B OP | 1B REG   | 1B REG
+    OP_CASE(HVM_OP_SETLOCALSLOT) // 1B OP | 1B SLOT | 1B REG (slot(A) = B)
+      AREG; BREG;
+      frame = vm->top;
+      frame->slots[areg] = _hvm_vm_register_read(vm, breg);
+      if(areg >= frame->slots_length) { frame->slots_length = areg + 1; }
+      DISPATCH_NEXT;
+    OP_CASE(HVM_OP_GETLOCALSLOT) // 1B OP | 1B REG  | 1B SLOT (A = slot(B))
+      AREG; BREG;
+      val = vm->top->slots[breg];
+      if(val == NULL) {
+        char buff[64];
+        snprintf(buff, sizeof(buff), "Undefined local slot: %d", breg);
+        hvm_obj_ref *message = hvm_new_obj_ref_string_data(vm, hvm_util_strclone(buff));
+        vm->exception = hvm_exception_new(vm, message);
+        goto EXCEPTION;
+      }
+      hvm_vm_register_write(vm, areg, val);
+      DISPATCH_NEXT;
+
+    OP_CASE(HVM_OP_SETGLOBAL) // 1B OP | 1B REG   | 1B REG
       AREG; BREG;
       key = _hvm_vm_register_read(vm, areg);
-      assert(key->type == HVM_SYMBOL);
-      hvm_set_global(vm, key->data.u64, _hvm_vm_register_read(vm, breg));
-      vm->ip += 2;
-      break;
-    case HVM_OP_GETGLOBAL: // 1B OP | 1B REG   | 1B SYM
+      assert(hvm_obj_type_of(key) == HVM_SYMBOL);
+      hvm_set_global(vm, hvm_obj_symbol_value(key), _hvm_vm_register_read(vm, breg));
+      DISPATCH_NEXT;
+    OP_CASE(HVM_OP_GETGLOBAL) // 1B OP | 1B REG   | 1B SYM
       AREG; BREG;
       key = _hvm_vm_register_read(vm, breg);
-      assert(key->type == HVM_SYMBOL);
-      hvm_vm_register_write(vm, areg, hvm_get_global(vm, key->data.u64));
-      vm->ip += 2;
-      break;
+      assert(hvm_obj_type_of(key) == HVM_SYMBOL);
+      hvm_vm_register_write(vm, areg, hvm_get_global(vm, hvm_obj_symbol_value(key)));
+      DISPATCH_NEXT;
 
-    case HVM_OP_GETCLOSURE: // 1B OP | 1B REG
-      reg = vm->program[vm->ip + 1];
+    OP_CASE(HVM_OP_GETCLOSURE) // 1B OP | 1B REG
+      reg = inst->a;
       // hvm_obj_ref* ref = hvm_new_obj_ref();
       // ref->type = HVM_STRUCTURE;
       // ref->data.v = vm->top->locals;
       hvm_obj_ref *ref = hvm_vm_build_closure(vm);
       hvm_obj_space_add_obj_ref(vm->obj_space, ref);
       hvm_vm_register_write(vm, reg, ref);
-      vm->ip += 1;
-      break;
+      hvm_gc1_safepoint(vm, vm->obj_space);
+      DISPATCH_NEXT;
 
     // MATH -----------------------------------------------------------------
-    case HVM_OP_ADD:
-    case HVM_OP_SUB:
-    case HVM_OP_MUL:
-    case HVM_OP_DIV:
-    case HVM_OP_MOD: // 1B OP | 3B REGs
+    OP_CASE(HVM_OP_ADD)
+    OP_CASE(HVM_OP_SUB)
+    OP_CASE(HVM_OP_MUL)
+    OP_CASE(HVM_OP_DIV)
+    OP_CASE(HVM_OP_MOD) // 1B OP | 3B REGs
       // A = B + C
       AREG; BREG; CREG;
       a = NULL;
@@ -451,15 +550,15 @@ EXECUTE:
       // Ensure the resulting integer is tracked in the GC
       hvm_obj_space_add_obj_ref(vm->obj_space, a);
       hvm_vm_register_write(vm, areg, a);
-      vm->ip += 3;
-      break;
+      hvm_gc1_safepoint(vm, vm->obj_space);
+      DISPATCH_NEXT;
 
     // MATHEMATICAL COMPARISON ----------------------------------------------
-    case HVM_OP_LT:
-    case HVM_OP_GT:
-    case HVM_OP_LTE:
-    case HVM_OP_GTE:
-    case HVM_OP_EQ:  // 1B OP | 3B REGs
+    OP_CASE(HVM_OP_LT)
+    OP_CASE(HVM_OP_GT)
+    OP_CASE(HVM_OP_LTE)
+    OP_CASE(HVM_OP_GTE)
+    OP_CASE(HVM_OP_EQ)  // 1B OP | 3B REGs
       // A = B < C
       AREG; BREG; CREG;
       a = NULL;
@@ -477,11 +576,11 @@ EXECUTE:
       }
       hvm_obj_space_add_obj_ref(vm->obj_space, a);
       hvm_vm_register_write(vm, areg, a);
-      vm->ip += 3;
-      break;
+      hvm_gc1_safepoint(vm, vm->obj_space);
+      DISPATCH_NEXT;
 
     // BOOLEAN COMPARISON
-    case HVM_OP_AND: // 1B OP | 3B REGS
+    OP_CASE(HVM_OP_AND) // 1B OP | 3B REGS
       AREG; BREG; CREG;
       b   = _hvm_vm_register_read(vm, breg);
       c   = _hvm_vm_register_read(vm, creg);
@@ -489,114 +588,107 @@ EXECUTE:
       // Add integer to GC object space and write to register
       hvm_obj_space_add_obj_ref(vm->obj_space, val);
       hvm_vm_register_write(vm, areg, val);
-      vm->ip += 3;
-      break;
+      hvm_gc1_safepoint(vm, vm->obj_space);
+      DISPATCH_NEXT;
 
     // ARRAYS ---------------------------------------------------------------
-    case HVM_OP_ARRAYPUSH: // 1B OP | 2B REGS
+    OP_CASE(HVM_OP_ARRAYPUSH) // 1B OP | 2B REGS
       // A.push(B)
       AREG; BREG;
       a = _hvm_vm_register_read(vm, areg);
       b = _hvm_vm_register_read(vm, breg);
       hvm_obj_array_push(a, b);
-      vm->ip += 2;
-      break;
-    case HVM_OP_ARRAYUNSHIFT: // 1B OP | 2B REGS
+      DISPATCH_NEXT;
+    OP_CASE(HVM_OP_ARRAYUNSHIFT) // 1B OP | 2B REGS
       // A.unshift(B)
       AREG; BREG;
       a = _hvm_vm_register_read(vm, areg);
       b = _hvm_vm_register_read(vm, breg);
       hvm_obj_array_unshift(a, b);
-      vm->ip += 2;
-      break;
-    case HVM_OP_ARRAYSHIFT: // 1B OP | 2B REGS
+      DISPATCH_NEXT;
+    OP_CASE(HVM_OP_ARRAYSHIFT) // 1B OP | 2B REGS
       // A = B.shift()
       AREG; BREG;
       b = _hvm_vm_register_read(vm, breg);
       hvm_vm_register_write(vm, areg, hvm_obj_array_shift(b));
-      vm->ip += 2;
-      break;
-    case HVM_OP_ARRAYPOP: // 1B OP | 2B REGS
+      DISPATCH_NEXT;
+    OP_CASE(HVM_OP_ARRAYPOP) // 1B OP | 2B REGS
       // A = B.pop()
       AREG; BREG;
       b = _hvm_vm_register_read(vm, breg);
       hvm_vm_register_write(vm, areg, hvm_obj_array_pop(b));
-      vm->ip += 2;
-      break;
-    case HVM_OP_ARRAYGET: // 1B OP | 3B REGS
+      DISPATCH_NEXT;
+    OP_CASE(HVM_OP_ARRAYGET) // 1B OP | 3B REGS
       // arrayget V A I -> V = A[I]
       AREG; BREG; CREG;
       arr = _hvm_vm_register_read(vm, breg);
       idx = _hvm_vm_register_read(vm, creg);
       hvm_vm_register_write(vm, areg, hvm_obj_array_get(arr, idx));
-      vm->ip += 3;
-      break;
-    case HVM_OP_ARRAYSET: // 1B OP | 3B REGS
+      DISPATCH_NEXT;
+    OP_CASE(HVM_OP_ARRAYSET) // 1B OP | 3B REGS
       // arrayset A I V -> A[I] = V
       AREG; BREG; CREG;
       arr = _hvm_vm_register_read(vm, areg);
       idx = _hvm_vm_register_read(vm, breg);
       val = _hvm_vm_register_read(vm, creg);
       hvm_obj_array_set(arr, idx, val);
-      vm->ip += 3;
-      break;
-    case HVM_OP_ARRAYREMOVE: // 1B OP | 3B REGS
+      DISPATCH_NEXT;
+    OP_CASE(HVM_OP_ARRAYREMOVE) // 1B OP | 3B REGS
       // arrayremove V A I
       AREG; BREG; CREG;
       arr = _hvm_vm_register_read(vm, breg);
       idx = _hvm_vm_register_read(vm, creg);
       hvm_vm_register_write(vm, areg, hvm_obj_array_remove(arr, idx));
-      vm->ip += 3;
-      break;
-    case HVM_OP_ARRAYNEW: // 1B OP | 2B REGS
+      DISPATCH_NEXT;
+    OP_CASE(HVM_OP_ARRAYNEW) // 1B OP | 2B REGS
       // arraynew A L
       AREG; BREG;
       {
         hvm_obj_ref *val       = _hvm_vm_register_read(vm, breg);
         hvm_obj_array *arr     = hvm_new_obj_array_with_length(val);
-        hvm_obj_ref *obj_array = hvm_new_obj_ref();
+        hvm_obj_ref *obj_array = hvm_obj_ref_new_from_pool(vm);
         obj_array->type = HVM_ARRAY;
         obj_array->data.v = arr;
         hvm_obj_space_add_obj_ref(vm->obj_space, obj_array);
         hvm_vm_register_write(vm, areg, obj_array);
-        vm->ip += 2;
       }
-      break;
-    case HVM_OP_ARRAYLEN: // 1B OP | 2B REGS
+      hvm_gc1_safepoint(vm, vm->obj_space);
+      DISPATCH_NEXT;
+    OP_CASE(HVM_OP_ARRAYLEN) // 1B OP | 2B REGS
       AREG; BREG;
       a = _hvm_vm_register_read(vm, breg);
-      assert(a->type == HVM_ARRAY);
+      assert(hvm_obj_type_of(a) == HVM_ARRAY);
       val = hvm_obj_array_len(vm, a);
       hvm_obj_space_add_obj_ref(vm->obj_space, val);
       hvm_vm_register_write(vm, areg, val);
-      vm->ip += 2;
-      break;
+      hvm_gc1_safepoint(vm, vm->obj_space);
+      DISPATCH_NEXT;
 
 
     // STRUCTS --------------------------------------------------------------
-    case HVM_OP_STRUCTSET:
+    OP_CASE(HVM_OP_STRUCTSET)
       // structset S K V
       AREG; BREG; CREG;
       strct = _hvm_vm_register_read(vm, areg);
       key   = _hvm_vm_register_read(vm, breg);
       val   = _hvm_vm_register_read(vm, creg);
-      hvm_obj_struct_set(strct, key, val);
+      assert(hvm_obj_type_of(strct) == HVM_STRUCTURE); assert(hvm_obj_type_of(key) == HVM_SYMBOL);
+      hvm_vm_struct_set_cached(inst, strct->data.v, hvm_obj_symbol_value(key), val);
       // fprintf(stderr, "0x%08llX  ", vm->ip);
       // fprintf(stderr, "STRUCTSET $%u = $%u[$%u(%llu)]\n", areg, breg, creg, key->data.u64);
       // hvm_obj_print_structure(vm, strct->data.v);
-      vm->ip += 3;
-      break;
-    case HVM_OP_STRUCTGET:
+      DISPATCH_NEXT;
+    OP_CASE(HVM_OP_STRUCTGET)
       // structget V S K
       AREG; BREG; CREG;
       // fprintf(stderr, "0x%08llX  ", vm->ip);
       // fprintf(stderr, "STRUCTGET $%u = $%u[$%u(%llu)]\n", areg, breg, creg, key->data.u64);
       strct = _hvm_vm_register_read(vm, breg);
       key   = _hvm_vm_register_read(vm, creg);
-      if(strct->type != HVM_STRUCTURE) {
+      if(hvm_obj_type_of(strct) != HVM_STRUCTURE) {
         // Bad type
         msg = "Attempting to get member of non-structure";
-        hvm_obj_ref *message = hvm_new_obj_ref_string_data(hvm_util_strclone(msg));
+        hvm_obj_ref *message = hvm_new_obj_ref_string_data(vm, hvm_util_strclone(msg));
         exc = hvm_exception_new(vm, message);
 
         hvm_location *loc = hvm_new_location();
@@ -606,46 +698,49 @@ EXECUTE:
         vm->exception = exc;
         goto EXCEPTION;
       }
-      assert(strct->type == HVM_STRUCTURE);
-      assert(key->type == HVM_SYMBOL);
+      assert(hvm_obj_type_of(strct) == HVM_STRUCTURE);
+      assert(hvm_obj_type_of(key) == HVM_SYMBOL);
       // hvm_obj_print_structure(vm, strct->data.v);
-      val = hvm_obj_struct_get(strct, key);
+      val = hvm_vm_struct_get_cached(inst, strct->data.v, hvm_obj_symbol_value(key));
       assert(val != NULL);
       hvm_vm_register_write(vm, areg, val);
-      vm->ip += 3;
-      break;
-    case HVM_OP_STRUCTDELETE:
+      DISPATCH_NEXT;
+    OP_CASE(HVM_OP_STRUCTDELETE)
       // structdelete V S K
       AREG; BREG; CREG;
       strct = _hvm_vm_register_read(vm, breg);
       key   = _hvm_vm_register_read(vm, creg);
       hvm_vm_register_write(vm, areg, hvm_obj_struct_delete(strct, key));
-      vm->ip += 3;
-      break;
-    case HVM_OP_STRUCTNEW:
+      DISPATCH_NEXT;
+    OP_CASE(HVM_OP_STRUCTNEW)
       // structnew S
       AREG;
-      hvm_obj_struct *s = hvm_new_obj_struct();
-      strct = hvm_new_obj_ref();
+      hvm_obj_struct *s = hvm_new_obj_struct_shaped(vm->root_shape);
+      strct = hvm_obj_ref_new_from_pool(vm);
       strct->type = HVM_STRUCTURE;
       strct->data.v = s;
       hvm_obj_space_add_obj_ref(vm->obj_space, strct);
       hvm_vm_register_write(vm, areg, strct);
-      vm->ip += 1;
-      break;
-    case HVM_OP_STRUCTHAS:
+      hvm_gc1_safepoint(vm, vm->obj_space);
+      DISPATCH_NEXT;
+    OP_CASE(HVM_OP_STRUCTHAS)
       // structhas B S K
-      fprintf(stderr, "STRUCTHAS not implemented yet!\n");
-      goto end;
+      AREG; BREG; CREG;
+      strct = _hvm_vm_register_read(vm, breg);
+      key   = _hvm_vm_register_read(vm, creg);
+      assert(hvm_obj_type_of(strct) == HVM_STRUCTURE); assert(hvm_obj_type_of(key) == HVM_SYMBOL);
+      branch = hvm_vm_struct_has_cached(inst, strct->data.v, hvm_obj_symbol_value(key));
+      hvm_vm_register_write(vm, areg, branch ? hvm_const_one : hvm_const_zero);
+      DISPATCH_NEXT;
 
-    case HVM_OP_SYMBOLICATE:
+    OP_CASE(HVM_OP_SYMBOLICATE)
       // symbolicate SYM STR
       AREG; BREG;
       b = _hvm_vm_register_read(vm, breg);
       // Make sure we got a string
-      if(b->type != HVM_STRING) {
+      if(hvm_obj_type_of(b) != HVM_STRING) {
         msg = "Symbolicate cannot handle non-string objects";
-        hvm_obj_ref *message = hvm_new_obj_ref_string_data(hvm_util_strclone(msg));
+        hvm_obj_ref *message = hvm_new_obj_ref_string_data(vm, hvm_util_strclone(msg));
         exc = hvm_exception_new(vm, message);
         vm->exception = exc;
         goto EXCEPTION;
@@ -653,15 +748,88 @@ EXECUTE:
       hvm_obj_string *string = b->data.v;
       char *cstring = string->data;
       hvm_symbol_id sym = hvm_symbolicate(vm->symbols, cstring);
-      val = hvm_new_obj_ref();
-      val->type = HVM_SYMBOL;
-      val->data.u64 = sym;
-      hvm_obj_space_add_obj_ref(vm->obj_space, val);
-      hvm_vm_register_write(vm, areg, val);
-      vm->ip += 2;
-      break;
+      hvm_vm_register_write(vm, areg, hvm_obj_symbol_immediate(sym));
+      DISPATCH_NEXT;
+
+    // SUPERINSTRUCTIONS ----------------------------------------------------
+    // Fused at load time; see `hvm_vm_fuse_superinstructions`. The second
+    // instruction of each pair is still in the code after the fused one.
+    OP_CASE(HVM_OP_LTIF)
+    OP_CASE(HVM_OP_GTIF)
+    OP_CASE(HVM_OP_LTEIF)
+    OP_CASE(HVM_OP_GTEIF)
+    OP_CASE(HVM_OP_EQIF) // A = B < C; IF A DEST
+      AREG; BREG; CREG;
+      b = _hvm_vm_register_read(vm, breg);
+      c = _hvm_vm_register_read(vm, creg);
+      if(hvm_obj_type_of(b) != HVM_INTEGER || hvm_obj_type_of(c) != HVM_INTEGER) {
+        vm->exception = hvm_new_operand_not_integer_exception(vm);
+        goto EXCEPTION;
+      }
+      i64 = hvm_obj_int_value(b);
+      if(instr == HVM_OP_LTIF)       { branch = (i64 <  hvm_obj_int_value(c)); }
+      else if(instr == HVM_OP_GTIF)  { branch = (i64 >  hvm_obj_int_value(c)); }
+      else if(instr == HVM_OP_LTEIF) { branch = (i64 <= hvm_obj_int_value(c)); }
+      else if(instr == HVM_OP_GTEIF) { branch = (i64 >= hvm_obj_int_value(c)); }
+      else                           { branch = (i64 == hvm_obj_int_value(c)); }
+      // The result is still written for later readers, but as a shared
+      // constant rather than a newly-allocated integer.
+      hvm_vm_register_write(vm, areg, (branch ? hvm_const_one : hvm_const_zero));
+      vm->dispatches_saved += 1;
+      IN_JIT(
+        if(vm->top->trace != NULL) {
+          hvm_jit_tracer_annotate_if_branched(vm, branch);
+        }
+      )
+      if(branch) {
+        if(inst->arg.dest <= vm->ip) { hvm_gc1_safepoint(vm, vm->obj_space); }
+        vm->ip = inst->arg.dest;
+        DISPATCH;
+      }
+      // Skip over the IF
+      vm->ip += 1;
+      DISPATCH_NEXT;
+
+    OP_CASE(HVM_OP_LITADD) // A = LIT; D = E + F (where E or F is A)
+      reg = inst->a;
+      hvm_vm_register_write(vm, reg, hvm_vm_get_const(vm, inst->constant));
+      vm->dispatches_saved += 1;
+      // Then the ADD
+      vm->ip += 1;
+      vm->top->current_addr = vm->ip;
+      inst = &vm->code[vm->ip];
+      AREG; BREG; CREG;
+      b = _hvm_vm_register_read(vm, breg);
+      c = _hvm_vm_register_read(vm, creg);
+      a = hvm_obj_int_add(vm, b, c);
+      if(a == NULL) {
+        vm->exception = hvm_new_operand_not_integer_exception(vm);
+        goto EXCEPTION;
+      }
+      hvm_obj_space_add_obj_ref(vm->obj_space, a);
+      hvm_vm_register_write(vm, areg, a);
+      hvm_gc1_safepoint(vm, vm->obj_space);
+      DISPATCH_NEXT;
+
+    OP_CASE(HVM_OP_ARRAYGET2) // V = A[I]; W = B[J]
+      AREG; BREG; CREG;
+      arr = _hvm_vm_register_read(vm, breg);
+      idx = _hvm_vm_register_read(vm, creg);
+      hvm_vm_register_write(vm, areg, hvm_obj_array_get(arr, idx));
+      vm->dispatches_saved += 1;
+      // Then the second ARRAYGET
+      vm->ip += 1;
+      inst = &vm->code[vm->ip];
+      AREG; BREG; CREG;
+      arr = _hvm_vm_register_read(vm, breg);
+      idx = _hvm_vm_register_read(vm, creg);
+      hvm_vm_register_write(vm, areg, hvm_obj_array_get(arr, idx));
+      DISPATCH_NEXT;
 
     default:
+#ifdef HVM_VM_COMPUTED_GOTO
+    HVM_DISPATCH_LABEL(EXECUTE, unknown):
+#endif
       fprintf(stderr, "Unknown instruction: %u\n", instr);
       return;
   }
@@ -671,13 +839,23 @@ EXECUTE:
 EXCEPTION:
   exc = vm->exception;
   assert(exc != NULL);
-  assert(exc->type == HVM_STRUCTURE);
+  assert(hvm_obj_type_of(exc) == HVM_STRUCTURE);
   hvm_exception_build_backtrace(exc, vm);
   // Climb stack looking for catch handler.
   depth = vm->stack_depth;
   while(1) {
     frame = &vm->stack[depth];
     if(frame->catch_addr != HVM_FRAME_EMPTY_CATCH) {
+      // Unwind the frames above the handler
+      while(vm->stack_depth > depth) {
+        // Calls being unwound can't be traced through to their returns
+        if(vm->stack[vm->stack_depth].trace != NULL) {
+          hvm_jit_tracer_abandon_frame(vm, &vm->stack[vm->stack_depth]);
+        }
+        vm->stack_depth -= 1;
+        hvm_vm_pop_windows(vm, &vm->stack[vm->stack_depth + 1], &vm->stack[vm->stack_depth]);
+      }
+      vm->top = frame;
       // val = hvm_obj_for_exception(vm, exc);
       val = exc;
       hvm_vm_register_write(vm, frame->catch_register, val);
@@ -686,7 +864,7 @@ EXCEPTION:
       // Clear the exception handler from the frame
       frame->catch_addr = HVM_FRAME_EMPTY_CATCH;
       frame->catch_register = hvm_vm_reg_null();
-      goto EXECUTE;
+      DISPATCH;
     }
     if(depth == 0) { break; }
     depth--;
@@ -15,6 +15,8 @@
 #include "debug.h"
 #include "jit-tracer.h"
 #include "jit-compiler.h"
+#include "jit-queue.h"
+#include "jit-cache.h"
 
 #ifndef bool
 #define bool char
@@ -23,16 +25,11 @@
 // Prefix a function definition with this to force its inling into caller
 #define ALWAYS_INLINE __attribute__((always_inline))
 
-struct hvm_obj_ref* hvm_const_null = &(hvm_obj_ref){
-  .type = HVM_NULL,
-  .data.v = NULL,
-  .flags = HVM_OBJ_FLAG_CONSTANT
-};
-struct hvm_obj_ref* hvm_const_zero = &(hvm_obj_ref){
-  .type = HVM_INTEGER,
-  .data.i64 = 0,
-  .flags = HVM_OBJ_FLAG_CONSTANT
-};
+// Shared null and integer values are tagged immediates (see object.h)
+struct hvm_obj_ref* hvm_const_null = HVM_OBJ_NULL;
+struct hvm_obj_ref* hvm_const_zero = (hvm_obj_ref*)((0 << 1) | HVM_OBJ_TAG_INTEGER);
+// Shared result for true comparisons in superinstructions
+struct hvm_obj_ref* hvm_const_one  = (hvm_obj_ref*)((1 << 1) | HVM_OBJ_TAG_INTEGER);
 
 char *hvm_util_strclone(char *str) {
   size_t len = strlen(str);
@@ -44,39 +41,129 @@ char *hvm_util_strclone(char *str) {
 // 1000 0000 = 0x80
 unsigned char HVM_DEBUG_FLAG_HIDE_BACKTRACE = 0x80;
 
+// Registers live in windows onto the value stack. Each frame has a window
+// of HVM_ARGUMENT_REGISTERS parameters, followed by its own general
+// registers if its subroutine declared a register count (otherwise it keeps
+// using its caller's). The argument registers are the window just past the
+// top frame's, so calling slides the windows up and the caller's arguments
+// become the callee's parameters without being copied; returning slides
+// them back down. Slots are cleared as windows are vacated, so everything
+// outside the live windows is always NULL.
+ALWAYS_INLINE void hvm_vm_slide_windows_up(hvm_vm *vm) {
+  vm->param_regs  = vm->arg_regs;
+  vm->param_count = vm->arg_count;
+  vm->arg_regs    = vm->param_regs + HVM_ARGUMENT_REGISTERS;
+  vm->arg_count   = 0;
+}
+ALWAYS_INLINE void hvm_vm_slide_windows_down(hvm_vm *vm, hvm_obj_ref **params, unsigned int param_count, hvm_obj_ref **args) {
+  memset(vm->arg_regs, 0, sizeof(hvm_obj_ref*) * vm->arg_count);
+  memset(vm->param_regs, 0, sizeof(hvm_obj_ref*) * vm->param_count);
+  vm->param_regs  = params;
+  vm->param_count = param_count;
+  vm->arg_regs    = args;
+  vm->arg_count   = 0;
+}
+// Give a frame its own window of general registers (all null) just past its
+// parameters, or have it share the registers currently in use.
+ALWAYS_INLINE void hvm_vm_open_register_window(hvm_vm *vm, hvm_frame *frame, unsigned int registers) {
+  frame->registers = registers;
+  if(registers == 0) {
+    frame->general_regs = vm->general_regs;
+    return;
+  }
+  hvm_obj_ref **regs = vm->param_regs + HVM_ARGUMENT_REGISTERS;
+  if(regs + registers + HVM_ARGUMENT_REGISTERS > vm->value_stack + HVM_VALUE_STACK_SIZE) {
+    fprintf(stderr, "Value stack overflow\n");
+    assert(false);
+  }
+  for(unsigned int i = 0; i < registers; i++) {
+    regs[i] = hvm_const_null;
+  }
+  frame->general_regs = regs;
+  vm->general_regs    = regs;
+  vm->arg_regs        = regs + registers;
+}
+// Pass the arguments to a new frame pushed onto the stack and set up its
+// registers.
+ALWAYS_INLINE void hvm_vm_push_windows(hvm_vm *vm, hvm_frame *frame, unsigned int registers) {
+  hvm_vm_slide_windows_up(vm);
+  frame->params      = vm->param_regs;
+  frame->param_count = vm->param_count;
+  hvm_vm_open_register_window(vm, frame, registers);
+}
+// Restore the windows of the parent frame after popping a frame.
+ALWAYS_INLINE void hvm_vm_pop_windows(hvm_vm *vm, hvm_frame *frame, hvm_frame *parent) {
+  if(frame->registers > 0) {
+    memset(frame->general_regs, 0, sizeof(hvm_obj_ref*) * frame->registers);
+  }
+  hvm_obj_ref **args = parent->params + HVM_ARGUMENT_REGISTERS + parent->registers;
+  hvm_vm_slide_windows_down(vm, parent->params, parent->param_count, args);
+  vm->general_regs = parent->general_regs;
+}
+// Tail calls reuse the frame, so the arguments have to be moved down into
+// its parameter window. A callee that declared its own registers gets a
+// fresh window; otherwise it carries on with the registers in use.
+ALWAYS_INLINE void hvm_vm_replace_windows(hvm_vm *vm, hvm_frame *frame, unsigned int registers) {
+  unsigned int count = vm->arg_count;
+  memcpy(vm->param_regs, vm->arg_regs, sizeof(hvm_obj_ref*) * count);
+  if(vm->param_count > count) {
+    memset(vm->param_regs + count, 0, sizeof(hvm_obj_ref*) * (vm->param_count - count));
+  }
+  memset(vm->arg_regs, 0, sizeof(hvm_obj_ref*) * count);
+  vm->param_count    = count;
+  vm->arg_count      = 0;
+  frame->params      = vm->param_regs;
+  frame->param_count = count;
+  if(registers > 0) {
+    if(frame->registers > 0) {
+      memset(frame->general_regs, 0, sizeof(hvm_obj_ref*) * frame->registers);
+    }
+    hvm_vm_open_register_window(vm, frame, registers);
+  }
+}
+
 hvm_vm *hvm_new_vm() {
   hvm_vm *vm = malloc(sizeof(hvm_vm));
   vm->ip = 0;
   vm->program_capacity = HVM_PROGRAM_INITIAL_CAPACITY;
   vm->program_size = 0;
   vm->program = calloc(sizeof(byte), vm->program_capacity);
+  vm->code_capacity = HVM_CODE_INITIAL_CAPACITY;
+  vm->code_size = 0;
+  vm->code = malloc(sizeof(hvm_instruction) * vm->code_capacity);
+  vm->code_index = malloc(sizeof(uint64_t) * vm->program_capacity);
+  vm->superinstructions_fused = 0;
+  vm->dispatches_saved = 0;
   vm->symbol_table = hvm_new_obj_struct();
-  // Registers
-  for(unsigned int i = 0; i < HVM_GENERAL_REGISTERS; i++) {
-    vm->general_regs[i] = hvm_const_null;
-  }
-  for(unsigned int i = 0; i < HVM_ARGUMENT_REGISTERS; i++) {
-    vm->arg_regs[i] = hvm_const_null;
-  }
-  for(unsigned int i = 0; i < HVM_PARAMETER_REGISTERS; i++) {
-    vm->param_regs[i] = hvm_const_null;
-  }
+  // Start at one so that call-site caches (zeroed when decoded) begin stale
+  vm->symbol_table_version = 1;
+  // Registers live on the value stack (see hvm_vm_push_windows)
+  vm->value_stack = calloc(HVM_VALUE_STACK_SIZE, sizeof(struct hvm_obj_ref*));
   // Constants
   vm->const_pool.next_index = 0;
   vm->const_pool.size = HVM_CONSTANT_POOL_INITIAL_SIZE;
-  vm->const_pool.entries = malloc(sizeof(hvm_obj_ref*) * vm->const_pool.size);
+  vm->const_pool.entries = calloc(vm->const_pool.size, sizeof(hvm_obj_ref*));
   // Variables
   vm->globals    = hvm_new_obj_struct();
   vm->symbols    = hvm_new_symbol_store();
   vm->primitives = hvm_new_obj_struct();
+  vm->root_shape = hvm_new_obj_shape_root();
 
   // Setup allocator and garbage collector
-  vm->obj_space = hvm_new_obj_space();
   vm->ref_pool  = hvm_obj_ref_pool_new();
+  vm->obj_space = hvm_new_obj_space(vm->ref_pool);
 
   vm->stack = calloc(HVM_STACK_SIZE, sizeof(struct hvm_frame));
   vm->stack_depth = 0;
   hvm_frame_initialize(&vm->stack[0]);
+  // The root frame's (empty) parameter window sits at the bottom of the
+  // value stack, followed by a full set of general registers
+  vm->param_regs  = vm->value_stack;
+  vm->param_count = 0;
+  vm->arg_count   = 0;
+  vm->stack[0].params      = vm->param_regs;
+  vm->stack[0].param_count = 0;
+  hvm_vm_open_register_window(vm, &vm->stack[0], HVM_GENERAL_REGISTERS);
   vm->root = &vm->stack[0];
   vm->top = &vm->stack[0];
 
@@ -92,6 +179,9 @@ hvm_vm *hvm_new_vm() {
   vm->jit_enabled   = 1;
   vm->is_tracing    = 0;
   vm->traces_length = 0;
+  vm->jit_queue     = hvm_new_jit_queue(vm);
+  vm->jit_cache     = getenv(HVM_JIT_CACHE_ENV);
+  vm->chunk_hash    = HVM_JIT_CACHE_HASH_SEED;
 
   return vm;
 }
@@ -99,6 +189,307 @@ hvm_vm *hvm_new_vm() {
 void hvm_vm_expand_program(hvm_vm *vm) {
   vm->program_capacity = HVM_PROGRAM_GROW_FUNCTION(vm->program_capacity);
   vm->program = realloc(vm->program, sizeof(byte) * vm->program_capacity);
+  vm->code_index = realloc(vm->code_index, sizeof(uint64_t) * vm->program_capacity);
+}
+
+uint64_t hvm_vm_instruction_index(hvm_vm *vm, uint64_t addr) {
+  // The end of the program is allowed (see `hvm_vm_decode_program`)
+  assert(addr <= vm->program_size);
+  uint64_t index = vm->code_index[addr];
+  assert(index != HVM_NOT_AN_INSTRUCTION);
+  return index;
+}
+
+// Find the index of the instruction that contains the given byte (rather
+// than just starting at it).
+static uint64_t hvm_vm_instruction_index_containing(hvm_vm *vm, uint64_t addr) {
+  if(addr >= vm->program_size) {
+    return vm->code_size;
+  }
+  while(vm->code_index[addr] == HVM_NOT_AN_INSTRUCTION) {
+    assert(addr > 0);
+    addr--;
+  }
+  return vm->code_index[addr];
+}
+
+// Returns the length (in bytes) of the instruction with the given opcode.
+static uint64_t hvm_vm_instruction_length(byte op) {
+  switch(op) {
+    case HVM_OP_NOOP:
+    case HVM_OP_DIE:
+    case HVM_OP_CLEARCATCH:
+    case HVM_OP_CLEAREXCEPTION:
+      return 1;
+    case HVM_OP_RETURN:
+    case HVM_OP_SETNULL:
+    case HVM_OP_GETCLOSURE:
+    case HVM_OP_SETEXCEPTION:
+    case HVM_OP_THROW:
+    case HVM_OP_STRUCTNEW:
+    case HVM_OP_GOTOADDRESS:
+      return 2;
+    case HVM_OP_INVOKEPRIMITIVE:
+    case HVM_OP_SYMBOLICATE:
+    case HVM_OP_GETLOCAL:
+    case HVM_OP_SETLOCAL:
+    case HVM_OP_GETLOCALSLOT:
+    case HVM_OP_SETLOCALSLOT:
+    case HVM_OP_GETGLOBAL:
+    case HVM_OP_SETGLOBAL:
+    case HVM_OP_GETEXCEPTIONDATA:
+    case HVM_OP_ARRAYPUSH:
+    case HVM_OP_ARRAYSHIFT:
+    case HVM_OP_ARRAYPOP:
+    case HVM_OP_ARRAYUNSHIFT:
+    case HVM_OP_ARRAYNEW:
+    case HVM_OP_ARRAYLEN:
+    case HVM_OP_MOVE:
+      return 3;
+    case HVM_OP_ADD:
+    case HVM_OP_SUB:
+    case HVM_OP_MUL:
+    case HVM_OP_DIV:
+    case HVM_OP_MOD:
+    case HVM_OP_POW:
+    case HVM_OP_LT:
+    case HVM_OP_GT:
+    case HVM_OP_LTE:
+    case HVM_OP_GTE:
+    case HVM_OP_EQ:
+    case HVM_OP_AND:
+    case HVM_OP_ARRAYGET:
+    case HVM_OP_ARRAYSET:
+    case HVM_OP_ARRAYREMOVE:
+    case HVM_OP_STRUCTSET:
+    case HVM_OP_STRUCTGET:
+    case HVM_OP_STRUCTDELETE:
+    case HVM_OP_STRUCTHAS:
+      return 4;
+    case HVM_OP_JUMP:
+      return 5;
+    case HVM_OP_INVOKESYMBOLIC:
+    case HVM_OP_INVOKEADDRESS:
+    case HVM_OP_SETSTRING:
+    case HVM_OP_SETINTEGER:
+    case HVM_OP_SETFLOAT:
+    case HVM_OP_SETSTRUCT:
+    case HVM_OP_SETSYMBOL:
+      return 6;
+    case HVM_OP_GOTO:
+    case HVM_OP_CALLSYMBOLIC:
+    case HVM_OP_CALLPRIMITIVE:
+      return 9;
+    case HVM_OP_IF:
+    case HVM_OP_LITINTEGER:
+    case HVM_OP_CATCH:
+      return 10;
+    case HVM_OP_TAILCALL:
+      return 12;
+    case HVM_OP_CALL:
+      return 13;
+    default:
+      // Let the dispatcher report the unknown instruction when it gets to it
+      return 1;
+  }
+}
+
+// Pull the operands for the instruction at `addr` out of the byte-code.
+static void hvm_vm_decode_instruction(hvm_vm *vm, uint64_t addr, hvm_instruction *inst) {
+  byte *bytes = &vm->program[addr];
+  uint64_t dest;
+  int32_t  diff;
+
+  memset(inst, 0, sizeof(hvm_instruction));
+  inst->op   = bytes[0];
+  inst->addr = addr;
+
+  switch(inst->op) {
+    case HVM_OP_JUMP: // 1B OP | 4B DIFF
+      memcpy(&diff, &bytes[1], sizeof(int32_t));
+      dest = (diff >= 0) ? (addr + (uint64_t)diff) : (addr - (uint64_t)(-(int64_t)diff));
+      inst->arg.dest = hvm_vm_instruction_index(vm, dest);
+      break;
+    case HVM_OP_GOTO: // 1B OP | 8B DEST
+      memcpy(&dest, &bytes[1], sizeof(uint64_t));
+      inst->arg.dest = hvm_vm_instruction_index(vm, dest);
+      break;
+    case HVM_OP_IF: // 1B OP | 1B REG  | 8B DEST
+      inst->a = bytes[1];
+      memcpy(&dest, &bytes[2], sizeof(uint64_t));
+      inst->arg.dest = hvm_vm_instruction_index(vm, dest);
+      break;
+    case HVM_OP_CATCH: // 1B OP | 8B DEST | 1B REG
+      memcpy(&dest, &bytes[1], sizeof(uint64_t));
+      inst->arg.dest = hvm_vm_instruction_index(vm, dest);
+      inst->a = bytes[9];
+      break;
+    case HVM_OP_CALL: // 1B OP | 3B TAG | 8B DEST  | 1B REG
+      hvm_subroutine_read_tag(&bytes[1], &inst->tag);
+      memcpy(&dest, &bytes[4], sizeof(uint64_t));
+      inst->arg.dest = hvm_vm_instruction_index(vm, dest);
+      inst->a = bytes[12];
+      break;
+    case HVM_OP_TAILCALL: // 1B OP | 3B TAG | 8B DEST
+      hvm_subroutine_read_tag(&bytes[1], &inst->tag);
+      memcpy(&dest, &bytes[4], sizeof(uint64_t));
+      inst->arg.dest = hvm_vm_instruction_index(vm, dest);
+      break;
+    case HVM_OP_CALLSYMBOLIC:
+    case HVM_OP_CALLPRIMITIVE: // 1B OP | 3B TAG | 4B CONST | 1B REG
+      hvm_subroutine_read_tag(&bytes[1], &inst->tag);
+      memcpy(&inst->constant, &bytes[4], sizeof(uint32_t));
+      inst->a = bytes[8];
+      break;
+    case HVM_OP_INVOKESYMBOLIC:
+    case HVM_OP_INVOKEADDRESS: // 1B OP | 3B TAG | 1B REG | 1B REG
+      hvm_subroutine_read_tag(&bytes[1], &inst->tag);
+      inst->a = bytes[4];
+      inst->b = bytes[5];
+      break;
+    case HVM_OP_SETSTRING:
+    case HVM_OP_SETINTEGER:
+    case HVM_OP_SETFLOAT:
+    case HVM_OP_SETSTRUCT:
+    case HVM_OP_SETSYMBOL: // 1B OP | 1B REG | 4B CONST
+      inst->a = bytes[1];
+      memcpy(&inst->constant, &bytes[2], sizeof(uint32_t));
+      break;
+    case HVM_OP_LITINTEGER: // 1B OP | 1B REG | 8B LIT
+      inst->a = bytes[1];
+      memcpy(&inst->arg.i64, &bytes[2], sizeof(int64_t));
+      break;
+    case HVM_OP_GETLOCALSLOT: // 1B OP | 1B REG  | 1B SLOT
+    case HVM_OP_SETLOCALSLOT: // 1B OP | 1B SLOT | 1B REG
+      inst->a = bytes[1];
+      inst->b = bytes[2];
+      // Check the slot once here so the handlers can index the frame blindly
+      byte slot = (inst->op == HVM_OP_GETLOCALSLOT) ? inst->b : inst->a;
+      if(slot >= HVM_FRAME_SLOTS) {
+        fprintf(stderr, "Local slot %d out of range at %llu (max %d)\n", slot, addr, HVM_FRAME_SLOTS);
+        assert(false);
+      }
+      break;
+    default:
+      // Everything else is just register operands
+      switch(hvm_vm_instruction_length(inst->op)) {
+        case 4: inst->c = bytes[3];// fall through
+        case 3: inst->b = bytes[2];// fall through
+        case 2: inst->a = bytes[1];// fall through
+        default: break;
+      }
+  }
+}
+
+byte hvm_vm_superinstruction_head(byte op) {
+  switch(op) {
+    case HVM_OP_LTIF:      return HVM_OP_LT;
+    case HVM_OP_GTIF:      return HVM_OP_GT;
+    case HVM_OP_LTEIF:     return HVM_OP_LTE;
+    case HVM_OP_GTEIF:     return HVM_OP_GTE;
+    case HVM_OP_EQIF:      return HVM_OP_EQ;
+    case HVM_OP_LITADD:    return HVM_OP_LITINTEGER;
+    case HVM_OP_ARRAYGET2: return HVM_OP_ARRAYGET;
+    default:               return op;
+  }
+}
+
+// Peephole pass over decoded instructions that replaces common pairs with a
+// single superinstruction. The superinstruction keeps the operands of the
+// first instruction; the second is left untouched (so that branches to it
+// still work) and is read by the superinstruction's handler as needed.
+static void hvm_vm_fuse_superinstructions(hvm_vm *vm, uint64_t start, uint64_t end) {
+  hvm_instruction *inst, *next;
+  hvm_obj_ref *lit;
+  byte fused;
+
+  for(uint64_t i = start; (i + 1) < end; i++) {
+    inst  = &vm->code[i];
+    next  = &vm->code[i + 1];
+    fused = inst->op;
+    switch(inst->op) {
+      case HVM_OP_LT:
+      case HVM_OP_GT:
+      case HVM_OP_LTE:
+      case HVM_OP_GTE:
+      case HVM_OP_EQ:
+        // Only fuse if the IF is branching on the result of the comparison
+        if(next->op != HVM_OP_IF || next->a != inst->a) { break; }
+        if(inst->op == HVM_OP_LT)  { fused = HVM_OP_LTIF; }
+        if(inst->op == HVM_OP_GT)  { fused = HVM_OP_GTIF; }
+        if(inst->op == HVM_OP_LTE) { fused = HVM_OP_LTEIF; }
+        if(inst->op == HVM_OP_GTE) { fused = HVM_OP_GTEIF; }
+        if(inst->op == HVM_OP_EQ)  { fused = HVM_OP_EQIF; }
+        inst->arg.dest = next->arg.dest;
+        break;
+      case HVM_OP_LITINTEGER:
+        if(next->op != HVM_OP_ADD || (next->b != inst->a && next->c != inst->a)) { break; }
+        // Build the literal once up front rather than on every execution
+        lit = hvm_new_obj_int_value(vm, inst->arg.i64);
+        if(!hvm_obj_is_immediate(lit)) {
+          lit->flags = lit->flags | HVM_OBJ_FLAG_CONSTANT;
+        }
+        inst->constant = hvm_vm_add_const(vm, lit);
+        fused = HVM_OP_LITADD;
+        break;
+      case HVM_OP_ARRAYGET:
+        if(next->op != HVM_OP_ARRAYGET) { break; }
+        fused = HVM_OP_ARRAYGET2;
+        break;
+      default:
+        break;
+    }
+    if(fused != inst->op) {
+      inst->op = fused;
+      vm->superinstructions_fused += 1;
+      // Don't let pairs overlap
+      i++;
+    }
+  }
+}
+
+void hvm_vm_print_superinstruction_stats(hvm_vm *vm) {
+  fprintf(stderr, "superinstructions: %llu fused, %llu dispatches saved\n",
+          vm->superinstructions_fused, vm->dispatches_saved);
+}
+
+// Translate the byte-code in the given range of the program into
+// instructions appended to the VM's code. Must be run after constants and
+// relocations have been resolved in the byte-code.
+void hvm_vm_decode_program(hvm_vm *vm, uint64_t start, uint64_t end) {
+  uint64_t addr, count = 0;
+  // First pass: figure out where each instruction begins so that branch
+  // destinations (which may point forwards) can be resolved in the second
+  addr = start;
+  while(addr < end) {
+    vm->code_index[addr] = vm->code_size + count;
+    uint64_t length = hvm_vm_instruction_length(vm->program[addr]);
+    for(uint64_t i = 1; i < length && (addr + i) < end; i++) {
+      vm->code_index[addr + i] = HVM_NOT_AN_INSTRUCTION;
+    }
+    addr  += length;
+    count += 1;
+  }
+  // Branches are allowed to target the very end of the program
+  vm->code_index[end] = vm->code_size + count;
+  // Make sure there's room for the new instructions (plus a terminating DIE)
+  while((vm->code_size + count + 1) > vm->code_capacity) {
+    vm->code_capacity = HVM_PROGRAM_GROW_FUNCTION(vm->code_capacity);
+  }
+  vm->code = realloc(vm->code, sizeof(hvm_instruction) * vm->code_capacity);
+  // Second pass: decode each instruction
+  uint64_t first = vm->code_size;
+  addr = start;
+  while(addr < end) {
+    hvm_vm_decode_instruction(vm, addr, &vm->code[vm->code_size]);
+    vm->code_size += 1;
+    addr += hvm_vm_instruction_length(vm->program[addr]);
+  }
+  hvm_vm_fuse_superinstructions(vm, first, vm->code_size);
+  // Halt if execution runs off the end of the program
+  memset(&vm->code[vm->code_size], 0, sizeof(hvm_instruction));
+  vm->code[vm->code_size].op   = HVM_OP_DIE;
+  vm->code[vm->code_size].addr = end;
 }
 
 void hvm_vm_load_chunk_debug_entries(hvm_vm *vm, uint64_t start, hvm_chunk_debug_entry **entries) {
@@ -113,8 +504,9 @@ void hvm_vm_load_chunk_debug_entries(hvm_vm *vm, uint64_t start, hvm_chunk_debug
     // Copy entry
     uint64_t size = vm->debug_entries_size;
     memcpy(&vm->debug_entries[size], de, sizeof(hvm_chunk_debug_entry));
-    vm->debug_entries[size].start += start;
-    vm->debug_entries[size].end   += start;
+    // Entries address bytes in the chunk; convert those to instructions
+    vm->debug_entries[size].start = hvm_vm_instruction_index_containing(vm, start + de->start);
+    vm->debug_entries[size].end   = hvm_vm_instruction_index_containing(vm, start + de->end);
 
     vm->debug_entries_size++;
     entries++;
@@ -125,12 +517,21 @@ void hvm_vm_load_chunk_symbols(hvm_vm *vm, uint64_t start, hvm_chunk_symbol **sy
   hvm_chunk_symbol *sym;
   while(*syms != NULL) {
     sym = *syms;
-    uint64_t dest   = start + sym->index;
+    uint64_t dest   = hvm_vm_instruction_index(vm, start + sym->index);
     uint64_t sym_id = hvm_symbolicate(vm->symbols, sym->name);
-    hvm_obj_ref *entry = malloc(sizeof(hvm_obj_ref));
+    // The GC visits the symbol table, so the entry's flags must be cleared
+    hvm_obj_ref *entry = hvm_new_obj_ref();
     entry->type = HVM_INTERNAL;
     entry->data.u64 = dest;
     hvm_obj_struct_internal_set(vm->symbol_table, sym_id, entry);
+    // Calls read the register count off the subroutine's first instruction
+    if(sym->registers > HVM_GENERAL_REGISTERS) {
+      fprintf(stderr, "Subroutine %s needs %u registers (max %d)\n", sym->name, sym->registers, HVM_GENERAL_REGISTERS);
+      assert(false);
+    }
+    vm->code[dest].registers = (byte)sym->registers;
+    // Subroutines may have been redefined; invalidate call-site caches
+    vm->symbol_table_version++;
 
     syms++;
   }
@@ -140,6 +541,13 @@ void hvm_vm_load_chunk_constants(hvm_vm *vm, uint64_t start, hvm_chunk_constant
   while(*consts != NULL) {
     cnst = *consts;
     hvm_obj_ref *obj = hvm_chunk_get_constant_object(vm, cnst);
+    // Compiled traces refer to constants by index, so their contents are
+    // part of what cached traces are keyed by
+    hvm_obj_ref *co = cnst->object;
+    vm->chunk_hash = hvm_jit_cache_hash(vm->chunk_hash, &co->type, sizeof(hvm_obj_type));
+    if(co->type == HVM_STRING || co->type == HVM_SYMBOL) {
+      vm->chunk_hash = hvm_jit_cache_hash(vm->chunk_hash, co->data.v, strlen(co->data.v));
+    }
     uint32_t const_id = hvm_vm_add_const(vm, obj);
     memcpy(&vm->program[start + cnst->index], &const_id, sizeof(uint32_t));
 
@@ -178,6 +586,8 @@ void hvm_vm_load_chunk_relocations(hvm_vm *vm, uint64_t start, hvm_chunk_relocat
 
 void hvm_vm_load_chunk(hvm_vm *vm, void *cv) {
   hvm_chunk *chunk = cv;
+  // Traces being compiled read the chunk hash and the constant pool
+  hvm_jit_queue_wait(vm->jit_queue);
   while((vm->program_size + chunk->size + 16) > vm->program_capacity) {
     hvm_vm_expand_program(vm);
   }
@@ -185,18 +595,26 @@ void hvm_vm_load_chunk(hvm_vm *vm, void *cv) {
   // Copy over the main chunk data.
   memcpy(&vm->program[start], chunk->data, sizeof(byte) * chunk->size);
   vm->program_size += chunk->size;
+  vm->chunk_hash = hvm_jit_cache_hash(vm->chunk_hash, chunk->data, chunk->size);
   // Copy over the stuff from the chunk header.
-  hvm_vm_load_chunk_symbols(vm, start, chunk->symbols);
   hvm_vm_load_chunk_constants(vm, start, chunk->constants);
   hvm_vm_load_chunk_relocations(vm, start, chunk->relocs);
+  // With the byte-code fixed up it can be decoded, after which symbols and
+  // debug entries can be mapped to their instructions.
+  hvm_vm_decode_program(vm, start, vm->program_size);
+  hvm_vm_load_chunk_symbols(vm, start, chunk->symbols);
   hvm_vm_load_chunk_debug_entries(vm, start, chunk->debug_entries);
 }
 
 hvm_obj_ref *hvm_vm_call_primitive(hvm_vm *vm, hvm_obj_ref *sym_object) {
   hvm_obj_ref* (*prim)(hvm_vm *vm);
+  hvm_obj_ref *result;
+  hvm_obj_ref **params = vm->param_regs;
+  hvm_obj_ref **args   = vm->arg_regs;
+  unsigned int param_count = vm->param_count;
 
-  assert(sym_object->type == HVM_SYMBOL);
-  hvm_symbol_id sym_id = sym_object->data.u64;
+  assert(hvm_obj_type_of(sym_object) == HVM_SYMBOL);
+  hvm_symbol_id sym_id = hvm_obj_symbol_value(sym_object);
 
   // hvm_obj_print_structure(vm, vm->primitives);
   void *pv = hvm_obj_struct_internal_get(vm->primitives, sym_id);
@@ -208,7 +626,7 @@ hvm_obj_ref *hvm_vm_call_primitive(hvm_vm *vm, hvm_obj_ref *sym_object) {
     strcat(buff, "Primitive not found: ");
     // NOTE: Possible error that desymbolicate() could fail.
     strcat(buff, hvm_desymbolicate(vm->symbols, sym_id));
-    hvm_obj_ref *message = hvm_new_obj_ref_string_data(hvm_util_strclone(buff));
+    hvm_obj_ref *message = hvm_new_obj_ref_string_data(vm, hvm_util_strclone(buff));
     hvm_obj_ref *exc = hvm_exception_new(vm, message);
 
     hvm_location *loc = hvm_new_location();
@@ -216,16 +634,24 @@ hvm_obj_ref *hvm_vm_call_primitive(hvm_vm *vm, hvm_obj_ref *sym_object) {
     hvm_exception_push_location(vm, exc, loc);
 
     vm->exception = exc;
+    // Arguments are consumed even though nothing was called
+    memset(vm->arg_regs, 0, sizeof(hvm_obj_ref*) * vm->arg_count);
+    vm->arg_count = 0;
     return NULL;
   }
   prim = pv;
+  // Primitives see the arguments as their parameters (just like a
+  // subroutine would)
+  hvm_vm_slide_windows_up(vm);
   // Invoke the actual primitive
-  return prim(vm);
+  result = prim(vm);
+  hvm_vm_slide_windows_down(vm, params, param_count, args);
+  return result;
 }
 
 hvm_obj_ref *hvm_new_operand_not_integer_exception(hvm_vm *vm) {
   char *msg = "Operands must be integers";
-  hvm_obj_ref *message = hvm_new_obj_ref_string_data(hvm_util_strclone(msg));
+  hvm_obj_ref *message = hvm_new_obj_ref_string_data(vm, hvm_util_strclone(msg));
   hvm_obj_ref *exc = hvm_exception_new(vm, message);
 
   hvm_location *loc = hvm_new_location();
@@ -235,7 +661,7 @@ hvm_obj_ref *hvm_new_operand_not_integer_exception(hvm_vm *vm) {
 }
 
 hvm_obj_ref* hvm_vm_build_closure(hvm_vm *vm) {
-  hvm_obj_ref *ref = hvm_new_obj_ref();
+  hvm_obj_ref *ref = hvm_obj_ref_new_from_pool(vm);
   ref->type = HVM_STRUCTURE;
   // Create the closure struct and write the whole stack into it (bottom-up)
   hvm_obj_struct *closure_struct = hvm_new_obj_struct();
@@ -244,10 +670,13 @@ hvm_obj_ref* hvm_vm_build_closure(hvm_vm *vm) {
     hvm_frame *frame = &vm->stack[i];
     hvm_obj_struct *locals = frame->locals;
     unsigned int idx;
-    for(idx = 0; idx < locals->heap_length; idx++) {
-      // Copy entry in the scope's structure heap into the closure
-      hvm_obj_struct_heap_pair *pair = locals->heap[idx];
-      hvm_obj_struct_internal_set(closure_struct, pair->id, pair->obj);
+    // Only symbolic locals are visible to closures
+    if(locals == NULL) { i++; continue; }
+    for(idx = 0; idx < hvm_obj_struct_slot_count(locals); idx++) {
+      // Copy entry in the scope's structure into the closure
+      hvm_symbol_id id = hvm_obj_struct_slot_key(locals, idx);
+      if(id == 0) { continue; }
+      hvm_obj_struct_internal_set(closure_struct, id, locals->values[idx]);
     }
     // Move up the stack
     i++;
@@ -297,7 +726,9 @@ void _hvm_vm_register_write(hvm_vm *vm, byte reg, hvm_obj_ref* ref) {
   if(reg <= 127) {
     vm->general_regs[reg] = ref;
   } else if(reg >= 130 && reg <= 145) {
-    vm->arg_regs[reg - 130] = ref;
+    unsigned int i = reg - 130;
+    vm->arg_regs[i] = ref;
+    if(i >= vm->arg_count) { vm->arg_count = i + 1; }
   }
   // Else noop
 }
@@ -308,9 +739,12 @@ hvm_obj_ref* _hvm_vm_register_read(hvm_vm *vm, byte reg) {
   if(reg <= 127) {
     return vm->general_regs[reg];
   }
-  if(reg >= 146 && reg <= 162) {
-    return vm->param_regs[reg - 146];
+  if(reg >= 146 && reg <= 161) {
+    hvm_obj_ref *ref = vm->param_regs[reg - 146];
+    // Parameters that weren't passed read as null
+    return (ref != NULL) ? ref : hvm_const_null;
   }
+  if(reg == 162) { return hvm_obj_int_immediate(vm->param_count); }
   if(reg == 128) { return hvm_const_zero; }
   if(reg == 129) { return hvm_const_null; }
   // Should never reach here.
@@ -326,26 +760,6 @@ void hvm_vm_register_write(hvm_vm *vm, byte reg, hvm_obj_ref *ref) {
   _hvm_vm_register_write(vm, reg, ref);
 }
 
-// Copy argument registers into parameter registers.
-void hvm_vm_copy_regs(hvm_vm *vm) {
-  int64_t i;
-  // Reset params
-  for(i = 0; i < HVM_PARAMETER_REGISTERS; i++) { vm->param_regs[i] = NULL; }
-  // Copy args into params
-  i = 0;
-  while(i < HVM_ARGUMENT_REGISTERS && vm->arg_regs[i] != NULL) {
-    // Copy and null the source
-    vm->param_regs[i] = vm->arg_regs[i];
-    vm->arg_regs[i] = NULL;
-  }
-  // Set special $pn register.
-  // TODO: Make sure this works with the object space properly so that it
-  //       doesn't get leaked.
-  hvm_obj_ref *pn = hvm_new_obj_int(vm);
-  pn->data.i64 = i + 1;
-  vm->param_regs[HVM_PARAMETER_REGISTERS - 1] = pn;
-}
-
 // Utility function for setting up new stack frames
 ALWAYS_INLINE void hvm_frame_initialize_returning(hvm_frame *frame, uint64_t return_addr, byte return_register) {
   // Initialize all the parts of the frame
@@ -360,10 +774,68 @@ typedef enum {
   HVM_DISPATCH_PATH_JIT
 } hvm_dispatch_path;
 
+// Whether a completed trace's native code is ready to run. Traces are
+// compiled in the background, so until it's been published the trace is
+// handed to the compiler (if it hasn't been already) and left interpreted.
+static inline bool hvm_dispatch_trace_ready(hvm_vm *vm, hvm_call_trace *trace) {
+  // Traces missing instructions the tracer couldn't follow (or cut short
+  // before the call returned) stay interpreted
+  if(trace->unsupported || trace->abandoned) {
+    return false;
+  }
+  if(__atomic_load_n(&trace->native_function, __ATOMIC_ACQUIRE) != NULL) {
+    return true;
+  }
+  if(!trace->queued) {
+    // If the queue's full it'll be offered again on a later call
+    trace->queued = hvm_jit_queue_push(vm->jit_queue, trace);
+  }
+  return __atomic_load_n(&trace->native_function, __ATOMIC_ACQUIRE) != NULL;
+}
+
+// Count a bailout from `trace` through its side exit to `vm->ip`. Returns
+// the trace of that exit if it's ready to run in place of the interpreter.
+// Otherwise returns NULL, and `path` says whether the interpreter should
+// trace the rest of the call from the exit (once the exit is hot).
+static hvm_call_trace *hvm_dispatch_side_exit(hvm_vm *vm, hvm_frame *frame, hvm_call_trace *trace, hvm_dispatch_path *path) {
+  *path = HVM_DISPATCH_PATH_NORMAL;
+  // A trace that bails out where it started hasn't got anywhere, so a
+  // trace from there wouldn't either
+  if(vm->ip == trace->entry) {
+    return NULL;
+  }
+  hvm_jit_side_exit *side_exit = hvm_jit_trace_side_exit(trace, vm->ip);
+  if(side_exit == NULL) {
+    return NULL;
+  }
+  hvm_call_trace *side_trace = side_exit->trace;
+  if(side_trace == NULL) {
+    side_exit->count += 1;
+    if(side_exit->count > HVM_JIT_SIDE_EXIT_THRESHOLD && !vm->is_tracing) {
+#ifdef HVM_JIT_DEBUG
+      fprintf(stderr, "switching to trace dispatch for side exit 0x%08llX\n", vm->ip);
+#endif
+      side_trace = hvm_new_call_trace(vm);
+      side_trace->parent = trace;
+      side_exit->trace = side_trace;
+      frame->trace = side_trace;
+      vm->is_tracing = 1;
+      *path = HVM_DISPATCH_PATH_JIT;
+    }
+    return NULL;
+  }
+  // It may still be being traced (by an outer call if it's recursive) or
+  // have been abandoned
+  if(!side_trace->complete || !hvm_dispatch_trace_ready(vm, side_trace)) {
+    return NULL;
+  }
+  return side_trace;
+}
+
 // Handle dispatching to JIT path if appropriate
-ALWAYS_INLINE hvm_dispatch_path hvm_dispatch_frame(hvm_vm *vm, hvm_frame *frame, hvm_subroutine_tag *tag, byte *caller_tag) {
-  uint64_t dest = vm->ip;
+ALWAYS_INLINE hvm_dispatch_path hvm_dispatch_frame(hvm_vm *vm, hvm_frame *frame, hvm_subroutine_tag *tag) {
   hvm_call_trace *trace;
+  hvm_dispatch_path path;
   // Return the normal path immediately if we shouldn't JIT
   if (!vm->jit_enabled) {
     return HVM_DISPATCH_PATH_NORMAL;
@@ -375,40 +847,53 @@ ALWAYS_INLINE hvm_dispatch_path hvm_dispatch_frame(hvm_vm *vm, hvm_frame *frame,
       // .trace_index is offset by one so that we can use 0 to mean
       // no-trace-exists.
       trace = vm->traces[tag->trace_index - 1];
-      // Guard that the trace really is completed
-      assert(trace->complete);
-      // If we don't already have a compiled function then compile it
-      if(trace->compiled_function == NULL) {
-        hvm_jit_compile_trace(vm, trace);
-        fprintf(stderr, "compiled trace for 0x%08llX\n", dest);
+      // Guard that the trace really is completed (or was abandoned, in which
+      // case it's never run)
+      assert(trace->complete || trace->abandoned);
+      // Keep interpreting until its native function has been published
+      if(!hvm_dispatch_trace_ready(vm, trace)) {
+        return HVM_DISPATCH_PATH_NORMAL;
       }
-      fprintf(stderr, "running compiled trace for 0x%08llX\n", dest);
-      hvm_jit_exit *result = hvm_jit_run_compiled_trace(vm, trace);
-      if(result->ret.status == HVM_JIT_EXIT_BAILOUT) {
+#ifdef HVM_JIT_DEBUG
+      fprintf(stderr, "running compiled trace for 0x%08llX\n", vm->ip);
+#endif
+      hvm_jit_exit result;
+      hvm_jit_run_compiled_trace(vm, trace, &result);
+      // Bailouts through side exits that have traces of their own go
+      // straight on into those (and from there on down the tree)
+      while(result.ret.status == HVM_JIT_EXIT_BAILOUT) {
         // If it's a bailout then we need to return to normal execution
-        vm->ip = result->bailout.destination;
-        return HVM_DISPATCH_PATH_NORMAL;
-      } else {
-        assert(vm->stack_depth != 0);
-        // Otherwise it was a successful execution so pop off our frame and
-        // return to the caller
-        vm->ip = frame->return_addr;
-        vm->stack_depth -= 1;
-        vm->top = &vm->stack[vm->stack_depth];
-        hvm_vm_register_write(vm, frame->return_register, result->ret.value);
-        return HVM_DISPATCH_PATH_NORMAL;
+        vm->ip = result.bailout.destination;
+        trace  = hvm_dispatch_side_exit(vm, frame, trace, &path);
+        if(trace == NULL) {
+          return path;
+        }
+        hvm_jit_run_compiled_trace(vm, trace, &result);
       }
+      assert(vm->stack_depth != 0);
+      // Otherwise it was a successful execution so pop off our frame and
+      // return to the caller
+      vm->ip = frame->return_addr;
+      vm->stack_depth -= 1;
+      vm->top = &vm->stack[vm->stack_depth];
+      hvm_vm_pop_windows(vm, frame, vm->top);
+      hvm_vm_register_write(vm, frame->return_register, result.ret.value);
+      return HVM_DISPATCH_PATH_NORMAL;
     }
     // fprintf(stderr, "subroutine %s:0x%08llX has heat %d\n", sym_name, dest, tag.heat);
     // Check if we need to start tracing
+    // If frame is already being traced
+    if(frame->trace != NULL) {
+      return HVM_DISPATCH_PATH_JIT;
+    }
+    // Only one call is traced at a time (a trace doesn't follow calls into
+    // other subroutines)
     if(!vm->is_tracing) {
-      // If frame is already being traced
-      if(frame->trace != NULL) {
-        return HVM_DISPATCH_PATH_JIT;
-      }
-      fprintf(stderr, "switching to trace dispatch for 0x%08llX\n", dest);
+#ifdef HVM_JIT_DEBUG
+      fprintf(stderr, "switching to trace dispatch for 0x%08llX\n", vm->ip);
+#endif
       trace = hvm_new_call_trace(vm);
-      trace->caller_tag = caller_tag;
+      trace->caller_tag = tag;
       frame->trace = trace;
       vm->is_tracing = 1;
       return HVM_DISPATCH_PATH_JIT;
@@ -417,6 +902,135 @@ ALWAYS_INLINE hvm_dispatch_path hvm_dispatch_frame(hvm_vm *vm, hvm_frame *frame,
   return HVM_DISPATCH_PATH_NORMAL;
 }
 
+// Look up the instruction index of a subroutine by name.
+static uint64_t hvm_vm_resolve_subroutine(hvm_vm *vm, hvm_symbol_id id) {
+  hvm_obj_ref *val = hvm_obj_struct_internal_get(vm->symbol_table, id);
+  assert(val != NULL && val->type == HVM_INTERNAL);
+  return val->data.u64;
+}
+
+ALWAYS_INLINE uint64_t hvm_vm_callsymbolic_dest(hvm_vm *vm, hvm_instruction *inst, hvm_symbol_id id) {
+  // The symbol is a constant, so the site only needs to be re-resolved when
+  // the symbol table changes
+  if(inst->cache.call.version == vm->symbol_table_version) {
+    return inst->cache.call.dest;
+  }
+  uint64_t dest = hvm_vm_resolve_subroutine(vm, id);
+  inst->cache.call.version = vm->symbol_table_version;
+  inst->cache.call.dest    = dest;
+  return dest;
+}
+
+ALWAYS_INLINE uint64_t hvm_vm_invokesymbolic_dest(hvm_vm *vm, hvm_instruction *inst, hvm_symbol_id id) {
+  hvm_call_cache *cache = inst->cache.invoke;
+  unsigned int i;
+  if(cache == NULL) {
+    cache = calloc(1, sizeof(hvm_call_cache));
+    inst->cache.invoke = cache;
+  }
+  if(cache->version != vm->symbol_table_version) {
+    cache->version = vm->symbol_table_version;
+    cache->length  = 0;
+    cache->next    = 0;
+  }
+  for(i = 0; i < cache->length; i++) {
+    if(cache->symbols[i] == id) { return cache->dests[i]; }
+  }
+  uint64_t dest = hvm_vm_resolve_subroutine(vm, id);
+  // Fill free entries first, then replace entries in turn
+  if(cache->length < HVM_CALL_CACHE_SIZE) {
+    i = cache->length++;
+  } else {
+    i = cache->next;
+    cache->next = (cache->next + 1) % HVM_CALL_CACHE_SIZE;
+  }
+  cache->symbols[i] = id;
+  cache->dests[i]   = dest;
+  return dest;
+}
+
+// Inline-cached structure access for STRUCTGET, STRUCTSET and STRUCTHAS.
+// Each instruction remembers the last (shape, key) it saw and the slot the
+// key lives in, so monomorphic accesses are a compare plus a load or store.
+// Misses do the full lookup and re-prime the cache.
+#define FIELD_CACHE_HIT(INST, SHAPE, KEY) \
+  ((SHAPE) != NULL && (SHAPE) == (INST)->cache.field.shape && (KEY) == (INST)->cache.field.key)
+
+static inline void hvm_vm_prime_field_cache(hvm_instruction *inst, hvm_obj_shape *shape, hvm_obj_shape *transition, hvm_symbol_id key, uint32_t slot) {
+  inst->cache.field.shape      = shape;
+  inst->cache.field.transition = transition;
+  inst->cache.field.key        = key;
+  inst->cache.field.slot       = slot;
+}
+
+ALWAYS_INLINE hvm_obj_ref *hvm_vm_struct_get_cached(hvm_instruction *inst, hvm_obj_struct *strct, hvm_symbol_id key) {
+  hvm_obj_shape *shape = strct->shape;
+  if(FIELD_CACHE_HIT(inst, shape, key)) {
+    return strct->values[inst->cache.field.slot];
+  }
+  if(shape == NULL) {
+    return hvm_obj_struct_internal_get(strct, key);
+  }
+  uint32_t slot = hvm_obj_shape_slot(shape, key);
+  if(slot == HVM_SHAPE_NO_SLOT) {
+    return NULL;
+  }
+  hvm_vm_prime_field_cache(inst, shape, NULL, key, slot);
+  return strct->values[slot];
+}
+
+ALWAYS_INLINE bool hvm_vm_struct_has_cached(hvm_instruction *inst, hvm_obj_struct *strct, hvm_symbol_id key) {
+  hvm_obj_shape *shape = strct->shape;
+  if(FIELD_CACHE_HIT(inst, shape, key)) {
+    return inst->cache.field.slot != HVM_SHAPE_NO_SLOT;
+  }
+  if(shape == NULL) {
+    return hvm_obj_struct_internal_get(strct, key) != NULL;
+  }
+  // Absence is cached too
+  uint32_t slot = hvm_obj_shape_slot(shape, key);
+  hvm_vm_prime_field_cache(inst, shape, NULL, key, slot);
+  return slot != HVM_SHAPE_NO_SLOT;
+}
+
+ALWAYS_INLINE void hvm_vm_struct_set_cached(hvm_instruction *inst, hvm_obj_struct *strct, hvm_symbol_id key, hvm_obj_ref *val) {
+  hvm_obj_shape *shape = strct->shape;
+  hvm_obj_shape *transition;
+  uint32_t slot;
+  if(FIELD_CACHE_HIT(inst, shape, key)) {
+    slot       = inst->cache.field.slot;
+    transition = inst->cache.field.transition;
+  } else {
+    if(shape == NULL) {
+      hvm_obj_struct_internal_set(strct, key, val);
+      return;
+    }
+    slot       = hvm_obj_shape_slot(shape, key);
+    transition = NULL;
+    if(slot == HVM_SHAPE_NO_SLOT) {
+      // Adding a key; remember the transition so the next structure built
+      // the same way skips the lookup
+      transition = hvm_obj_shape_transition(shape, key);
+      if(transition == NULL) {
+        // Shape is full, so this moves the structure to dictionary mode
+        hvm_obj_struct_internal_set(strct, key, val);
+        return;
+      }
+      slot = shape->length;
+    }
+    hvm_vm_prime_field_cache(inst, shape, transition, key, slot);
+  }
+  hvm_obj_struct_write_barrier(strct, val);
+  if(transition != NULL) {
+    if(transition->length > strct->capacity) {
+      hvm_obj_struct_reserve_slots(strct, transition->length);
+    }
+    strct->shape  = transition;
+    strct->length = transition->length;
+  }
+  strct->values[slot] = val;
+}
+
 // Utility macro for properly dispatching a dispatch-path to the
 // regular dispatcher or the tracing-for-JIT dispatcher
 #define DISPATCH_PATH(DP)          \
@@ -434,30 +1048,41 @@ ALWAYS_INLINE hvm_dispatch_path hvm_dispatch_frame(hvm_vm *vm, hvm_frame *frame,
 #define READ_I64(V) *(int64_t*)(V)
 
 
-#define READ_TAG            hvm_subroutine_read_tag(&vm->program[vm->ip + 1], &tag);
-#define WRITE_TAG           hvm_subroutine_write_tag(&vm->program[vm->ip + 1], &tag);
-#define INCREMENT_TAG_HEAT  if(tag.heat != 1024) { tag.heat += 1; }
+#define INCREMENT_TAG_HEAT  if(inst->tag.heat != 1024) { inst->tag.heat += 1; }
 
 // Generic tag handler
 #define PROCESS_TAG { \
-  READ_TAG; \
   INCREMENT_TAG_HEAT; \
-  WRITE_TAG; \
 }
 
 
-#define AREG areg = vm->program[vm->ip + 1];
-#define BREG breg = vm->program[vm->ip + 2];
-#define CREG creg = vm->program[vm->ip + 3];
+#define AREG areg = inst->a;
+#define BREG breg = inst->b;
+#define CREG creg = inst->c;
 
 #define CHECK_EXCEPTION if(vm->exception != NULL) { goto handle_exception; }
 
+// Direct-threaded dispatch (HVM_VM_COMPUTED_GOTO) relies on GCC's
+// labels-as-values extension. The debugger needs to get control before every
+// instruction, so debug builds always use the plain switch dispatcher.
+#if defined(HVM_VM_COMPUTED_GOTO) && !defined(__GNUC__)
+#error HVM_VM_COMPUTED_GOTO requires labels-as-values (GCC or Clang)
+#endif
+#ifdef HVM_VM_DEBUG
+#undef HVM_VM_COMPUTED_GOTO
+#endif
+
+// Build the per-dispatcher label for an opcode handler (eg.
+// `execute_HVM_OP_ADD` or `execute_jit_HVM_OP_ADD`).
+#define HVM_DISPATCH_LABEL(PREFIX, OP)  _HVM_DISPATCH_LABEL(PREFIX, OP)
+#define _HVM_DISPATCH_LABEL(PREFIX, OP) PREFIX##_##OP
+
 void hvm_vm_run(hvm_vm *vm) {
   byte instr;
-  byte *caller_tag;
+  hvm_instruction *inst;
   uint32_t const_index, depth;
   uint64_t dest, sym_id;//, return_addr;
-  int32_t diff;
+  bool branch;
   int64_t i64;
   unsigned char reg, areg, breg, creg;
   hvm_obj_ref *a, *b, *c, *arr, *idx, *key, *val, *strct;
@@ -465,7 +1090,6 @@ void hvm_vm_run(hvm_vm *vm) {
   // hvm_exception *exc;
   hvm_obj_ref *exc;
   char *msg;
-  hvm_subroutine_tag tag;
   // hvm_call_trace *trace;
   // Variables needed by the debugger
   #ifdef HVM_VM_DEBUG
@@ -531,20 +1155,27 @@ struct hvm_obj_ref* hvm_vm_get_const(hvm_vm *vm, uint32_t id) {
   return hvm_const_pool_get_const(&vm->const_pool, id);
 }
 void hvm_vm_set_const(hvm_vm *vm, uint32_t id, struct hvm_obj_ref* obj) {
+  // Traces being compiled read constants out of the pool, so it can't be
+  // reallocated from under them
+  if(id >= vm->const_pool.size) { hvm_jit_queue_wait(vm->jit_queue); }
   hvm_const_pool_set_const(&vm->const_pool, id, obj);
 }
 uint32_t hvm_vm_add_const(hvm_vm *vm, struct hvm_obj_ref* obj) {
+  // Setting the constant moves `next_index` past it
   uint32_t id = vm->const_pool.next_index;
   hvm_vm_set_const(vm, id, obj);
-  vm->const_pool.next_index += 1;
   return id;
 }
 
 void hvm_const_pool_expand(hvm_const_pool* pool, uint32_t id) {
+  uint32_t old_size = pool->size;
   while(id >= pool->size) {
     pool->size = pool->size * HVM_CONSTANT_POOL_GROWTH_RATE;
-    pool->entries = realloc(pool->entries, sizeof(struct hvm_obj_ref*) * pool->size);
   }
+  if(pool->size == old_size) { return; }
+  pool->entries = realloc(pool->entries, sizeof(struct hvm_obj_ref*) * pool->size);
+  // The GC scans every entry below `next_index`, so gaps have to be empty
+  memset(&pool->entries[old_size], 0, sizeof(struct hvm_obj_ref*) * (pool->size - old_size));
 }
 
 struct hvm_obj_ref* hvm_const_pool_get_const(hvm_const_pool* pool, uint32_t id) {
@@ -555,6 +1186,7 @@ struct hvm_obj_ref* hvm_const_pool_get_const(hvm_const_pool* pool, uint32_t id)
 void hvm_const_pool_set_const(hvm_const_pool* pool, uint32_t id, struct hvm_obj_ref* obj) {
   hvm_const_pool_expand(pool, id);
   pool->entries[id] = obj;
+  if(id >= pool->next_index) { pool->next_index = id + 1; }
 }
 
 hvm_obj_ref* hvm_get_global(hvm_vm *vm, hvm_symbol_id id) {
@@ -567,12 +1199,15 @@ void hvm_set_global(hvm_vm* vm, hvm_symbol_id id, struct hvm_obj_ref *global) {
 }
 
 void hvm_set_local(struct hvm_frame *frame, hvm_symbol_id id, struct hvm_obj_ref* local) {
-  hvm_obj_struct *locals = frame->locals;
-  hvm_obj_struct_internal_set(locals, id, local);
+  if(frame->locals == NULL) {
+    frame->locals = hvm_new_obj_struct();
+  }
+  hvm_obj_struct_internal_set(frame->locals, id, local);
 }
 
 struct hvm_obj_ref* hvm_get_local(struct hvm_frame *frame, hvm_symbol_id id) {
   hvm_obj_struct *locals = frame->locals;
+  if(locals == NULL) { return NULL; }
   hvm_obj_ref    *ref    = hvm_obj_struct_internal_get(locals, id);
   return ref;
 }
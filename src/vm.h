@@ -10,8 +10,6 @@ typedef unsigned char byte;
 
 /// VM opcode (256 max)
 typedef byte hvm_opcode;
-/// VM instruction
-typedef uint64_t hvm_instruction;
 
 /// Internal ID of a symbol.
 typedef uint64_t hvm_symbol_id;
@@ -28,10 +26,19 @@ typedef uint64_t hvm_symbol_id;
 
 #define HVM_PROGRAM_GROW_FUNCTION(V) (V * 2)
 
+/// Initial size (in instructions) for decoded program code.
+/// @relates hvm_vm
+#define HVM_CODE_INITIAL_CAPACITY 4096
+
 /// Maximum stack size (in frames)
 /// @relates hvm_vm
 #define HVM_STACK_SIZE 16384
 
+/// Size (in object references) of the value stack holding the frames'
+/// parameter and register windows.
+/// @relates hvm_vm
+#define HVM_VALUE_STACK_SIZE (1 << 20)
+
 /// Threshold for a function to be hot and ready for tracing and compiling
 #define HVM_TRACE_THRESHOLD 2
 
@@ -103,7 +110,7 @@ typedef struct hvm_vm {
   uint64_t debug_entries_capacity;
   uint64_t debug_entries_size;
 
-  /// Instruction pointer (indexes bytes in the program)
+  /// Instruction pointer (indexes instructions in .code)
   uint64_t ip;
   /// Data for instructions
   byte* program;
@@ -111,17 +118,43 @@ typedef struct hvm_vm {
   uint64_t program_capacity;
   /// Size of program memory (in bytes)
   uint64_t program_size;
+  /// Pre-decoded instructions (built from .program when a chunk is loaded)
+  struct hvm_instruction *code;
+  /// Number of instructions that .code has space for
+  uint64_t code_capacity;
+  /// Number of decoded instructions
+  uint64_t code_size;
+  /// Maps byte offsets in .program to indexes in .code
+  /// (HVM_NOT_AN_INSTRUCTION if an instruction doesn't start at that byte)
+  uint64_t *code_index;
+  /// Number of superinstructions fused when loading chunks
+  uint64_t superinstructions_fused;
+  /// Number of dispatches skipped by executing superinstructions
+  uint64_t dispatches_saved;
 
   /// Pool of constants (dynamic array).
   hvm_const_pool const_pool;
   /// Symbol table: resolves symbols to code locations
   struct hvm_obj_struct *symbol_table;
-  /// General purpose registers ($r0...$rN)
-  struct hvm_obj_ref* general_regs[HVM_GENERAL_REGISTERS];
-  /// Ephemeral argument registers (not preserved between subroutine calls)
-  struct hvm_obj_ref* arg_regs[HVM_ARGUMENT_REGISTERS];
-  /// Ephemeral parameter registers
-  struct hvm_obj_ref* param_regs[HVM_PARAMETER_REGISTERS];
+  /// Incremented whenever the symbol table changes; call-site caches
+  /// resolved under an older version are stale.
+  uint64_t symbol_table_version;
+  /// General purpose registers ($r0...$rN) of the current register window
+  struct hvm_obj_ref **general_regs;
+  /// Value stack: each frame's parameters live in a window of
+  /// HVM_ARGUMENT_REGISTERS slots, followed by the frame's general registers
+  /// if its subroutine declared a register count. Windows are laid out in
+  /// call order and slots outside the live windows are always NULL.
+  struct hvm_obj_ref **value_stack;
+  /// Ephemeral argument registers: the window just above the current
+  /// parameters, which becomes the parameter window of the next call.
+  struct hvm_obj_ref **arg_regs;
+  /// One past the highest argument register written since the last call
+  unsigned int arg_count;
+  /// Parameter registers of the current frame (or primitive)
+  struct hvm_obj_ref **param_regs;
+  /// Number of parameters passed to the current frame (read through $pn)
+  unsigned int param_count;
 
   /// Pool for object references to be allocated and freed
   struct hvm_obj_ref_pool *ref_pool;
@@ -134,20 +167,29 @@ typedef struct hvm_vm {
   struct hvm_symbol_store *symbols;
   /// Primitives
   struct hvm_obj_struct *primitives;
+  /// Empty shape that structures created by STRUCTNEW start out with
+  struct hvm_obj_shape *root_shape;
 
   /// Debugger information store
   void *debugger;
 
   /// Whether or not JIT'ing is enabled
   bool jit_enabled;
-  /// Whether or not it's tracing
+  /// Whether a frame's call is being traced (only one is at a time)
   bool is_tracing;
   /// Special flag to tell it to *always* trace
   bool always_trace;
   /// Array of traces that have been collected and are ready for compilation
   struct hvm_call_trace* traces[HVM_MAX_TRACES];
-  /// Number of traces in .traces
+  /// Highest index used in .traces (they start at index 1). Slots of
+  /// discarded traces are NULL until another trace is registered in them.
   unsigned short traces_length;
+  /// Traces waiting to be compiled in the background
+  struct hvm_jit_queue *jit_queue;
+  /// Directory compiled traces are cached in (NULL if caching is off)
+  char *jit_cache;
+  /// Hash of every chunk loaded so far, which cached traces are keyed by
+  uint64_t chunk_hash;
 } hvm_vm;
 
 /// Create a new virtual machine.
@@ -161,12 +203,8 @@ void hvm_vm_run(hvm_vm*);
 /// @memberof hvm_vm
 void hvm_vm_load_chunk(hvm_vm *vm, void *cv);
 
-/// Internal function for copying argument registers to parameter registers
-/// upon invocation of a subroutine.
-/// @memberof hvm_vm
-void hvm_vm_copy_regs(hvm_vm*);
-
 struct hvm_obj_ref *hvm_vm_register_read(hvm_vm *vm, byte reg);
+void hvm_vm_register_write(hvm_vm *vm, byte reg, struct hvm_obj_ref *ref);
 
 /// Set a constant in the VM constant table.
 /// @memberof hvm_vm
@@ -246,6 +284,8 @@ typedef enum {
 
   HVM_OP_GETLOCAL = 17,  // 1B OP | 1B REG  | 1B REG
   HVM_OP_SETLOCAL = 18,  // 1B OP | 1B REG  | 1B REG
+  HVM_OP_GETLOCALSLOT = 61, // 1B OP | 1B REG  | 1B SLOT
+  HVM_OP_SETLOCALSLOT = 62, // 1B OP | 1B SLOT | 1B REG
   HVM_OP_GETGLOBAL = 19, // 1B OP | 1B REG  | 1B REG
   HVM_OP_SETGLOBAL = 20, // 1B OP | 1B REG  | 1B REG
 
@@ -295,6 +335,17 @@ typedef enum {
 
   HVM_OP_GOTOADDRESS = 44,// 1B OP | 1B REG
 
+  // Superinstructions: never appear in byte-code; these are fused from pairs
+  // of instructions by `hvm_vm_load_chunk` (the second instruction of the
+  // pair is left in place and skipped over).
+  HVM_OP_LTIF  = 100,     // LT  followed by IF on its result
+  HVM_OP_GTIF  = 101,     // GT  followed by IF on its result
+  HVM_OP_LTEIF = 102,     // LTE followed by IF on its result
+  HVM_OP_GTEIF = 103,     // GTE followed by IF on its result
+  HVM_OP_EQIF  = 104,     // EQ  followed by IF on its result
+  HVM_OP_LITADD = 105,    // LITINTEGER followed by ADD using the literal
+  HVM_OP_ARRAYGET2 = 106, // ARRAYGET followed by another ARRAYGET
+
 } hvm_opcodes;
 
 /// Size of subroutine tags (in bytes)
@@ -309,4 +360,84 @@ typedef struct hvm_subroutine_tag {
 void hvm_subroutine_read_tag(byte *tag_start, hvm_subroutine_tag *tag);
 void hvm_subroutine_write_tag(byte *tag_start, hvm_subroutine_tag *tag);
 
+/// Marks bytes in hvm_vm.code_index that aren't the start of an instruction.
+#define HVM_NOT_AN_INSTRUCTION UINT64_MAX
+
+/// Number of symbols remembered by each INVOKESYMBOLIC call site.
+#define HVM_CALL_CACHE_SIZE 4
+
+/// Polymorphic cache of subroutine destinations for an INVOKESYMBOLIC call
+/// site (which may see a different symbol each time it runs).
+typedef struct hvm_call_cache {
+  /// hvm_vm.symbol_table_version the entries were resolved under
+  uint64_t version;
+  /// Number of entries in use
+  unsigned int length;
+  /// Entry to replace next once the cache is full
+  unsigned int next;
+  hvm_symbol_id symbols[HVM_CALL_CACHE_SIZE];
+  /// Destinations as indexes into hvm_vm.code
+  uint64_t dests[HVM_CALL_CACHE_SIZE];
+} hvm_call_cache;
+
+/// Instruction decoded into a fixed-width, aligned form. Chunks are
+/// translated into arrays of these by `hvm_vm_load_chunk` so that the
+/// dispatcher doesn't have to pick operands out of the byte-code each time
+/// an instruction is executed.
+typedef struct hvm_instruction {
+  /// Opcode
+  byte op;
+  /// Register operands (in the order they appear in the byte-code)
+  byte a, b, c;
+  /// Size of the register window for frames of the subroutine starting at
+  /// this instruction (0 if it uses its caller's registers)
+  byte registers;
+  /// Subroutine tag (for tagged call and invoke instructions)
+  hvm_subroutine_tag tag;
+  /// Constant pool index (CALLSYMBOLIC, SETSTRING, etc.)
+  uint32_t constant;
+  union {
+    /// Branch destination as an index into hvm_vm.code (GOTO, IF, etc.)
+    uint64_t dest;
+    /// Literal value (LITINTEGER)
+    int64_t  i64;
+  } arg;
+  /// Byte offset of the instruction in hvm_vm.program
+  uint64_t addr;
+  /// Per-instruction inline cache (filled in as the instruction executes)
+  union {
+    /// STRUCTGET, STRUCTSET, STRUCTHAS: where `key` was found for structures
+    /// with `shape`. For STRUCTSET a non-NULL `transition` means `key` was
+    /// added at `slot`, moving the structure from `shape` to `transition`.
+    /// For STRUCTHAS `slot` is HVM_SHAPE_NO_SLOT if the key was absent.
+    struct {
+      struct hvm_obj_shape *shape;
+      struct hvm_obj_shape *transition;
+      hvm_symbol_id key;
+      uint32_t slot;
+    } field;
+    /// CALLSYMBOLIC: destination of the call as of symbol table `version`
+    /// (zero until the instruction first runs).
+    struct {
+      uint64_t version;
+      uint64_t dest;
+    } call;
+    /// INVOKESYMBOLIC: allocated the first time the instruction runs.
+    hvm_call_cache *invoke;
+  } cache;
+} hvm_instruction;
+
+/// Returns the opcode of the first instruction in a superinstruction (or
+/// just the given opcode if it isn't a superinstruction).
+byte hvm_vm_superinstruction_head(byte op);
+
+/// Print the counts of superinstructions fused and dispatches saved by them.
+/// @memberof hvm_vm
+void hvm_vm_print_superinstruction_stats(hvm_vm *vm);
+
+/// Look up the index of the instruction beginning at the given byte offset
+/// in the program (eg. for GOTOADDRESS and INVOKEADDRESS).
+/// @memberof hvm_vm
+uint64_t hvm_vm_instruction_index(hvm_vm *vm, uint64_t addr);
+
 #endif
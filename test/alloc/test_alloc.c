@@ -0,0 +1,98 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include <jemalloc/jemalloc.h>
+
+#include "hvm.h"
+#include "hvm_object.h"
+
+// Allocation-throughput microbenchmark comparing the zone-based object
+// reference pool against plain `je_malloc`/`je_free` (which is what every
+// boxed reference used to go through).
+//
+// Two patterns are measured for each allocator:
+//   batch: allocate COUNT references, then free them all
+//   churn: keep WINDOW references live, freeing the oldest for each new one
+// Both are repeated ROUNDS times so the pool gets to recycle its slots.
+
+#define COUNT  1000000
+#define WINDOW 4096
+#define ROUNDS 10
+
+static hvm_vm *vm;
+static hvm_obj_ref *refs[COUNT];
+
+static int64_t now_usec() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (1000000 * (int64_t)tv.tv_sec) + tv.tv_usec;
+}
+
+static hvm_obj_ref *pool_alloc() { return hvm_obj_ref_new_from_pool(vm); }
+static void pool_free(hvm_obj_ref *ref) { hvm_obj_ref_free(vm, ref); }
+
+static hvm_obj_ref *malloc_alloc() {
+  hvm_obj_ref *ref = je_malloc(sizeof(hvm_obj_ref));
+  ref->type = HVM_NULL;
+  ref->data.u64 = 0;
+  ref->flags = 0;
+  ref->gc = 0;
+  return ref;
+}
+static void malloc_free(hvm_obj_ref *ref) { je_free(ref); }
+
+static double bench_batch(hvm_obj_ref *(*alloc)(), void (*dealloc)(hvm_obj_ref*)) {
+  int64_t start = now_usec();
+  for(unsigned int r = 0; r < ROUNDS; r++) {
+    for(unsigned int i = 0; i < COUNT; i++) {
+      refs[i] = alloc();
+      refs[i]->type = HVM_INTEGER;
+    }
+    for(unsigned int i = 0; i < COUNT; i++) {
+      dealloc(refs[i]);
+    }
+  }
+  return (double)(now_usec() - start) * 1000.0 / ((double)COUNT * ROUNDS);
+}
+
+static double bench_churn(hvm_obj_ref *(*alloc)(), void (*dealloc)(hvm_obj_ref*)) {
+  int64_t start = now_usec();
+  for(unsigned int i = 0; i < WINDOW; i++) {
+    refs[i] = alloc();
+  }
+  for(unsigned int r = 0; r < ROUNDS; r++) {
+    for(unsigned int i = 0; i < COUNT; i++) {
+      unsigned int slot = i % WINDOW;
+      dealloc(refs[slot]);
+      refs[slot] = alloc();
+      refs[slot]->type = HVM_INTEGER;
+    }
+  }
+  for(unsigned int i = 0; i < WINDOW; i++) {
+    dealloc(refs[i]);
+  }
+  return (double)(now_usec() - start) * 1000.0 / ((double)COUNT * ROUNDS);
+}
+
+int main(int argc, char const *argv[]) {
+  vm = hvm_new_vm();
+
+  double pool_batch   = bench_batch(pool_alloc, pool_free);
+  double malloc_batch = bench_batch(malloc_alloc, malloc_free);
+  double pool_churn   = bench_churn(pool_alloc, pool_free);
+  double malloc_churn = bench_churn(malloc_alloc, malloc_free);
+
+  printf("%d x %d allocations (ns per alloc+free):\n", ROUNDS, COUNT);
+  printf("  %-6s pool %6.2f  je_malloc %6.2f  (%.1f%%)\n", "batch",
+         pool_batch, malloc_batch, pool_batch / malloc_batch * 100);
+  printf("  %-6s pool %6.2f  je_malloc %6.2f  (%.1f%%)\n", "churn",
+         pool_churn, malloc_churn, pool_churn / malloc_churn * 100);
+  unsigned int zones    = vm->ref_pool->zones;
+  unsigned int released = hvm_obj_ref_pool_release_empty_zones(vm->ref_pool);
+  printf("  pool zones after run: %u, released when empty: %u\n", zones, released);
+
+  return 0;
+}
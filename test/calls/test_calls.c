@@ -0,0 +1,93 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "hvm.h"
+#include "hvm_symbol.h"
+#include "hvm_object.h"
+#include "hvm_chunk.h"
+#include "hvm_generator.h"
+#include "hvm_bootstrap.h"
+
+// Call overhead benchmark for compiled traces. Calls a subroutine that just
+// adds one to its parameter CALLS times, once with the JIT off (so every
+// call is interpreted) and once with it on (so once the subroutine is hot
+// its calls go through its compiled trace), and compares the time per
+// call. The loop making the calls is interpreted in both. Run it with
+// HVM_JIT_BACKGROUND=0 so the trace is compiled as soon as it's hot (see
+// the `bench` task).
+
+#define CALLS  1000000
+#define ROUNDS 5
+
+static int64_t now_usec() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (1000000 * (int64_t)tv.tv_sec) + tv.tv_usec;
+}
+
+static hvm_chunk *build_chunk() {
+  hvm_gen *gen = hvm_new_gen();
+  hvm_gen_set_file(gen, "calls");
+
+  byte r0 = hvm_vm_reg_gen(0);
+  byte r1 = hvm_vm_reg_gen(1);
+  hvm_gen_goto_label(gen->block, "program");
+
+  // add_one($p0) = $p0 + 1
+  hvm_gen_sub(gen->block, "add_one");
+  hvm_gen_litinteger(gen->block, r1, 1);
+  // The JIT only knows the types of general registers' values
+  hvm_gen_move(gen->block, r0, hvm_vm_reg_param(0));
+  hvm_gen_add(gen->block, r0, r0, r1);
+  hvm_gen_return(gen->block, r0);
+
+  hvm_gen_label(gen->block, "program");
+  byte idx  = hvm_vm_reg_gen(100);
+  byte lim  = hvm_vm_reg_gen(101);
+  byte cond = hvm_vm_reg_gen(102);
+  byte one  = hvm_vm_reg_gen(103);
+  byte ret  = hvm_vm_reg_gen(104);
+  hvm_gen_litinteger(gen->block, idx, 0);
+  hvm_gen_litinteger(gen->block, lim, CALLS);
+  hvm_gen_litinteger(gen->block, one, 1);
+  hvm_gen_label(gen->block, "loop_condition");
+  hvm_gen_eq(gen->block, cond, idx, lim);
+  hvm_gen_if_label(gen->block, cond, "loop_end");
+    hvm_gen_move(gen->block, hvm_vm_reg_arg(0), idx);
+    hvm_gen_callsymbolic(gen->block, "add_one", ret);
+    hvm_gen_add(gen->block, idx, idx, one);
+    hvm_gen_goto_label(gen->block, "loop_condition");
+  hvm_gen_label(gen->block, "loop_end");
+  hvm_gen_die(gen->block);
+
+  return hvm_gen_chunk(gen);
+}
+
+// Best time of a run in nanoseconds per call.
+static double bench_calls(bool jit) {
+  double best = 0;
+  for(unsigned int r = 0; r < ROUNDS; r++) {
+    hvm_vm *vm = hvm_new_vm();
+    hvm_bootstrap_primitives(vm);
+    vm->jit_enabled = jit;
+    hvm_vm_load_chunk(vm, build_chunk());
+    int64_t start = now_usec();
+    hvm_vm_run(vm);
+    double ns = (double)(now_usec() - start) * 1000.0 / CALLS;
+    if(r == 0 || ns < best) { best = ns; }
+  }
+  return best;
+}
+
+int main(int argc, char const *argv[]) {
+  double interpreted = bench_calls(false);
+  double compiled    = bench_calls(true);
+  printf("%d calls, best of %d runs (ns per call):\n", CALLS, ROUNDS);
+  printf("  interpreted %8.2f\n", interpreted);
+  printf("  compiled    %8.2f  (%.2fx)\n", compiled, interpreted / compiled);
+
+  return 0;
+}
@@ -0,0 +1,85 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+// Shares the unit tests' allocation helpers
+#include "../unit/preamble.h"
+
+// Full-collection benchmark for the parallel collector. Builds a live set
+// of ROWS arrays of COLS structures (each holding a boxed integer), then
+// times stop-the-world collections with 1 worker thread and doubling up to
+// the number of CPUs (or the count given as the first argument). Before
+// each collection GARBAGE dead objects are promoted into the old
+// generation for the sweep to free.
+
+#define ROWS    1000
+#define COLS    1000
+#define GARBAGE 1000000
+#define ROUNDS  5
+
+static hvm_vm *vm;
+
+static int64_t now_usec() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (1000000 * (int64_t)tv.tv_sec) + tv.tv_usec;
+}
+
+static void build_live_set() {
+  hvm_symbol_id x = hvm_symbolicate(vm->symbols, "x");
+  hvm_obj_ref *table = new_array(vm);
+  vm->general_regs[0] = table;
+  for(int64_t r = 0; r < ROWS; r++) {
+    hvm_obj_ref *row = new_array(vm);
+    hvm_obj_array_push(table, row);
+    for(int64_t c = 0; c < COLS; c++) {
+      hvm_obj_ref *item = new_struct(vm);
+      hvm_obj_struct_internal_set(item->data.v, x, track(vm, hvm_new_obj_int_value(vm, BOXED((r * COLS) + c))));
+      hvm_obj_array_push(row, item);
+    }
+  }
+}
+
+// Average time of a full collection in milliseconds.
+static double bench_collect(unsigned int workers) {
+  hvm_gc1_obj_space *space = vm->obj_space;
+  space->workers = workers;
+  // Start the worker threads outside of the timing
+  hvm_gc1_run(vm, space);
+  int64_t total = 0;
+  for(unsigned int r = 0; r < ROUNDS; r++) {
+    for(int64_t i = 0; i < GARBAGE; i++) {
+      track(vm, hvm_new_obj_int_value(vm, BOXED(i)));
+    }
+    int64_t start = now_usec();
+    hvm_gc1_run(vm, space);
+    total += now_usec() - start;
+  }
+  return (double)total / (1000.0 * ROUNDS);
+}
+
+int main(int argc, char const *argv[]) {
+  unsigned int max_workers = (argc > 1) ? (unsigned int)atoi(argv[1]) : (unsigned int)sysconf(_SC_NPROCESSORS_ONLN);
+  if(max_workers < 1) { max_workers = 1; }
+  if(max_workers > HVM_GC1_MAX_WORKERS) { max_workers = HVM_GC1_MAX_WORKERS; }
+
+  vm = hvm_new_vm();
+  vm->obj_space->ratio = 0;
+  build_live_set();
+
+  printf("%d live objects, %d dead (ms per full collection):\n", ROWS + (2 * ROWS * COLS) + 1, GARBAGE);
+  double single = 0;
+  unsigned int workers = 1;
+  while(true) {
+    double ms = bench_collect(workers);
+    if(workers == 1) { single = ms; }
+    printf("  %2u workers %8.2f  (%.2fx)\n", workers, ms, single / ms);
+    if(workers == max_workers) { break; }
+    workers = (workers * 2 > max_workers) ? max_workers : workers * 2;
+  }
+
+  return 0;
+}
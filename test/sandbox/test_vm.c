@@ -327,7 +327,7 @@ int main(int argc, char **argv) {
   hvm_obj_ref *reg;
   reg = vm->general_regs[1];
   printf("reg: %p\n", reg);
-  printf("reg->type: %d\n", reg->type);
+  printf("reg->type: %d\n", hvm_obj_type_of(reg));
   hvm_obj_string *str2;
   str2 = (hvm_obj_string*)(reg->data);
   printf("str2->data: %s\n", str2->data);
@@ -255,6 +255,8 @@ int main(int argc, char **argv) {
 
   printf("\nDONE\n\n");
 
+  hvm_vm_print_superinstruction_stats(vm);
+
   // hvm_obj_ref *arrref = hvm_get_local(vm->top, hvm_symbolicate(vm->symbols, array));
 
   // hvm_obj_ref *arrref = hvm_vm_register_read(vm, timings_array);
@@ -266,8 +268,8 @@ int main(int argc, char **argv) {
   printf("timings_array = [%u]{\n", arr->array->len);
   for(unsigned int i = 0; i < arr->array->len; i++) {
     hvm_obj_ref *intval = g_array_index(arr->array, hvm_obj_ref*, i);
-    assert(intval->type == HVM_INTEGER);
-    printf("  %4u = %lld\n", i, intval->data.i64);
+    assert(hvm_obj_type_of(intval) == HVM_INTEGER);
+    printf("  %4u = %lld\n", i, hvm_obj_int_value(intval));
   }
   printf("}\n\n");
 
@@ -276,8 +278,8 @@ int main(int argc, char **argv) {
     hvm_obj_ref *start = g_array_index(arr->array, hvm_obj_ref*, i);
     hvm_obj_ref *end   = g_array_index(arr->array, hvm_obj_ref*, i + 1);
 
-    int64_t st = start->data.i64;
-    int64_t et = end->data.i64;
+    int64_t st = hvm_obj_int_value(start);
+    int64_t et = hvm_obj_int_value(end);
     unsigned int run = ((i == 0 ? 1 : i) / 2) + 1;
 
     printf("  run[%d] = %lld microseconds\n", run, et - st);
@@ -293,7 +295,7 @@ int main(int argc, char **argv) {
     printf("result[%d] =\n", i);
     for(unsigned int x = 0; x < result->array->len; x += 1) {
       hvm_obj_ref *intref = g_array_index(result->array, hvm_obj_ref*, x);
-      int64_t _i          = intref->data.i64;
+      int64_t _i          = hvm_obj_int_value(intref);
       printf("  [%4d] = %lld\n", x, _i);
     }
   }
@@ -303,7 +305,7 @@ int main(int argc, char **argv) {
   printf("local_array[%d] =\n", arr->array->len);
   for(unsigned int x = 0; x < arr->array->len; x += 1) {
     hvm_obj_ref *intref = g_array_index(arr->array, hvm_obj_ref*, x);
-    int64_t _i          = intref->data.i64;
+    int64_t _i          = hvm_obj_int_value(intref);
     printf("  [%4d] = %lld\n", x, _i);
   }
   */
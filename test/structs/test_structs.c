@@ -0,0 +1,80 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "hvm.h"
+#include "hvm_symbol.h"
+#include "hvm_object.h"
+
+// Structure get/set benchmark. For each size a structure is filled with
+// that many symbol keys, then OPS gets, in-place sets and delete/re-set
+// pairs are timed cycling over the keys.
+
+#define OPS 10000000
+
+static int64_t now_usec() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (1000000 * (int64_t)tv.tv_sec) + tv.tv_usec;
+}
+
+static double ns_per_op(int64_t start) {
+  return (double)(now_usec() - start) * 1000.0 / (double)OPS;
+}
+
+static void bench(hvm_vm *vm, unsigned int size) {
+  char name[32];
+  hvm_symbol_id *keys = malloc(sizeof(hvm_symbol_id) * size);
+  for(unsigned int i = 0; i < size; i++) {
+    snprintf(name, sizeof(name), "key_%u", i);
+    keys[i] = hvm_symbolicate(vm->symbols, name);
+  }
+  hvm_obj_struct *strct = hvm_new_obj_struct();
+  for(unsigned int i = 0; i < size; i++) {
+    hvm_obj_struct_internal_set(strct, keys[i], hvm_obj_int_immediate(i));
+  }
+
+  // Accumulate the results so the gets can't be optimized away
+  uint64_t sum = 0;
+  int64_t start = now_usec();
+  for(unsigned int i = 0; i < OPS; i++) {
+    sum += (uint64_t)hvm_obj_struct_internal_get(strct, keys[i % size]);
+  }
+  double get = ns_per_op(start);
+
+  start = now_usec();
+  for(unsigned int i = 0; i < OPS; i++) {
+    hvm_obj_struct_internal_set(strct, keys[i % size], hvm_obj_int_immediate(i));
+  }
+  double set = ns_per_op(start);
+
+  start = now_usec();
+  for(unsigned int i = 0; i < OPS; i++) {
+    hvm_symbol_id key = keys[i % size];
+    hvm_obj_ref *val = hvm_obj_struct_internal_delete(strct, key);
+    hvm_obj_struct_internal_set(strct, key, val);
+  }
+  double churn = ns_per_op(start);
+
+  if(strct->length != size) {
+    fprintf(stderr, "Structure has %u keys (expected %u)\n", strct->length, size);
+    exit(1);
+  }
+  printf("  %6u keys   get %6.2f  set %6.2f  delete+set %6.2f  (%llu)\n",
+         size, get, set, churn, (unsigned long long)(sum & 0xF));
+  hvm_obj_struct_free(strct);
+  free(keys);
+}
+
+int main(int argc, char const *argv[]) {
+  hvm_vm *vm = hvm_new_vm();
+
+  printf("%d operations per size (ns per op):\n", OPS);
+  bench(vm, 4);
+  bench(vm, 64);
+  bench(vm, 10000);
+
+  return 0;
+}
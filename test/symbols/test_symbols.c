@@ -0,0 +1,78 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/time.h>
+
+#include "hvm.h"
+#include "hvm_symbol.h"
+#include "hvm_object.h"
+#include "hvm_chunk.h"
+#include "hvm_generator.h"
+#include "hvm_bootstrap.h"
+
+// Symbol store benchmark: loads a chunk defining SYMBOLS subroutines (each
+// of which gets symbolicated at load time), then looks every one of them up
+// again by name and by ID.
+
+#define SYMBOLS 100000
+
+static int64_t now_usec() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (1000000 * (int64_t)tv.tv_sec) + tv.tv_usec;
+}
+
+static char *sub_name(unsigned int i) {
+  char *name = malloc(sizeof(char) * 32);
+  snprintf(name, 32, "subroutine_%u", i);
+  return name;
+}
+
+int main(int argc, char const *argv[]) {
+  hvm_gen *gen = hvm_new_gen();
+  byte reg = hvm_vm_reg_gen(0);
+  char **names = malloc(sizeof(char*) * SYMBOLS);
+
+  hvm_gen_die(gen->block);
+  for(unsigned int i = 0; i < SYMBOLS; i++) {
+    names[i] = sub_name(i);
+    hvm_gen_sub(gen->block, names[i]);
+    hvm_gen_litinteger(gen->block, reg, (int64_t)i);
+    hvm_gen_return(gen->block, reg);
+  }
+  hvm_chunk *chunk = hvm_gen_chunk(gen);
+
+  hvm_vm *vm = hvm_new_vm();
+  hvm_bootstrap_primitives(vm);
+
+  int64_t start = now_usec();
+  hvm_vm_load_chunk(vm, chunk);
+  int64_t load = now_usec() - start;
+
+  hvm_symbol_id *ids = malloc(sizeof(hvm_symbol_id) * SYMBOLS);
+  start = now_usec();
+  for(unsigned int i = 0; i < SYMBOLS; i++) {
+    ids[i] = hvm_symbolicate(vm->symbols, names[i]);
+  }
+  int64_t symbolicate = now_usec() - start;
+
+  start = now_usec();
+  for(unsigned int i = 0; i < SYMBOLS; i++) {
+    char *name = hvm_desymbolicate(vm->symbols, ids[i]);
+    if(strcmp(name, names[i]) != 0) {
+      fprintf(stderr, "Symbol %llu desymbolicated to %s (expected %s)\n", ids[i], name, names[i]);
+      return 1;
+    }
+  }
+  int64_t desymbolicate = now_usec() - start;
+
+  printf("%d symbols:\n", SYMBOLS);
+  printf("  load chunk      %8.3f ms\n", (double)load / 1000.0);
+  printf("  symbolicate     %8.3f ms\n", (double)symbolicate / 1000.0);
+  printf("  desymbolicate   %8.3f ms\n", (double)desymbolicate / 1000.0);
+
+  return 0;
+}
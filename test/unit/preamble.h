@@ -9,6 +9,10 @@
 #include "hvm_chunk.h"
 #include "hvm_generator.h"
 #include "hvm_bootstrap.h"
+#include "hvm_gc1.h"
+#include "hvm_jit_tracer.h"
+#include "hvm_jit_queue.h"
+#include "hvm_jit_cache.h"
 
 // Each file is an independent set of assertions. The preamble provides the
 // functionality required for each test in a suite.
@@ -56,3 +60,33 @@ hvm_vm *gen_chunk_and_run(hvm_gen *gen) {
   hvm_vm *vm = run_chunk(chunk);
   return vm;
 }
+
+// Values are offset past the immediate range so every one is boxed
+#define BOXED(V) (HVM_OBJ_INT_IMMEDIATE_MAX + 1 + (V))
+
+// Allocate objects the way the VM does and hand them to the collector
+hvm_obj_ref *track(hvm_vm *vm, hvm_obj_ref *ref) {
+  hvm_obj_space_add_obj_ref(vm->obj_space, ref);
+  return ref;
+}
+hvm_obj_ref *new_array(hvm_vm *vm) {
+  hvm_obj_ref *ref = hvm_obj_ref_new_from_pool(vm);
+  ref->type   = HVM_ARRAY;
+  ref->data.v = hvm_new_obj_array();
+  return track(vm, ref);
+}
+hvm_obj_ref *new_struct(hvm_vm *vm) {
+  hvm_obj_ref *ref = hvm_obj_ref_new_from_pool(vm);
+  ref->type   = HVM_STRUCTURE;
+  ref->data.v = hvm_new_obj_struct();
+  return track(vm, ref);
+}
+
+// Number of references handed out from a pool's zones
+unsigned int pool_used(hvm_obj_ref_pool *pool) {
+  unsigned int used = 0;
+  for(hvm_obj_ref_pool_zone *zone = pool->head; zone != NULL; zone = zone->next) {
+    used += zone->used;
+  }
+  return used;
+}
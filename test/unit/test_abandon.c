@@ -0,0 +1,65 @@
+#include "preamble.h"
+
+#define CALLS 20
+
+int main(int argc, char const *argv[]) {
+  hvm_gen *gen = hvm_new_gen();
+  byte val    = hvm_vm_reg_gen(0);
+  byte one    = hvm_vm_reg_gen(1);
+  byte exc    = hvm_vm_reg_gen(2);
+  byte idx    = hvm_vm_reg_gen(100);
+  byte lim    = hvm_vm_reg_gen(101);
+  byte cond   = hvm_vm_reg_gen(102);
+  byte ret    = hvm_vm_reg_gen(103);
+  byte caught = hvm_vm_reg_gen(104);
+  byte sum    = hvm_vm_reg_gen(105);
+
+  hvm_gen_goto_label(gen->block, "program");
+
+  // fail($p0) never gets to its return, so its trace is cut short by the
+  // exception every time
+  hvm_gen_sub(gen->block, "fail");
+  hvm_gen_move(gen->block, val, hvm_vm_reg_param(0));
+  hvm_gen_litinteger(gen->block, one, 1);
+  hvm_gen_add(gen->block, val, val, one);
+  hvm_gen_structnew(gen->block, exc);
+  hvm_gen_throw(gen->block, exc);
+  hvm_gen_return(gen->block, val);
+
+  hvm_gen_label(gen->block, "program");
+  hvm_gen_litinteger(gen->block, idx, 0);
+  hvm_gen_litinteger(gen->block, sum, 0);
+  hvm_gen_litinteger(gen->block, lim, CALLS);
+  hvm_gen_litinteger(gen->block, one, 1);
+  hvm_gen_label(gen->block, "loop");
+  hvm_gen_eq(gen->block, cond, idx, lim);
+  hvm_gen_if_label(gen->block, cond, "end");
+    hvm_gen_catch_label(gen->block, "caught", caught);
+    hvm_gen_move(gen->block, hvm_vm_reg_arg(0), idx);
+    hvm_gen_callsymbolic(gen->block, "fail", ret);
+  hvm_gen_label(gen->block, "caught");
+    hvm_gen_add(gen->block, sum, sum, one);
+    hvm_gen_add(gen->block, idx, idx, one);
+    hvm_gen_goto_label(gen->block, "loop");
+  hvm_gen_label(gen->block, "end");
+  hvm_gen_die(gen->block);
+
+  hvm_vm *vm = hvm_new_vm();
+  hvm_bootstrap_primitives(vm);
+  // Compile traces as soon as they're hot
+  vm->jit_queue->background = false;
+  hvm_vm_load_chunk(vm, hvm_gen_chunk(gen));
+  hvm_vm_run(vm);
+
+  assert_true(hvm_obj_int_value(vm->general_regs[sum]) == CALLS, "Expected every call's exception to be caught");
+  assert_true(!vm->is_tracing, "Expected tracing to stop when the traced call is unwound");
+
+  // The abandoned trace stays registered so the call isn't traced again
+  assert_true(vm->traces_length == 1, "Expected the call to be traced once");
+  hvm_call_trace *trace = vm->traces[vm->traces_length];
+  assert_true(trace->abandoned && !trace->complete, "Expected the trace to be abandoned");
+  assert_true(trace->sequence == NULL, "Expected the abandoned trace's sequence to be freed");
+  assert_true(trace->native_function == NULL, "Expected the abandoned trace not to be compiled");
+
+  return done();
+}
@@ -0,0 +1,69 @@
+#include "preamble.h"
+
+int main(int argc, char const *argv[]) {
+  hvm_gen *gen = hvm_new_gen();
+
+  byte arr   = hvm_vm_reg_gen(0);
+  byte s     = hvm_vm_reg_gen(1);
+  byte tmp   = hvm_vm_reg_gen(2);
+  byte ctr   = hvm_vm_reg_gen(3);
+  byte one   = hvm_vm_reg_gen(4);
+  byte max   = hvm_vm_reg_gen(5);
+  byte cond  = hvm_vm_reg_gen(6);
+  byte x     = hvm_vm_reg_gen(7);
+  byte kept  = hvm_vm_reg_gen(8);
+  byte gsym  = hvm_vm_reg_gen(9);
+  byte len   = hvm_vm_reg_gen(10);
+
+  hvm_gen_litinteger(gen->block, ctr, 0);
+  hvm_gen_litinteger(gen->block, one, 1);
+  hvm_gen_litinteger(gen->block, max, 3000);
+  hvm_gen_set_symbol(gen->block, x, "x");
+  hvm_gen_set_symbol(gen->block, gsym, "kept");
+  hvm_gen_arraynew(gen->block, arr, hvm_vm_reg_null());
+  // Only reachable through a global
+  hvm_gen_structnew(gen->block, kept);
+  hvm_gen_structset(gen->block, kept, x, max);
+  hvm_gen_setglobal(gen->block, gsym, kept);
+  hvm_gen_move(gen->block, kept, hvm_vm_reg_null());
+
+  // Each iteration keeps one structure alive in the array and drops two
+  hvm_gen_label(gen->block, "loop");
+  hvm_gen_structnew(gen->block, s);
+  hvm_gen_structset(gen->block, s, x, ctr);
+  hvm_gen_arraypush(gen->block, arr, s);
+  hvm_gen_structnew(gen->block, tmp);
+  hvm_gen_structnew(gen->block, tmp);
+  hvm_gen_add(gen->block, ctr, ctr, one);
+  hvm_gen_lt(gen->block, cond, ctr, max);
+  hvm_gen_if_label(gen->block, cond, "loop");
+  hvm_gen_getglobal(gen->block, kept, gsym);
+  hvm_gen_arraylen(gen->block, len, arr);
+  hvm_gen_die(gen->block);
+
+  hvm_vm *vm = gen_chunk_and_run(gen);
+  hvm_gc1_obj_space *space = vm->obj_space;
+
+  assert_true(space->allocated >= 9000, "Expected allocations to be counted");
+  assert_true(space->minor_collections > 0, "Expected allocation to trigger minor collections");
+  assert_true(space->major_collections > 0, "Expected old generation growth to trigger a full collection");
+  assert_true(space->heap_target >= space->heap.length, "Expected heap target to be set from the live set");
+  assert_true(hvm_obj_int_value(vm->general_regs[len]) == 3000, "Expected array to keep every element");
+  hvm_obj_ref *last = hvm_obj_array_get(vm->general_regs[arr], hvm_obj_int_immediate(2999));
+  assert_true(hvm_obj_int_value(hvm_obj_struct_get(last, hvm_obj_symbol_immediate(hvm_symbolicate(vm->symbols, "x")))) == 2999, "Expected surviving structures to be intact");
+  hvm_obj_ref *global = vm->general_regs[kept];
+  assert_true(hvm_obj_int_value(hvm_obj_struct_get(global, hvm_obj_symbol_immediate(hvm_symbolicate(vm->symbols, "x")))) == 3000, "Expected globals to be roots");
+
+  // Dropping the array lets a full collection hand its references back to
+  // the pool
+  unsigned int used = pool_used(vm->ref_pool);
+  vm->general_regs[arr] = hvm_const_null;
+  vm->general_regs[s]   = hvm_const_null;
+  vm->general_regs[tmp] = hvm_const_null;
+  hvm_gc1_run(vm, space);
+  assert_true(space->heap.length < 10, "Expected dead structures to be freed");
+  assert_true(pool_used(vm->ref_pool) < used, "Expected freed references to go back to the pool");
+  assert_true(space->heap_target == HVM_GC1_MIN_HEAP_TARGET, "Expected heap target to follow the live set");
+
+  return done();
+}
@@ -40,14 +40,14 @@ int main(int argc, char const *argv[]) {
 
   // Assertions
   obj = vm->general_regs[reg1];
-  assert_true(obj->data.i64 == val_callsymbolic, "Expected CALLSYMBOLIC return to be 1");
+  assert_true(hvm_obj_int_value(obj) == val_callsymbolic, "Expected CALLSYMBOLIC return to be 1");
   obj = vm->general_regs[reg2];
-  assert_true(obj->data.i64 == val_call, "Expected CALL return to be 2");
+  assert_true(hvm_obj_int_value(obj) == val_call, "Expected CALL return to be 2");
   // Check that the array_clone'd array in reg4 is different from the one
   // in reg3
   hvm_obj_ref *arr3 = vm->general_regs[reg3];
   hvm_obj_ref *arr4 = vm->general_regs[reg4];
-  assert_true(arr4->type == HVM_ARRAY, "Expected array_clone to return an array");
+  assert_true(hvm_obj_type_of(arr4) == HVM_ARRAY, "Expected array_clone to return an array");
   assert_true(arr3->data.v != arr4->data.v, "Expected array_clone to return a new array");
 
   return done();
@@ -0,0 +1,73 @@
+#include "preamble.h"
+
+int main(int argc, char const *argv[]) {
+  hvm_gen *gen = hvm_new_gen();
+
+  byte ret   = hvm_vm_reg_gen(0);
+  byte sym   = hvm_vm_reg_gen(1);
+  byte sum   = hvm_vm_reg_gen(2);
+  byte first = hvm_vm_reg_gen(3);
+  byte again = hvm_vm_reg_gen(4);
+  byte ctr   = hvm_vm_reg_gen(5);
+  byte one   = hvm_vm_reg_gen(6);
+  byte max   = hvm_vm_reg_gen(7);
+  byte cond  = hvm_vm_reg_gen(8);
+
+  hvm_gen_callsymbolic(gen->block, "run", first);
+  hvm_gen_die(gen->block);
+
+  // Calls "value" through CALLSYMBOLIC, then alternates between "one" and
+  // "two" through INVOKESYMBOLIC so that call site sees both symbols
+  hvm_gen_sub(gen->block, "run");
+  hvm_gen_callsymbolic(gen->block, "value", sum);
+  hvm_gen_litinteger(gen->block, ctr, 0);
+  hvm_gen_litinteger(gen->block, one, 1);
+  hvm_gen_litinteger(gen->block, max, 4);
+  hvm_gen_label(gen->block, "loop");
+  hvm_gen_set_symbol(gen->block, sym, "one");
+  hvm_gen_invokesymbolic(gen->block, sym, ret);
+  hvm_gen_add(gen->block, sum, sum, ret);
+  hvm_gen_set_symbol(gen->block, sym, "two");
+  hvm_gen_invokesymbolic(gen->block, sym, ret);
+  hvm_gen_add(gen->block, sum, sum, ret);
+  hvm_gen_add(gen->block, ctr, ctr, one);
+  hvm_gen_lt(gen->block, cond, ctr, max);
+  hvm_gen_if_label(gen->block, cond, "loop");
+  hvm_gen_return(gen->block, sum);
+
+  hvm_gen_sub(gen->block, "value");
+  hvm_gen_litinteger(gen->block, ret, 100);
+  hvm_gen_return(gen->block, ret);
+  hvm_gen_sub(gen->block, "one");
+  hvm_gen_litinteger(gen->block, ret, 1);
+  hvm_gen_return(gen->block, ret);
+  hvm_gen_sub(gen->block, "two");
+  hvm_gen_litinteger(gen->block, ret, 2);
+  hvm_gen_return(gen->block, ret);
+
+  hvm_vm *vm = gen_chunk_and_run(gen);
+
+  assert_true(hvm_obj_int_value(vm->general_regs[first]) == 112, "Expected both invoked subroutines to be called");
+
+  // Redefine "value" and "two" in a second chunk; the call sites in "run"
+  // must pick up the new definitions
+  uint64_t version = vm->symbol_table_version;
+  gen = hvm_new_gen();
+  hvm_gen_callsymbolic(gen->block, "run", again);
+  hvm_gen_die(gen->block);
+  hvm_gen_sub(gen->block, "value");
+  hvm_gen_litinteger(gen->block, ret, 200);
+  hvm_gen_return(gen->block, ret);
+  hvm_gen_sub(gen->block, "two");
+  hvm_gen_litinteger(gen->block, ret, 3);
+  hvm_gen_return(gen->block, ret);
+
+  vm->ip = vm->code_size;
+  hvm_vm_load_chunk(vm, hvm_gen_chunk(gen));
+  hvm_vm_run(vm);
+
+  assert_true(vm->symbol_table_version != version, "Expected loading subroutines to change the symbol table version");
+  assert_true(hvm_obj_int_value(vm->general_regs[again]) == 216, "Expected call sites to use the redefined subroutines");
+
+  return done();
+}
@@ -0,0 +1,164 @@
+#include "preamble.h"
+
+#define SLOTS  2048
+#define CYCLES 20
+// Upper bound on the rounds it takes to get through CYCLES collections
+#define MAX_ROUNDS 4000000
+
+static uint64_t seed = 88172645463325252ULL;
+static uint64_t next_random() {
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return seed;
+}
+
+static hvm_obj_ref *new_int(hvm_vm *vm, int64_t value) {
+  return track(vm, hvm_new_obj_int_value(vm, BOXED(value)));
+}
+
+// Items are structures holding a boxed value under "x" and an array with
+// the same value under "list"
+static hvm_obj_ref *new_item(hvm_vm *vm, hvm_symbol_id x, hvm_symbol_id list, int64_t value) {
+  hvm_obj_ref *item = new_struct(vm);
+  hvm_obj_ref *arr  = new_array(vm);
+  hvm_obj_array_push(arr, new_int(vm, value));
+  hvm_obj_struct_internal_set(item->data.v, x, new_int(vm, value));
+  hvm_obj_struct_internal_set(item->data.v, list, arr);
+  return item;
+}
+
+// Freed references have their GC state cleared, so a live object is either
+// young or flagged as old (and not left marked between collections).
+static bool is_alive(hvm_gc1_obj_space *space, hvm_obj_ref *obj) {
+  if((obj->flags & HVM_OBJ_FLAG_GC_TRACKED) == 0) { return false; }
+  return hvm_obj_is_young(obj) || obj->gc == HVM_GC1_OBJ_OLD;
+}
+
+// Every old object in the pool is counted in the heap, and none of them is
+// left marked after a collection.
+static bool heap_is_consistent(hvm_vm *vm, hvm_gc1_obj_space *space) {
+  unsigned int old = 0;
+  for(hvm_obj_ref_pool_zone *zone = vm->ref_pool->head; zone != NULL; zone = zone->next) {
+    for(unsigned int id = 0; id < zone->bump; id++) {
+      hvm_obj_ref *obj = &zone->refs[id];
+      if(obj->gc == 0) { continue; }
+      if(obj->gc != HVM_GC1_OBJ_OLD || hvm_obj_is_young(obj)) { return false; }
+      old += 1;
+    }
+  }
+  return old == space->heap.length;
+}
+
+static bool items_are_intact(hvm_vm *vm, hvm_obj_ref *table, hvm_symbol_id x, hvm_symbol_id list, int64_t *expected) {
+  hvm_gc1_obj_space *space = vm->obj_space;
+  for(int64_t i = 0; i < SLOTS; i++) {
+    hvm_obj_ref *item = hvm_obj_array_get(table, hvm_obj_int_immediate(i));
+    if(!is_alive(space, item) || hvm_obj_type_of(item) != HVM_STRUCTURE) { return false; }
+    hvm_obj_ref *val = hvm_obj_struct_internal_get(item->data.v, x);
+    hvm_obj_ref *arr = hvm_obj_struct_internal_get(item->data.v, list);
+    if(val == NULL || !is_alive(space, val) || hvm_obj_int_value(val) != BOXED(expected[i])) { return false; }
+    if(arr == NULL || !is_alive(space, arr) || hvm_obj_type_of(arr) != HVM_ARRAY) { return false; }
+    hvm_obj_ref *elem = hvm_obj_array_get(arr, hvm_obj_int_immediate(0));
+    if(!is_alive(space, elem) || hvm_obj_int_value(elem) != BOXED(expected[i])) { return false; }
+  }
+  return true;
+}
+
+int main(int argc, char const *argv[]) {
+  hvm_vm *vm = hvm_new_vm();
+  hvm_gc1_obj_space *space = vm->obj_space;
+  space->concurrent = true;
+  space->torture    = false;
+  space->ratio = 50;
+  hvm_symbol_id x    = hvm_symbolicate(vm->symbols, "x");
+  hvm_symbol_id list = hvm_symbolicate(vm->symbols, "list");
+  int64_t expected[SLOTS];
+
+  hvm_obj_ref *table = track(vm, hvm_obj_ref_new_from_pool(vm));
+  table->type   = HVM_ARRAY;
+  table->data.v = hvm_new_obj_array_with_length(hvm_obj_int_immediate(SLOTS));
+  vm->general_regs[0] = table;
+  for(int64_t i = 0; i < SLOTS; i++) {
+    hvm_obj_array_set(table, hvm_obj_int_immediate(i), new_item(vm, x, list, i));
+    expected[i] = i;
+  }
+
+  // Mutate the items under the collector thread, making the same changes
+  // to `expected`; the table is the only root
+  unsigned int checked = 0;
+  bool intact = true, consistent = true;
+  for(int64_t round = 0; round < MAX_ROUNDS && checked < CYCLES; round++) {
+    int64_t i = (int64_t)(next_random() % SLOTS);
+    int64_t j = (int64_t)(next_random() % SLOTS);
+    hvm_obj_ref *idx  = hvm_obj_int_immediate(i);
+    hvm_obj_ref *item = hvm_obj_array_get(table, idx);
+    hvm_obj_ref *arr  = hvm_obj_struct_internal_get(item->data.v, list);
+    switch(next_random() % 5) {
+      case 0:
+        // Replace the whole item
+        hvm_obj_array_set(table, idx, new_item(vm, x, list, round));
+        expected[i] = round;
+        break;
+      case 1: {
+        // Swap two items
+        hvm_obj_ref *other = hvm_obj_array_get(table, hvm_obj_int_immediate(j));
+        hvm_obj_array_set(table, hvm_obj_int_immediate(j), item);
+        hvm_obj_array_set(table, idx, other);
+        int64_t tmp = expected[i]; expected[i] = expected[j]; expected[j] = tmp;
+        break;
+      }
+      case 2:
+        // Overwrite the item's values in place
+        hvm_obj_struct_internal_set(item->data.v, x, new_int(vm, round));
+        hvm_obj_array_set(arr, hvm_obj_int_immediate(0), new_int(vm, round));
+        expected[i] = round;
+        break;
+      case 3: {
+        // Move another item's array into this one; the only other
+        // reference to the old array is removed
+        hvm_obj_ref *other = hvm_obj_array_get(table, hvm_obj_int_immediate(j));
+        hvm_obj_ref *moved = hvm_obj_struct_internal_delete(other->data.v, list);
+        hvm_obj_ref *elem  = hvm_obj_array_pop(moved);
+        hvm_obj_array_push(moved, elem);
+        hvm_obj_ref *fresh = new_array(vm);
+        hvm_obj_array_push(fresh, hvm_obj_struct_internal_get(other->data.v, x));
+        hvm_obj_struct_internal_set(other->data.v, list, fresh);
+        hvm_obj_struct_internal_set(item->data.v, list, moved);
+        hvm_obj_struct_internal_set(item->data.v, x, elem);
+        expected[i] = expected[j];
+        break;
+      }
+      case 4: {
+        // Shift the value out and back in
+        hvm_obj_ref *elem = hvm_obj_array_shift(arr);
+        hvm_obj_array_unshift(arr, elem);
+        break;
+      }
+    }
+    hvm_gc1_safepoint(vm, space);
+    if(space->concurrent_cycles != checked) {
+      checked = space->concurrent_cycles;
+      intact     = intact && items_are_intact(vm, table, x, list, expected);
+      consistent = consistent && heap_is_consistent(vm, space);
+    }
+  }
+  hvm_gc1_finish(vm, space);
+  intact     = intact && items_are_intact(vm, table, x, list, expected);
+  consistent = consistent && heap_is_consistent(vm, space);
+
+  hvm_gc1_stats stats;
+  hvm_gc1_get_stats(space, &stats);
+  assert_true(stats.concurrent_cycles >= CYCLES, "Expected many concurrent collections");
+  assert_true(stats.concurrent_cycles <= stats.major_collections, "Expected every finished collection to have been started");
+  assert_true(intact, "Expected reachable objects to survive concurrent collections");
+  assert_true(consistent, "Expected the old generation to match the pool after each collection");
+
+  // Dropping the table frees everything
+  vm->general_regs[0] = hvm_const_null;
+  hvm_gc1_run(vm, space);
+  assert_true(space->heap.length == 0, "Expected a full collection to free everything");
+  assert_true(space->phase == HVM_GC1_IDLE && !space->marking, "Expected the collector thread to be idle");
+
+  return done();
+}
@@ -0,0 +1,40 @@
+#include "preamble.h"
+
+int main(int argc, char const *argv[]) {
+  hvm_gen *gen = hvm_new_gen();
+
+  byte reg0 = hvm_vm_reg_gen(0);
+  byte reg1 = hvm_vm_reg_gen(1);
+  byte reg2 = hvm_vm_reg_gen(2);
+  hvm_obj_ref *obj;
+
+  hvm_gen_litinteger(gen->block, reg0, 1);
+  // Skip over the JUMP (5 bytes) and the LITINTEGER (10 bytes)
+  hvm_gen_jump(gen->block, 15);
+  hvm_gen_litinteger(gen->block, reg0, 2);
+  // GOTOADDRESS with a byte offset (resolved through the side table)
+  hvm_gen_litinteger_label(gen->block, reg1, "target");
+  hvm_gen_gotoaddress(gen->block, reg1);
+  hvm_gen_litinteger(gen->block, reg2, 2);
+  hvm_gen_label(gen->block, "target");
+  hvm_gen_litinteger(gen->block, reg2, 3);
+  hvm_gen_die(gen->block);
+
+  hvm_vm *vm = gen_chunk_and_run(gen);
+
+  obj = vm->general_regs[reg0];
+  assert_true(hvm_obj_type_of(obj) == HVM_INTEGER && hvm_obj_int_value(obj) == 1, "Expected JUMP to skip over LITINTEGER");
+  obj = vm->general_regs[reg2];
+  assert_true(hvm_obj_type_of(obj) == HVM_INTEGER && hvm_obj_int_value(obj) == 3, "Expected GOTOADDRESS to reach label");
+
+  // Every instruction should map back to its byte offset
+  assert_true(vm->code_size == 8, "Expected 8 decoded instructions");
+  bool mapped = true;
+  for(uint64_t i = 0; i < vm->code_size; i++) {
+    uint64_t addr = vm->code[i].addr;
+    if(vm->code_index[addr] != i) { mapped = false; }
+  }
+  assert_true(mapped, "Expected side table to map byte offsets to instructions");
+
+  return done();
+}
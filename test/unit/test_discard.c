@@ -0,0 +1,91 @@
+#include "preamble.h"
+
+#define CALLS 20
+// Iteration after which the trace of "inc" is discarded (it's compiled by
+// then)
+#define DISCARD_AT 10
+
+static hvm_call_trace *discarded = NULL;
+static unsigned short discarded_index = 0;
+
+// The most recently completed call trace
+static hvm_call_trace *registered_trace(hvm_vm *vm) {
+  return vm->traces[vm->traces_length];
+}
+
+static hvm_obj_ref *prim_discard(hvm_vm *vm) {
+  discarded = registered_trace(vm);
+  assert_true(discarded != NULL && discarded->native_function != NULL, "Expected the call to have been compiled before it's discarded");
+  hvm_subroutine_tag *tag = discarded->caller_tag;
+  discarded_index = discarded->index;
+  hvm_jit_discard_trace(vm, discarded);
+  assert_true(discarded->native_function == NULL, "Expected the discarded trace not to be run");
+  assert_true(tag != NULL && tag->trace_index == 0, "Expected the call's tag to be cleared");
+  assert_true(discarded->caller_tag == NULL, "Expected the trace to be detached from the tag");
+  assert_true(vm->traces[discarded_index] == NULL, "Expected the trace's index to be freed");
+  return hvm_const_null;
+}
+
+int main(int argc, char const *argv[]) {
+  hvm_gen *gen = hvm_new_gen();
+  byte val  = hvm_vm_reg_gen(0);
+  byte one  = hvm_vm_reg_gen(1);
+  byte idx  = hvm_vm_reg_gen(100);
+  byte lim  = hvm_vm_reg_gen(101);
+  byte cond = hvm_vm_reg_gen(102);
+  byte ret  = hvm_vm_reg_gen(103);
+  byte sum  = hvm_vm_reg_gen(104);
+  byte at   = hvm_vm_reg_gen(105);
+
+  hvm_gen_goto_label(gen->block, "program");
+
+  // inc($p0) = $p0 + 1
+  hvm_gen_sub(gen->block, "inc");
+  hvm_gen_move(gen->block, val, hvm_vm_reg_param(0));
+  hvm_gen_litinteger(gen->block, one, 1);
+  hvm_gen_add(gen->block, val, val, one);
+  hvm_gen_return(gen->block, val);
+
+  hvm_gen_label(gen->block, "program");
+  hvm_gen_litinteger(gen->block, idx, 0);
+  hvm_gen_litinteger(gen->block, sum, 0);
+  hvm_gen_litinteger(gen->block, lim, CALLS);
+  hvm_gen_litinteger(gen->block, at, DISCARD_AT);
+  hvm_gen_litinteger(gen->block, one, 1);
+  hvm_gen_label(gen->block, "loop");
+  hvm_gen_eq(gen->block, cond, idx, lim);
+  hvm_gen_if_label(gen->block, cond, "end");
+    hvm_gen_move(gen->block, hvm_vm_reg_arg(0), idx);
+    hvm_gen_callsymbolic(gen->block, "inc", ret);
+    hvm_gen_add(gen->block, sum, sum, ret);
+    hvm_gen_eq(gen->block, cond, idx, at);
+    hvm_gen_add(gen->block, idx, idx, one);
+    hvm_gen_if_label(gen->block, cond, "discard");
+    hvm_gen_goto_label(gen->block, "loop");
+  hvm_gen_label(gen->block, "discard");
+  hvm_gen_callprimitive(gen->block, "discard", ret);
+  hvm_gen_goto_label(gen->block, "loop");
+  hvm_gen_label(gen->block, "end");
+  hvm_gen_die(gen->block);
+
+  hvm_vm *vm = hvm_new_vm();
+  hvm_bootstrap_primitives(vm);
+  hvm_obj_struct_internal_set(vm->primitives, hvm_symbolicate(vm->symbols, "discard"), (void*)prim_discard);
+  // Compile traces as soon as they're hot
+  vm->jit_queue->background = false;
+  hvm_vm_load_chunk(vm, hvm_gen_chunk(gen));
+  hvm_vm_run(vm);
+
+  int64_t expected = 0;
+  for(int64_t i = 0; i < CALLS; i++) { expected += i + 1; }
+  assert_true(hvm_obj_int_value(vm->general_regs[sum]) == expected, "Expected the same results before and after the discard");
+
+  // Once it's hot again the call is traced and compiled afresh
+  hvm_call_trace *trace = registered_trace(vm);
+  assert_true(discarded != NULL, "Expected the trace to have been discarded");
+  assert_true(trace != NULL && trace != discarded, "Expected the call to be traced again");
+  assert_true(trace != NULL && trace->native_function != NULL, "Expected the new trace to be compiled");
+  assert_true(trace != NULL && trace->index == discarded_index && vm->traces_length == discarded_index, "Expected the new trace to reuse the discarded trace's index");
+
+  return done();
+}
@@ -0,0 +1,55 @@
+#include "preamble.h"
+
+#define ITEMS 100
+
+int main(int argc, char const *argv[]) {
+  hvm_vm *vm = hvm_new_vm();
+  hvm_gc1_obj_space *space = vm->obj_space;
+  space->ratio = 0;
+
+  hvm_obj_ref *table = new_array(vm);
+  vm->general_regs[0] = table;
+  hvm_obj_ref *items[ITEMS];
+  for(unsigned int i = 0; i < ITEMS; i++) {
+    items[i] = new_array(vm);
+    hvm_obj_array_push(table, items[i]);
+  }
+  hvm_gc1_run_minor(vm, space);
+  assert_true(space->heap.length == ITEMS + 1, "Expected surviving objects to be promoted");
+  bool old = true;
+  for(unsigned int i = 0; i < ITEMS; i++) {
+    if(items[i]->gc != HVM_GC1_OBJ_OLD || hvm_obj_is_young(items[i])) { old = false; }
+  }
+  assert_true(old, "Expected promotion to flag objects as old in place");
+  hvm_obj_ref_pool_zone *zone = vm->ref_pool->head;
+  unsigned int used = pool_used(vm->ref_pool);
+  unsigned int bump = zone->bump;
+
+  // Dropping every other item frees their slots in the pool
+  for(unsigned int i = 0; i < ITEMS; i += 2) {
+    hvm_obj_array_set(table, hvm_obj_int_immediate(i), hvm_const_null);
+  }
+  hvm_gc1_run(vm, space);
+  assert_true(space->heap.length == (ITEMS / 2) + 1, "Expected dropped items to be freed");
+  assert_true(pool_used(vm->ref_pool) == used - (ITEMS / 2), "Expected freed references to go back to the pool");
+  bool unmoved = true;
+  for(unsigned int i = 1; i < ITEMS; i += 2) {
+    hvm_obj_ref *item = hvm_obj_array_get(table, hvm_obj_int_immediate(i));
+    if(item != items[i] || item->gc != HVM_GC1_OBJ_OLD) { unmoved = false; }
+  }
+  assert_true(unmoved, "Expected surviving objects to stay put and be unmarked");
+
+  // New objects fill the freed slots before taking fresh ones
+  for(unsigned int i = 0; i < ITEMS; i += 2) {
+    hvm_obj_array_set(table, hvm_obj_int_immediate(i), new_array(vm));
+  }
+  hvm_gc1_run_minor(vm, space);
+  assert_true(space->heap.length == ITEMS + 1, "Expected new objects to be promoted");
+  assert_true(zone->bump == bump && pool_used(vm->ref_pool) == used, "Expected new objects to reuse freed slots");
+
+  vm->general_regs[0] = hvm_const_null;
+  hvm_gc1_run(vm, space);
+  assert_true(space->heap.length == 0, "Expected an empty heap once everything is dropped");
+
+  return done();
+}
@@ -0,0 +1,48 @@
+#include "preamble.h"
+
+int main(int argc, char const *argv[]) {
+  hvm_gen *gen = hvm_new_gen();
+
+  byte reg0 = hvm_vm_reg_gen(0);
+  byte reg1 = hvm_vm_reg_gen(1);
+  byte reg2 = hvm_vm_reg_gen(2);
+  byte reg3 = hvm_vm_reg_gen(3);
+  byte reg4 = hvm_vm_reg_gen(4);
+  byte reg5 = hvm_vm_reg_gen(5);
+  byte reg6 = hvm_vm_reg_gen(6);
+  hvm_obj_ref *obj;
+
+  // Small integers and their sum should stay immediate
+  hvm_gen_litinteger(gen->block, reg0, -5);
+  hvm_gen_litinteger(gen->block, reg1, 2);
+  hvm_gen_add(gen->block, reg2, reg0, reg1);
+  // Largest immediate plus one overflows into a boxed integer
+  hvm_gen_litinteger(gen->block, reg3, HVM_OBJ_INT_IMMEDIATE_MAX);
+  hvm_gen_litinteger(gen->block, reg1, 1);
+  hvm_gen_add(gen->block, reg4, reg3, reg1);
+  // Literals too big to tag are boxed
+  hvm_gen_litinteger(gen->block, reg5, INT64_MIN);
+  // Symbols are immediate
+  hvm_gen_set_symbol(gen->block, reg6, "key");
+  hvm_gen_die(gen->block);
+
+  hvm_vm *vm = gen_chunk_and_run(gen);
+
+  obj = vm->general_regs[reg2];
+  assert_true(hvm_obj_is_immediate(obj), "Expected sum of small integers to be immediate");
+  assert_true(hvm_obj_type_of(obj) == HVM_INTEGER && hvm_obj_int_value(obj) == -3, "Expected sum to be -3");
+  obj = vm->general_regs[reg3];
+  assert_true(hvm_obj_is_immediate(obj), "Expected largest immediate integer to be immediate");
+  obj = vm->general_regs[reg4];
+  assert_true(!hvm_obj_is_immediate(obj), "Expected overflowing sum to be boxed");
+  assert_true(hvm_obj_int_value(obj) == HVM_OBJ_INT_IMMEDIATE_MAX + 1, "Expected overflowing sum to be correct");
+  obj = vm->general_regs[reg5];
+  assert_true(!hvm_obj_is_immediate(obj), "Expected large literal to be boxed");
+  assert_true(hvm_obj_type_of(obj) == HVM_INTEGER && hvm_obj_int_value(obj) == INT64_MIN, "Expected large literal to be correct");
+  obj = vm->general_regs[reg6];
+  assert_true(hvm_obj_is_immediate(obj), "Expected symbol to be immediate");
+  assert_true(hvm_obj_type_of(obj) == HVM_SYMBOL, "Expected symbol type");
+  assert_true(hvm_obj_symbol_value(obj) == hvm_symbolicate(vm->symbols, "key"), "Expected symbol ID to round-trip");
+
+  return done();
+}
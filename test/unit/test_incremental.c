@@ -0,0 +1,116 @@
+#include "preamble.h"
+
+// Allocate an array and promote it to the old generation, then push an
+// element into it
+static hvm_obj_ref *old_array(hvm_vm *vm, hvm_obj_ref *elem) {
+  hvm_obj_ref *arr = hvm_obj_ref_new_from_pool(vm);
+  arr->type   = HVM_ARRAY;
+  arr->data.v = hvm_new_obj_array();
+  hvm_obj_space_add_obj_ref(vm->obj_space, arr);
+  // Keep it reachable while it's promoted
+  vm->general_regs[HVM_GENERAL_REGISTERS - 1] = arr;
+  hvm_gc1_run_minor(vm, vm->obj_space);
+  vm->general_regs[HVM_GENERAL_REGISTERS - 1] = hvm_const_null;
+  if(elem != NULL) { hvm_obj_array_push(arr, elem); }
+  return arr;
+}
+
+int main(int argc, char const *argv[]) {
+  hvm_gen *gen = hvm_new_gen();
+
+  byte arr   = hvm_vm_reg_gen(0);
+  byte s     = hvm_vm_reg_gen(1);
+  byte tmp   = hvm_vm_reg_gen(2);
+  byte ctr   = hvm_vm_reg_gen(3);
+  byte one   = hvm_vm_reg_gen(4);
+  byte max   = hvm_vm_reg_gen(5);
+  byte cond  = hvm_vm_reg_gen(6);
+  byte x     = hvm_vm_reg_gen(7);
+  byte len   = hvm_vm_reg_gen(8);
+
+  hvm_gen_litinteger(gen->block, ctr, 0);
+  hvm_gen_litinteger(gen->block, one, 1);
+  hvm_gen_litinteger(gen->block, max, 20000);
+  hvm_gen_set_symbol(gen->block, x, "x");
+  hvm_gen_arraynew(gen->block, arr, hvm_vm_reg_null());
+
+  // Each iteration keeps one structure alive in the array and drops two
+  hvm_gen_label(gen->block, "loop");
+  hvm_gen_structnew(gen->block, s);
+  hvm_gen_structset(gen->block, s, x, ctr);
+  hvm_gen_arraypush(gen->block, arr, s);
+  hvm_gen_structnew(gen->block, tmp);
+  hvm_gen_structnew(gen->block, tmp);
+  hvm_gen_add(gen->block, ctr, ctr, one);
+  hvm_gen_lt(gen->block, cond, ctr, max);
+  hvm_gen_if_label(gen->block, cond, "loop");
+  hvm_gen_arraylen(gen->block, len, arr);
+  hvm_gen_die(gen->block);
+
+  hvm_vm *vm = hvm_new_vm();
+  hvm_gc1_obj_space *space = vm->obj_space;
+  // Pacing is checked step by step, so the other modes are kept off
+  space->incremental = true;
+  space->concurrent  = false;
+  space->torture     = false;
+  hvm_bootstrap_primitives(vm);
+  hvm_vm_load_chunk(vm, hvm_gen_chunk(gen));
+  hvm_vm_run(vm);
+
+  hvm_gc1_stats stats;
+  hvm_gc1_get_stats(space, &stats);
+  assert_true(stats.major_collections > 0, "Expected incremental marking cycles to run");
+  assert_true(stats.pauses > 0, "Expected pauses to be recorded");
+  assert_true(stats.pause_max >= stats.pause_p99, "Expected p99 pause to be at most the max");
+  assert_true(hvm_obj_int_value(vm->general_regs[len]) == 20000, "Expected array to keep every element");
+  uint64_t sym = hvm_symbolicate(vm->symbols, "x");
+  bool intact = true;
+  for(int64_t i = 0; i < 20000; i++) {
+    hvm_obj_ref *elem = hvm_obj_array_get(vm->general_regs[arr], hvm_obj_int_immediate(i));
+    if(hvm_obj_int_value(hvm_obj_struct_get(elem, hvm_obj_symbol_immediate(sym))) != i) { intact = false; }
+  }
+  assert_true(intact, "Expected surviving structures to be intact");
+
+  // Moving a white object into a container that has already been scanned
+  // must not get it freed
+  vm->general_regs[arr] = hvm_const_null;
+  vm->general_regs[s]   = hvm_const_null;
+  vm->general_regs[tmp] = hvm_const_null;
+  hvm_gc1_run(vm, space);
+  unsigned int base = space->heap.length;
+  hvm_obj_ref *hidden = old_array(vm, NULL);
+  // Deep enough that one step can't reach the end of it
+  hvm_obj_ref *deep  = old_array(vm, hidden);
+  hvm_obj_ref *chain = deep;
+  for(unsigned int i = 0; i < 4 * HVM_GC1_MARK_STEP_BUDGET; i++) {
+    chain = old_array(vm, chain);
+  }
+  hvm_obj_ref *container = old_array(vm, NULL);
+  vm->general_regs[0] = chain;
+  vm->general_regs[1] = container;
+  space->heap_target = space->heap.length;
+  hvm_gc1_collect(vm, space);
+  assert_true(space->marking, "Expected reaching the heap target to start a marking cycle");
+  hvm_gc1_collect(vm, space);
+  assert_true(space->marking && space->gray.length > 0, "Expected a step to stop at its budget");
+  unsigned int gray = space->gray.length;
+  hvm_obj_array_push(container, hidden);
+  hvm_obj_array_set(deep, hvm_obj_int_immediate(0), hvm_const_null);
+  assert_true(space->gray.length == gray + 1, "Expected write barrier to shade the stored object");
+  hvm_gc1_run(vm, space);
+  assert_true(!space->marking, "Expected a full collection to finish marking");
+  assert_true(space->heap.length == base + 3 + (4 * HVM_GC1_MARK_STEP_BUDGET), "Expected everything reachable to survive");
+  assert_true(hvm_obj_array_get(container, hvm_obj_int_immediate(0)) == hidden, "Expected the stored object to be intact");
+
+  // Marking deep structures doesn't recurse on the C stack
+  vm->general_regs[1] = hvm_const_null;
+  chain = old_array(vm, NULL);
+  for(unsigned int i = 0; i < 100000; i++) {
+    chain = old_array(vm, chain);
+  }
+  vm->general_regs[0] = chain;
+  hvm_gc1_run(vm, space);
+  assert_true(space->heap.length == base + 100001, "Expected the whole chain to be kept");
+
+  return done();
+}
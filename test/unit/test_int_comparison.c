@@ -22,13 +22,13 @@ int main(int argc, char const *argv[]) {
 
   // Assertions
   obj = vm->general_regs[hvm_vm_reg_gen(lt_reg)];
-  assert_true(obj->data.i64 == 1, "Less-than test register should be 1");
+  assert_true(hvm_obj_int_value(obj) == 1, "Less-than test register should be 1");
   obj = vm->general_regs[hvm_vm_reg_gen(gt_reg)];
-  assert_true(obj->data.i64 == 1, "Greater-than test register should be 1");
+  assert_true(hvm_obj_int_value(obj) == 1, "Greater-than test register should be 1");
   obj = vm->general_regs[hvm_vm_reg_gen(lte_reg)];
-  assert_true(obj->data.i64 == 1, "Less-than-or-equal test register should be 1");
+  assert_true(hvm_obj_int_value(obj) == 1, "Less-than-or-equal test register should be 1");
   obj = vm->general_regs[hvm_vm_reg_gen(gte_reg)];
-  assert_true(obj->data.i64 == 1, "Greater-than-or-equal test register should be 1");
+  assert_true(hvm_obj_int_value(obj) == 1, "Greater-than-or-equal test register should be 1");
 
   return done();
 }
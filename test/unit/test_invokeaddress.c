@@ -30,14 +30,14 @@ int main(int argc, char const *argv[]) {
 
   // Make sure that an okay-looking address value was set in reg1
   obj1 = vm->general_regs[reg1];
-  int64_t addr = obj1->data.i64;
-  assert_true(obj1->type == HVM_INTEGER, "Expected integer in register 1");
+  int64_t addr = hvm_obj_int_value(obj1);
+  assert_true(hvm_obj_type_of(obj1) == HVM_INTEGER, "Expected integer in register 1");
   assert_true(addr > 0 && addr < 32, "Expected reasonable value in register 1");
 
   // Make sure that the invocation returned the expected value (in reg0)
   obj0 = vm->general_regs[reg0];
-  assert_true(obj0->type == HVM_INTEGER, "Expected integer in register 0");
-  assert_true(obj0->data.i64 == val, "Expected register 0 to contain value 1");
+  assert_true(hvm_obj_type_of(obj0) == HVM_INTEGER, "Expected integer in register 0");
+  assert_true(hvm_obj_int_value(obj0) == val, "Expected register 0 to contain value 1");
 
   return done();
 }
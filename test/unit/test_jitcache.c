@@ -0,0 +1,91 @@
+#include "preamble.h"
+
+#include <string.h>
+
+#define DIR "/tmp"
+#define KEY 0x68766d6a69746361ULL
+#define OTHER_KEY (KEY + 1)
+#define COMPILER "test-compiler"
+
+// Offsets into a cache file's header: magic, VM version, compiler version,
+// key and then size
+#define VERSION_OFFSET 8
+#define SIZE_OFFSET (8 + 2 * HVM_JIT_CACHE_VERSION_SIZE + 8)
+
+static const char code[] = "not really compiled code";
+
+static void path_for(char *path, uint64_t key) {
+  sprintf(path, "%s/%016llx.trace", DIR, (unsigned long long)key);
+}
+
+// Overwrite `size` bytes of the cache file for `key` at `offset`
+static void patch(uint64_t key, long offset, const void *data, size_t size) {
+  char path[256];
+  path_for(path, key);
+  FILE *file = fopen(path, "r+b");
+  fseek(file, offset, SEEK_SET);
+  fwrite(data, 1, size, file);
+  fclose(file);
+}
+
+static bool write_entry(uint64_t key) {
+  return hvm_jit_cache_write(DIR, key, COMPILER, code, sizeof(code));
+}
+
+static bool is_miss(uint64_t key, const char *compiler) {
+  size_t size = 0;
+  void *data = hvm_jit_cache_read(DIR, key, compiler, &size);
+  free(data);
+  return data == NULL;
+}
+
+int main(int argc, char const *argv[]) {
+  char path[256], other_path[256];
+  path_for(path, KEY);
+  path_for(other_path, OTHER_KEY);
+
+  // Round trip
+  assert_true(write_entry(KEY), "Expected the entry to be written");
+  size_t size = 0;
+  char *data = hvm_jit_cache_read(DIR, KEY, COMPILER, &size);
+  assert_true(data != NULL && size == sizeof(code), "Expected the entry to be read back");
+  assert_true(data != NULL && memcmp(data, code, sizeof(code)) == 0, "Expected the code to survive the round trip");
+  free(data);
+
+  // Anything written by another compiler or VM version is ignored
+  assert_true(is_miss(KEY, "other-compiler"), "Expected a compiler mismatch to miss");
+  patch(KEY, VERSION_OFFSET, "X", 1);
+  assert_true(is_miss(KEY, COMPILER), "Expected a VM version mismatch to miss");
+
+  // So is an entry filed under the wrong key
+  write_entry(KEY);
+  rename(path, other_path);
+  assert_true(is_miss(OTHER_KEY, COMPILER), "Expected a key mismatch to miss");
+  remove(other_path);
+
+  // And one that's been cut short or claims more code than it holds
+  write_entry(KEY);
+  FILE *file = fopen(path, "r+b");
+  char header[SIZE_OFFSET + 8];
+  fread(header, 1, sizeof(header), file);
+  fclose(file);
+  file = fopen(path, "wb");
+  fwrite(header, 1, sizeof(header), file);
+  fwrite(code, 1, sizeof(code) / 2, file);
+  fclose(file);
+  assert_true(is_miss(KEY, COMPILER), "Expected a truncated entry to miss");
+  write_entry(KEY);
+  uint64_t huge = UINT64_MAX;
+  patch(KEY, SIZE_OFFSET, &huge, sizeof(huge));
+  assert_true(is_miss(KEY, COMPILER), "Expected an oversized entry to miss");
+  remove(path);
+
+  // Root and side traces of the same instructions get different keys
+  hvm_vm *vm = hvm_new_vm();
+  hvm_call_trace *trace = hvm_new_call_trace(vm);
+  uint64_t root_key = hvm_jit_cache_key(vm, trace);
+  trace->parent = hvm_new_call_trace(vm);
+  assert_true(hvm_jit_cache_key(vm, trace) != root_key, "Expected side traces to be keyed apart from root traces");
+
+  return done();
+}
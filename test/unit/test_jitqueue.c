@@ -0,0 +1,91 @@
+#include "preamble.h"
+
+#include <pthread.h>
+#include <sys/time.h>
+
+// Stand-ins for the compiler so the queue can be driven without LLVM
+
+static unsigned int compiles = 0;
+static void count_compile(hvm_vm *vm, hvm_call_trace *trace) {
+  compiles += 1;
+}
+
+// Holds up the compiler thread until the test unlocks it
+static pthread_mutex_t gate = PTHREAD_MUTEX_INITIALIZER;
+static void gated_compile(hvm_vm *vm, hvm_call_trace *trace) {
+  pthread_mutex_lock(&gate);
+  compiles += 1;
+  pthread_mutex_unlock(&gate);
+}
+
+#define SLOW_COMPILE_US 3000
+static uint64_t now_us() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return ((uint64_t)tv.tv_sec * 1000000) + (uint64_t)tv.tv_usec;
+}
+static void slow_compile(hvm_vm *vm, hvm_call_trace *trace) {
+  uint64_t start = now_us();
+  while(now_us() - start < SLOW_COMPILE_US) {}
+  compiles += 1;
+}
+
+int main(int argc, char const *argv[]) {
+  hvm_vm *vm = hvm_new_vm();
+  hvm_call_trace *trace = hvm_new_call_trace(vm);
+  hvm_jit_stats stats;
+  unsigned int i;
+
+  // In the foreground traces are compiled before the push returns
+  hvm_jit_queue *queue = hvm_new_jit_queue(vm);
+  queue->background    = false;
+  queue->compile_trace = count_compile;
+  assert_true(hvm_jit_queue_push(queue, trace), "Expected a foreground push to succeed");
+  assert_true(compiles == 1, "Expected the trace to be compiled by the push");
+  assert_true(!queue->compiler_started, "Expected no compiler thread in the foreground");
+  hvm_jit_get_stats(queue, &stats);
+  assert_true(stats.queued == 1 && stats.compiled == 1 && stats.queue_depth == 0, "Expected the foreground compile to be counted");
+
+  // With the compiler thread held up the queue fills and then turns traces
+  // away (the thread may have taken one off before it blocked)
+  compiles = 0;
+  queue = hvm_new_jit_queue(vm);
+  queue->background    = true;
+  queue->compile_trace = gated_compile;
+  pthread_mutex_lock(&gate);
+  unsigned int pushed = 0;
+  while(pushed <= HVM_JIT_QUEUE_SIZE + 1 && hvm_jit_queue_push(queue, trace)) {
+    pushed += 1;
+  }
+  assert_true(pushed == HVM_JIT_QUEUE_SIZE || pushed == HVM_JIT_QUEUE_SIZE + 1, "Expected the queue to fill up");
+  hvm_jit_get_stats(queue, &stats);
+  assert_true(stats.rejected == 1, "Expected the push to a full queue to be rejected");
+  assert_true(stats.queue_depth == HVM_JIT_QUEUE_SIZE && stats.queue_depth_max == HVM_JIT_QUEUE_SIZE, "Expected the queue depth to be recorded");
+  assert_true(stats.queued == pushed, "Expected only accepted pushes to be counted");
+
+  // Waiting lets the compiler thread drain it
+  pthread_mutex_unlock(&gate);
+  hvm_jit_queue_wait(queue);
+  hvm_jit_get_stats(queue, &stats);
+  assert_true(stats.queue_depth == 0, "Expected the wait to drain the queue");
+  assert_true(compiles == pushed && stats.compiled == pushed, "Expected every queued trace to be compiled");
+
+  // Compile times land in power-of-two microsecond buckets
+  queue = hvm_new_jit_queue(vm);
+  queue->background    = false;
+  queue->compile_trace = slow_compile;
+  hvm_jit_queue_push(queue, trace);
+  hvm_jit_queue_push(queue, trace);
+  hvm_jit_get_stats(queue, &stats);
+  uint64_t total = 0, slow = 0;
+  for(i = 0; i < HVM_JIT_COMPILE_TIME_BUCKETS; i++) {
+    total += stats.compile_times[i];
+    // 2^11 is the bucket SLOW_COMPILE_US falls in
+    if(i >= 11) { slow += stats.compile_times[i]; }
+  }
+  assert_true(total == 2, "Expected every compile in the histogram");
+  assert_true(slow == 2, "Expected slow compiles in the slow buckets");
+  assert_true(stats.compile_time_max >= SLOW_COMPILE_US && stats.compile_time_total >= 2 * SLOW_COMPILE_US, "Expected compile times to be totalled");
+
+  return done();
+}
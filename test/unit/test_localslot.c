@@ -0,0 +1,59 @@
+#include "preamble.h"
+
+int main(int argc, char const *argv[]) {
+  hvm_gen *gen = hvm_new_gen();
+
+  byte reg0 = hvm_vm_reg_gen(0);
+  byte reg1 = hvm_vm_reg_gen(1);
+  byte reg2 = hvm_vm_reg_gen(2);
+  byte reg3 = hvm_vm_reg_gen(3);
+  byte reg4 = hvm_vm_reg_gen(4);
+  byte reg5 = hvm_vm_reg_gen(5);
+  byte reg6 = hvm_vm_reg_gen(6);
+  byte reg7 = hvm_vm_reg_gen(7);
+  byte reg8 = hvm_vm_reg_gen(8);
+  hvm_obj_ref *obj;
+
+  hvm_gen_litinteger(gen->block, reg2, 5);
+  hvm_gen_setlocalslot(gen->block, "x", reg2);
+  // Symbolic locals are kept separately from slot locals
+  hvm_gen_set_symbol(gen->block, reg7, "x");
+  hvm_gen_litinteger(gen->block, reg2, 6);
+  hvm_gen_setlocal(gen->block, reg7, reg2);
+  hvm_gen_call_label(gen->block, "fill", reg3);
+  hvm_gen_getlocalslot(gen->block, reg4, "x");
+  hvm_gen_getlocal(gen->block, reg8, reg7);
+  // Reading a slot the callee's frame never wrote should throw, even though
+  // the previous call left a value in that slot of the reused frame
+  hvm_gen_catch_label(gen->block, "caught", reg5);
+  hvm_gen_call_label(gen->block, "peek", reg6);
+  hvm_gen_die(gen->block);
+
+  hvm_gen_label(gen->block, "caught");
+  hvm_gen_die(gen->block);
+
+  hvm_gen_sub(gen->block, "fill");
+  hvm_gen_litinteger(gen->block, reg0, 7);
+  hvm_gen_setlocalslot(gen->block, "a", reg0);
+  hvm_gen_litinteger(gen->block, reg0, 8);
+  hvm_gen_setlocalslot(gen->block, "b", reg0);
+  hvm_gen_getlocalslot(gen->block, reg1, "a");
+  hvm_gen_return(gen->block, reg1);
+
+  hvm_gen_sub(gen->block, "peek");
+  hvm_gen_getlocalslot(gen->block, reg1, "a");
+  hvm_gen_return(gen->block, reg1);
+
+  hvm_vm *vm = gen_chunk_and_run(gen);
+
+  obj = vm->general_regs[reg3];
+  assert_true(hvm_obj_int_value(obj) == 7, "Expected callee to read back its own slot");
+  obj = vm->general_regs[reg4];
+  assert_true(hvm_obj_int_value(obj) == 5, "Expected caller's slot to survive the call");
+  obj = vm->general_regs[reg8];
+  assert_true(hvm_obj_int_value(obj) == 6, "Expected symbolic local to be separate from slot local");
+  assert_true(vm->general_regs[reg5] != NULL, "Expected undefined slot to throw");
+  assert_true(hvm_obj_type_of(vm->general_regs[reg6]) == HVM_NULL, "Expected undefined slot to not return");
+
+  return done();
+}
@@ -37,10 +37,10 @@ int main(int argc, char const *argv[]) {
 
   // Assertions
   obj = vm->general_regs[reg_ctr];
-  assert_true(obj->data.i64 == val_iterations, "Expected counter to equal number of iterations");
+  assert_true(hvm_obj_int_value(obj) == val_iterations, "Expected counter to equal number of iterations");
 
   obj = vm->general_regs[reg_acc];
-  assert_true(obj->data.i64 == (val_iterations * val_incr), "Expected accumulator to be correct value");
+  assert_true(hvm_obj_int_value(obj) == (val_iterations * val_incr), "Expected accumulator to be correct value");
 
   return done();
 }
@@ -0,0 +1,62 @@
+#include "preamble.h"
+
+// Allocate a boxed integer in the nursery
+static hvm_obj_ref *young_int(hvm_vm *vm) {
+  hvm_obj_ref *ref = hvm_new_obj_int_value(vm, HVM_OBJ_INT_IMMEDIATE_MAX + 1);
+  hvm_obj_space_add_obj_ref(vm->obj_space, ref);
+  return ref;
+}
+
+int main(int argc, char const *argv[]) {
+  hvm_vm *vm = hvm_new_vm();
+  hvm_gc1_obj_space *space = vm->obj_space;
+  hvm_obj_ref *strct, *arr, *kept, *stored, *pushed;
+  unsigned int used;
+
+  strct = hvm_obj_ref_new_from_pool(vm);
+  strct->type   = HVM_STRUCTURE;
+  strct->data.v = hvm_new_obj_struct();
+  hvm_obj_space_add_obj_ref(space, strct);
+  arr = hvm_obj_ref_new_from_pool(vm);
+  arr->type   = HVM_ARRAY;
+  arr->data.v = hvm_new_obj_array_with_length(hvm_obj_int_immediate(1));
+  hvm_obj_space_add_obj_ref(space, arr);
+  assert_true(hvm_obj_is_young(strct) && space->nursery.length == 2, "Expected new objects to start in the nursery");
+
+  // Survivors of a minor collection are promoted
+  vm->general_regs[0] = strct;
+  vm->general_regs[1] = arr;
+  kept = young_int(vm);
+  vm->general_regs[2] = kept;
+  young_int(vm);
+  used = vm->ref_pool->head->used;
+  hvm_gc1_run_minor(vm, space);
+  assert_true(space->nursery.length == 0, "Expected minor collection to empty the nursery");
+  assert_true(space->heap.length == 3, "Expected reachable objects to be promoted");
+  assert_true(!hvm_obj_is_young(strct) && !hvm_obj_is_young(kept), "Expected promoted objects to be old");
+  assert_true(vm->ref_pool->head->used == used - 1, "Expected unreachable object to be freed");
+
+  // Old containers given young objects are remembered
+  stored = young_int(vm);
+  pushed = young_int(vm);
+  hvm_obj_struct_internal_set(strct->data.v, hvm_symbolicate(vm->symbols, "x"), stored);
+  hvm_obj_array_set(arr, hvm_obj_int_immediate(0), pushed);
+  assert_true(space->remembered_length == 2, "Expected write barrier to remember both containers");
+  hvm_obj_struct_internal_set(strct->data.v, hvm_symbolicate(vm->symbols, "y"), stored);
+  assert_true(space->remembered_length == 2, "Expected containers to be remembered once");
+  used = vm->ref_pool->head->used;
+  hvm_gc1_run_minor(vm, space);
+  assert_true(!hvm_obj_is_young(stored) && !hvm_obj_is_young(pushed), "Expected objects reachable from the remembered set to survive");
+  assert_true(vm->ref_pool->head->used == used, "Expected remembered objects to not be freed");
+  assert_true(space->remembered_length == 0, "Expected remembered set to be cleared");
+
+  // A full nursery promotes everything to make room
+  for(unsigned int i = 0; i <= HVM_GC1_NURSERY_SIZE; i++) {
+    young_int(vm);
+  }
+  assert_true(space->nursery.length == 1, "Expected full nursery to be promoted");
+  assert_true(space->heap.length == 5 + HVM_GC1_NURSERY_SIZE, "Expected promoted objects in the old heap");
+  assert_true(strct->gc == HVM_GC1_OBJ_OLD, "Expected promoted objects to be flagged as old");
+
+  return done();
+}
@@ -0,0 +1,78 @@
+#include "preamble.h"
+
+#define WORKERS 4
+#define ROWS    64
+#define COLS    512
+
+int main(int argc, char const *argv[]) {
+  hvm_vm *vm = hvm_new_vm();
+  hvm_gc1_obj_space *space = vm->obj_space;
+  space->workers = WORKERS;
+  space->ratio   = 0;
+  hvm_symbol_id x      = hvm_symbolicate(vm->symbols, "x");
+  hvm_symbol_id common = hvm_symbolicate(vm->symbols, "common");
+
+  // Rows of structures that all share one object (so workers race to mark
+  // it), with a dead structure allocated after each live one
+  hvm_obj_ref *table  = new_array(vm);
+  hvm_obj_ref *shared = track(vm, hvm_new_obj_int_value(vm, BOXED(ROWS * COLS)));
+  vm->general_regs[0] = table;
+  vm->general_regs[1] = shared;
+  for(int64_t r = 0; r < ROWS; r++) {
+    hvm_obj_ref *row = new_array(vm);
+    hvm_obj_array_push(table, row);
+    for(int64_t c = 0; c < COLS; c++) {
+      hvm_obj_ref *item = new_struct(vm);
+      hvm_obj_struct_internal_set(item->data.v, x, track(vm, hvm_new_obj_int_value(vm, BOXED((r * COLS) + c))));
+      hvm_obj_struct_internal_set(item->data.v, common, shared);
+      hvm_obj_array_push(row, item);
+      new_struct(vm);
+    }
+  }
+  vm->general_regs[1] = hvm_const_null;
+  unsigned int live = 1 + ROWS + (2 * ROWS * COLS) + 1;
+
+  hvm_gc1_run(vm, space);
+  assert_true(space->parallel != NULL && space->parallel->started == WORKERS, "Expected the worker threads to be started");
+  assert_true(space->heap.length == live, "Expected the parallel collection to free just the dead objects");
+  bool intact = true;
+  for(int64_t r = 0; r < ROWS; r++) {
+    hvm_obj_ref *row = hvm_obj_array_get(table, hvm_obj_int_immediate(r));
+    for(int64_t c = 0; c < COLS; c++) {
+      hvm_obj_ref *item = hvm_obj_array_get(row, hvm_obj_int_immediate(c));
+      hvm_obj_ref *val  = hvm_obj_struct_internal_get(item->data.v, x);
+      if(hvm_obj_int_value(val) != BOXED((r * COLS) + c)) { intact = false; }
+      if(hvm_obj_struct_internal_get(item->data.v, common) != shared) { intact = false; }
+    }
+  }
+  assert_true(intact, "Expected the surviving objects to be intact");
+
+  // Fewer workers than have been started
+  space->workers = 2;
+  hvm_gc1_run(vm, space);
+  assert_true(space->heap.length == live, "Expected a collection with fewer workers to keep everything");
+  // Dropping half the rows
+  for(int64_t r = 0; r < ROWS / 2; r++) {
+    hvm_obj_array_set(table, hvm_obj_int_immediate(r), hvm_const_null);
+  }
+  space->workers = WORKERS;
+  hvm_gc1_run(vm, space);
+  assert_true(space->heap.length == live - ((ROWS / 2) * (1 + (2 * COLS))), "Expected the dropped rows to be freed");
+
+  // A long chain can only be marked one link at a time
+  hvm_obj_ref *chain = new_array(vm);
+  vm->general_regs[0] = chain;
+  for(unsigned int i = 0; i < 100000; i++) {
+    hvm_obj_ref *link = new_array(vm);
+    hvm_obj_array_push(link, chain);
+    chain = link;
+    vm->general_regs[0] = chain;
+  }
+  hvm_gc1_run(vm, space);
+  assert_true(space->heap.length == 100001, "Expected the whole chain to be kept");
+  vm->general_regs[0] = hvm_const_null;
+  hvm_gc1_run(vm, space);
+  assert_true(space->heap.length == 0, "Expected a parallel collection to free everything");
+
+  return done();
+}
@@ -0,0 +1,70 @@
+#include "preamble.h"
+
+int main(int argc, char const *argv[]) {
+  hvm_gen *gen = hvm_new_gen();
+
+  byte val       = hvm_vm_reg_gen(0);
+  byte outer     = hvm_vm_reg_gen(1);
+  byte inner     = hvm_vm_reg_gen(2);
+  byte sum       = hvm_vm_reg_gen(3);
+  byte count     = hvm_vm_reg_gen(4);
+  byte unpassed  = hvm_vm_reg_gen(5);
+  byte param     = hvm_vm_reg_gen(6);
+  byte exc       = hvm_vm_reg_gen(7);
+  byte thrown    = hvm_vm_reg_gen(8);
+  byte after     = hvm_vm_reg_gen(9);
+  byte pn        = hvm_vm_reg_param(HVM_PARAMETER_REGISTERS - 1);
+
+  hvm_gen_litinteger(gen->block, val, 3);
+  hvm_gen_move(gen->block, hvm_vm_reg_arg(0), val);
+  hvm_gen_litinteger(gen->block, val, 4);
+  hvm_gen_move(gen->block, hvm_vm_reg_arg(1), val);
+  hvm_gen_call_label(gen->block, "outer", outer);
+  // Parameters that weren't passed read as null
+  hvm_gen_move(gen->block, hvm_vm_reg_arg(0), val);
+  hvm_gen_call_label(gen->block, "unpassed", unpassed);
+  // Throw from a callee and catch in this frame, then make sure calls
+  // still pass arguments correctly
+  hvm_gen_catch_label(gen->block, "caught", exc);
+  hvm_gen_move(gen->block, hvm_vm_reg_arg(0), val);
+  hvm_gen_call_label(gen->block, "thrower", hvm_vm_reg_null());
+  hvm_gen_die(gen->block);
+  hvm_gen_label(gen->block, "caught");
+  hvm_gen_move(gen->block, hvm_vm_reg_arg(0), val);
+  hvm_gen_move(gen->block, hvm_vm_reg_arg(1), val);
+  hvm_gen_move(gen->block, hvm_vm_reg_arg(2), val);
+  hvm_gen_call_label(gen->block, "inner", after);
+  hvm_gen_die(gen->block);
+
+  // Returns $p0 + (number of parameters passed to "inner") + $pn
+  hvm_gen_sub(gen->block, "outer");
+  hvm_gen_move(gen->block, hvm_vm_reg_arg(0), hvm_vm_reg_param(1));
+  hvm_gen_call_label(gen->block, "inner", inner);
+  hvm_gen_add(gen->block, sum, hvm_vm_reg_param(0), inner);
+  hvm_gen_move(gen->block, count, pn);
+  hvm_gen_add(gen->block, sum, sum, count);
+  hvm_gen_return(gen->block, sum);
+
+  hvm_gen_sub(gen->block, "inner");
+  hvm_gen_return(gen->block, pn);
+
+  hvm_gen_sub(gen->block, "unpassed");
+  hvm_gen_move(gen->block, param, hvm_vm_reg_param(3));
+  hvm_gen_return(gen->block, param);
+
+  hvm_gen_sub(gen->block, "thrower");
+  hvm_gen_structnew(gen->block, thrown);
+  hvm_gen_throw(gen->block, thrown);
+
+  hvm_vm *vm = gen_chunk_and_run(gen);
+
+  assert_true(hvm_obj_int_value(vm->general_regs[inner]) == 1, "Expected $pn to count the parameters passed");
+  assert_true(hvm_obj_int_value(vm->general_regs[outer]) == 6, "Expected parameters to survive a nested call");
+  assert_true(hvm_obj_type_of(vm->general_regs[unpassed]) == HVM_NULL, "Expected unpassed parameter to be null");
+  assert_true(vm->general_regs[exc] == vm->general_regs[thrown], "Expected exception to be caught by the caller");
+  assert_true(hvm_obj_int_value(vm->general_regs[after]) == 3, "Expected calls to work after unwinding");
+  assert_true(vm->stack_depth == 0, "Expected catching to unwind the stack");
+  assert_true(vm->param_regs == vm->value_stack, "Expected windows to be back at the bottom of the value stack");
+
+  return done();
+}
@@ -0,0 +1,40 @@
+#include "preamble.h"
+
+int main(int argc, char const *argv[]) {
+  hvm_vm *vm = hvm_new_vm();
+  hvm_obj_ref_pool *pool = vm->ref_pool;
+  hvm_obj_ref *a, *b, *c;
+
+  // References know which zone they came from
+  a = hvm_obj_ref_new_from_pool(vm);
+  assert_true((a->flags & HVM_OBJ_FLAG_POOLED) != 0, "Expected reference to be flagged as pooled");
+  assert_true(hvm_obj_ref_pool_zone_of(a) == pool->head, "Expected reference to belong to the first zone");
+
+  // Freed slots are reused before fresh ones
+  b = hvm_obj_ref_new_from_pool(vm);
+  hvm_obj_ref_free(vm, b);
+  c = hvm_obj_ref_new_from_pool(vm);
+  assert_true(b == c, "Expected freed slot to be reused");
+  assert_true(c->type == HVM_NULL && c->data.u64 == 0, "Expected reused slot to be sanitized");
+
+  // Filling the first zone spills into a second
+  unsigned int count = HVM_OBJ_REF_POOL_ZONE_SIZE + 1;
+  hvm_obj_ref **refs = malloc(sizeof(hvm_obj_ref*) * count);
+  for(unsigned int i = 0; i < count; i++) {
+    refs[i] = hvm_obj_ref_new_from_pool(vm);
+  }
+  assert_true(pool->zones == 2, "Expected pool to grow a second zone");
+  assert_true(hvm_obj_ref_pool_zone_of(refs[count - 1]) == pool->tail, "Expected last reference in the second zone");
+
+  // Emptying the second zone lets it be released in bulk
+  for(unsigned int i = 0; i < count; i++) {
+    if(hvm_obj_ref_pool_zone_of(refs[i]) == pool->tail) {
+      hvm_obj_ref_free(vm, refs[i]);
+    }
+  }
+  assert_true(hvm_obj_ref_pool_release_empty_zones(pool) == 1, "Expected one empty zone to be released");
+  assert_true(pool->zones == 1, "Expected pool to shrink back to one zone");
+  free(refs);
+
+  return done();
+}
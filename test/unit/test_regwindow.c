@@ -0,0 +1,86 @@
+#include "preamble.h"
+
+int main(int argc, char const *argv[]) {
+  hvm_gen *gen = hvm_new_gen();
+
+  // Caller's registers
+  byte val     = hvm_vm_reg_gen(0);
+  byte kept    = hvm_vm_reg_gen(1);
+  byte clobber = hvm_vm_reg_gen(2);
+  byte fresh   = hvm_vm_reg_gen(3);
+  byte sum     = hvm_vm_reg_gen(4);
+  byte shared  = hvm_vm_reg_gen(5);
+  byte exc     = hvm_vm_reg_gen(6);
+  byte thrown  = hvm_vm_reg_gen(7);
+  byte after   = hvm_vm_reg_gen(8);
+  // Registers of the windowed subroutines
+  byte n       = hvm_vm_reg_gen(0);
+  byte one     = hvm_vm_reg_gen(1);
+  byte cond    = hvm_vm_reg_gen(2);
+  byte rest    = hvm_vm_reg_gen(3);
+
+  hvm_gen_litinteger(gen->block, val, 5);
+  hvm_gen_litinteger(gen->block, kept, 42);
+  hvm_gen_call_label(gen->block, "clobber", clobber);
+  hvm_gen_call_label(gen->block, "fresh", fresh);
+  hvm_gen_move(gen->block, hvm_vm_reg_arg(0), val);
+  hvm_gen_call_label(gen->block, "sum", sum);
+  // Subroutines without a declared register count use the caller's
+  hvm_gen_call_label(gen->block, "shared", hvm_vm_reg_null());
+  hvm_gen_catch_label(gen->block, "caught", exc);
+  hvm_gen_call_label(gen->block, "thrower", hvm_vm_reg_null());
+  hvm_gen_die(gen->block);
+  hvm_gen_label(gen->block, "caught");
+  hvm_gen_litinteger(gen->block, after, 1);
+  hvm_gen_die(gen->block);
+
+  // Overwrites $r0 through $r3 of its own window
+  hvm_gen_sub_with_registers(gen->block, "clobber", 4);
+  hvm_gen_litinteger(gen->block, n, 100);
+  hvm_gen_litinteger(gen->block, one, 101);
+  hvm_gen_litinteger(gen->block, cond, 102);
+  hvm_gen_litinteger(gen->block, rest, 103);
+  hvm_gen_return(gen->block, one);
+
+  // Returns its never-written $r1
+  hvm_gen_sub_with_registers(gen->block, "fresh", 2);
+  hvm_gen_return(gen->block, one);
+
+  // Recursively computes 1 + 2 + ... + $p0 with every frame using $r0-$r3
+  hvm_gen_sub_with_registers(gen->block, "sum", 4);
+  hvm_gen_move(gen->block, n, hvm_vm_reg_param(0));
+  hvm_gen_litinteger(gen->block, one, 1);
+  hvm_gen_lt(gen->block, cond, one, n);
+  hvm_gen_if_label(gen->block, cond, "sum_recurse");
+  hvm_gen_return(gen->block, one);
+  hvm_gen_label(gen->block, "sum_recurse");
+  hvm_gen_litinteger(gen->block, one, -1);
+  hvm_gen_add(gen->block, hvm_vm_reg_arg(0), n, one);
+  hvm_gen_call_label(gen->block, "sum", rest);
+  hvm_gen_add(gen->block, rest, rest, n);
+  hvm_gen_return(gen->block, rest);
+
+  hvm_gen_sub(gen->block, "shared");
+  hvm_gen_litinteger(gen->block, shared, 7);
+  hvm_gen_return(gen->block, hvm_vm_reg_null());
+
+  hvm_gen_sub_with_registers(gen->block, "thrower", 2);
+  hvm_gen_structnew(gen->block, one);
+  hvm_gen_throw(gen->block, one);
+
+  hvm_vm *vm = gen_chunk_and_run(gen);
+
+  assert_true(hvm_obj_int_value(vm->general_regs[clobber]) == 101, "Expected value returned from the callee's window");
+  assert_true(hvm_obj_int_value(vm->general_regs[val]) == 5, "Expected caller's registers to survive the callee");
+  assert_true(hvm_obj_int_value(vm->general_regs[kept]) == 42, "Expected caller's registers to survive the callee");
+  assert_true(hvm_obj_type_of(vm->general_regs[fresh]) == HVM_NULL, "Expected new window registers to be null");
+  assert_true(hvm_obj_int_value(vm->general_regs[sum]) == 15, "Expected recursive frames to have separate windows");
+  assert_true(hvm_obj_int_value(vm->general_regs[shared]) == 7, "Expected undeclared subroutine to share registers");
+  assert_true(hvm_obj_type_of(vm->general_regs[exc]) == HVM_STRUCTURE, "Expected exception caught through a window");
+  assert_true(vm->general_regs[thrown] == hvm_const_null, "Expected thrower's registers to be separate");
+  assert_true(hvm_obj_int_value(vm->general_regs[after]) == 1, "Expected to resume in the catching frame");
+  assert_true(vm->general_regs == vm->value_stack + HVM_ARGUMENT_REGISTERS, "Expected to be back in the root window");
+  assert_true(vm->stack_depth == 0, "Expected catching to unwind the stack");
+
+  return done();
+}
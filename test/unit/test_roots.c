@@ -0,0 +1,134 @@
+#include "preamble.h"
+
+#define LOOPS 200
+
+typedef struct root_search {
+  hvm_obj_ref *obj;
+  unsigned int found;
+} root_search;
+
+static void find_root(hvm_obj_ref **slot, void *data) {
+  root_search *search = data;
+  if(*slot == search->obj) { search->found += 1; }
+}
+
+static unsigned int root_count(hvm_vm *vm, hvm_obj_ref *obj) {
+  root_search search = { .obj = obj, .found = 0 };
+  hvm_gc1_each_root(vm, find_root, &search);
+  return search.found;
+}
+
+// Allocates in a loop where every value is only reachable from a register,
+// a local, a closure, a global or the exception being handled.
+static hvm_gen *gen_allocations() {
+  hvm_gen *gen = hvm_new_gen();
+  byte ctr  = hvm_vm_reg_gen(0);
+  byte one  = hvm_vm_reg_gen(1);
+  byte max  = hvm_vm_reg_gen(2);
+  byte cond = hvm_vm_reg_gen(3);
+  byte x    = hvm_vm_reg_gen(4);
+  byte s    = hvm_vm_reg_gen(5);
+  byte arr  = hvm_vm_reg_gen(6);
+  byte clo  = hvm_vm_reg_gen(7);
+  byte exc  = hvm_vm_reg_gen(8);
+  byte len  = hvm_vm_reg_gen(9);
+  byte gsym = hvm_vm_reg_gen(10);
+
+  hvm_gen_litinteger(gen->block, ctr, 0);
+  hvm_gen_litinteger(gen->block, one, 1);
+  hvm_gen_litinteger(gen->block, max, LOOPS);
+  hvm_gen_set_symbol(gen->block, x, "x");
+  hvm_gen_set_symbol(gen->block, gsym, "kept");
+  hvm_gen_arraynew(gen->block, arr, hvm_vm_reg_null());
+  hvm_gen_setglobal(gen->block, gsym, arr);
+  hvm_gen_move(gen->block, arr, hvm_vm_reg_null());
+  hvm_gen_goto_label(gen->block, "loop");
+
+  // Whatever was thrown is kept in the global array
+  hvm_gen_label(gen->block, "catch");
+  hvm_gen_getglobal(gen->block, arr, gsym);
+  hvm_gen_arraypush(gen->block, arr, exc);
+  hvm_gen_move(gen->block, arr, hvm_vm_reg_null());
+  hvm_gen_add(gen->block, ctr, ctr, one);
+  hvm_gen_lt(gen->block, cond, ctr, max);
+  hvm_gen_if_label(gen->block, cond, "loop");
+  hvm_gen_getglobal(gen->block, arr, gsym);
+  hvm_gen_arraylen(gen->block, len, arr);
+  hvm_gen_die(gen->block);
+
+  hvm_gen_label(gen->block, "loop");
+  hvm_gen_catch_label(gen->block, "catch", exc);
+  hvm_gen_structnew(gen->block, s);
+  hvm_gen_structset(gen->block, s, x, ctr);
+  hvm_gen_setlocal(gen->block, gsym, s);
+  hvm_gen_move(gen->block, s, hvm_vm_reg_null());
+  hvm_gen_getclosure(gen->block, clo);
+  hvm_gen_structnew(gen->block, s);
+  hvm_gen_structset(gen->block, s, x, clo);
+  hvm_gen_move(gen->block, clo, hvm_vm_reg_null());
+  hvm_gen_throw(gen->block, s);
+  hvm_gen_die(gen->block);
+  return gen;
+}
+
+int main(int argc, char const *argv[]) {
+  hvm_vm *vm = hvm_new_vm();
+  hvm_gc1_obj_space *space = vm->obj_space;
+  space->ratio = 0;
+  hvm_symbol_id x = hvm_symbolicate(vm->symbols, "x");
+
+  // Objects held by the VM outside of registers and frames
+  hvm_obj_ref *exc = new_struct(vm);
+  hvm_obj_ref *cnst = new_struct(vm);
+  vm->exception = exc;
+  uint32_t id = hvm_vm_add_const(vm, cnst);
+  hvm_obj_ref *held = new_struct(vm);
+  hvm_obj_struct_internal_set(held->data.v, x, new_struct(vm));
+  hvm_gc1_add_root(space, &held);
+  new_struct(vm);
+  assert_true(root_count(vm, exc) == 1 && root_count(vm, cnst) == 1 && root_count(vm, held) == 1, "Expected each root to be visited once");
+  hvm_gc1_run_minor(vm, space);
+  assert_true(space->heap.length == 4, "Expected a minor collection to keep everything reachable from the roots");
+  hvm_gc1_run(vm, space);
+  assert_true(space->heap.length == 4, "Expected a full collection to keep everything reachable from the roots");
+  assert_true(hvm_vm_get_const(vm, id) == cnst && vm->exception == exc, "Expected the roots to be left alone");
+
+  // Registered slots are read when each collection starts
+  held = hvm_obj_struct_internal_get(held->data.v, x);
+  hvm_gc1_run(vm, space);
+  assert_true(space->heap.length == 3 && held->gc == HVM_GC1_OBJ_OLD, "Expected the slot's current object to be kept");
+  hvm_gc1_remove_root(space, &held);
+  vm->exception = NULL;
+  hvm_gc1_run(vm, space);
+  assert_true(space->heap.length == 1 && space->roots_length == 0, "Expected objects to be freed once they're not roots");
+  assert_true(root_count(vm, cnst) == 1, "Expected the constant to still be a root");
+
+  // Constants set past the end of the pool leave empty gaps
+  hvm_vm_set_const(vm, 1000, cnst);
+  assert_true(vm->const_pool.next_index == 1001 && hvm_vm_get_const(vm, 500) == NULL, "Expected gaps in the constant pool to be empty");
+  assert_true(hvm_vm_add_const(vm, cnst) == 1001, "Expected added constants to go after the last one set");
+
+  // In torture mode every allocating instruction is followed by a full
+  // collection
+  hvm_chunk *chunk = hvm_gen_chunk(gen_allocations());
+  vm = hvm_new_vm();
+  vm->obj_space->torture = true;
+  hvm_bootstrap_primitives(vm);
+  hvm_vm_load_chunk(vm, chunk);
+  hvm_vm_run(vm);
+  space = vm->obj_space;
+  x = hvm_symbolicate(vm->symbols, "x");
+  hvm_obj_ref *kept = hvm_get_global(vm, hvm_symbolicate(vm->symbols, "kept"));
+  assert_true(space->major_collections >= 3 * LOOPS, "Expected a full collection after every allocation");
+  assert_true(hvm_obj_int_value(vm->general_regs[9]) == LOOPS, "Expected every thrown object to be kept");
+  bool intact = true;
+  for(int64_t i = 0; i < LOOPS; i++) {
+    hvm_obj_ref *thrown  = hvm_obj_array_get(kept, hvm_obj_int_immediate(i));
+    hvm_obj_ref *closure = hvm_obj_struct_internal_get(thrown->data.v, x);
+    hvm_obj_ref *local   = hvm_obj_struct_internal_get(closure->data.v, hvm_symbolicate(vm->symbols, "kept"));
+    if(hvm_obj_int_value(hvm_obj_struct_internal_get(local->data.v, x)) != i) { intact = false; }
+  }
+  assert_true(intact, "Expected objects reachable from closures to survive");
+
+  return done();
+}
@@ -0,0 +1,95 @@
+#include "preamble.h"
+
+int main(int argc, char const *argv[]) {
+  hvm_gen *gen = hvm_new_gen();
+
+  byte x    = hvm_vm_reg_gen(0);
+  byte y    = hvm_vm_reg_gen(1);
+  byte s1   = hvm_vm_reg_gen(2);
+  byte s2   = hvm_vm_reg_gen(3);
+  byte s3   = hvm_vm_reg_gen(4);
+  byte val  = hvm_vm_reg_gen(5);
+  byte get1 = hvm_vm_reg_gen(6);
+  byte get2 = hvm_vm_reg_gen(7);
+  byte has1 = hvm_vm_reg_gen(8);
+  byte has2 = hvm_vm_reg_gen(9);
+  byte ctr  = hvm_vm_reg_gen(10);
+  byte cond = hvm_vm_reg_gen(11);
+  byte one  = hvm_vm_reg_gen(12);
+  byte max  = hvm_vm_reg_gen(13);
+  byte del  = hvm_vm_reg_gen(14);
+  hvm_obj_ref *obj;
+
+  hvm_gen_set_symbol(gen->block, x, "x");
+  hvm_gen_set_symbol(gen->block, y, "y");
+  hvm_gen_litinteger(gen->block, ctr, 0);
+  hvm_gen_litinteger(gen->block, one, 1);
+  hvm_gen_litinteger(gen->block, max, 2);
+  hvm_gen_structnew(gen->block, s1);
+
+  // Build two structures with the same code so the second one goes through
+  // the caches primed by the first
+  hvm_gen_label(gen->block, "build");
+  hvm_gen_move(gen->block, s2, s1);
+  hvm_gen_structnew(gen->block, s1);
+  hvm_gen_litinteger(gen->block, val, 10);
+  hvm_gen_structset(gen->block, s1, x, val);
+  hvm_gen_litinteger(gen->block, val, 20);
+  hvm_gen_structset(gen->block, s1, y, val);
+  hvm_gen_structget(gen->block, get1, s1, x);
+  hvm_gen_structget(gen->block, get2, s1, y);
+  hvm_gen_structhas(gen->block, has1, s1, y);
+  hvm_gen_add(gen->block, ctr, ctr, one);
+  hvm_gen_lt(gen->block, cond, ctr, max);
+  hvm_gen_if_label(gen->block, cond, "build");
+
+  // Same keys in a different order get a different shape
+  hvm_gen_structnew(gen->block, s3);
+  hvm_gen_structset(gen->block, s3, y, val);
+  hvm_gen_structset(gen->block, s3, x, val);
+  // Deleting drops the structure to dictionary mode
+  hvm_gen_structdelete(gen->block, del, s3, y);
+  hvm_gen_structhas(gen->block, has2, s3, y);
+  hvm_gen_die(gen->block);
+
+  hvm_vm *vm = gen_chunk_and_run(gen);
+
+  obj = vm->general_regs[get1];
+  assert_true(hvm_obj_int_value(obj) == 10, "Expected x to be 10");
+  obj = vm->general_regs[get2];
+  assert_true(hvm_obj_int_value(obj) == 20, "Expected y to be 20");
+  assert_true(hvm_obj_int_value(vm->general_regs[has1]) == 1, "Expected structure to have y");
+
+  hvm_obj_struct *st1 = vm->general_regs[s1]->data.v;
+  hvm_obj_struct *st2 = vm->general_regs[s2]->data.v;
+  hvm_obj_struct *st3 = vm->general_regs[s3]->data.v;
+  assert_true(st1 != st2, "Expected two different structures");
+  assert_true(st1->shape != NULL && st1->shape == st2->shape, "Expected structures built the same way to share a shape");
+  assert_true(st1->shape->length == 2, "Expected shape to have two slots");
+
+  assert_true(st3->shape == NULL, "Expected delete to switch to dictionary mode");
+  assert_true(hvm_obj_int_value(vm->general_regs[del]) == 20, "Expected delete to return the value");
+  assert_true(hvm_obj_int_value(vm->general_regs[has2]) == 0, "Expected deleted key to be gone");
+  assert_true(hvm_obj_int_value(hvm_obj_struct_internal_get(st3, hvm_symbolicate(vm->symbols, "x"))) == 20, "Expected x to survive the switch");
+
+  // The STRUCTGET caches should have been primed with the shared shape
+  bool primed = false;
+  for(uint64_t i = 0; i < vm->code_size; i++) {
+    hvm_instruction *inst = &vm->code[i];
+    if(inst->op == HVM_OP_STRUCTGET && inst->cache.field.shape == st1->shape) {
+      primed = true;
+    }
+  }
+  assert_true(primed, "Expected STRUCTGET inline cache to hold the shared shape");
+
+  // Transitions are looked up among a shape's children
+  hvm_obj_shape *root   = hvm_new_obj_shape_root();
+  hvm_obj_shape *with_x = hvm_obj_shape_transition(root, 1);
+  hvm_obj_shape *with_y = hvm_obj_shape_transition(root, 2);
+  assert_true(with_x != with_y, "Expected each key to get its own child shape");
+  assert_true(hvm_obj_shape_transition(root, 1) == with_x && hvm_obj_shape_transition(root, 2) == with_y, "Expected transitions to be reused");
+  assert_true(with_x->parent == root && hvm_obj_shape_slot(with_x, 1) == 0, "Expected the child to add its key");
+  assert_true(hvm_obj_shape_transition(with_x, 2) != with_y, "Expected transitions to depend on the parent shape");
+
+  return done();
+}
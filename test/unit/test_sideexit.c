@@ -0,0 +1,103 @@
+#include "preamble.h"
+
+// Calls past the limit take the branch the trace of "clamp" didn't, so its
+// side exit gets hot and is traced in turn
+#define CALLS 400
+#define LIMIT 200
+
+// clamp($p0): y = $p0 + 1; return (y > LIMIT) ? y : 0
+static void gen_clamp(hvm_gen *gen) {
+  byte val  = hvm_vm_reg_gen(0);
+  byte one  = hvm_vm_reg_gen(1);
+  byte sym  = hvm_vm_reg_gen(2);
+  byte lim  = hvm_vm_reg_gen(3);
+  byte cond = hvm_vm_reg_gen(4);
+  byte ret  = hvm_vm_reg_gen(5);
+
+  hvm_gen_sub(gen->block, "clamp");
+  hvm_gen_move(gen->block, val, hvm_vm_reg_param(0));
+  hvm_gen_litinteger(gen->block, one, 1);
+  hvm_gen_add(gen->block, val, val, one);
+  hvm_gen_set_symbol(gen->block, sym, "y");
+  hvm_gen_setlocal(gen->block, sym, val);
+  hvm_gen_litinteger(gen->block, lim, LIMIT);
+  hvm_gen_gt(gen->block, cond, val, lim);
+  hvm_gen_if_label(gen->block, cond, "big");
+  hvm_gen_litinteger(gen->block, ret, 0);
+  hvm_gen_return(gen->block, ret);
+  // The local is read after the branch, so a trace from here has to get it
+  // from the frame
+  hvm_gen_label(gen->block, "big");
+  hvm_gen_getlocal(gen->block, ret, sym);
+  hvm_gen_return(gen->block, ret);
+}
+
+int main(int argc, char const *argv[]) {
+  hvm_gen *gen = hvm_new_gen();
+  byte idx  = hvm_vm_reg_gen(100);
+  byte lim  = hvm_vm_reg_gen(101);
+  byte cond = hvm_vm_reg_gen(102);
+  byte one  = hvm_vm_reg_gen(103);
+  byte ret  = hvm_vm_reg_gen(104);
+  byte sum  = hvm_vm_reg_gen(105);
+
+  hvm_gen_goto_label(gen->block, "program");
+  gen_clamp(gen);
+
+  hvm_gen_label(gen->block, "program");
+  hvm_gen_litinteger(gen->block, idx, 0);
+  hvm_gen_litinteger(gen->block, sum, 0);
+  hvm_gen_litinteger(gen->block, lim, CALLS);
+  hvm_gen_litinteger(gen->block, one, 1);
+  hvm_gen_label(gen->block, "loop");
+  hvm_gen_eq(gen->block, cond, idx, lim);
+  hvm_gen_if_label(gen->block, cond, "end");
+    hvm_gen_move(gen->block, hvm_vm_reg_arg(0), idx);
+    hvm_gen_callsymbolic(gen->block, "clamp", ret);
+    hvm_gen_add(gen->block, sum, sum, ret);
+    hvm_gen_add(gen->block, idx, idx, one);
+    hvm_gen_goto_label(gen->block, "loop");
+  hvm_gen_label(gen->block, "end");
+  hvm_gen_die(gen->block);
+
+  hvm_vm *vm = hvm_new_vm();
+  hvm_bootstrap_primitives(vm);
+  // Compile traces as soon as they're hot
+  vm->jit_queue->background = false;
+  hvm_vm_load_chunk(vm, hvm_gen_chunk(gen));
+  hvm_vm_run(vm);
+
+  int64_t expected = 0;
+  for(int64_t i = 0; i < CALLS; i++) {
+    if(i + 1 > LIMIT) { expected += i + 1; }
+  }
+  assert_true(hvm_obj_int_value(vm->general_regs[sum]) == expected, "Expected the same results from traces as from the interpreter");
+
+  // The trace of the call went down the short branch; the other one is a
+  // side exit with a trace of its own
+  hvm_call_trace *trace = vm->traces[vm->traces_length];
+  assert_true(trace != NULL && trace->parent == NULL, "Expected the call's trace to be registered");
+  assert_true(trace->side_exits_length == 1, "Expected one side exit");
+  hvm_jit_side_exit *side_exit = &trace->side_exits[0];
+  assert_true(side_exit->count == HVM_JIT_SIDE_EXIT_THRESHOLD + 1, "Expected the side exit to be counted until it was hot");
+  hvm_call_trace *side_trace = side_exit->trace;
+  assert_true(side_trace != NULL && side_trace->complete, "Expected the side exit to be traced");
+  assert_true(side_trace->parent == trace, "Expected the side trace to know its parent");
+  assert_true(side_trace->native_function != NULL, "Expected the side trace to be compiled");
+  assert_true(vm->traces[vm->traces_length] == trace, "Expected side traces not to be registered as calls' traces");
+
+  // Exits are looked up by destination, up to HVM_JIT_MAX_SIDE_EXITS of them
+  trace = hvm_new_call_trace(vm);
+  unsigned int i;
+  for(i = 0; i < HVM_JIT_MAX_SIDE_EXITS; i++) {
+    side_exit = hvm_jit_trace_side_exit(trace, 100 + i);
+    side_exit->count = i;
+  }
+  assert_true(trace->side_exits_length == HVM_JIT_MAX_SIDE_EXITS, "Expected a side exit per destination");
+  side_exit = hvm_jit_trace_side_exit(trace, 101);
+  assert_true(side_exit != NULL && side_exit->count == 1, "Expected to find an existing side exit");
+  assert_true(hvm_jit_trace_side_exit(trace, 100 + i) == NULL, "Expected no more side exits past the cap");
+  assert_true(trace->side_exits_length == HVM_JIT_MAX_SIDE_EXITS, "Expected the cap to hold");
+
+  return done();
+}
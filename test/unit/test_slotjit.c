@@ -0,0 +1,111 @@
+#include "preamble.h"
+
+#define CALLS 50
+
+// twice_plus_one($p0): a = $p0; b = a + 1; return b + $p0
+static void gen_slots(hvm_gen *gen) {
+  byte val = hvm_vm_reg_gen(0);
+  byte one = hvm_vm_reg_gen(1);
+  byte tmp = hvm_vm_reg_gen(2);
+
+  hvm_gen_sub(gen->block, "twice_plus_one");
+  hvm_gen_move(gen->block, val, hvm_vm_reg_param(0));
+  hvm_gen_setlocalslot(gen->block, "a", val);
+  hvm_gen_litinteger(gen->block, one, 1);
+  hvm_gen_getlocalslot(gen->block, tmp, "a");
+  hvm_gen_add(gen->block, tmp, tmp, one);
+  hvm_gen_setlocalslot(gen->block, "b", tmp);
+  hvm_gen_getlocalslot(gen->block, tmp, "b");
+  hvm_gen_add(gen->block, tmp, tmp, val);
+  hvm_gen_return(gen->block, tmp);
+}
+
+// plus_one($p0), going through an instruction the tracer doesn't follow
+static void gen_unsupported(hvm_gen *gen) {
+  byte val = hvm_vm_reg_gen(0);
+  byte one = hvm_vm_reg_gen(1);
+  byte obj = hvm_vm_reg_gen(2);
+
+  hvm_gen_sub(gen->block, "plus_one");
+  hvm_gen_move(gen->block, val, hvm_vm_reg_param(0));
+  hvm_gen_structnew(gen->block, obj);
+  hvm_gen_litinteger(gen->block, one, 1);
+  hvm_gen_add(gen->block, val, val, one);
+  hvm_gen_return(gen->block, val);
+}
+
+// Loop calling `sub` CALLS times with the counter and summing the results
+static void gen_loop(hvm_gen *gen, char *sub, char *label, byte sum) {
+  byte idx  = hvm_vm_reg_gen(100);
+  byte lim  = hvm_vm_reg_gen(101);
+  byte cond = hvm_vm_reg_gen(102);
+  byte one  = hvm_vm_reg_gen(103);
+  byte ret  = hvm_vm_reg_gen(104);
+  char end[32];
+  sprintf(end, "%s_end", label);
+
+  hvm_gen_litinteger(gen->block, idx, 0);
+  hvm_gen_litinteger(gen->block, sum, 0);
+  hvm_gen_litinteger(gen->block, lim, CALLS);
+  hvm_gen_litinteger(gen->block, one, 1);
+  hvm_gen_label(gen->block, label);
+  hvm_gen_eq(gen->block, cond, idx, lim);
+  hvm_gen_if_label(gen->block, cond, end);
+    hvm_gen_move(gen->block, hvm_vm_reg_arg(0), idx);
+    hvm_gen_callsymbolic(gen->block, sub, ret);
+    hvm_gen_add(gen->block, sum, sum, ret);
+    hvm_gen_add(gen->block, idx, idx, one);
+    hvm_gen_goto_label(gen->block, label);
+  hvm_gen_label(gen->block, end);
+}
+
+static hvm_call_trace *find_trace(hvm_vm *vm, char *sub) {
+  hvm_symbol_id sym = hvm_symbolicate(vm->symbols, sub);
+  hvm_obj_ref *dest = hvm_obj_struct_internal_get(vm->symbol_table, sym);
+  for(unsigned int i = 1; i <= vm->traces_length; i++) {
+    if(vm->traces[i] != NULL && vm->traces[i]->entry == dest->data.u64) { return vm->traces[i]; }
+  }
+  return NULL;
+}
+
+int main(int argc, char const *argv[]) {
+  hvm_gen *gen = hvm_new_gen();
+  byte slots_sum       = hvm_vm_reg_gen(110);
+  byte unsupported_sum = hvm_vm_reg_gen(111);
+
+  hvm_gen_goto_label(gen->block, "program");
+  gen_slots(gen);
+  gen_unsupported(gen);
+
+  hvm_gen_label(gen->block, "program");
+  gen_loop(gen, "twice_plus_one", "slots", slots_sum);
+  gen_loop(gen, "plus_one", "unsupported", unsupported_sum);
+  hvm_gen_die(gen->block);
+
+  hvm_vm *vm = hvm_new_vm();
+  hvm_bootstrap_primitives(vm);
+  // Compile traces as soon as they're hot
+  vm->jit_queue->background = false;
+  hvm_vm_load_chunk(vm, hvm_gen_chunk(gen));
+  hvm_vm_run(vm);
+
+  int64_t slots_expected = 0, unsupported_expected = 0;
+  for(int64_t i = 0; i < CALLS; i++) {
+    slots_expected       += (2 * i) + 1;
+    unsupported_expected += i + 1;
+  }
+
+  // Slot locals are read and written through the frame by compiled traces
+  assert_true(hvm_obj_int_value(vm->general_regs[slots_sum]) == slots_expected, "Expected the same results from slot locals in traces as in the interpreter");
+  hvm_call_trace *trace = find_trace(vm, "twice_plus_one");
+  assert_true(trace != NULL && !trace->unsupported, "Expected slot locals to be traced");
+  assert_true(trace != NULL && trace->native_function != NULL, "Expected the slot local trace to be compiled");
+
+  // Traces missing an instruction are never compiled
+  assert_true(hvm_obj_int_value(vm->general_regs[unsupported_sum]) == unsupported_expected, "Expected the same results from a call the tracer can't follow");
+  trace = find_trace(vm, "plus_one");
+  assert_true(trace != NULL && trace->unsupported, "Expected the trace to be marked unsupported");
+  assert_true(trace != NULL && trace->native_function == NULL, "Expected the unsupported trace not to be compiled");
+
+  return done();
+}
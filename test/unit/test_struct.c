@@ -0,0 +1,40 @@
+#include "preamble.h"
+
+int main(int argc, char const *argv[]) {
+  hvm_obj_struct *strct = hvm_new_obj_struct();
+  unsigned int count = HVM_STRUCT_INITIAL_CAPACITY * 16;
+  bool ok;
+
+  // Setting an existing key updates it in place
+  hvm_obj_struct_internal_set(strct, 1, hvm_obj_int_immediate(1));
+  hvm_obj_struct_internal_set(strct, 1, hvm_obj_int_immediate(2));
+  assert_true(strct->length == 1, "Expected update to not add a key");
+  assert_true(hvm_obj_struct_internal_get(strct, 1) == hvm_obj_int_immediate(2), "Expected updated value");
+
+  // Deleting removes the key entirely
+  assert_true(hvm_obj_struct_internal_delete(strct, 1) == hvm_obj_int_immediate(2), "Expected delete to return value");
+  assert_true(strct->length == 0, "Expected delete to remove key");
+  assert_true(hvm_obj_struct_internal_get(strct, 1) == NULL, "Expected deleted key to be missing");
+  assert_true(hvm_obj_struct_internal_delete(strct, 1) == NULL, "Expected deleting missing key to return NULL");
+
+  // Grow well past the initial capacity
+  for(unsigned int i = 1; i <= count; i++) {
+    hvm_obj_struct_internal_set(strct, i, hvm_obj_int_immediate(i));
+  }
+  assert_true(strct->length == count, "Expected every key to be added");
+  // Delete every other key; the rest must still be reachable through
+  // their probe runs
+  for(unsigned int i = 1; i <= count; i += 2) {
+    hvm_obj_struct_internal_delete(strct, i);
+  }
+  ok = true;
+  for(unsigned int i = 1; i <= count; i++) {
+    hvm_obj_ref *expected = (i % 2 == 1) ? NULL : hvm_obj_int_immediate(i);
+    ok = ok && hvm_obj_struct_internal_get(strct, i) == expected;
+  }
+  assert_true(ok, "Expected remaining keys to survive deletes");
+  assert_true(strct->length == count / 2, "Expected half the keys to remain");
+
+  hvm_obj_struct_free(strct);
+  return done();
+}
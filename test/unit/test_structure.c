@@ -24,11 +24,11 @@ int main(int argc, char const *argv[]) {
 
   // Check that integer in $reg3 is expected
   obj = vm->general_regs[reg3];
-  assert_true(obj->type == HVM_INTEGER, "General register 3 should be integer");
-  assert_true(obj->data.i64 == 1, "General register 3 should be 1");
+  assert_true(hvm_obj_type_of(obj) == HVM_INTEGER, "General register 3 should be integer");
+  assert_true(hvm_obj_int_value(obj) == 1, "General register 3 should be 1");
   // Check that there's a structure in $strct
   obj = vm->general_regs[strct];
-  assert_true(obj->type == HVM_STRUCTURE, "Expected structure");
+  assert_true(hvm_obj_type_of(obj) == HVM_STRUCTURE, "Expected structure");
 
   return done();
 }
@@ -0,0 +1,54 @@
+#include "preamble.h"
+
+int main(int argc, char const *argv[]) {
+  hvm_gen *gen = hvm_new_gen();
+
+  byte reg0   = hvm_vm_reg_gen(0);
+  byte reg1   = hvm_vm_reg_gen(1);
+  byte reg2   = hvm_vm_reg_gen(2);
+  byte reg3   = hvm_vm_reg_gen(3);
+  byte reg4   = hvm_vm_reg_gen(4);
+  byte reg_ar = hvm_vm_reg_gen(5);
+  hvm_obj_ref *obj;
+
+  // Array of [7, 9] for the ARRAYGET pair
+  hvm_gen_litinteger(gen->block, reg0, 2);
+  hvm_gen_arraynew(gen->block, reg_ar, reg0);
+  hvm_gen_litinteger(gen->block, reg0, 0);
+  hvm_gen_litinteger(gen->block, reg1, 7);
+  hvm_gen_arrayset(gen->block, reg_ar, reg0, reg1);
+  hvm_gen_litinteger(gen->block, reg0, 1);
+  hvm_gen_litinteger(gen->block, reg1, 9);
+  hvm_gen_arrayset(gen->block, reg_ar, reg0, reg1);
+  hvm_gen_litinteger(gen->block, reg1, 0);
+  hvm_gen_arrayget(gen->block, reg2, reg_ar, reg1);// $2 = [0]
+  hvm_gen_arrayget(gen->block, reg3, reg_ar, reg0);// $3 = [1]
+
+  // LT and IF: 7 < 9 so this should branch past the DIE
+  hvm_gen_lt(gen->block, reg4, reg2, reg3);
+  hvm_gen_if_label(gen->block, reg4, "taken");
+  hvm_gen_die(gen->block);
+  hvm_gen_label(gen->block, "taken");
+  // GT and IF: 7 > 9 is false so this should fall through
+  hvm_gen_gt(gen->block, reg4, reg2, reg3);
+  hvm_gen_if_label(gen->block, reg4, "end");
+  // LITINTEGER and ADD: $2 = 7 + 5
+  hvm_gen_litinteger(gen->block, reg1, 5);
+  hvm_gen_add(gen->block, reg2, reg2, reg1);
+  hvm_gen_label(gen->block, "end");
+  hvm_gen_die(gen->block);
+
+  hvm_vm *vm = gen_chunk_and_run(gen);
+
+  assert_true(vm->superinstructions_fused == 4, "Expected 4 superinstructions to be fused");
+  obj = vm->general_regs[reg3];
+  assert_true(hvm_obj_int_value(obj) == 9, "Expected ARRAYGET pair to get both values");
+  obj = vm->general_regs[reg4];
+  assert_true(hvm_obj_type_of(obj) == HVM_INTEGER && hvm_obj_int_value(obj) == 0, "Expected comparison result to be written");
+  obj = vm->general_regs[reg2];
+  assert_true(hvm_obj_int_value(obj) == 12, "Expected branches to be followed and add to be run");
+  obj = vm->general_regs[reg1];
+  assert_true(hvm_obj_int_value(obj) == 5, "Expected literal to be written by add-immediate");
+
+  return done();
+}
@@ -0,0 +1,34 @@
+#include <string.h>
+
+#include "preamble.h"
+
+int main(int argc, char const *argv[]) {
+  hvm_symbol_store *st = hvm_new_symbol_store();
+  char name[32];
+  unsigned int count = HVM_SYMBOL_INDEX_INITIAL_SIZE * 4;
+  bool ok;
+
+  hvm_symbol_id a = hvm_symbolicate(st, "a");
+  hvm_symbol_id b = hvm_symbolicate(st, "b");
+  assert_true(a != b, "Expected different strings to get different IDs");
+  assert_true(hvm_symbolicate(st, "a") == a, "Expected same string to get same ID");
+  assert_true(strcmp(hvm_desymbolicate(st, b), "b") == 0, "Expected ID to desymbolicate to its string");
+  assert_true(hvm_desymbolicate(st, 0) == NULL, "Expected zero ID to be unknown");
+  assert_true(hvm_desymbolicate(st, b + 1) == NULL, "Expected unallocated ID to be unknown");
+
+  // Add enough symbols to force the table and index to grow
+  for(unsigned int i = 0; i < count; i++) {
+    snprintf(name, sizeof(name), "sym%u", i);
+    hvm_symbolicate(st, name);
+  }
+  ok = true;
+  for(unsigned int i = 0; i < count; i++) {
+    snprintf(name, sizeof(name), "sym%u", i);
+    hvm_symbol_id id = hvm_symbolicate(st, name);
+    ok = ok && (id == b + 1 + i) && strcmp(hvm_desymbolicate(st, id), name) == 0;
+  }
+  assert_true(ok, "Expected symbols to survive growing the table");
+  assert_true(hvm_symbolicate(st, "a") == a, "Expected earlier symbols to survive growing the table");
+
+  return done();
+}